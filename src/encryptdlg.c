@@ -137,6 +137,9 @@ gpa_file_encrypt_dialog_constructor (GType type, guint n_construct_properties,
   GtkWidget *clistKeys;
   GtkWidget *checkerSign;
   GtkWidget *checkerArmor;
+  GtkWidget *hboxCompress;
+  GtkWidget *labelCompress;
+  GtkWidget *comboCompress;
   GtkWidget *labelWho;
   GtkWidget *scrollerWho;
   GtkWidget *clistWho;
@@ -235,6 +238,27 @@ gpa_file_encrypt_dialog_constructor (GType type, guint n_construct_properties,
       gtk_widget_set_sensitive (dialog->check_armor, FALSE);
     }
 
+  /* The entries must match the order of gpa_compress_policy_t.  */
+  hboxCompress = gtk_box_new (GTK_ORIENTATION_HORIZONTAL, 6);
+  gtk_box_pack_start (GTK_BOX (vboxEncrypt), hboxCompress, FALSE, FALSE, 0);
+  labelCompress = gtk_label_new_with_mnemonic (_("Co_mpression:"));
+  gtk_box_pack_start (GTK_BOX (hboxCompress), labelCompress, FALSE, FALSE, 0);
+  comboCompress = gtk_combo_box_text_new ();
+  gtk_combo_box_text_append_text (GTK_COMBO_BOX_TEXT (comboCompress),
+                                  _("Automatic"));
+  gtk_combo_box_text_append_text (GTK_COMBO_BOX_TEXT (comboCompress),
+                                  _("Always"));
+  gtk_combo_box_text_append_text (GTK_COMBO_BOX_TEXT (comboCompress),
+                                  _("Never"));
+  gtk_combo_box_set_active (GTK_COMBO_BOX (comboCompress), GPA_COMPRESS_AUTO);
+  gtk_widget_set_tooltip_text
+    (comboCompress, _("With \"Automatic\", files which are already"
+                      " compressed, like archives, images or videos,"
+                      " are encrypted without compressing them again."));
+  gtk_box_pack_start (GTK_BOX (hboxCompress), comboCompress, FALSE, FALSE, 0);
+  gtk_label_set_mnemonic_widget (GTK_LABEL (labelCompress), comboCompress);
+  dialog->combo_compress = comboCompress;
+
   return object;
 }
 
@@ -351,6 +375,24 @@ gpa_file_encrypt_dialog_set_armor (GpaFileEncryptDialog *dialog, gboolean armor)
 }
 
 
+gpa_compress_policy_t
+gpa_file_encrypt_dialog_get_compress (GpaFileEncryptDialog *dialog)
+{
+  int policy;
+
+  policy = gtk_combo_box_get_active (GTK_COMBO_BOX (dialog->combo_compress));
+  return policy < 0? GPA_COMPRESS_AUTO : (gpa_compress_policy_t) policy;
+}
+
+
+void
+gpa_file_encrypt_dialog_set_compress (GpaFileEncryptDialog *dialog,
+                                      gpa_compress_policy_t policy)
+{
+  gtk_combo_box_set_active (GTK_COMBO_BOX (dialog->combo_compress), policy);
+}
+
+
 gboolean
 gpa_file_encrypt_dialog_get_sign (GpaFileEncryptDialog *dialog)
 {
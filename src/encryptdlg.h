@@ -23,6 +23,7 @@
 #define ENCRYPTDLG_H
 
 #include <gtk/gtk.h>
+#include "gpgmetools.h"
 
 /* GObject stuff */
 #define GPA_FILE_ENCRYPT_DIALOG_TYPE	  (gpa_file_encrypt_dialog_get_type ())
@@ -41,6 +42,7 @@ struct _GpaFileEncryptDialog {
   GtkWidget *clist_keys;
   GtkWidget *check_sign;
   GtkWidget *check_armor;
+  GtkWidget *combo_compress;
   GtkWidget *clist_who;
   /* FIXME: See comment in encryptdlg.h.  */
   GtkWidget *scroller_who;
@@ -71,4 +73,9 @@ gboolean gpa_file_encrypt_dialog_get_armor (GpaFileEncryptDialog *dialog);
 void gpa_file_encrypt_dialog_set_armor (GpaFileEncryptDialog *dialog,
 					gboolean armor);
 
+gpa_compress_policy_t
+gpa_file_encrypt_dialog_get_compress (GpaFileEncryptDialog *dialog);
+void gpa_file_encrypt_dialog_set_compress (GpaFileEncryptDialog *dialog,
+                                           gpa_compress_policy_t policy);
+
 #endif /* ENCRYPTDLG_H */
@@ -0,0 +1,495 @@
+/* filejournal.c - Progress journal for batch file operations.
+   Copyright (C) 2026 g10 Code GmbH
+
+   This file is part of GPA.
+
+   GPA is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   GPA is distributed in the hope that it will be useful, but WITHOUT
+   ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+   or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public
+   License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, see <http://www.gnu.org/licenses/>.  */
+
+/* The journal is a line oriented text file:
+
+     # GPA file journal v1
+     kind <kind>
+     file <filename_in>
+     ...
+     done <filename_in> <filename_out>
+     fail <filename_in> <error_code>
+
+   The header and the file lines are written together with the first
+   done or fail line, so that no journal is left behind by an
+   operation which never started a file; the done and fail lines are
+   appended as the operation proceeds and flushed immediately.  File
+   names are percent escaped.  A truncated last line, as left by a
+   crash, is ignored and removed before new lines are appended.
+
+   While an operation writes to a journal, the file <journal>.lock
+   holds the process id of its process.  A journal whose lock names a
+   running process belongs to an active operation and must not be
+   resumed.  */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/types.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#ifdef G_OS_UNIX
+#include <unistd.h>
+#include <signal.h>
+#else
+#include <windows.h>
+#include <process.h>
+#endif
+
+#include "gpa.h"
+#include "gpafileop.h"
+#include "filejournal.h"
+
+
+#define JOURNAL_HEADER "# GPA file journal v1\n"
+#define LOCK_SUFFIX ".lock"
+
+struct gpa_journal_s
+{
+  /* The name of the journal file.  */
+  char *filename;
+
+  /* The stream used to append records.  */
+  FILE *fp;
+
+  /* Set if we created the lock file.  */
+  gboolean locked;
+
+  /* For a new journal not yet written, its kind and input files.  */
+  char *kind;
+  GPtrArray *files;
+
+  /* The set of finished input files.  */
+  GHashTable *done;
+};
+
+
+
+/* Call FUNC for each complete line of the journal FILENAME.  Returns
+   an error if the journal can't be read.  */
+static gpg_error_t
+parse_journal (const char *filename,
+               void (*func) (char **fields, void *opaque), void *opaque)
+{
+  gchar *contents;
+  char *line, *next;
+  GError *error = NULL;
+
+  if (!g_file_get_contents (filename, &contents, NULL, &error))
+    {
+      gpg_error_t err;
+
+      err = gpg_error (g_error_matches (error, G_FILE_ERROR,
+                                        G_FILE_ERROR_NOENT)
+                       ? GPG_ERR_ENOENT : GPG_ERR_GENERAL);
+      g_error_free (error);
+      return err;
+    }
+
+  for (line = contents; line && *line; line = next)
+    {
+      char **fields;
+      int idx;
+
+      next = strchr (line, '\n');
+      if (!next)
+        break;   /* Truncated line.  */
+      *next++ = 0;
+      if (*line == '#')
+        continue;
+
+      fields = g_strsplit (line, " ", 4);
+      for (idx = 1; fields[idx]; idx++)
+        decode_percent_string (fields[idx]);
+      if (fields[0] && fields[1])
+        func (fields, opaque);
+      g_strfreev (fields);
+    }
+  g_free (contents);
+
+  return 0;
+}
+
+
+static void
+load_done_cb (char **fields, void *opaque)
+{
+  gpa_journal_t journal = opaque;
+
+  if (!strcmp (fields[0], "done"))
+    g_hash_table_add (journal->done, g_strdup (fields[1]));
+  else if (!strcmp (fields[0], "fail"))
+    g_hash_table_remove (journal->done, fields[1]);
+}
+
+
+/* Remove a truncated last line from the journal FILENAME, so that
+   appended records start on a new line.  */
+static gpg_error_t
+drop_truncated_line (const char *filename)
+{
+  gchar *contents;
+  gsize length;
+  char *end;
+  GError *error = NULL;
+  gpg_error_t err = 0;
+
+  if (!g_file_get_contents (filename, &contents, &length, &error))
+    {
+      g_error_free (error);
+      return gpg_error (GPG_ERR_GENERAL);
+    }
+
+  if (length && contents[length - 1] != '\n')
+    {
+      end = g_strrstr_len (contents, length, "\n");
+      if (!g_file_set_contents (filename, contents,
+                                end? end - contents + 1 : 0, &error))
+        {
+          g_message ("error repairing journal '%s': %s",
+                     filename, error->message);
+          g_error_free (error);
+          err = gpg_error (GPG_ERR_GENERAL);
+        }
+    }
+  g_free (contents);
+
+  return err;
+}
+
+
+/* Return true if the process PID is running.  */
+static gboolean
+process_is_alive (unsigned long pid)
+{
+#ifdef G_OS_UNIX
+  return !kill ((pid_t) pid, 0) || errno == EPERM;
+#else
+  HANDLE proc;
+  DWORD code;
+  gboolean alive = FALSE;
+
+  proc = OpenProcess (PROCESS_QUERY_INFORMATION, FALSE, (DWORD) pid);
+  if (proc)
+    {
+      alive = GetExitCodeProcess (proc, &code) && code == STILL_ACTIVE;
+      CloseHandle (proc);
+    }
+  return alive;
+#endif
+}
+
+
+/* Create the lock file of JOURNAL with our process id.  */
+static void
+lock_journal (gpa_journal_t journal)
+{
+  char *lockname = g_strconcat (journal->filename, LOCK_SUFFIX, NULL);
+  char *pid = g_strdup_printf ("%lu\n", (unsigned long) getpid ());
+  GError *error = NULL;
+
+  if (g_file_set_contents (lockname, pid, -1, &error))
+    journal->locked = TRUE;
+  else
+    {
+      g_message ("error locking journal '%s': %s",
+                 journal->filename, error->message);
+      g_error_free (error);
+    }
+  g_free (pid);
+  g_free (lockname);
+}
+
+
+/* Write a line made up of KEYWORD and the strings ARG1 and ARG2
+   (which may be NULL) and flush it.  */
+static void
+write_line (gpa_journal_t journal, const char *keyword,
+            const char *arg1, const char *arg2)
+{
+  char *p1, *p2;
+
+  if (!journal->fp)
+    return;
+
+  p1 = percent_escape (arg1, NULL, 0);
+  p2 = arg2? percent_escape (arg2, NULL, 0) : NULL;
+  fprintf (journal->fp, "%s %s%s%s\n", keyword, p1, p2? " ":"", p2? p2:"");
+  g_free (p1);
+  g_free (p2);
+
+  if (fflush (journal->fp))
+    {
+      g_message ("error writing journal '%s': %s",
+                 journal->filename, strerror (errno));
+      fclose (journal->fp);
+      journal->fp = NULL;
+    }
+}
+
+
+/* Create the file of a new JOURNAL with its header and the list of
+   input files.  */
+static void
+create_journal (gpa_journal_t journal)
+{
+  guint idx;
+
+  journal->fp = g_fopen (journal->filename, "w");
+  if (!journal->fp)
+    g_message ("error creating journal '%s': %s",
+               journal->filename, strerror (errno));
+  else
+    {
+      lock_journal (journal);
+      fputs (JOURNAL_HEADER, journal->fp);
+      write_line (journal, "kind", journal->kind, NULL);
+      for (idx = 0; idx < journal->files->len; idx++)
+        write_line (journal, "file", journal->files->pdata[idx], NULL);
+    }
+
+  g_free (journal->kind);
+  journal->kind = NULL;
+  g_ptr_array_free (journal->files, TRUE);
+  journal->files = NULL;
+}
+
+
+/* Write a record made up of KEYWORD and the strings ARG1 and ARG2
+   (which may be NULL), creating the journal file if needed.  */
+static void
+write_record (gpa_journal_t journal, const char *keyword,
+              const char *arg1, const char *arg2)
+{
+  if (journal->files)
+    create_journal (journal);
+  write_line (journal, keyword, arg1, arg2);
+}
+
+
+
+/* Open the journal FILENAME for the operation KIND on the list of
+   gpa_file_item_t FILES.  If RESUME is set and the journal exists,
+   the already finished files are loaded from it and new records are
+   appended; otherwise a new journal is created once the first record
+   is written.  Returns NULL on error.  */
+gpa_journal_t
+gpa_journal_open (const char *filename, const char *kind,
+                  GList *files, gboolean resume)
+{
+  gpa_journal_t journal;
+  GList *cur;
+
+  g_return_val_if_fail (filename && kind, NULL);
+
+  journal = g_malloc0 (sizeof *journal);
+  journal->filename = g_strdup (filename);
+  journal->done = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                         g_free, NULL);
+
+  if (resume && gpa_journal_is_active (filename))
+    {
+      g_message ("journal '%s' is in use", filename);
+      gpa_journal_close (journal, FALSE);
+      return NULL;
+    }
+
+  if (resume && !parse_journal (filename, load_done_cb, journal))
+    {
+      lock_journal (journal);
+      if (drop_truncated_line (filename)
+          || !(journal->fp = g_fopen (filename, "a")))
+        {
+          g_message ("error opening journal '%s'", filename);
+          gpa_journal_close (journal, FALSE);
+          return NULL;
+        }
+      return journal;
+    }
+
+  journal->kind = g_strdup (kind);
+  journal->files = g_ptr_array_new_with_free_func (g_free);
+  for (cur = files; cur; cur = g_list_next (cur))
+    {
+      gpa_file_item_t file_item = cur->data;
+
+      if (file_item->filename_in)
+        g_ptr_array_add (journal->files, g_strdup (file_item->filename_in));
+    }
+
+  return journal;
+}
+
+
+/* Close JOURNAL.  If REMOVE is set, the journal file is deleted.  */
+void
+gpa_journal_close (gpa_journal_t journal, gboolean remove)
+{
+  if (!journal)
+    return;
+
+  if (journal->fp)
+    fclose (journal->fp);
+  if (remove && !journal->files)
+    g_unlink (journal->filename);
+  if (journal->locked)
+    {
+      char *lockname = g_strconcat (journal->filename, LOCK_SUFFIX, NULL);
+
+      g_unlink (lockname);
+      g_free (lockname);
+    }
+  g_free (journal->kind);
+  if (journal->files)
+    g_ptr_array_free (journal->files, TRUE);
+  g_hash_table_destroy (journal->done);
+  g_free (journal->filename);
+  g_free (journal);
+}
+
+
+/* Return true if the journal FILENAME is used by a running
+   operation, possibly of another process.  */
+gboolean
+gpa_journal_is_active (const char *filename)
+{
+  char *lockname = g_strconcat (filename, LOCK_SUFFIX, NULL);
+  gchar *contents;
+  unsigned long pid;
+  gboolean active = FALSE;
+
+  if (g_file_get_contents (lockname, &contents, NULL, NULL))
+    {
+      pid = strtoul (contents, NULL, 10);
+      active = pid && process_is_alive (pid);
+      g_free (contents);
+    }
+  g_free (lockname);
+
+  return active;
+}
+
+
+/* Return true if FILENAME_IN has been finished according to
+   JOURNAL.  */
+gboolean
+gpa_journal_is_done (gpa_journal_t journal, const char *filename_in)
+{
+  if (!journal || !filename_in)
+    return FALSE;
+
+  return g_hash_table_contains (journal->done, filename_in);
+}
+
+
+/* Record that FILENAME_IN has been processed into FILENAME_OUT.  */
+void
+gpa_journal_record_done (gpa_journal_t journal, const char *filename_in,
+                         const char *filename_out)
+{
+  if (!journal || !filename_in)
+    return;
+
+  write_record (journal, "done", filename_in,
+                filename_out? filename_out : "");
+  g_hash_table_add (journal->done, g_strdup (filename_in));
+}
+
+
+/* Record that processing FILENAME_IN failed with ERR.  */
+void
+gpa_journal_record_failure (gpa_journal_t journal, const char *filename_in,
+                            gpg_error_t err)
+{
+  char numbuf[20];
+
+  if (!journal || !filename_in)
+    return;
+
+  snprintf (numbuf, sizeof numbuf, "%u", (unsigned int) err);
+  write_record (journal, "fail", filename_in, numbuf);
+}
+
+
+struct read_job_parm_s
+{
+  char *kind;
+  GList *files;
+};
+
+static void
+read_job_cb (char **fields, void *opaque)
+{
+  struct read_job_parm_s *parm = opaque;
+
+  if (!strcmp (fields[0], "kind") && !parm->kind)
+    parm->kind = g_strdup (fields[1]);
+  else if (!strcmp (fields[0], "file"))
+    {
+      gpa_file_item_t file_item;
+
+      file_item = g_malloc0 (sizeof (*file_item));
+      file_item->filename_in = g_strdup (fields[1]);
+      parm->files = g_list_prepend (parm->files, file_item);
+    }
+}
+
+
+/* Read the kind and the list of input files from the journal
+   FILENAME.  On success the kind is stored as a malloced string at
+   R_KIND and a new list of gpa_file_item_t at R_FILES.  */
+gpg_error_t
+gpa_journal_read_job (const char *filename, char **r_kind, GList **r_files)
+{
+  struct read_job_parm_s parm;
+  gpg_error_t err;
+
+  *r_kind = NULL;
+  *r_files = NULL;
+
+  memset (&parm, 0, sizeof parm);
+  err = parse_journal (filename, read_job_cb, &parm);
+  if (!err && (!parm.kind || !parm.files))
+    err = gpg_error (GPG_ERR_INV_DATA);
+  if (err)
+    {
+      GList *cur;
+
+      for (cur = parm.files; cur; cur = g_list_next (cur))
+        {
+          gpa_file_item_t file_item = cur->data;
+
+          g_free (file_item->filename_in);
+          g_free (file_item);
+        }
+      g_list_free (parm.files);
+      g_free (parm.kind);
+      return err;
+    }
+
+  *r_kind = parm.kind;
+  *r_files = g_list_reverse (parm.files);
+  return 0;
+}
@@ -0,0 +1,66 @@
+/* filejournal.h - Progress journal for batch file operations.
+   Copyright (C) 2026 g10 Code GmbH
+
+   This file is part of GPA.
+
+   GPA is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   GPA is distributed in the hope that it will be useful, but WITHOUT
+   ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+   or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public
+   License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, see <http://www.gnu.org/licenses/>.  */
+
+#ifndef FILEJOURNAL_H
+#define FILEJOURNAL_H
+
+#include <glib.h>
+#include <gpgme.h>
+
+/* A journal is an append-only file which records the kind of a batch
+   operation, its input files and for each finished input file
+   whether it succeeded.  It allows to resume an interrupted batch
+   without redoing finished work.  */
+typedef struct gpa_journal_s *gpa_journal_t;
+
+/* Open the journal FILENAME for the operation KIND on the list of
+   gpa_file_item_t FILES.  If RESUME is set and the journal exists,
+   the already finished files are loaded from it and new records are
+   appended; otherwise a new journal is created once the first record
+   is written.  Returns NULL on error.  */
+gpa_journal_t gpa_journal_open (const char *filename, const char *kind,
+                                GList *files, gboolean resume);
+
+/* Close JOURNAL.  If REMOVE is set, the journal file is deleted.  */
+void gpa_journal_close (gpa_journal_t journal, gboolean remove);
+
+/* Return true if the journal FILENAME is used by a running
+   operation, possibly of another process.  */
+gboolean gpa_journal_is_active (const char *filename);
+
+/* Return true if FILENAME_IN has been finished according to
+   JOURNAL.  */
+gboolean gpa_journal_is_done (gpa_journal_t journal,
+                              const char *filename_in);
+
+/* Record that FILENAME_IN has been processed into FILENAME_OUT.  */
+void gpa_journal_record_done (gpa_journal_t journal,
+                              const char *filename_in,
+                              const char *filename_out);
+
+/* Record that processing FILENAME_IN failed with ERR.  */
+void gpa_journal_record_failure (gpa_journal_t journal,
+                                 const char *filename_in, gpg_error_t err);
+
+/* Read the kind and the list of input files from the journal
+   FILENAME.  On success the kind is stored as a malloced string at
+   R_KIND and a new list of gpa_file_item_t at R_FILES.  */
+gpg_error_t gpa_journal_read_job (const char *filename, char **r_kind,
+                                  GList **r_files);
+
+#endif /*FILEJOURNAL_H*/
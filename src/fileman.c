@@ -29,9 +29,12 @@
 #include <errno.h>
 #include <assert.h>
 #include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
 
 #include <gdk/gdkkeysyms.h>
 #include <glib.h>
+#include <glib/gstdio.h>
 #include <gtk/gtk.h>
 
 #include "gpa.h"
@@ -62,6 +65,9 @@ struct _GpaFileManager
   GtkWidget *window;
   GtkWidget *list_files;
   GList *selection_sensitive_actions;
+
+  /* What to do with existing output files.  */
+  gpa_conflict_policy_t conflict;
 };
 
 struct _GpaFileManagerClass
@@ -123,6 +129,7 @@ static void
 gpa_file_manager_init (GpaFileManager *fileman)
 {
   fileman->selection_sensitive_actions = NULL;
+  fileman->conflict = GPA_CONFLICT_ASK;
 }
 
 static void
@@ -287,6 +294,7 @@ file_created_cb (GpaFileOperation *op, gpa_file_item_t item, gpointer data)
 static void
 register_operation (GpaFileManager *fileman, GpaFileOperation *op)
 {
+  gpa_file_operation_set_conflict_policy (op, fileman->conflict);
   g_signal_connect (G_OBJECT (op), "created_file",
 		    G_CALLBACK (file_created_cb), fileman);
   g_signal_connect (G_OBJECT (op), "completed",
@@ -294,6 +302,79 @@ register_operation (GpaFileManager *fileman, GpaFileOperation *op)
 }
 
 
+/* Journals of file manager operations are stored in the GnuPG home
+   directory using these name parts.  */
+#define JOURNAL_PREFIX "gpa-files-"
+#define JOURNAL_SUFFIX ".journal"
+
+/* Keep a journal for OP of type KIND, so that it can be resumed if it
+   is interrupted.  If JOURNAL is NULL a new journal is created,
+   otherwise the existing JOURNAL is resumed.  The journal file is
+   only written once the first file has been processed.  It is
+   removed when the operation completes successfully, and kept after
+   a failure or when canceled so that the operation can be resumed.  */
+static void
+journal_operation (GpaFileOperation *op, const char *kind,
+                   const char *journal)
+{
+  static unsigned int counter;
+  char *fname;
+
+  if (journal)
+    {
+      gpa_file_operation_set_journal (op, journal, kind, TRUE, TRUE);
+      return;
+    }
+
+  fname = g_strdup_printf ("%s%lu-%lu-%u%s", JOURNAL_PREFIX,
+                           (unsigned long) time (NULL),
+                           (unsigned long) getpid (), counter++,
+                           JOURNAL_SUFFIX);
+  journal = g_build_filename (gnupg_homedir, fname, NULL);
+  gpa_file_operation_set_journal (op, journal, kind, FALSE, TRUE);
+  g_free (fname);
+  g_free ((char *) journal);
+}
+
+
+/* Return the name of the most recent journal of an interrupted file
+   manager operation or NULL if there is none.  Journals of operations
+   which are still running are skipped.  */
+static char *
+find_latest_journal (void)
+{
+  GDir *dir;
+  const char *name;
+  char *fname;
+  char *latest = NULL;
+  time_t latest_mtime = 0;
+  struct stat st;
+
+  dir = g_dir_open (gnupg_homedir, 0, NULL);
+  if (!dir)
+    return NULL;
+  while ((name = g_dir_read_name (dir)))
+    {
+      if (!g_str_has_prefix (name, JOURNAL_PREFIX)
+          || !g_str_has_suffix (name, JOURNAL_SUFFIX))
+        continue;
+      fname = g_build_filename (gnupg_homedir, name, NULL);
+      if (!g_stat (fname, &st) && (!latest || st.st_mtime >= latest_mtime)
+          && !gpa_journal_is_active (fname))
+        {
+          g_free (latest);
+          latest = fname;
+          latest_mtime = st.st_mtime;
+        }
+      else
+        g_free (fname);
+    }
+  g_dir_close (dir);
+
+  return latest;
+}
+
+
 
 /* Management of the selection sensitive actions.  */
 
@@ -453,6 +534,7 @@ file_sign (GSimpleAction *simple, GVariant *parameter, gpointer param)
 
   op = gpa_file_sign_operation_new (GTK_WIDGET (fileman), files, FALSE);
 
+  journal_operation (GPA_FILE_OPERATION (op), "sign", NULL);
   register_operation (fileman, GPA_FILE_OPERATION (op));
 }
 
@@ -471,6 +553,7 @@ file_encrypt (GSimpleAction *simple, GVariant *parameter, gpointer param)
 
   op = gpa_file_encrypt_operation_new (GTK_WIDGET (fileman), files, FALSE);
 
+  journal_operation (GPA_FILE_OPERATION (op), "encrypt", NULL);
   register_operation (fileman, GPA_FILE_OPERATION (op));
 }
 
@@ -489,10 +572,77 @@ file_decrypt (GSimpleAction *simple, GVariant *parameter, gpointer param)
 
   op = gpa_file_decrypt_verify_operation_new (GTK_WIDGET (fileman), files);
 
+  journal_operation (GPA_FILE_OPERATION (op), "decrypt-verify", NULL);
   register_operation (fileman, GPA_FILE_OPERATION (op));
 }
 
 
+/* Handle menu item "File/Resume".  */
+static void
+file_resume (GSimpleAction *simple, GVariant *parameter, gpointer param)
+{
+  GpaFileManager *fileman = param;
+  GpaFileOperation *op;
+  char *journal;
+  char *kind;
+  GList *files, *cur;
+
+  journal = find_latest_journal ();
+  if (!journal)
+    {
+      gpa_window_message (_("There is no interrupted file operation."),
+                          GTK_WIDGET (fileman));
+      return;
+    }
+
+  if (gpa_journal_read_job (journal, &kind, &files))
+    {
+      gpa_window_error (_("The journal of the interrupted file operation"
+                          " is corrupt and has been removed."),
+                        GTK_WIDGET (fileman));
+      g_unlink (journal);
+      g_free (journal);
+      return;
+    }
+
+  for (cur = files; cur; cur = g_list_next (cur))
+    add_file (fileman, ((gpa_file_item_t) cur->data)->filename_in);
+
+  /* Only the kinds created by journal_operation are expected here.  */
+  if (!strcmp (kind, "sign"))
+    op = GPA_FILE_OPERATION
+      (gpa_file_sign_operation_new (GTK_WIDGET (fileman), files, FALSE));
+  else if (!strcmp (kind, "encrypt"))
+    op = GPA_FILE_OPERATION
+      (gpa_file_encrypt_operation_new (GTK_WIDGET (fileman), files, FALSE));
+  else
+    op = GPA_FILE_OPERATION
+      (gpa_file_decrypt_verify_operation_new (GTK_WIDGET (fileman), files));
+
+  journal_operation (op, kind, journal);
+  register_operation (fileman, op);
+
+  g_free (kind);
+  g_free (journal);
+}
+
+
+/* Handle menu items "Edit/If Output File Exists".  */
+static void
+file_conflict (GSimpleAction *simple, GVariant *value, gpointer param)
+{
+  GpaFileManager *fileman = param;
+  gpa_conflict_policy_t policy;
+
+  if (!gpa_conflict_policy_from_string (g_variant_get_string (value, NULL),
+                                        &policy))
+    return;
+
+  fileman->conflict = policy;
+  g_simple_action_set_state (simple, value);
+}
+
+
 /* Handle menu item "File/Close".  */
 static void
 file_close (GSimpleAction *simple, GVariant *parameter, gpointer param)
@@ -539,6 +689,8 @@ fileman_action_new (GpaFileManager *fileman, GtkWidget **menubar,
     { "file_verify", file_verify },
     { "file_encrypt", file_encrypt },
     { "file_decrypt", file_decrypt },
+    { "file_resume", file_resume },
+    { "file_conflict", NULL, "s", "'ask'", file_conflict },
     { "file_close", file_close },
     { "file_quit", file_quit },
 
@@ -668,6 +820,10 @@ fileman_action_new (GpaFileManager *fileman, GtkWidget **menubar,
               "<attribute name='label' translatable='yes'>Decrypt</attribute>"
               "<attribute name='action'>app.file_decrypt</attribute>"
             "</item>"
+            "<item>"
+              "<attribute name='label' translatable='yes'>Resume Interrupted</attribute>"
+              "<attribute name='action'>app.file_resume</attribute>"
+            "</item>"
           "</section>"
           "<section>"
             "<item>"
@@ -688,6 +844,36 @@ fileman_action_new (GpaFileManager *fileman, GtkWidget **menubar,
               "<attribute name='action'>app.file_close</attribute>"
             "</item>"
           "</section>"
+          "<section>"
+            "<submenu>"
+              "<attribute name='label' translatable='yes'>If Output File Exists</attribute>"
+              "<item>"
+                "<attribute name='label' translatable='yes'>Ask</attribute>"
+                "<attribute name='action'>app.file_conflict</attribute>"
+                "<attribute name='target'>ask</attribute>"
+              "</item>"
+              "<item>"
+                "<attribute name='label' translatable='yes'>Overwrite</attribute>"
+                "<attribute name='action'>app.file_conflict</attribute>"
+                "<attribute name='target'>overwrite</attribute>"
+              "</item>"
+              "<item>"
+                "<attribute name='label' translatable='yes'>Skip</attribute>"
+                "<attribute name='action'>app.file_conflict</attribute>"
+                "<attribute name='target'>skip</attribute>"
+              "</item>"
+              "<item>"
+                "<attribute name='label' translatable='yes'>Rename</attribute>"
+                "<attribute name='action'>app.file_conflict</attribute>"
+                "<attribute name='target'>rename</attribute>"
+              "</item>"
+              "<item>"
+                "<attribute name='label' translatable='yes'>Fail</attribute>"
+                "<attribute name='action'>app.file_conflict</attribute>"
+                "<attribute name='target'>fail</attribute>"
+              "</item>"
+            "</submenu>"
+          "</section>"
           "<section>"
             "<item>"
               "<attribute name='label' translatable='yes'>Backend Settings</attribute>"
@@ -0,0 +1,392 @@
+/* filemanifest.c - Manifest of already processed files.
+   Copyright (C) 2026 g10 Code GmbH
+
+   This file is part of GPA.
+
+   GPA is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   GPA is distributed in the hope that it will be useful, but WITHOUT
+   ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+   or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public
+   License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, see <http://www.gnu.org/licenses/>.  */
+
+/* The manifest is a plain text file with one line per input file:
+
+     <filename_in> <size> <mtime> <content_hash> <param_hash> <filename_out>
+
+   The file names are percent escaped so that they don't contain
+   spaces.  The hashes are hex encoded SHA-256 digests.  Lines
+   starting with a hash mark are comments.  The file is always
+   replaced atomically so that an interrupted run never leaves a
+   truncated manifest behind.  */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "gpa.h"
+#include "filemanifest.h"
+
+
+#define MANIFEST_HEADER "# GPA file manifest v1\n"
+
+/* One entry of the manifest.  The key of the hash table is the name
+   of the input file.  */
+struct manifest_entry_s
+{
+  gint64 size;
+  gint64 mtime;
+  char *content_hash;
+  char *param_hash;
+  char *filename_out;
+};
+typedef struct manifest_entry_s *manifest_entry_t;
+
+
+struct gpa_manifest_s
+{
+  /* The name of the manifest file.  */
+  char *filename;
+
+  /* Map from the input file name to a manifest_entry_t.  */
+  GHashTable *entries;
+
+  /* True if the manifest needs to be written.  */
+  int dirty;
+};
+
+
+
+static void
+release_entry (void *p)
+{
+  manifest_entry_t entry = p;
+
+  if (!entry)
+    return;
+  g_free (entry->content_hash);
+  g_free (entry->param_hash);
+  g_free (entry->filename_out);
+  g_free (entry);
+}
+
+
+/* Return a malloced hex string with the SHA-256 hash of the content
+   of FILENAME or NULL on error.  */
+static char *
+hash_file_content (const char *filename)
+{
+  GChecksum *md;
+  FILE *fp;
+  guchar buffer[16384];
+  size_t n;
+  char *result = NULL;
+
+  fp = g_fopen (filename, "rb");
+  if (!fp)
+    return NULL;
+
+  md = g_checksum_new (G_CHECKSUM_SHA256);
+  while ((n = fread (buffer, 1, sizeof buffer, fp)) > 0)
+    g_checksum_update (md, buffer, n);
+  if (!ferror (fp))
+    result = g_strdup (g_checksum_get_string (md));
+  g_checksum_free (md);
+  fclose (fp);
+
+  return result;
+}
+
+
+/* Parse one LINE of a manifest file and insert it into MANIFEST.
+   Invalid lines are silently ignored.  */
+static void
+parse_line (gpa_manifest_t manifest, char *line)
+{
+  char **fields;
+  manifest_entry_t entry;
+
+  if (!*line || *line == '#')
+    return;
+
+  fields = g_strsplit (line, " ", 7);
+  if (g_strv_length (fields) != 6)
+    {
+      g_strfreev (fields);
+      return;
+    }
+
+  decode_percent_string (fields[0]);
+  decode_percent_string (fields[5]);
+
+  entry = g_malloc0 (sizeof *entry);
+  entry->size = g_ascii_strtoll (fields[1], NULL, 10);
+  entry->mtime = g_ascii_strtoll (fields[2], NULL, 10);
+  entry->content_hash = g_strdup (fields[3]);
+  entry->param_hash = g_strdup (fields[4]);
+  entry->filename_out = g_strdup (fields[5]);
+  g_hash_table_replace (manifest->entries, g_strdup (fields[0]), entry);
+
+  g_strfreev (fields);
+}
+
+
+
+/* Load the manifest from FILENAME.  A missing file yields an empty
+   manifest.  */
+gpa_manifest_t
+gpa_manifest_new (const char *filename)
+{
+  gpa_manifest_t manifest;
+  gchar *contents;
+  GError *error = NULL;
+
+  g_return_val_if_fail (filename, NULL);
+
+  manifest = g_malloc0 (sizeof *manifest);
+  manifest->filename = g_strdup (filename);
+  manifest->entries = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                             g_free, release_entry);
+
+  if (g_file_get_contents (filename, &contents, NULL, &error))
+    {
+      char *line, *next;
+
+      for (line = contents; line; line = next)
+        {
+          next = strchr (line, '\n');
+          if (next)
+            *next++ = 0;
+          parse_line (manifest, line);
+        }
+      g_free (contents);
+    }
+  else
+    {
+      if (!g_error_matches (error, G_FILE_ERROR, G_FILE_ERROR_NOENT))
+        g_message ("error reading manifest '%s': %s",
+                   filename, error->message);
+      g_error_free (error);
+    }
+
+  return manifest;
+}
+
+
+/* Write the manifest if it has been modified and release it.  */
+void
+gpa_manifest_release (gpa_manifest_t manifest)
+{
+  if (!manifest)
+    return;
+
+  gpa_manifest_commit (manifest);
+  g_hash_table_destroy (manifest->entries);
+  g_free (manifest->filename);
+  g_free (manifest);
+}
+
+
+/* Atomically write MANIFEST back to its file if it has been
+   modified.  */
+gpg_error_t
+gpa_manifest_commit (gpa_manifest_t manifest)
+{
+  GString *buffer;
+  GHashTableIter iter;
+  gpointer key, value;
+  GError *error = NULL;
+  gpg_error_t err = 0;
+
+  if (!manifest || !manifest->dirty)
+    return 0;
+
+  buffer = g_string_new (MANIFEST_HEADER);
+  g_hash_table_iter_init (&iter, manifest->entries);
+  while (g_hash_table_iter_next (&iter, &key, &value))
+    {
+      manifest_entry_t entry = value;
+      char *name_in, *name_out;
+
+      name_in = percent_escape (key, NULL, 0);
+      name_out = percent_escape (entry->filename_out, NULL, 0);
+      g_string_append_printf (buffer,
+                              "%s %" G_GINT64_FORMAT " %" G_GINT64_FORMAT
+                              " %s %s %s\n",
+                              name_in, entry->size, entry->mtime,
+                              entry->content_hash, entry->param_hash,
+                              name_out);
+      g_free (name_in);
+      g_free (name_out);
+    }
+
+  /* g_file_set_contents writes to a temporary file and renames it,
+     thus readers never see a partially written manifest.  */
+  if (g_file_set_contents (manifest->filename, buffer->str, buffer->len,
+                           &error))
+    manifest->dirty = 0;
+  else
+    {
+      g_message ("error writing manifest '%s': %s",
+                 manifest->filename, error->message);
+      g_error_free (error);
+      err = gpg_error (GPG_ERR_GENERAL);
+    }
+  g_string_free (buffer, TRUE);
+
+  return err;
+}
+
+
+static int
+compare_strings (gconstpointer a, gconstpointer b)
+{
+  return strcmp (*(const char * const *)a, *(const char * const *)b);
+}
+
+
+/* Return a malloced hex string with a hash over the fingerprints of
+   the NULL terminated array KEYS, the signers set in CTX and the
+   string PARAMS.  Any of them may be NULL.  The order of the keys
+   does not matter.  */
+char *
+gpa_manifest_hash_params (gpgme_ctx_t ctx, gpgme_key_t *keys,
+                          const char *params)
+{
+  GChecksum *md;
+  GPtrArray *fprs;
+  gpgme_key_t key;
+  char *result;
+  int idx;
+
+  fprs = g_ptr_array_new_with_free_func (g_free);
+  for (idx = 0; keys && keys[idx]; idx++)
+    if (keys[idx]->subkeys && keys[idx]->subkeys->fpr)
+      g_ptr_array_add (fprs, g_strconcat ("R:", keys[idx]->subkeys->fpr,
+                                          NULL));
+  for (idx = 0; ctx && (key = gpgme_signers_enum (ctx, idx)); idx++)
+    {
+      if (key->subkeys && key->subkeys->fpr)
+        g_ptr_array_add (fprs, g_strconcat ("S:", key->subkeys->fpr, NULL));
+      gpgme_key_unref (key);
+    }
+  g_ptr_array_sort (fprs, compare_strings);
+
+  md = g_checksum_new (G_CHECKSUM_SHA256);
+  for (idx = 0; idx < fprs->len; idx++)
+    {
+      const char *s = g_ptr_array_index (fprs, idx);
+
+      g_checksum_update (md, (const guchar *) s, strlen (s));
+      g_checksum_update (md, (const guchar *) "\n", 1);
+    }
+  if (params)
+    g_checksum_update (md, (const guchar *) params, strlen (params));
+  result = g_strdup (g_checksum_get_string (md));
+
+  g_checksum_free (md);
+  g_ptr_array_free (fprs, TRUE);
+
+  return result;
+}
+
+
+/* Return true if FILENAME_IN has already been processed with
+   PARAM_HASH, has not changed since then and the output file still
+   exists.  On success the name of that output file is stored at
+   R_FILENAME_OUT; it must be freed by the caller.
+
+   Size and mtime are used as a fast check; only if the mtime changed
+   but the size did not, the content hash is computed to detect files
+   which have merely been touched.  */
+gboolean
+gpa_manifest_is_unchanged (gpa_manifest_t manifest, const char *filename_in,
+                           const char *param_hash, char **r_filename_out)
+{
+  manifest_entry_t entry;
+  struct stat st;
+  char *content_hash;
+
+  *r_filename_out = NULL;
+  if (!manifest || !filename_in || !param_hash)
+    return FALSE;
+
+  entry = g_hash_table_lookup (manifest->entries, filename_in);
+  if (!entry || strcmp (entry->param_hash, param_hash))
+    return FALSE;
+  if (!g_file_test (entry->filename_out, G_FILE_TEST_EXISTS))
+    return FALSE;
+  if (g_stat (filename_in, &st) || (gint64) st.st_size != entry->size)
+    return FALSE;
+
+  if ((gint64) st.st_mtime != entry->mtime)
+    {
+      content_hash = hash_file_content (filename_in);
+      if (!content_hash || strcmp (content_hash, entry->content_hash))
+        {
+          g_free (content_hash);
+          return FALSE;
+        }
+      g_free (content_hash);
+      /* Only touched; remember the new mtime to avoid hashing again
+         on the next run.  */
+      entry->mtime = st.st_mtime;
+      manifest->dirty = 1;
+    }
+
+  *r_filename_out = g_strdup (entry->filename_out);
+  return TRUE;
+}
+
+
+/* Record that FILENAME_IN has been processed with PARAM_HASH into
+   FILENAME_OUT.  */
+void
+gpa_manifest_update (gpa_manifest_t manifest, const char *filename_in,
+                     const char *param_hash, const char *filename_out)
+{
+  manifest_entry_t entry;
+  struct stat st;
+  char *content_hash;
+
+  if (!manifest || !filename_in || !param_hash || !filename_out)
+    return;
+
+  content_hash = hash_file_content (filename_in);
+  if (!content_hash || g_stat (filename_in, &st))
+    {
+      g_free (content_hash);
+      if (g_hash_table_remove (manifest->entries, filename_in))
+        manifest->dirty = 1;
+      return;
+    }
+
+  entry = g_malloc0 (sizeof *entry);
+  entry->size = st.st_size;
+  /* If the file was modified within the current second, a later
+     modification might not change the mtime.  Store an invalid mtime
+     to force a content check on the next run.  */
+  entry->mtime = (st.st_mtime < time (NULL))? (gint64) st.st_mtime : 0;
+  entry->content_hash = content_hash;
+  entry->param_hash = g_strdup (param_hash);
+  entry->filename_out = g_strdup (filename_out);
+  g_hash_table_replace (manifest->entries, g_strdup (filename_in), entry);
+  manifest->dirty = 1;
+}
@@ -0,0 +1,63 @@
+/* filemanifest.h - Manifest of already processed files.
+   Copyright (C) 2026 g10 Code GmbH
+
+   This file is part of GPA.
+
+   GPA is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   GPA is distributed in the hope that it will be useful, but WITHOUT
+   ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+   or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public
+   License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, see <http://www.gnu.org/licenses/>.  */
+
+#ifndef FILEMANIFEST_H
+#define FILEMANIFEST_H
+
+#include <glib.h>
+#include <gpgme.h>
+
+/* A manifest records for each processed input file its size, mtime
+   and content hash together with a hash over the parameters used to
+   process it (recipients, signers, armor, ...) and the name of the
+   created output file.  It allows to skip files which have not
+   changed since the last run.  */
+typedef struct gpa_manifest_s *gpa_manifest_t;
+
+/* Load the manifest from FILENAME.  A missing file yields an empty
+   manifest.  */
+gpa_manifest_t gpa_manifest_new (const char *filename);
+
+/* Write the manifest if it has been modified and release it.  */
+void gpa_manifest_release (gpa_manifest_t manifest);
+
+/* Atomically write MANIFEST back to its file if it has been
+   modified.  */
+gpg_error_t gpa_manifest_commit (gpa_manifest_t manifest);
+
+/* Return a malloced hex string with a hash over the fingerprints of
+   the NULL terminated array KEYS, the signers set in CTX and the
+   string PARAMS.  Any of them may be NULL.  */
+char *gpa_manifest_hash_params (gpgme_ctx_t ctx, gpgme_key_t *keys,
+                                const char *params);
+
+/* Return true if FILENAME_IN has already been processed with
+   PARAM_HASH, has not changed since then and the output file still
+   exists.  On success the name of that output file is stored at
+   R_FILENAME_OUT; it must be freed by the caller.  */
+gboolean gpa_manifest_is_unchanged (gpa_manifest_t manifest,
+                                    const char *filename_in,
+                                    const char *param_hash,
+                                    char **r_filename_out);
+
+/* Record that FILENAME_IN has been processed with PARAM_HASH into
+   FILENAME_OUT.  */
+void gpa_manifest_update (gpa_manifest_t manifest, const char *filename_in,
+                          const char *param_hash, const char *filename_out);
+
+#endif /*FILEMANIFEST_H*/
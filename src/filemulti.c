@@ -0,0 +1,661 @@
+/* filemulti.c - Multi-file backend for file operations.
+   Copyright (C) 2026 g10 Code GmbH
+
+   This file is part of GPA.
+
+   GPA is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   GPA is distributed in the hope that it will be useful, but WITHOUT
+   ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+   or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public
+   License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, see <http://www.gnu.org/licenses/>.  */
+
+/* The names of the files are passed to gpg on stdin, one per line,
+   so that the command line length is not a limit.  gpg processes
+   them in that order and emits
+
+     FILE_START <what> <filename>
+     ...
+     FILE_DONE
+
+   for each file on the status fd (which we map to stdout because the
+   output goes to files anyway).  The status lines in between tell
+   whether the file succeeded.  */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "gpa.h"
+#include "i18n.h"
+#include "gtktools.h"
+#include "gpafileop.h"
+#include "filemulti.h"
+
+
+/* Use the multi-file backend only if at least this many files are
+   left.  For fewer files the process startup does not matter.  */
+#define MULTIFILE_MIN_FILES 8
+
+/* The maximum number of files handed to one gpg process.  This keeps
+   the progress display and cancellation reasonably fine grained.  */
+#define MULTIFILE_MAX_FILES 256
+
+/* Larger files are left to the regular backend; for them the time is
+   spent in the crypto and not in the process startup.  */
+#define MULTIFILE_MAX_FILE_SIZE (1024 * 1024)
+
+/* The maximum amount of data handed to one gpg process.  */
+#define MULTIFILE_MAX_BYTES (64 * 1024 * 1024)
+
+/* gpg reads the file names with a fixed size line buffer.  */
+#define MULTIFILE_MAX_NAME_LEN 2000
+
+
+/* The result of one file.  */
+struct multifile_entry_s
+{
+  gpa_file_item_t file_item;
+  unsigned int started:1;  /* Seen FILE_START.  */
+  unsigned int done:1;     /* Seen FILE_DONE.  */
+  unsigned int okay:1;     /* Seen the success status.  */
+  unsigned int failed:1;   /* Seen a failure status.  */
+  unsigned int sigs:1;     /* The data was signed.  */
+  unsigned int goodsig:1;  /* Seen a good signature.  */
+  unsigned int plain:1;    /* Seen PLAINTEXT.  */
+  gpg_error_t err;         /* The first error code reported.  */
+};
+
+
+/* A file which may still be handed to gpg.  */
+struct multifile_candidate_s
+{
+  gpa_file_item_t file_item;
+  int klass;
+  gint64 size;
+  char *filename_out;
+};
+
+
+struct gpa_multifile_s
+{
+  /* The files which may still be handed to gpg in the order of the
+     operation, and an index from the file items to their links.
+     The files are classified only once when the first group is
+     selected.  */
+  gboolean classified;
+  GQueue candidates;
+  GHashTable *candidate_links;
+
+  /* The file items whose result has been reported.  */
+  GHashTable *finished;
+
+  /* Set if no more groups shall be selected.  */
+  gboolean exhausted;
+
+  /* The state of the running gpg process.  */
+  gboolean running;
+  gpa_multifile_mode_t mode;
+  gpgme_protocol_t saved_protocol;
+  struct multifile_entry_s *entries;
+  unsigned int nentries;
+  int current;
+  GString *line;
+  gpgme_data_t names;
+  gpgme_data_t status;
+
+  /* For the progress display.  */
+  GpaFileOperation *op;
+};
+
+
+
+static gpa_multifile_t
+get_multifile (GpaFileOperation *op)
+{
+  if (!op->multifile)
+    {
+      op->multifile = g_malloc0 (sizeof *op->multifile);
+      g_queue_init (&op->multifile->candidates);
+      op->multifile->candidate_links = g_hash_table_new (NULL, NULL);
+      op->multifile->finished = g_hash_table_new (NULL, NULL);
+    }
+  return op->multifile;
+}
+
+
+/* Forget the output file name of FILE_ITEM so that the regular
+   backend can set its own.  */
+static void
+clear_filename_out (gpa_file_item_t file_item)
+{
+  g_free (file_item->filename_out);
+  file_item->filename_out = NULL;
+}
+
+
+/* Return true if FILE_ITEM may be handed to gpg at all.  Its size is
+   stored at R_SIZE.  */
+static gboolean
+suitable_file (gpa_file_item_t file_item, gint64 *r_size)
+{
+  const char *name = file_item->filename_in;
+  struct stat st;
+
+  if (file_item->direct_in || !name)
+    return FALSE;
+  if (strlen (name) > MULTIFILE_MAX_NAME_LEN || strpbrk (name, "\r\n"))
+    return FALSE;
+  if (g_stat (name, &st) || !S_ISREG (st.st_mode)
+      || st.st_size > MULTIFILE_MAX_FILE_SIZE)
+    return FALSE;
+
+  *r_size = st.st_size;
+  return TRUE;
+}
+
+
+static void
+free_candidate (struct multifile_candidate_s *cand)
+{
+  g_free (cand->filename_out);
+  g_free (cand);
+}
+
+
+/* Remove the candidate at LINK from MULTI and return it.  */
+static struct multifile_candidate_s *
+remove_candidate (gpa_multifile_t multi, GList *link)
+{
+  struct multifile_candidate_s *cand = link->data;
+
+  g_hash_table_remove (multi->candidate_links, cand->file_item);
+  g_queue_delete_link (&multi->candidates, link);
+  return cand;
+}
+
+
+/* Classify the remaining files of OP with CLASSIFY.  This stats and
+   may read each file, thus it is done only once.  */
+static void
+classify_files (gpa_multifile_t multi, GpaFileOperation *op,
+                gpa_multifile_classify_t classify)
+{
+  GList *cur;
+
+  for (cur = op->current; cur; cur = g_list_next (cur))
+    {
+      gpa_file_item_t file_item = cur->data;
+      struct multifile_candidate_s *cand;
+      char *filename_out;
+      gint64 size;
+      int c;
+
+      if (g_hash_table_contains (multi->candidate_links, file_item)
+          || !suitable_file (file_item, &size)
+          || gpa_file_operation_skip_file (op, file_item))
+        continue;
+      c = classify (op, file_item, &filename_out);
+      if (c < 0)
+        continue;
+
+      cand = g_malloc0 (sizeof *cand);
+      cand->file_item = file_item;
+      cand->klass = c;
+      cand->size = size;
+      cand->filename_out = filename_out;
+      g_queue_push_tail (&multi->candidates, cand);
+      g_hash_table_insert (multi->candidate_links, file_item,
+                           g_queue_peek_tail_link (&multi->candidates));
+    }
+  multi->classified = TRUE;
+}
+
+
+static void
+set_entry_error (struct multifile_entry_s *entry, gpg_error_t err)
+{
+  if (!entry->err)
+    entry->err = err;
+}
+
+
+/* Parse one status LINE of the gpg process.  */
+static void
+parse_status_line (gpa_multifile_t multi, char *line)
+{
+  struct multifile_entry_s *entry;
+  char *keyword, *args;
+
+  if (strncmp (line, "[GNUPG:] ", 9))
+    return;
+  keyword = line + 9;
+  args = strchr (keyword, ' ');
+  if (args)
+    *args++ = 0;
+  else
+    args = "";
+
+  if (!strcmp (keyword, "FILE_START"))
+    {
+      multi->current++;
+      if ((unsigned int) multi->current < multi->nentries)
+        {
+          entry = multi->entries + multi->current;
+          entry->started = 1;
+          gpa_progress_dialog_set_label
+            (GPA_PROGRESS_DIALOG (multi->op->progress_dialog),
+             entry->file_item->filename_in);
+        }
+      return;
+    }
+
+  if (multi->current < 0 || (unsigned int) multi->current >= multi->nentries)
+    return;
+  entry = multi->entries + multi->current;
+
+  if (!strcmp (keyword, "FILE_DONE"))
+    entry->done = 1;
+  else if (!strcmp (keyword, "END_ENCRYPTION"))
+    {
+      if (multi->mode == GPA_MULTIFILE_ENCRYPT)
+        entry->okay = 1;
+    }
+  else if (!strcmp (keyword, "DECRYPTION_OKAY"))
+    {
+      if (multi->mode != GPA_MULTIFILE_ENCRYPT)
+        entry->okay = 1;
+    }
+  else if (!strcmp (keyword, "DECRYPTION_FAILED"))
+    {
+      entry->failed = 1;
+      set_entry_error (entry, gpg_error (GPG_ERR_DECRYPT_FAILED));
+    }
+  else if (!strcmp (keyword, "NODATA"))
+    {
+      entry->failed = 1;
+      set_entry_error (entry, gpg_error (GPG_ERR_NO_DATA));
+    }
+  else if (!strcmp (keyword, "ERROR") || !strcmp (keyword, "FAILURE"))
+    {
+      /* The arguments are the location and the error code.  These
+         are not necessarily fatal, thus only remember the code.  */
+      char *p = strchr (args, ' ');
+
+      if (p)
+        set_entry_error (entry, (gpg_error_t) strtoul (p + 1, NULL, 10));
+    }
+  else if (!strcmp (keyword, "PLAINTEXT"))
+    entry->plain = 1;
+  else if (!strcmp (keyword, "GOODSIG") || !strcmp (keyword, "VALIDSIG"))
+    entry->sigs = entry->goodsig = 1;
+  else if (!strcmp (keyword, "NEWSIG") || !strcmp (keyword, "BADSIG")
+           || !strcmp (keyword, "ERRSIG"))
+    entry->sigs = 1;
+}
+
+
+/* Collect the status output of gpg and parse complete lines.  */
+static ssize_t
+status_write_cb (void *handle, const void *buffer, size_t size)
+{
+  gpa_multifile_t multi = handle;
+  char *p;
+
+  g_string_append_len (multi->line, buffer, size);
+  while ((p = memchr (multi->line->str, '\n', multi->line->len)))
+    {
+      gsize n = p - multi->line->str + 1;
+
+      *p = 0;
+      if (p > multi->line->str && p[-1] == '\r')
+        p[-1] = 0;
+      parse_status_line (multi, multi->line->str);
+      g_string_erase (multi->line, 0, n);
+    }
+
+  return size;
+}
+
+static struct gpgme_data_cbs status_cbs =
+  {
+    NULL,
+    status_write_cb,
+    NULL,
+    NULL
+  };
+
+
+/* Release the resources of the gpg process of MULTI.  */
+static void
+release_process (gpa_multifile_t multi)
+{
+  gpgme_data_release (multi->names);
+  multi->names = NULL;
+  gpgme_data_release (multi->status);
+  multi->status = NULL;
+  if (multi->line)
+    g_string_free (multi->line, TRUE);
+  multi->line = NULL;
+  g_free (multi->entries);
+  multi->entries = NULL;
+  multi->nentries = 0;
+  multi->running = FALSE;
+}
+
+
+
+/* Release the multi-file state MULTI.  */
+void
+gpa_multifile_release (gpa_multifile_t multi)
+{
+  struct multifile_candidate_s *cand;
+
+  if (!multi)
+    return;
+
+  release_process (multi);
+  while ((cand = g_queue_pop_head (&multi->candidates)))
+    free_candidate (cand);
+  g_hash_table_destroy (multi->candidate_links);
+  g_hash_table_destroy (multi->finished);
+  g_free (multi);
+}
+
+
+/* Select the next group of files of OP for the multi-file backend.
+   Returns NULL if there are not enough suitable files left so that
+   the regular backend shall be used.  The class of the group is
+   stored at R_CLASS.  The returned list must be freed with
+   g_list_free.  */
+GList *
+gpa_multifile_select (GpaFileOperation *op, gpa_multifile_classify_t classify,
+                      int *r_class)
+{
+  gpa_multifile_t multi = get_multifile (op);
+  GList *cur, *next, *links, *items;
+  struct multifile_candidate_s *cand;
+  unsigned int count;
+  gint64 total;
+  int klass;
+
+  *r_class = -1;
+  if (multi->exhausted)
+    return NULL;
+  if (!multi->classified)
+    classify_files (multi, op, classify);
+
+  while (!g_queue_is_empty (&multi->candidates))
+    {
+      /* Try to make a group of the class of the first file.  */
+      cand = g_queue_peek_head (&multi->candidates);
+      klass = cand->klass;
+      links = NULL;
+      count = 0;
+      total = 0;
+      for (cur = g_queue_peek_head_link (&multi->candidates);
+           cur && count < MULTIFILE_MAX_FILES; cur = next)
+        {
+          next = g_list_next (cur);
+          cand = cur->data;
+          if (cand->klass != klass)
+            continue;
+          if (total + cand->size > MULTIFILE_MAX_BYTES)
+            break;
+          if (g_file_test (cand->filename_out, G_FILE_TEST_EXISTS))
+            {
+              /* The user needs to be asked.  */
+              free_candidate (remove_candidate (multi, cur));
+              continue;
+            }
+          links = g_list_prepend (links, cur);
+          total += cand->size;
+          count++;
+        }
+
+      if (count >= MULTIFILE_MIN_FILES)
+        {
+          items = NULL;
+          for (cur = links; cur; cur = g_list_next (cur))
+            {
+              cand = remove_candidate (multi, cur->data);
+              g_free (cand->file_item->filename_out);
+              cand->file_item->filename_out = cand->filename_out;
+              items = g_list_prepend (items, cand->file_item);
+              g_free (cand);
+            }
+          g_list_free (links);
+          *r_class = klass;
+          return items;
+        }
+
+      /* We looked at all remaining files of this class and they are
+         not enough.  Leave them to the regular backend.  */
+      for (cur = links; cur; cur = g_list_next (cur))
+        free_candidate (remove_candidate (multi, cur->data));
+      g_list_free (links);
+    }
+
+  multi->exhausted = TRUE;
+  return NULL;
+}
+
+
+/* Start a gpg process in MODE on the files in ITEMS of OP.  ARGS is
+   a NULL terminated array of additional gpg options and may be
+   NULL.  */
+gpg_error_t
+gpa_multifile_start (GpaFileOperation *op, gpa_multifile_mode_t mode,
+                     GList *items, const char **args)
+{
+  gpa_multifile_t multi = get_multifile (op);
+  gpgme_ctx_t ctx = GPA_OPERATION (op)->context->ctx;
+  const char *gpg, *homedir;
+  GPtrArray *argv;
+  GString *names;
+  GList *cur;
+  gpg_error_t err;
+  int idx;
+
+  g_return_val_if_fail (!multi->running, gpg_error (GPG_ERR_CONFLICT));
+
+  gpg = gpa_get_gpg_engine (ctx, &homedir);
+  if (!gpg)
+    {
+      err = gpg_error (GPG_ERR_NOT_SUPPORTED);
+      goto leave;
+    }
+
+  argv = g_ptr_array_new ();
+  g_ptr_array_add (argv, (char *) gpg);
+  g_ptr_array_add (argv, "--batch");
+  g_ptr_array_add (argv, "--no-tty");
+  g_ptr_array_add (argv, "--status-fd");
+  g_ptr_array_add (argv, "1");
+  if (homedir)
+    {
+      g_ptr_array_add (argv, "--homedir");
+      g_ptr_array_add (argv, (char *) homedir);
+    }
+  for (idx = 0; args && args[idx]; idx++)
+    g_ptr_array_add (argv, (char *) args[idx]);
+  g_ptr_array_add (argv, mode == GPA_MULTIFILE_ENCRYPT
+                   ? "--encrypt-files" : "--decrypt-files");
+  g_ptr_array_add (argv, NULL);
+
+  multi->nentries = g_list_length (items);
+  multi->entries = g_malloc0 (multi->nentries * sizeof *multi->entries);
+  names = g_string_new (NULL);
+  for (cur = items, idx = 0; cur; cur = g_list_next (cur), idx++)
+    {
+      gpa_file_item_t file_item = cur->data;
+
+      multi->entries[idx].file_item = file_item;
+      g_string_append (names, file_item->filename_in);
+      g_string_append_c (names, '\n');
+    }
+  multi->mode = mode;
+  multi->current = -1;
+  multi->line = g_string_new (NULL);
+  multi->op = op;
+
+  err = gpgme_data_new_from_mem (&multi->names, names->str, names->len, 1);
+  g_string_free (names, TRUE);
+  if (!err)
+    err = gpgme_data_new_from_cbs (&multi->status, &status_cbs, multi);
+  if (!err)
+    {
+      multi->saved_protocol = gpgme_get_protocol (ctx);
+      err = gpgme_set_protocol (ctx, GPGME_PROTOCOL_SPAWN);
+      if (!err)
+        {
+          err = gpgme_op_spawn_start (ctx, gpg, (const char **) argv->pdata,
+                                      multi->names, multi->status, NULL, 0);
+          if (err)
+            gpgme_set_protocol (ctx, multi->saved_protocol);
+        }
+    }
+  g_ptr_array_free (argv, TRUE);
+  if (err)
+    release_process (multi);
+
+ leave:
+  /* The files are never handed to gpg again; if we failed they are
+     processed by the regular backend.  */
+  if (err)
+    {
+      for (cur = items; cur; cur = g_list_next (cur))
+        clear_filename_out (cur->data);
+      g_debug ("multi-file backend not available: %s", gpg_strerror (err));
+      multi->exhausted = TRUE;
+      return err;
+    }
+
+  multi->running = TRUE;
+  gtk_widget_show_all (op->progress_dialog);
+  gpa_progress_dialog_set_label (GPA_PROGRESS_DIALOG (op->progress_dialog),
+                                 _("Starting..."));
+  return 0;
+}
+
+
+/* Return true if a multi-file gpg process of OP is running.  */
+gboolean
+gpa_multifile_running (GpaFileOperation *op)
+{
+  return op->multifile && op->multifile->running;
+}
+
+
+/* Return true if FILE_ITEM of OP has already been handled by the
+   multi-file backend.  */
+gboolean
+gpa_multifile_is_finished (GpaFileOperation *op, gpa_file_item_t file_item)
+{
+  return (op->multifile
+          && g_hash_table_contains (op->multifile->finished, file_item));
+}
+
+
+/* Finish the multi-file process of OP which terminated with ERR and
+   report the per-file results.  Files which gpg did not get to are
+   left for the regular backend.  Returns an error if the operation
+   shall be aborted.  */
+gpg_error_t
+gpa_multifile_finish (GpaFileOperation *op, gpg_error_t err)
+{
+  gpa_multifile_t multi = op->multifile;
+  gpa_file_item_t failed_item = NULL;
+  gpg_error_t failed_err = 0;
+  gpg_error_t abort_err = 0;
+  unsigned int idx;
+
+  g_return_val_if_fail (gpa_multifile_running (op), err);
+
+  gpgme_set_protocol (GPA_OPERATION (op)->context->ctx,
+                      multi->saved_protocol);
+
+  for (idx = 0; idx < multi->nentries; idx++)
+    {
+      struct multifile_entry_s *entry = multi->entries + idx;
+      gpa_file_item_t file_item = entry->file_item;
+      gpg_error_t file_err;
+
+      if (!entry->started)
+        {
+          /* gpg did not get to this file, either because it died or
+             because it was canceled.  */
+          if (err && !abort_err)
+            abort_err = err;
+          clear_filename_out (file_item);
+          continue;
+        }
+
+      if (multi->mode == GPA_MULTIFILE_DECRYPT_VERIFY && entry->sigs && !err)
+        {
+          /* Let the regular backend do it again to get the
+             signatures.  This includes files which are only signed
+             and thus have no DECRYPTION_OKAY.  The output file did
+             not exist before.  */
+          g_unlink (file_item->filename_out);
+          clear_filename_out (file_item);
+          continue;
+        }
+
+      /* Data which is only signed has no DECRYPTION_OKAY.  */
+      if (multi->mode == GPA_MULTIFILE_DECRYPT
+          && entry->plain && entry->goodsig)
+        entry->okay = 1;
+
+      if (entry->okay && !entry->failed && entry->done
+          && g_file_test (file_item->filename_out, G_FILE_TEST_EXISTS))
+        {
+          g_hash_table_add (multi->finished, file_item);
+          gpa_file_operation_file_done (op, file_item);
+          g_signal_emit_by_name (GPA_OPERATION (op), "created_file",
+                                 file_item);
+          continue;
+        }
+
+      /* The output file did not exist before, thus it is safe to
+         delete whatever gpg left behind.  */
+      g_unlink (file_item->filename_out);
+      clear_filename_out (file_item);
+      g_hash_table_add (multi->finished, file_item);
+      file_err = err? err : entry->err;
+      if (!file_err)
+        file_err = gpg_error (GPG_ERR_GENERAL);
+      if (!failed_item)
+        {
+          failed_item = file_item;
+          failed_err = file_err;
+        }
+      if (!gpa_file_operation_file_failed (op, file_item, file_err)
+          && !abort_err)
+        abort_err = file_err;
+    }
+
+  release_process (multi);
+
+  if (failed_item && gpg_err_code (failed_err) != GPG_ERR_CANCELED)
+    gpa_show_warn (GPA_OPERATION (op)->window, GPA_OPERATION (op)->context,
+                   _("The file \"%s\" could not be processed: %s"),
+                   failed_item->filename_in, gpg_strerror (failed_err));
+
+  return abort_err;
+}
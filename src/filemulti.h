@@ -0,0 +1,89 @@
+/* filemulti.h - Multi-file backend for file operations.
+   Copyright (C) 2026 g10 Code GmbH
+
+   This file is part of GPA.
+
+   GPA is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   GPA is distributed in the hope that it will be useful, but WITHOUT
+   ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+   or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public
+   License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, see <http://www.gnu.org/licenses/>.  */
+
+#ifndef FILEMULTI_H
+#define FILEMULTI_H
+
+#include <glib.h>
+#include <gpgme.h>
+
+/* The multi-file backend hands a group of small files to a single gpg
+   process using --encrypt-files or --decrypt-files.  This saves one
+   process startup and agent handshake per file.  The gpg process is
+   run through GPGME_PROTOCOL_SPAWN on the context of the file
+   operation and its status output is parsed back into per-file
+   results.  */
+typedef struct gpa_multifile_s *gpa_multifile_t;
+
+/* Forward declarations to avoid including gpafileop.h.  */
+struct _GpaFileOperation;
+struct gpa_file_item_s;
+
+typedef enum
+  {
+    GPA_MULTIFILE_ENCRYPT,
+    GPA_MULTIFILE_DECRYPT,
+    /* Like GPA_MULTIFILE_DECRYPT but signed files are left to the
+       regular backend so that their signatures can be shown.  */
+    GPA_MULTIFILE_DECRYPT_VERIFY
+  } gpa_multifile_mode_t;
+
+/* Classify FILE_ITEM for the multi-file backend.  Returns -1 if the
+   file can't be handled by it; otherwise a class number.  Only files
+   of the same class are processed by one gpg process.  On success
+   the name of the output file as created by gpg is stored as a
+   malloced string at R_FILENAME_OUT.  */
+typedef int (*gpa_multifile_classify_t) (struct _GpaFileOperation *op,
+                                         struct gpa_file_item_s *file_item,
+                                         char **r_filename_out);
+
+/* Release the multi-file state MULTI.  */
+void gpa_multifile_release (gpa_multifile_t multi);
+
+/* Select the next group of files of OP for the multi-file backend.
+   Returns NULL if there are not enough suitable files left so that
+   the regular backend shall be used.  The class of the group is
+   stored at R_CLASS.  The returned list must be freed with
+   g_list_free.  */
+GList *gpa_multifile_select (struct _GpaFileOperation *op,
+                             gpa_multifile_classify_t classify,
+                             int *r_class);
+
+/* Start a gpg process in MODE on the files in ITEMS of OP.  ARGS is
+   a NULL terminated array of additional gpg options and may be
+   NULL.  */
+gpg_error_t gpa_multifile_start (struct _GpaFileOperation *op,
+                                 gpa_multifile_mode_t mode, GList *items,
+                                 const char **args);
+
+/* Return true if a multi-file gpg process of OP is running.  */
+gboolean gpa_multifile_running (struct _GpaFileOperation *op);
+
+/* Return true if FILE_ITEM of OP has already been handled by the
+   multi-file backend.  */
+gboolean gpa_multifile_is_finished (struct _GpaFileOperation *op,
+                                    struct gpa_file_item_s *file_item);
+
+/* Finish the multi-file process of OP which terminated with ERR and
+   report the per-file results.  Files which gpg did not get to are
+   left for the regular backend.  Returns an error if the operation
+   shall be aborted.  */
+gpg_error_t gpa_multifile_finish (struct _GpaFileOperation *op,
+                                  gpg_error_t err);
+
+#endif /*FILEMULTI_H*/
@@ -22,6 +22,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <math.h>
 #include <gpgme.h>
 
 #include "parsetlv.h"
@@ -31,6 +32,10 @@
 /* The size of the buffer we use to identify CMS objects.  */
 #define CMS_BUFFER_SIZE 2048
 
+/* The number of bytes sampled to decide whether compression is
+   worthwhile.  */
+#define COMPRESS_SAMPLE_SIZE 65536
+
 
 /* Warning: DATA may be binary but there must be a Nul before DATALEN.  */
 #ifndef HAVE_GPGME_DATA_IDENTIFY
@@ -223,3 +228,132 @@ is_cms_data_ext (gpgme_data_t dh)
   return 0;
 #endif
 }
+
+
+/* Return true if DATA starts with the signature of a file format
+   which is already compressed.  */
+static int
+has_compressed_magic (const unsigned char *data, size_t datalen)
+{
+  static const struct {
+    size_t off;
+    size_t len;
+    const char *magic;
+  } table[] = {
+    { 0, 4, "PK\x03\x04" },           /* Zip, Office, ODF, Jar.  */
+    { 0, 2, "\x1f\x8b" },             /* Gzip.  */
+    { 0, 3, "BZh" },                  /* Bzip2.  */
+    { 0, 6, "\xfd" "7zXZ\x00" },      /* Xz.  */
+    { 0, 4, "\x28\xb5\x2f\xfd" },     /* Zstandard.  */
+    { 0, 6, "7z\xbc\xaf\x27\x1c" },   /* 7-Zip.  */
+    { 0, 6, "Rar!\x1a\x07" },         /* Rar.  */
+    { 0, 4, "LZIP" },                 /* Lzip.  */
+    { 0, 3, "\xff\xd8\xff" },         /* JPEG.  */
+    { 0, 8, "\x89PNG\r\n\x1a\n" },    /* PNG.  */
+    { 0, 4, "GIF8" },                 /* GIF.  */
+    { 8, 4, "WEBP" },                 /* WebP.  */
+    { 4, 4, "ftyp" },                 /* MP4, MOV, HEIF.  */
+    { 0, 4, "\x1a\x45\xdf\xa3" },     /* Matroska, WebM.  */
+    { 0, 4, "OggS" },                 /* Ogg.  */
+    { 0, 4, "fLaC" },                 /* FLAC.  */
+    { 0, 3, "ID3" }                   /* MP3.  */
+  };
+  int idx;
+
+  for (idx = 0; idx < sizeof table / sizeof table[0]; idx++)
+    if (datalen >= table[idx].off + table[idx].len
+        && !memcmp (data + table[idx].off, table[idx].magic, table[idx].len))
+      return 1;
+
+  /* MP3 frame without an ID3 tag.  Besides the frame sync check that
+     this is a valid MPEG layer III header: no reserved version, a
+     bitrate index which is neither free nor invalid, no reserved
+     sample rate and no reserved emphasis.  The frame sync alone would
+     also match the UTF-16LE byte order mark FF FE.  */
+  if (datalen >= 4 && data[0] == 0xff && (data[1] & 0xe0) == 0xe0
+      && (data[1] & 0x18) != 0x08
+      && (data[1] & 0x06) == 0x02
+      && (data[2] & 0xf0) != 0x00 && (data[2] & 0xf0) != 0xf0
+      && (data[2] & 0x0c) != 0x0c
+      && (data[3] & 0x03) != 0x02)
+    return 1;
+
+  return 0;
+}
+
+
+/* Return true if the Shannon entropy of DATA is so high that
+   compression won't gain anything.  */
+static int
+has_high_entropy (const unsigned char *data, size_t datalen)
+{
+  size_t counts[256];
+  double entropy = 0.0;
+  size_t n;
+  int idx;
+
+  /* Too short for a meaningful estimate.  */
+  if (datalen < 512)
+    return 0;
+
+  memset (counts, 0, sizeof counts);
+  for (n = 0; n < datalen; n++)
+    counts[data[n]]++;
+
+  for (idx = 0; idx < 256; idx++)
+    if (counts[idx])
+      {
+        double p = (double) counts[idx] / datalen;
+
+        entropy -= p * log (p);
+      }
+  entropy /= log (2.0);
+
+  /* Deflate output is at about 7.9 bits per byte; text rarely gets
+     above 5.  */
+  return entropy > 7.5;
+}
+
+
+/* Return true if the data (DATA,DATALEN) is unlikely to gain anything
+   from compression.  Only the head of the data is sampled.  */
+int
+is_incompressible_data (const char *data, size_t datalen)
+{
+  if (datalen > COMPRESS_SAMPLE_SIZE)
+    datalen = COMPRESS_SAMPLE_SIZE;
+
+  return (has_compressed_magic ((const unsigned char *) data, datalen)
+          || has_high_entropy ((const unsigned char *) data, datalen));
+}
+
+
+/* Return true if the file FNAME is unlikely to gain anything from
+   compression.  There is no error return; if the file can't be read
+   false is returned.  */
+int
+is_incompressible_file (const char *fname)
+{
+  FILE *fp;
+  char *data;
+  size_t datalen;
+  int result;
+
+  fp = fopen (fname, "rb");
+  if (!fp)
+    return 0;
+
+  data = malloc (COMPRESS_SAMPLE_SIZE);
+  if (!data)
+    {
+      fclose (fp);
+      return 0; /* Oops */
+    }
+
+  datalen = fread (data, 1, COMPRESS_SAMPLE_SIZE, fp);
+  fclose (fp);
+
+  result = is_incompressible_data (data, datalen);
+  free (data);
+  return result;
+}
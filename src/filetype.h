@@ -22,5 +22,8 @@ int is_cms_file (const char *fname);
 int is_cms_data (const char *data, size_t datalen);
 int is_cms_data_ext (gpgme_data_t dh);
 
+int is_incompressible_file (const char *fname);
+int is_incompressible_data (const char *data, size_t datalen);
+
 
 #endif /*FILETYPE_H*/
@@ -0,0 +1,1481 @@
+/* gpa-bench.c - Benchmark driver for core GPA operations.
+   Copyright (C) 2026 g10 Code GmbH
+
+   This file is part of GPA.
+
+   GPA is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   GPA is distributed in the hope that it will be useful, but WITHOUT
+   ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+   or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public
+   License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, see <http://www.gnu.org/licenses/>.  */
+
+/* This program links all of GPA and drives some of its core
+   operations without user interaction.  It creates a throwaway
+   GnuPG home directory, generates a number of keys and files and
+   then times the requested scenarios.  The results are written as a
+   JSON object to stdout.
+
+   The scenarios which use widgets need a display; under a headless
+   system run the program with xvfb-run.  Without a display those
+   scenarios are reported as skipped.  Dialogs which would ask the
+   user for recipients are confirmed automatically.
+
+   The keyserver-refresh scenario is also a test: with the stub
+   engine it checks that the keyserver requests are batched, run
+   concurrently and rate limited as configured.  The exit status is 1
+   if any scenario failed.  */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <gtk/gtk.h>
+#include <gpgme.h>
+#include <assuan.h>
+
+#include "gpa.h"
+#include "options.h"
+#include "icons.h"
+#include "keytable.h"
+#include "keylist.h"
+#include "gpa-key-details.h"
+#include "encryptdlg.h"
+#include "recipientdlg.h"
+#include "gpafileencryptop.h"
+#include "gpafiledecryptop.h"
+#include "gparefreshop.h"
+
+#ifndef O_BINARY
+# define O_BINARY 0
+#endif
+
+/* The interval in milliseconds used to look for dialogs to
+   confirm.  */
+#define AUTOCONFIRM_INTERVAL 5
+
+/* The keyserver options of the keyserver-refresh scenario and the
+   duration in milliseconds of one request of the stub engine.  The
+   rate allows one request every 100 ms, thus with the default
+   number of keys all requests overlap.  */
+#define REFRESH_BATCH_SIZE   7
+#define REFRESH_CONCURRENCY  3
+#define REFRESH_RATE         600
+#define REFRESH_DELAY        250
+
+
+/* Command line options.  */
+static struct
+{
+  int keys;
+  int files;
+  char *file_sizes;
+  int iterations;
+  int roundtrips;
+  int timeout;
+  char **scenarios;
+  char *output;
+  gboolean keep_home;
+  char *gpg_binary;
+} opt = { 20, 50, NULL, 3, 10, 120, NULL, NULL, FALSE, NULL };
+
+static GOptionEntry option_entries[] =
+  {
+    { "keys", 'k', 0, G_OPTION_ARG_INT, &opt.keys,
+      "Number of keys to generate (default 20)", "N" },
+    { "files", 'f', 0, G_OPTION_ARG_INT, &opt.files,
+      "Number of files to create (default 50)", "N" },
+    { "file-size", 's', 0, G_OPTION_ARG_STRING, &opt.file_sizes,
+      "Comma separated list of file sizes in bytes (default 4096)",
+      "SIZES" },
+    { "iterations", 'i', 0, G_OPTION_ARG_INT, &opt.iterations,
+      "Number of runs per scenario (default 3)", "N" },
+    { "roundtrips", 'r', 0, G_OPTION_ARG_INT, &opt.roundtrips,
+      "Number of UI server requests per run (default 10)", "N" },
+    { "timeout", 't', 0, G_OPTION_ARG_INT, &opt.timeout,
+      "Seconds to wait for a single run (default 120)", "N" },
+    { "scenario", 'S', 0, G_OPTION_ARG_STRING_ARRAY, &opt.scenarios,
+      "Run only scenario NAME (may be repeated)", "NAME" },
+    { "output", 'o', 0, G_OPTION_ARG_FILENAME, &opt.output,
+      "Write the results to FILE", "FILE" },
+    { "keep-home", 0, 0, G_OPTION_ARG_NONE, &opt.keep_home,
+      "Do not remove the temporary home directory", NULL },
+    { "gpg-binary", 0, 0, G_OPTION_ARG_FILENAME, &opt.gpg_binary,
+      "Use FILE, for example gpa-stub-engine, instead of gpg", "FILE" },
+    { NULL }
+  };
+
+
+/* The state of the benchmark run.  */
+static struct
+{
+  gboolean have_gtk;
+
+  /* The temporary GnuPG home directory.  */
+  char *homedir;
+
+  /* The number of generated keys.  */
+  int n_keys;
+
+  /* The names of the generated files and their total size.  */
+  GList *files;
+  guint64 file_bytes;
+
+  /* The files created by the file-encrypt and server-encrypt
+     scenarios.  */
+  GList *encrypted_files;
+  GList *server_encrypted_files;
+
+  /* The time of the last automatic confirmation of a dialog.  */
+  double confirm_time;
+
+  double setup_keys_ms;
+  double setup_files_ms;
+} bench;
+
+
+/* The result of one scenario.  */
+typedef struct
+{
+  const char *name;
+  /* Either "ok", "failed" or "skipped".  */
+  const char *status;
+  char *reason;
+  /* The duration of each run in milliseconds.  */
+  GArray *samples;
+  /* The number of items processed per run.  */
+  unsigned int items;
+} result_t;
+
+static GPtrArray *results;
+
+
+
+/* Helper functions.  */
+
+static double
+now_ms (void)
+{
+  return g_get_monotonic_time () / 1000.0;
+}
+
+
+static result_t *
+new_result (const char *name)
+{
+  result_t *res;
+
+  res = g_malloc0 (sizeof *res);
+  res->name = name;
+  res->status = "ok";
+  res->samples = g_array_new (FALSE, FALSE, sizeof (double));
+  g_ptr_array_add (results, res);
+  return res;
+}
+
+
+static void
+set_status (result_t *res, const char *status, const char *format, ...)
+{
+  va_list arg_ptr;
+
+  res->status = status;
+  g_free (res->reason);
+  va_start (arg_ptr, format);
+  res->reason = g_strdup_vprintf (format, arg_ptr);
+  va_end (arg_ptr);
+}
+
+
+static void
+add_sample (result_t *res, double value)
+{
+  g_array_append_val (res->samples, value);
+}
+
+
+static gboolean
+timeout_cb (gpointer opaque)
+{
+  *(gboolean *) opaque = TRUE;
+  return G_SOURCE_REMOVE;
+}
+
+
+/* Run the main loop until PRED returns true for OPAQUE.  Returns
+   false if that did not happen within SECONDS.  */
+static gboolean
+run_until (gboolean (*pred) (void *), void *opaque, unsigned int seconds)
+{
+  gboolean expired = FALSE;
+  guint id;
+
+  id = g_timeout_add_seconds (seconds, timeout_cb, &expired);
+  while (!pred (opaque) && !expired)
+    g_main_context_iteration (NULL, TRUE);
+  if (!expired)
+    g_source_remove (id);
+
+  return !expired;
+}
+
+
+static gboolean
+flag_is_set (void *opaque)
+{
+  return g_atomic_int_get ((gint *) opaque);
+}
+
+
+/* Return true if the tree view OPAQUE shows at least one row per
+   generated key.  */
+static gboolean
+has_all_keys (void *opaque)
+{
+  GtkTreeModel *model = gtk_tree_view_get_model (GTK_TREE_VIEW (opaque));
+
+  return (model
+          && gtk_tree_model_iter_n_children (model, NULL) >= bench.n_keys);
+}
+
+
+/* Process all pending events.  */
+static void
+drain_events (void)
+{
+  while (g_main_context_iteration (NULL, FALSE))
+    ;
+}
+
+
+/* Confirm the first dialog which would ask the user for recipients.
+   In the file encryption dialog all keys are selected.  */
+static gboolean
+autoconfirm_cb (gpointer opaque)
+{
+  GList *toplevels, *cur;
+
+  toplevels = gtk_window_list_toplevels ();
+  for (cur = toplevels; cur; cur = g_list_next (cur))
+    {
+      GtkWidget *widget = cur->data;
+      GtkWidget *button;
+
+      if (!gtk_widget_get_visible (widget)
+          || g_object_get_data (G_OBJECT (widget), "gpa-bench-confirmed"))
+        continue;
+
+      if (GPA_IS_FILE_ENCRYPT_DIALOG (widget))
+        {
+          GtkWidget *keys = GPA_FILE_ENCRYPT_DIALOG (widget)->clist_keys;
+
+          if (!has_all_keys (keys))
+            continue;
+          gtk_tree_selection_select_all
+            (gtk_tree_view_get_selection (GTK_TREE_VIEW (keys)));
+        }
+      else if (!IS_RECIPIENT_DLG (widget))
+        continue;
+
+      button = gtk_dialog_get_widget_for_response (GTK_DIALOG (widget),
+                                                   GTK_RESPONSE_OK);
+      if (button && !gtk_widget_is_sensitive (button))
+        continue;
+
+      g_object_set_data (G_OBJECT (widget), "gpa-bench-confirmed", widget);
+      bench.confirm_time = now_ms ();
+      gtk_dialog_response (GTK_DIALOG (widget), GTK_RESPONSE_OK);
+      break;
+    }
+  g_list_free (toplevels);
+
+  return G_SOURCE_CONTINUE;
+}
+
+
+/* Recursively remove the directory PATH.  */
+static void
+remove_tree (const char *path)
+{
+  GDir *dir;
+  const char *name;
+
+  dir = g_dir_open (path, 0, NULL);
+  if (dir)
+    {
+      while ((name = g_dir_read_name (dir)))
+        {
+          char *fname = g_build_filename (path, name, NULL);
+
+          if (g_file_test (fname, G_FILE_TEST_IS_DIR)
+              && !g_file_test (fname, G_FILE_TEST_IS_SYMLINK))
+            remove_tree (fname);
+          else
+            g_unlink (fname);
+          g_free (fname);
+        }
+      g_dir_close (dir);
+    }
+  g_rmdir (path);
+}
+
+
+
+/* Setup.  */
+
+static gpg_error_t
+create_keys (void)
+{
+  gpgme_ctx_t ctx;
+  gpg_error_t err;
+  int idx;
+
+  err = gpgme_new (&ctx);
+  if (err)
+    return err;
+
+  for (idx = 0; idx < opt.keys; idx++)
+    {
+      char *userid;
+
+      userid = g_strdup_printf ("Test Key %d <key%d@example.org>",
+                                idx, idx);
+      err = gpgme_op_createkey (ctx, userid, "future-default", 0, 0, NULL,
+                                (GPGME_CREATE_NOPASSWD
+                                 | GPGME_CREATE_NOEXPIRE
+                                 | GPGME_CREATE_FORCE));
+      g_free (userid);
+      if (err)
+        break;
+      bench.n_keys++;
+    }
+  gpgme_release (ctx);
+
+  return err;
+}
+
+
+/* Create the files with sizes taken round robin from the option
+   --file-size.  The content is made up of words so that it is
+   compressible like typical documents.  */
+static gboolean
+create_files (void)
+{
+  static const char *words[] =
+    {
+      "alpha", "bravo", "charlie", "delta", "echo", "foxtrot", "golf",
+      "hotel", "india", "juliet", "kilo", "lima", "mike", "november",
+      "oscar", "papa", "quebec", "romeo", "sierra", "tango"
+    };
+  char **sizes;
+  int n_sizes;
+  char *dirname;
+  GRand *rand;
+  int idx;
+  gboolean okay = TRUE;
+
+  sizes = g_strsplit (opt.file_sizes? opt.file_sizes : "4096", ",", -1);
+  n_sizes = g_strv_length (sizes);
+  if (!n_sizes)
+    {
+      g_strfreev (sizes);
+      return FALSE;
+    }
+
+  dirname = g_build_filename (bench.homedir, "files", NULL);
+  if (g_mkdir (dirname, 0700))
+    {
+      g_free (dirname);
+      g_strfreev (sizes);
+      return FALSE;
+    }
+
+  rand = g_rand_new_with_seed (4711);
+  for (idx = 0; okay && idx < opt.files; idx++)
+    {
+      gsize size = g_ascii_strtoull (sizes[idx % n_sizes], NULL, 10);
+      GString *content = g_string_sized_new (size + 16);
+      char name[32];
+      char *fname;
+
+      while (content->len < size)
+        {
+          g_string_append (content,
+                           words[g_rand_int_range (rand, 0,
+                                                   G_N_ELEMENTS (words))]);
+          g_string_append_c (content,
+                             g_rand_int_range (rand, 0, 12)? ' ' : '\n');
+        }
+      g_string_truncate (content, size);
+
+      snprintf (name, sizeof name, "file-%04d.txt", idx);
+      fname = g_build_filename (dirname, name, NULL);
+      okay = g_file_set_contents (fname, content->str, content->len, NULL);
+      g_string_free (content, TRUE);
+
+      bench.files = g_list_append (bench.files, fname);
+      bench.file_bytes += size;
+    }
+  g_rand_free (rand);
+  g_free (dirname);
+  g_strfreev (sizes);
+
+  return okay;
+}
+
+
+
+/* Scenario: List all keys through the key table.  */
+
+struct listing_s
+{
+  gint done;
+  unsigned int count;
+  /* If set, the keys are kept in KEYS.  */
+  gboolean keep;
+  GList *keys;
+};
+
+
+static void
+listing_next_cb (gpgme_key_t key, gpointer opaque)
+{
+  struct listing_s *parm = opaque;
+
+  parm->count++;
+  if (parm->keep)
+    parm->keys = g_list_append (parm->keys, key);
+  else
+    gpgme_key_unref (key);
+}
+
+
+static void
+listing_end_cb (gpointer opaque)
+{
+  struct listing_s *parm = opaque;
+
+  g_atomic_int_set (&parm->done, 1);
+}
+
+
+static void
+bench_keytable (result_t *res)
+{
+  /* Static because the callbacks may still fire after a timeout.  */
+  static struct listing_s parm;
+  int iter;
+
+  for (iter = 0; iter < opt.iterations; iter++)
+    {
+      double start;
+
+      memset (&parm, 0, sizeof parm);
+      start = now_ms ();
+      gpa_keytable_force_reload (gpa_keytable_get_public_instance (),
+                                 listing_next_cb, listing_end_cb, &parm);
+      if (!run_until (flag_is_set, &parm.done, opt.timeout))
+        {
+          set_status (res, "failed", "timeout");
+          return;
+        }
+      add_sample (res, now_ms () - start);
+      res->items = parm.count;
+    }
+}
+
+
+
+/* Scenario: Populate a key list widget.  */
+
+static void
+bench_keylist (result_t *res)
+{
+  int iter;
+
+  for (iter = 0; iter < opt.iterations; iter++)
+    {
+      GtkWidget *window;
+      GtkWidget *keylist;
+      double start;
+      gboolean okay;
+
+      window = gtk_offscreen_window_new ();
+      start = now_ms ();
+      keylist = gpa_keylist_new (window);
+      gtk_container_add (GTK_CONTAINER (window), keylist);
+      gtk_widget_show_all (window);
+      okay = run_until (has_all_keys, keylist, opt.timeout);
+      if (okay)
+        {
+          drain_events ();
+          add_sample (res, now_ms () - start);
+          res->items = bench.n_keys;
+        }
+      gtk_widget_destroy (window);
+      if (!okay)
+        {
+          set_status (res, "failed", "timeout");
+          return;
+        }
+    }
+}
+
+
+
+/* Scenario: Show the details of every key.  */
+
+static void
+bench_key_details (result_t *res)
+{
+  static struct listing_s parm;
+  GtkWidget *window;
+  GtkWidget *details;
+  GList *cur;
+  int iter;
+
+  /* Get the keys from the key table's cache.  */
+  memset (&parm, 0, sizeof parm);
+  parm.keep = TRUE;
+  gpa_keytable_list_keys (gpa_keytable_get_public_instance (),
+                          listing_next_cb, listing_end_cb, &parm);
+  if (!run_until (flag_is_set, &parm.done, opt.timeout) || !parm.keys)
+    {
+      set_status (res, "failed", "no keys listed");
+      return;
+    }
+
+  window = gtk_offscreen_window_new ();
+  details = gpa_key_details_new ();
+  gtk_container_add (GTK_CONTAINER (window), details);
+  gtk_widget_show_all (window);
+  drain_events ();
+
+  for (iter = 0; iter < opt.iterations; iter++)
+    {
+      double start = now_ms ();
+
+      for (cur = parm.keys; cur; cur = g_list_next (cur))
+        {
+          gpa_key_details_update (details, cur->data, 1);
+          drain_events ();
+        }
+      add_sample (res, now_ms () - start);
+      res->items = g_list_length (parm.keys);
+    }
+
+  gtk_widget_destroy (window);
+  g_list_free_full (parm.keys, (GDestroyNotify) gpgme_key_unref);
+  parm.keys = NULL;
+}
+
+
+
+/* Scenarios: Encrypt and decrypt the files using the file
+   operations.  */
+
+struct fileop_parm_s
+{
+  gint done;
+  gpg_error_t err;
+  GList *outputs;
+};
+
+
+static void
+fileop_created_cb (GpaFileOperation *op, gpa_file_item_t file_item,
+                   gpointer opaque)
+{
+  struct fileop_parm_s *parm = opaque;
+
+  parm->outputs = g_list_prepend (parm->outputs,
+                                  g_strdup (file_item->filename_out));
+}
+
+
+static void
+fileop_completed_cb (GpaOperation *op, gpg_error_t err, gpointer opaque)
+{
+  struct fileop_parm_s *parm = opaque;
+
+  parm->err = err;
+  g_atomic_int_set (&parm->done, 1);
+}
+
+
+/* Return a new list of gpa_file_item_t for the file NAMES.  */
+static GList *
+make_file_items (GList *names)
+{
+  GList *files = NULL;
+
+  for (; names; names = g_list_next (names))
+    {
+      gpa_file_item_t file_item;
+
+      file_item = g_malloc0 (sizeof (*file_item));
+      file_item->filename_in = g_strdup (names->data);
+      files = g_list_append (files, file_item);
+    }
+  return files;
+}
+
+
+/* Run the file operation OP to completion and add a sample to RES.
+   If CONFIRMED is set, the time is taken from the confirmation of
+   the encryption dialog.  On success the list of output files is
+   returned.  */
+static GList *
+run_file_operation (result_t *res, GpaFileOperation *op, gboolean confirmed)
+{
+  struct fileop_parm_s *parm;
+  double start = now_ms ();
+  GList *outputs;
+
+  gpa_file_operation_set_conflict_policy (op, GPA_CONFLICT_OVERWRITE);
+
+  parm = g_malloc0 (sizeof *parm);
+  g_signal_connect (G_OBJECT (op), "created_file",
+                    G_CALLBACK (fileop_created_cb), parm);
+  g_signal_connect (G_OBJECT (op), "completed",
+                    G_CALLBACK (fileop_completed_cb), parm);
+  g_signal_connect (G_OBJECT (op), "completed",
+                    G_CALLBACK (g_object_unref), NULL);
+
+  if (!run_until (flag_is_set, &parm->done, opt.timeout))
+    {
+      /* PARM is leaked because the operation may still use it.  */
+      set_status (res, "failed", "timeout");
+      return NULL;
+    }
+  if (parm->err)
+    {
+      set_status (res, "failed", "%s", gpg_strerror (parm->err));
+      g_list_free_full (parm->outputs, g_free);
+      g_free (parm);
+      return NULL;
+    }
+
+  add_sample (res, now_ms () - (confirmed? bench.confirm_time : start));
+  res->items = g_list_length (parm->outputs);
+  outputs = g_list_reverse (parm->outputs);
+  g_free (parm);
+
+  return outputs;
+}
+
+
+static void
+bench_file_encrypt (result_t *res)
+{
+  GtkWidget *window;
+  guint autoconfirm_id;
+  int iter;
+
+  window = gtk_offscreen_window_new ();
+  autoconfirm_id = g_timeout_add (AUTOCONFIRM_INTERVAL, autoconfirm_cb, NULL);
+
+  for (iter = 0; iter < opt.iterations; iter++)
+    {
+      GpaFileEncryptOperation *op;
+      GList *outputs;
+
+      op = gpa_file_encrypt_operation_new (window,
+                                           make_file_items (bench.files),
+                                           FALSE);
+      outputs = run_file_operation (res, GPA_FILE_OPERATION (op), TRUE);
+      if (!outputs)
+        break;
+      g_list_free_full (bench.encrypted_files, g_free);
+      bench.encrypted_files = outputs;
+    }
+
+  g_source_remove (autoconfirm_id);
+  gtk_widget_destroy (window);
+}
+
+
+static void
+bench_file_decrypt (result_t *res)
+{
+  GtkWidget *window;
+  int iter;
+
+  if (!bench.encrypted_files)
+    {
+      set_status (res, "skipped", "needs the file-encrypt scenario");
+      return;
+    }
+
+  window = gtk_offscreen_window_new ();
+  for (iter = 0; iter < opt.iterations; iter++)
+    {
+      GpaFileDecryptOperation *op;
+      GList *outputs;
+
+      op = gpa_file_decrypt_operation_new
+        (window, make_file_items (bench.encrypted_files));
+      outputs = run_file_operation (res, GPA_FILE_OPERATION (op), FALSE);
+      if (!outputs)
+        break;
+      g_list_free_full (outputs, g_free);
+    }
+  gtk_widget_destroy (window);
+}
+
+
+
+/* Scenarios: Encrypt and decrypt through the UI server.  The client
+   runs in its own thread because the server is run by the main
+   loop.  */
+
+struct client_parm_s
+{
+  gint done;
+  gboolean decrypt;
+  /* The input files; used round robin.  */
+  GList *inputs;
+  /* The duration of each request.  */
+  GArray *samples;
+  /* The created output files.  */
+  GList *outputs;
+  char *error;
+};
+
+
+static gpg_error_t
+transact (assuan_context_t ctx, const char *command)
+{
+  return assuan_transact (ctx, command, NULL, NULL, NULL, NULL, NULL, NULL);
+}
+
+
+/* Send FD to the server and announce it with COMMAND.  */
+static gpg_error_t
+send_fd (assuan_context_t ctx, int fd, const char *command)
+{
+  gpg_error_t err;
+
+  err = assuan_sendfd (ctx, (assuan_fd_t) fd);
+  if (!err)
+    err = transact (ctx, command);
+  return err;
+}
+
+
+static gpg_error_t
+client_request (assuan_context_t ctx, struct client_parm_s *parm, int n)
+{
+  const char *input = g_list_nth_data (parm->inputs,
+                                       n % g_list_length (parm->inputs));
+  char *output;
+  int in_fd, out_fd;
+  gpg_error_t err;
+  double start;
+
+  output = g_strconcat (input, parm->decrypt? ".out" : ".srv.gpg", NULL);
+  in_fd = g_open (input, O_RDONLY | O_BINARY, 0);
+  out_fd = g_open (output, O_WRONLY | O_CREAT | O_TRUNC | O_BINARY, 0600);
+  if (in_fd == -1 || out_fd == -1)
+    {
+      err = gpg_error_from_syserror ();
+      goto leave;
+    }
+
+  start = now_ms ();
+  if (!parm->decrypt)
+    {
+      char line[64];
+
+      snprintf (line, sizeof line, "RECIPIENT key%d@example.org",
+                n % bench.n_keys);
+      err = transact (ctx, line);
+      if (!err)
+        err = transact (ctx, "PREP_ENCRYPT --protocol=OpenPGP");
+      if (err)
+        goto leave;
+    }
+  err = send_fd (ctx, in_fd, "INPUT FD");
+  if (!err)
+    err = send_fd (ctx, out_fd, "OUTPUT FD");
+  if (!err)
+    err = transact (ctx, parm->decrypt? "DECRYPT --protocol=OpenPGP"
+                    /* */           : "ENCRYPT --protocol=OpenPGP");
+  if (!err)
+    {
+      double value = now_ms () - start;
+
+      g_array_append_val (parm->samples, value);
+      if (!g_list_find_custom (parm->outputs, output, (GCompareFunc) strcmp))
+        {
+          parm->outputs = g_list_append (parm->outputs, output);
+          output = NULL;
+        }
+    }
+
+ leave:
+  if (in_fd != -1)
+    close (in_fd);
+  if (out_fd != -1)
+    close (out_fd);
+  g_free (output);
+  return err;
+}
+
+
+static gpointer
+client_thread (gpointer opaque)
+{
+  struct client_parm_s *parm = opaque;
+  assuan_context_t ctx = NULL;
+  char *socket_name;
+  gpg_error_t err;
+  int n;
+
+  socket_name = g_build_filename (gnupg_homedir, "S.uiserver", NULL);
+  err = assuan_new (&ctx);
+  if (!err)
+    err = assuan_socket_connect (ctx, socket_name, ASSUAN_INVALID_PID, 0);
+  g_free (socket_name);
+
+  for (n = 0; !err && n < opt.roundtrips * opt.iterations; n++)
+    err = client_request (ctx, parm, n);
+
+  if (err)
+    parm->error = g_strdup (gpg_strerror (err));
+  assuan_release (ctx);
+
+  g_atomic_int_set (&parm->done, 1);
+  g_main_context_wakeup (NULL);
+  return NULL;
+}
+
+
+/* Run the client in mode DECRYPT on INPUTS and return the list of
+   created files.  */
+static GList *
+run_client (result_t *res, gboolean decrypt, GList *inputs)
+{
+  struct client_parm_s *parm;
+  GThread *thread;
+  GList *outputs;
+
+  parm = g_malloc0 (sizeof *parm);
+  parm->decrypt = decrypt;
+  parm->inputs = inputs;
+  parm->samples = res->samples;
+
+  thread = g_thread_new ("gpa-bench-client", client_thread, parm);
+  if (!run_until (flag_is_set, &parm->done,
+                  opt.timeout * opt.roundtrips * opt.iterations))
+    {
+      /* The thread and PARM are leaked because the thread may still
+         be blocked.  */
+      g_thread_unref (thread);
+      set_status (res, "failed", "timeout");
+      return NULL;
+    }
+  g_thread_join (thread);
+
+  if (parm->error)
+    set_status (res, "failed", "%s", parm->error);
+  res->items = 1;
+  outputs = parm->outputs;
+  g_free (parm->error);
+  g_free (parm);
+
+  return outputs;
+}
+
+
+static void
+bench_server_encrypt (result_t *res)
+{
+  guint autoconfirm_id;
+
+  autoconfirm_id = g_timeout_add (AUTOCONFIRM_INTERVAL, autoconfirm_cb, NULL);
+  bench.server_encrypted_files = run_client (res, FALSE, bench.files);
+  g_source_remove (autoconfirm_id);
+}
+
+
+static void
+bench_server_decrypt (result_t *res)
+{
+  GList *outputs;
+
+  if (!bench.server_encrypted_files)
+    {
+      set_status (res, "skipped", "needs the server-encrypt scenario");
+      return;
+    }
+  outputs = run_client (res, TRUE, bench.server_encrypted_files);
+  g_list_free_full (outputs, g_free);
+}
+
+
+
+/* Scenario: Refresh all keys from the keyserver.  The stub engine
+   logs its requests, which are then checked against the keyserver
+   options.  */
+
+#ifdef ENABLE_KEYSERVER_SUPPORT
+struct refresh_parm_s
+{
+  gint done;
+  gpg_error_t err;
+  guint updated;
+  guint warnings;
+};
+
+
+static void
+refresh_updated_cb (GpaRefreshOperation *op, const char **fprs,
+                    gpointer opaque)
+{
+  struct refresh_parm_s *parm = opaque;
+
+  parm->updated += g_strv_length ((char **) fprs);
+}
+
+
+static void
+refresh_completed_cb (GpaOperation *op, gpg_error_t err, gpointer opaque)
+{
+  struct refresh_parm_s *parm = opaque;
+
+  parm->err = err;
+  g_atomic_int_set (&parm->done, 1);
+}
+
+
+/* Close the message dialogs, which show the import results or
+   warnings, and count the warnings.  */
+static gboolean
+dismiss_messages_cb (gpointer opaque)
+{
+  struct refresh_parm_s *parm = opaque;
+  GList *toplevels, *cur;
+  GtkMessageType type;
+
+  toplevels = gtk_window_list_toplevels ();
+  for (cur = toplevels; cur; cur = g_list_next (cur))
+    if (GTK_IS_MESSAGE_DIALOG (cur->data)
+        && gtk_widget_get_visible (cur->data))
+      {
+        g_object_get (cur->data, "message-type", &type, NULL);
+        if (type != GTK_MESSAGE_INFO)
+          parm->warnings++;
+        gtk_dialog_response (GTK_DIALOG (cur->data), GTK_RESPONSE_CLOSE);
+        break;
+      }
+  g_list_free (toplevels);
+
+  return G_SOURCE_CONTINUE;
+}
+
+
+/* One request as logged by the stub engine.  */
+struct request_s
+{
+  double start;
+  double end;
+  int keys;
+};
+
+
+static int
+compare_requests (const void *a, const void *b)
+{
+  double da = ((const struct request_s *) a)->start;
+  double db = ((const struct request_s *) b)->start;
+
+  return da < db? -1 : da > db;
+}
+
+
+/* Check the requests logged to LOGNAME.  Returns NULL on success or
+   a malloced description of the problem.  */
+static char *
+check_requests (const char *logname)
+{
+  gchar *contents;
+  gchar **lines;
+  GArray *requests;
+  struct request_s *req;
+  double interval = 60.0 / REFRESH_RATE;
+  int keys = 0;
+  guint idx, other, running;
+  char *problem = NULL;
+
+  if (!g_file_get_contents (logname, &contents, NULL, NULL))
+    return g_strdup ("no requests logged");
+  lines = g_strsplit (contents, "\n", -1);
+  g_free (contents);
+
+  requests = g_array_new (FALSE, TRUE, sizeof (struct request_s));
+  for (idx = 0; lines[idx]; idx++)
+    {
+      struct request_s r;
+      char *p;
+
+      if (!*lines[idx])
+        continue;
+      r.start = g_ascii_strtod (lines[idx], &p);
+      r.end = g_ascii_strtod (p, &p);
+      r.keys = atoi (p);
+      g_array_append_val (requests, r);
+    }
+  g_strfreev (lines);
+  g_array_sort (requests, compare_requests);
+  req = (struct request_s *) requests->data;
+
+  for (idx = 0; idx < requests->len; idx++)
+    keys += req[idx].keys;
+  if (keys != bench.n_keys)
+    problem = g_strdup_printf ("%d of %d keys requested", keys, bench.n_keys);
+  else if (requests->len
+           != (guint) (bench.n_keys + REFRESH_BATCH_SIZE - 1)
+              / REFRESH_BATCH_SIZE)
+    problem = g_strdup_printf ("%u requests for %d keys", requests->len,
+                               bench.n_keys);
+
+  for (idx = 0; !problem && idx < requests->len; idx++)
+    {
+      if (req[idx].keys > REFRESH_BATCH_SIZE)
+        problem = g_strdup_printf ("request with %d keys", req[idx].keys);
+      /* Allow for some jitter in the startup of the engine.  */
+      else if (idx && req[idx].start - req[idx - 1].start < interval * 0.8)
+        problem = g_strdup_printf ("requests started %.3f s apart",
+                                   req[idx].start - req[idx - 1].start);
+
+      for (running = 0, other = 0; other < idx; other++)
+        if (req[other].end > req[idx].start)
+          running++;
+      if (!problem && running >= REFRESH_CONCURRENCY)
+        problem = g_strdup_printf ("%u requests running at once",
+                                   running + 1);
+    }
+
+  g_array_free (requests, TRUE);
+  return problem;
+}
+
+
+static void
+bench_keyserver_refresh (result_t *res)
+{
+  GtkWidget *window;
+  char *logname;
+  int iter;
+
+  /* We don't want to hammer a real keyserver.  */
+  if (!opt.gpg_binary)
+    {
+      set_status (res, "skipped", "needs the stub engine");
+      return;
+    }
+
+  logname = g_build_filename (bench.homedir, "recv-keys.log", NULL);
+  g_setenv ("GPA_STUB_RECV_LOG", logname, TRUE);
+  g_setenv ("GPA_STUB_RECV_DELAY", G_STRINGIFY (REFRESH_DELAY), TRUE);
+  window = gtk_offscreen_window_new ();
+
+  for (iter = 0; iter < opt.iterations; iter++)
+    {
+      struct refresh_parm_s *parm;
+      GpaRefreshOperation *op;
+      double start = now_ms ();
+      char *problem;
+      guint dismiss_id;
+
+      g_unlink (logname);
+      parm = g_malloc0 (sizeof *parm);
+      dismiss_id = g_timeout_add (AUTOCONFIRM_INTERVAL, dismiss_messages_cb,
+                                  parm);
+      op = gpa_refresh_operation_new (window, NULL);
+      g_signal_connect (G_OBJECT (op), "updated_keys",
+                        G_CALLBACK (refresh_updated_cb), parm);
+      g_signal_connect (G_OBJECT (op), "completed",
+                        G_CALLBACK (refresh_completed_cb), parm);
+      g_signal_connect (G_OBJECT (op), "completed",
+                        G_CALLBACK (g_object_unref), NULL);
+
+      if (!run_until (flag_is_set, &parm->done, opt.timeout))
+        {
+          /* PARM is leaked because the operation may still use it.  */
+          g_source_remove (dismiss_id);
+          set_status (res, "failed", "timeout");
+          break;
+        }
+      g_source_remove (dismiss_id);
+
+      if (parm->err)
+        problem = g_strdup (gpg_strerror (parm->err));
+      else if (parm->warnings)
+        problem = g_strdup ("a warning was shown");
+      else if (parm->updated != (guint) bench.n_keys)
+        problem = g_strdup_printf ("%u of %d keys updated", parm->updated,
+                                   bench.n_keys);
+      else
+        problem = check_requests (logname);
+      g_free (parm);
+      if (problem)
+        {
+          set_status (res, "failed", "%s", problem);
+          g_free (problem);
+          break;
+        }
+
+      add_sample (res, now_ms () - start);
+      res->items = bench.n_keys;
+    }
+
+  gtk_widget_destroy (window);
+  g_unsetenv ("GPA_STUB_RECV_LOG");
+  g_free (logname);
+}
+#endif /*ENABLE_KEYSERVER_SUPPORT*/
+
+
+
+/* The table of scenarios in the order they are run.  */
+static struct
+{
+  const char *name;
+  gboolean need_gtk;
+  void (*func) (result_t *res);
+} scenarios[] =
+  {
+    { "keytable",       FALSE, bench_keytable },
+    { "keylist",        TRUE,  bench_keylist },
+    { "key-details",    TRUE,  bench_key_details },
+    { "file-encrypt",   TRUE,  bench_file_encrypt },
+    { "file-decrypt",   TRUE,  bench_file_decrypt },
+    { "server-encrypt", TRUE,  bench_server_encrypt },
+    { "server-decrypt", TRUE,  bench_server_decrypt },
+#ifdef ENABLE_KEYSERVER_SUPPORT
+    { "keyserver-refresh", TRUE, bench_keyserver_refresh }
+#endif
+  };
+
+
+static gboolean
+scenario_selected (const char *name)
+{
+  return !opt.scenarios || g_strv_contains ((const char * const *)
+                                            opt.scenarios, name);
+}
+
+
+
+/* Output.  */
+
+static void
+print_string (FILE *fp, const char *string)
+{
+  putc ('\"', fp);
+  for (; string && *string; string++)
+    {
+      if (*string == '\"' || *string == '\\')
+        fprintf (fp, "\\%c", *string);
+      else if ((unsigned char)*string < 0x20)
+        fprintf (fp, "\\u%04x", *string);
+      else
+        putc (*string, fp);
+    }
+  putc ('\"', fp);
+}
+
+
+/* Print VALUE independent of the locale.  */
+static void
+print_ms (FILE *fp, double value)
+{
+  char buffer[G_ASCII_DTOSTR_BUF_SIZE];
+
+  fputs (g_ascii_formatd (buffer, sizeof buffer, "%.3f", value), fp);
+}
+
+
+static int
+compare_doubles (const void *a, const void *b)
+{
+  double da = *(const double *) a;
+  double db = *(const double *) b;
+
+  return da < db? -1 : da > db;
+}
+
+
+static void
+print_result (FILE *fp, result_t *res)
+{
+  GArray *samples = res->samples;
+  double sum = 0;
+  guint idx;
+
+  fprintf (fp, "    {\n      \"name\": ");
+  print_string (fp, res->name);
+  fprintf (fp, ",\n      \"status\": ");
+  print_string (fp, res->status);
+  if (res->reason)
+    {
+      fprintf (fp, ",\n      \"reason\": ");
+      print_string (fp, res->reason);
+    }
+  fprintf (fp, ",\n      \"items\": %u", res->items);
+  fprintf (fp, ",\n      \"samples\": %u", samples->len);
+
+  if (samples->len)
+    {
+      g_array_sort (samples, compare_doubles);
+      for (idx = 0; idx < samples->len; idx++)
+        sum += g_array_index (samples, double, idx);
+
+      fprintf (fp, ",\n      \"min_ms\": ");
+      print_ms (fp, g_array_index (samples, double, 0));
+      fprintf (fp, ",\n      \"median_ms\": ");
+      print_ms (fp, g_array_index (samples, double, samples->len / 2));
+      fprintf (fp, ",\n      \"mean_ms\": ");
+      print_ms (fp, sum / samples->len);
+      fprintf (fp, ",\n      \"max_ms\": ");
+      print_ms (fp, g_array_index (samples, double, samples->len - 1));
+    }
+  fprintf (fp, "\n    }");
+}
+
+
+static void
+print_results (FILE *fp)
+{
+  guint idx;
+
+  fprintf (fp, "{\n  \"gpa_version\": ");
+  print_string (fp, VERSION);
+  fprintf (fp, ",\n  \"gpgme_version\": ");
+  print_string (fp, gpgme_check_version (NULL));
+  fprintf (fp, ",\n  \"gpg_binary\": ");
+  print_string (fp, opt.gpg_binary? opt.gpg_binary : "");
+  fprintf (fp, ",\n  \"display\": %s", bench.have_gtk? "true" : "false");
+  fprintf (fp, ",\n  \"keys\": %d", bench.n_keys);
+  fprintf (fp, ",\n  \"files\": %u", g_list_length (bench.files));
+  fprintf (fp, ",\n  \"file_bytes\": %" G_GUINT64_FORMAT, bench.file_bytes);
+  fprintf (fp, ",\n  \"iterations\": %d", opt.iterations);
+  fprintf (fp, ",\n  \"roundtrips\": %d", opt.roundtrips);
+  fprintf (fp, ",\n  \"setup_keys_ms\": ");
+  print_ms (fp, bench.setup_keys_ms);
+  fprintf (fp, ",\n  \"setup_files_ms\": ");
+  print_ms (fp, bench.setup_files_ms);
+  fprintf (fp, ",\n  \"results\": [\n");
+  for (idx = 0; idx < results->len; idx++)
+    {
+      print_result (fp, g_ptr_array_index (results, idx));
+      fprintf (fp, "%s\n", idx + 1 < results->len? "," : "");
+    }
+  fprintf (fp, "  ]\n}\n");
+}
+
+
+
+/* Stop the agent and any other daemon using the temporary home
+   directory.  */
+static void
+stop_daemons (void)
+{
+  const char *gpgconf = gpgme_get_dirinfo ("gpgconf-name");
+  char *argv[4];
+
+  if (!gpgconf)
+    return;
+  argv[0] = (char *) gpgconf;
+  argv[1] = (char *) "--kill";
+  argv[2] = (char *) "all";
+  argv[3] = NULL;
+  g_spawn_sync (NULL, argv, NULL,
+                G_SPAWN_STDOUT_TO_DEV_NULL | G_SPAWN_STDERR_TO_DEV_NULL,
+                NULL, NULL, NULL, NULL, NULL, NULL);
+}
+
+
+int
+main (int argc, char *argv[])
+{
+  GOptionContext *context;
+  GError *error = NULL;
+  GtkApplication *application = NULL;
+  char *configname;
+  gpg_error_t err;
+  double start;
+  size_t idx;
+  int rc = 0;
+
+  context = g_option_context_new (NULL);
+  g_option_context_set_summary (context,
+                                "Time core operations of GPA in a throwaway"
+                                " GnuPG home directory.");
+  g_option_context_add_main_entries (context, option_entries, NULL);
+  if (!g_option_context_parse (context, &argc, &argv, &error))
+    {
+      fprintf (stderr, "gpa-bench: %s\n", error->message);
+      return 2;
+    }
+  g_option_context_free (context);
+  if (opt.keys < 1 || opt.files < 1 || opt.iterations < 1
+      || opt.roundtrips < 1 || opt.timeout < 1)
+    {
+      fprintf (stderr, "gpa-bench: counts must be positive\n");
+      return 2;
+    }
+
+#ifndef G_OS_WIN32
+  {
+    struct sigaction sa;
+
+    sa.sa_handler = SIG_IGN;
+    sigemptyset (&sa.sa_mask);
+    sa.sa_flags = 0;
+    sigaction (SIGPIPE, &sa, NULL);
+  }
+#endif
+
+  /* Everything, including the agent, uses the temporary home
+     directory.  */
+  bench.homedir = g_dir_make_tmp ("gpa-bench-XXXXXX", &error);
+  if (!bench.homedir)
+    {
+      fprintf (stderr, "gpa-bench: %s\n", error->message);
+      return 1;
+    }
+  g_setenv ("GNUPGHOME", bench.homedir, TRUE);
+  gnupg_homedir = g_strdup (bench.homedir);
+
+  bench.have_gtk = gtk_init_check (&argc, &argv);
+  gpgme_check_version (NULL);
+  if (opt.gpg_binary)
+    {
+      char *value = g_strdup_printf ("%d", opt.keys);
+
+      /* The stub engine lists the same user IDs we would create.  */
+      g_setenv ("GPA_STUB_KEYS", value, TRUE);
+      g_free (value);
+      gpgme_set_engine_info (GPGME_PROTOCOL_OpenPGP, opt.gpg_binary, NULL);
+    }
+
+  configname = g_build_filename (gnupg_homedir, "gpa.conf", NULL);
+  if (opt.gpg_binary && scenario_selected ("keyserver-refresh"))
+    {
+      char *conf;
+
+      conf = g_strdup_printf ("keyserver-batch-size %d\n"
+                              "keyserver-concurrency %d\n"
+                              "keyserver-rate %d\n",
+                              REFRESH_BATCH_SIZE, REFRESH_CONCURRENCY,
+                              REFRESH_RATE);
+      g_file_set_contents (configname, conf, -1, NULL);
+      g_free (conf);
+    }
+  gpa_options_set_file (gpa_options_get_instance (), configname);
+  g_free (configname);
+
+  if (bench.have_gtk)
+    {
+      application = gtk_application_new ("org.gnupg.gpa.bench",
+                                         G_APPLICATION_NON_UNIQUE);
+      gpa_bench_set_application (application);
+      gpa_register_stock_items ();
+    }
+
+  results = g_ptr_array_new ();
+
+  start = now_ms ();
+  if (opt.gpg_binary)
+    {
+      bench.n_keys = opt.keys;
+      err = 0;
+    }
+  else
+    err = create_keys ();
+  bench.setup_keys_ms = now_ms () - start;
+  if (err)
+    {
+      fprintf (stderr, "gpa-bench: error creating keys: %s\n",
+               gpg_strerror (err));
+      rc = 1;
+      goto leave;
+    }
+
+  start = now_ms ();
+  if (!create_files ())
+    {
+      fprintf (stderr, "gpa-bench: error creating files\n");
+      rc = 1;
+      goto leave;
+    }
+  bench.setup_files_ms = now_ms () - start;
+
+  if (bench.have_gtk
+      && (scenario_selected ("server-encrypt")
+          || scenario_selected ("server-decrypt")))
+    gpa_start_server ();
+
+  for (idx = 0; idx < G_N_ELEMENTS (scenarios); idx++)
+    {
+      result_t *res;
+
+      if (!scenario_selected (scenarios[idx].name))
+        continue;
+
+      res = new_result (scenarios[idx].name);
+      if (scenarios[idx].need_gtk && !bench.have_gtk)
+        set_status (res, "skipped", "no display");
+      else
+        scenarios[idx].func (res);
+      if (!strcmp (res->status, "failed"))
+        rc = 1;
+    }
+
+  if (opt.output)
+    {
+      FILE *fp = g_fopen (opt.output, "w");
+
+      if (!fp)
+        {
+          fprintf (stderr, "gpa-bench: can't create '%s'\n", opt.output);
+          rc = 1;
+          goto leave;
+        }
+      print_results (fp);
+      if (fclose (fp))
+        rc = 1;
+    }
+  else
+    print_results (stdout);
+
+ leave:
+  stop_daemons ();
+  if (opt.keep_home)
+    fprintf (stderr, "gpa-bench: keeping '%s'\n", bench.homedir);
+  else
+    remove_tree (bench.homedir);
+  if (application)
+    g_object_unref (application);
+
+  return rc;
+}
@@ -41,6 +41,7 @@
 #include "gpa-tofu-list.h"
 #include "gpa-key-details.h"
 #include "gtktools.h"
+#include "keyref.h"
 
 
 /* Object's class definition.  */
@@ -682,7 +683,7 @@ gpa_key_details_finalize (GObject *object)
 
   if (kdt->current_key)
     {
-      gpgme_key_unref (kdt->current_key);
+      gpa_key_unref (kdt->current_key, GPA_KEY_OWNER_KEYDETAILS);
       kdt->current_key = NULL;
     }
   if (kdt->uid_list)
@@ -793,13 +794,13 @@ gpa_key_details_update (GtkWidget *keydetails, gpgme_key_t key, int keycount)
 
   if (kdt->current_key)
     {
-      gpgme_key_unref (kdt->current_key);
+      gpa_key_unref (kdt->current_key, GPA_KEY_OWNER_KEYDETAILS);
       kdt->current_key = NULL;
     }
 
   if (key && keycount == 1)
     {
-      gpgme_key_ref (key);
+      gpa_key_ref (key, GPA_KEY_OWNER_KEYDETAILS);
       kdt->current_key = key;
       details_page_fill_key (kdt, key);
 
@@ -0,0 +1,985 @@
+/* gpa-stub-engine.c - A stand-in for gpg and gpgsm.
+   Copyright (C) 2026 g10 Code GmbH
+
+   This file is part of GPA.
+
+   GPA is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   GPA is distributed in the hope that it will be useful, but WITHOUT
+   ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+   or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public
+   License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, see <http://www.gnu.org/licenses/>.  */
+
+/*
+   This program can be used instead of gpg or gpgsm by way of the
+   hidden options --gpg-binary and --gpgsm-binary of GPA and gpa-bench.
+   It does no cryptography at all: key listings are synthesized,
+   encryption and decryption copy the data and emit the status lines
+   gpgme expects.  This allows to profile GPA's key table, key list,
+   file operations and UI server without the cost of gpg itself.
+
+   When invoked with --server it speaks a minimal subset of the
+   Assuan protocol as used by gpgme for gpgsm; otherwise it parses a
+   gpg command line.  It is configured by these environment variables:
+
+     GPA_STUB_KEYS        The number of keys listed (default 100).
+     GPA_STUB_UIDS        The number of user IDs per key (default 1).
+     GPA_STUB_SIGS        The number of signatures per user ID listed
+                          with --list-sigs or --check-sigs (default 0).
+     GPA_STUB_SECRET      The number of keys with a secret key
+                          (default 1).
+     GPA_STUB_LATENCY     A delay in milliseconds before the engine
+                          starts to work (default 0).
+     GPA_STUB_KEY_DELAY   A delay in microseconds for each listed key
+                          (default 0).
+     GPA_STUB_RATE        The data rate in KiB/s for encryption and
+                          decryption; 0 for unlimited (default 0).
+     GPA_STUB_RECV_DELAY  The duration in milliseconds of a
+                          --recv-keys request (default 0).
+     GPA_STUB_RECV_LOG    If set, a line with the start and end time
+                          and the number of keys of each --recv-keys
+                          request is appended to this file.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <ctype.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+#define PGM "gpa-stub-engine"
+
+/* The creation time of the synthetic keys.  */
+#define KEY_CREATED 1546300800UL
+
+/* The size of the copy buffer.  */
+#define COPY_BUFSIZE 65536
+
+/* The configuration from the environment.  */
+static struct
+{
+  unsigned long keys;
+  unsigned long uids;
+  unsigned long sigs;
+  unsigned long secret;
+  unsigned long latency;
+  unsigned long key_delay;
+  unsigned long rate;
+  unsigned long recv_delay;
+} conf;
+
+/* The stream for status lines or NULL.  */
+static FILE *statusfp;
+
+/* True if --armor was given.  */
+static int armor;
+
+
+
+static unsigned long
+getenv_ulong (const char *name, unsigned long dflt)
+{
+  const char *s = getenv (name);
+
+  return s && *s? strtoul (s, NULL, 10) : dflt;
+}
+
+
+static void
+sleep_us (unsigned long usec)
+{
+  struct timespec ts;
+
+  if (!usec)
+    return;
+  ts.tv_sec = usec / 1000000;
+  ts.tv_nsec = (usec % 1000000) * 1000;
+  while (nanosleep (&ts, &ts) && errno == EINTR)
+    ;
+}
+
+
+static double
+now (void)
+{
+  struct timeval tv;
+
+  gettimeofday (&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+
+static void
+status (const char *format, ...) __attribute__ ((format (printf, 1, 2)));
+
+static void
+status (const char *format, ...)
+{
+  va_list arg_ptr;
+
+  if (!statusfp)
+    return;
+  fputs ("[GNUPG:] ", statusfp);
+  va_start (arg_ptr, format);
+  vfprintf (statusfp, format, arg_ptr);
+  va_end (arg_ptr);
+  putc ('\n', statusfp);
+  fflush (statusfp);
+}
+
+
+/* Copy all data from INFD to OUTFD, throttled to the configured rate.
+   Returns 0 on success.  */
+static int
+copy_data (int infd, int outfd)
+{
+  static char buffer[COPY_BUFSIZE];
+  double start = now ();
+  unsigned long long total = 0;
+  ssize_t nread, nwritten, off;
+
+  for (;;)
+    {
+      nread = read (infd, buffer, sizeof buffer);
+      if (nread < 0 && errno == EINTR)
+        continue;
+      if (nread < 0)
+        return -1;
+      if (!nread)
+        return 0;
+      for (off = 0; off < nread; off += nwritten)
+        {
+          nwritten = write (outfd, buffer + off, nread - off);
+          if (nwritten < 0 && errno == EINTR)
+            nwritten = 0;
+          else if (nwritten < 0)
+            return -1;
+        }
+      total += nread;
+
+      if (conf.rate)
+        {
+          double due = start + total / (conf.rate * 1024.0);
+          double delay = due - now ();
+
+          if (delay > 0)
+            sleep_us (delay * 1e6);
+        }
+    }
+}
+
+
+
+/* Key listings.  */
+
+/* Write the fingerprint of key IDX, subkey SUB, to FPR which must
+   have room for 41 bytes.  */
+static void
+make_fpr (char *fpr, unsigned long idx, int sub)
+{
+  snprintf (fpr, 41, "5354554200000000%08lX%08X%08lX",
+            ((idx + 1) >> 16) >> 16, sub, (idx + 1) & 0xffffffff);
+}
+
+
+/* Write user ID UID of key IDX to BUFFER of SIZE.  */
+static void
+make_uid (char *buffer, size_t size, unsigned long idx, unsigned long uid)
+{
+  if (uid)
+    snprintf (buffer, size, "Test Key %lu.%lu <key%lu.%lu@example.org>",
+              idx, uid, idx, uid);
+  else
+    snprintf (buffer, size, "Test Key %lu <key%lu@example.org>", idx, idx);
+}
+
+
+/* Return true if key IDX matches PATTERN which is a fingerprint or
+   key ID, or a substring of a user ID.  */
+static int
+key_matches (unsigned long idx, const char *pattern)
+{
+  char fpr[41], buf[128];
+  size_t len;
+  unsigned long uid;
+
+  if (*pattern == '=' || *pattern == '<' || *pattern == '@')
+    pattern++;
+  if (!strncasecmp (pattern, "0x", 2))
+    pattern += 2;
+  len = strlen (pattern);
+  if (len && pattern[len - 1] == '>')
+    len--;
+  if (!len)
+    return 1;
+
+  for (uid = 0; uid < 2; uid++)
+    {
+      make_fpr (fpr, idx, uid);
+      if (len <= 40 && !strncasecmp (fpr + 40 - len, pattern, len))
+        return 1;
+    }
+  for (uid = 0; uid < conf.uids; uid++)
+    {
+      const char *p;
+
+      make_uid (buf, sizeof buf, idx, uid);
+      for (p = buf; *p; p++)
+        if (!strncasecmp (p, pattern, len))
+          return 1;
+    }
+  return 0;
+}
+
+
+/* Print the colon listing of key IDX to FP.  TYPE is "pub", "sec" or
+   "crt".  */
+static void
+list_key (FILE *fp, unsigned long idx, const char *type, int with_secret,
+          int with_sigs)
+{
+  int has_secret = idx < conf.secret;
+  int x509 = !strcmp (type, "crt");
+  unsigned long uid, sig, nsigs;
+  unsigned long created = KEY_CREATED + idx;
+  char fpr[41], subfpr[41], name[128];
+
+  make_fpr (fpr, idx, 0);
+  make_fpr (subfpr, idx, 1);
+
+  if (x509 && has_secret)
+    type = "crs";
+  fprintf (fp, "%s:u:%s:%s:%s:%lu:::%s:::%s:::%s::%s:::0:\n",
+           type, x509? "2048" : "255", x509? "1" : "22", fpr + 24, created,
+           x509? "" : "u", x509? "sceSCE" : "scESC",
+           (with_secret || !strcmp (type, "sec")) && has_secret? "+" : "",
+           x509? "" : "ed25519");
+  fprintf (fp, "fpr:::::::::%s:\n", fpr);
+
+  for (uid = 0; uid < conf.uids; uid++)
+    {
+      if (x509)
+        {
+          fprintf (fp, "uid:u::::::::CN=Test Key %lu\\x2cO=Example:\n", idx);
+          continue;
+        }
+      make_uid (name, sizeof name, idx, uid);
+      fprintf (fp, "uid:u::::%lu::%08lX%08lX%024X::%s::::::::::0:\n",
+               created, idx, uid, 0, name);
+
+      if (!with_sigs)
+        continue;
+      /* The first signature is the self-signature; the others are
+         certifications by the following keys.  */
+      nsigs = conf.sigs < conf.keys? conf.sigs + 1 : conf.keys;
+      for (sig = 0; sig < nsigs; sig++)
+        {
+          unsigned long signer = (idx + sig) % conf.keys;
+          char sfpr[41];
+
+          make_fpr (sfpr, signer, 0);
+          make_uid (name, sizeof name, signer, 0);
+          fprintf (fp, "sig:!::22:%s:%lu::::%s:13x::%s:::8:\n",
+                   sfpr + 24, created + sig, name, sfpr);
+        }
+    }
+
+  if (!x509)
+    {
+      fprintf (fp, "%s:u:255:18:%s:%lu::::::e:::%s::cv25519::\n",
+               strcmp (type, "sec")? "sub" : "ssb", subfpr + 24, created,
+               (with_secret || !strcmp (type, "sec")) && has_secret? "+" : "");
+      fprintf (fp, "fpr:::::::::%s:\n", subfpr);
+    }
+
+  sleep_us (conf.key_delay);
+}
+
+
+/* List the keys matching one of the NPATTERNS PATTERNS to FP.  */
+static void
+list_keys (FILE *fp, char **patterns, int npatterns, const char *type,
+           int secret_only, int with_secret, int with_sigs)
+{
+  unsigned long idx;
+  int i;
+
+  if (strcmp (type, "crt"))
+    fprintf (fp, "tru::1:%lu:0:3:1:5\n", KEY_CREATED);
+  for (idx = 0; idx < conf.keys; idx++)
+    {
+      if (secret_only && idx >= conf.secret)
+        break;
+      for (i = 0; i < npatterns; i++)
+        if (key_matches (idx, patterns[i]))
+          break;
+      if (npatterns && i == npatterns)
+        continue;
+      list_key (fp, idx, type, with_secret, with_sigs);
+    }
+  fflush (fp);
+}
+
+
+
+/* The gpg command line.  */
+
+/* Return a file descriptor for the file name NAME which may also be
+   "-" or "-&N".  */
+static int
+open_file (const char *name, int output)
+{
+  if (!name || !strcmp (name, "-"))
+    return output? 1 : 0;
+  if (name[0] == '-' && name[1] == '&')
+    return atoi (name + 2);
+  if (output)
+    return open (name, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+  return open (name, O_RDONLY);
+}
+
+
+/* Copy the file INFILE to OUTFILE.  Returns 0 on success.  */
+static int
+copy_file (const char *infile, const char *outfile)
+{
+  int infd, outfd, rc;
+
+  infd = open_file (infile, 0);
+  if (infd < 0)
+    {
+      fprintf (stderr, PGM ": can't open '%s': %s\n",
+               infile, strerror (errno));
+      return -1;
+    }
+  outfd = open_file (outfile, 1);
+  if (outfd < 0)
+    {
+      fprintf (stderr, PGM ": can't create '%s': %s\n",
+               outfile, strerror (errno));
+      if (infd > 2)
+        close (infd);
+      return -1;
+    }
+  rc = copy_data (infd, outfd);
+  if (infd > 2)
+    close (infd);
+  if (outfd > 2 && close (outfd))
+    rc = -1;
+  return rc;
+}
+
+
+static int
+do_encrypt (const char *infile, const char *outfile)
+{
+  status ("BEGIN_ENCRYPTION 2 9");
+  if (copy_file (infile, outfile))
+    {
+      status ("FAILURE encrypt 1");
+      return 2;
+    }
+  status ("END_ENCRYPTION");
+  return 0;
+}
+
+
+static int
+do_decrypt (const char *infile, const char *outfile)
+{
+  status ("BEGIN_DECRYPTION");
+  status ("DECRYPTION_INFO 2 9 0");
+  status ("PLAINTEXT 62 %lu", (unsigned long) time (NULL));
+  if (copy_file (infile, outfile))
+    {
+      status ("DECRYPTION_FAILED");
+      status ("END_DECRYPTION");
+      return 2;
+    }
+  status ("DECRYPTION_OKAY");
+  status ("GOODMDC");
+  status ("END_DECRYPTION");
+  return 0;
+}
+
+
+static int
+do_sign (const char *infile, const char *outfile, int mode)
+{
+  char fpr[41];
+  int rc = 0;
+
+  make_fpr (fpr, 0, 0);
+  if (mode == 'D')
+    {
+      FILE *fp;
+      int fd = open_file (outfile, 1);
+
+      fp = fd < 0? NULL : fdopen (fd, "w");
+      if (!fp)
+        rc = -1;
+      else
+        {
+          fputs ("-----BEGIN PGP SIGNATURE-----\n\nstub\n"
+                 "-----END PGP SIGNATURE-----\n", fp);
+          if (fclose (fp))
+            rc = -1;
+        }
+    }
+  else
+    rc = copy_file (infile, outfile);
+
+  if (rc)
+    {
+      status ("FAILURE sign 1");
+      return 2;
+    }
+  status ("SIG_CREATED %c 22 8 %s %lu %s", mode,
+          mode == 'C'? "01" : "00", (unsigned long) time (NULL), fpr);
+  return 0;
+}
+
+
+static int
+do_verify (const char *sigfile, const char *datafile, const char *outfile)
+{
+  char fpr[41];
+  int rc;
+
+  make_fpr (fpr, 0, 0);
+  if (datafile)
+    {
+      /* Detached signature: just consume the data.  */
+      rc = copy_file (sigfile, "/dev/null") || copy_file (datafile,
+                                                          "/dev/null");
+    }
+  else
+    rc = copy_file (sigfile, outfile? outfile : "/dev/null");
+  if (rc)
+    {
+      status ("NODATA 1");
+      return 2;
+    }
+  status ("NEWSIG");
+  status ("GOODSIG %s Test Key 0 <key0@example.org>", fpr + 24);
+  status ("VALIDSIG %s %s %lu 0 4 0 22 8 00 %s", fpr,
+          "2019-01-01", KEY_CREATED, fpr);
+  status ("TRUST_ULTIMATE 0 pgp");
+  return 0;
+}
+
+
+/* Encrypt or decrypt the files whose names are read from stdin.  */
+static int
+do_files (int decrypt)
+{
+  char line[4096];
+  int rc = 0;
+
+  while (fgets (line, sizeof line, stdin))
+    {
+      size_t len = strlen (line);
+      char *outfile;
+
+      while (len && (line[len - 1] == '\n' || line[len - 1] == '\r'))
+        line[--len] = 0;
+      if (!len)
+        continue;
+
+      outfile = malloc (len + 5);
+      if (!outfile)
+        return 2;
+      strcpy (outfile, line);
+      if (!decrypt)
+        strcat (outfile, armor? ".asc" : ".gpg");
+      else if (len > 4 && (!strcmp (outfile + len - 4, ".gpg")
+                           || !strcmp (outfile + len - 4, ".pgp")
+                           || !strcmp (outfile + len - 4, ".asc")))
+        outfile[len - 4] = 0;
+      else
+        strcat (outfile, ".out");
+
+      status ("FILE_START %d %s", decrypt? 3 : 2, line);
+      if (decrypt)
+        rc |= do_decrypt (line, outfile);
+      else
+        rc |= do_encrypt (line, outfile);
+      status ("FILE_DONE");
+      free (outfile);
+    }
+  return rc;
+}
+
+
+/* Pretend to receive the keys with the fingerprints FPRS from the
+   keyserver.  All keys are reported as updated with new
+   signatures.  */
+static int
+do_recv_keys (char **fprs, int nfprs)
+{
+  const char *logname = getenv ("GPA_STUB_RECV_LOG");
+  double start = now ();
+  int i;
+
+  sleep_us (conf.recv_delay * 1000);
+  for (i = 0; i < nfprs; i++)
+    status ("IMPORT_OK 4 %s", fprs[i]);
+  status ("IMPORT_RES %d 0 0 0 0 0 0 %d 0 0 0 0 0 0 0", nfprs, nfprs);
+
+  if (logname && *logname)
+    {
+      FILE *fp = fopen (logname, "a");
+
+      if (!fp)
+        return 2;
+      fprintf (fp, "%.6f %.6f %d\n", start, now (), nfprs);
+      if (fclose (fp))
+        return 2;
+    }
+  return 0;
+}
+
+
+/* Options taking an argument which we do not care about.  */
+static const char *const options_with_arg[] =
+  {
+    "--command-fd", "--logger-fd", "--attribute-fd", "--passphrase-fd",
+    "--charset", "--display", "--ttyname", "--ttytype", "--lc-ctype",
+    "--lc-messages", "--trust-model", "--pinentry-mode", "--request-origin",
+    "--sender", "--input-size-hint", "--set-filename", "--compress-algo",
+    "--default-key", "--local-user", "--keyserver", "--keyserver-options",
+    "--list-options", "--verify-options", "--export-options",
+    "--import-options", "--auto-key-locate", "--cipher-algo",
+    "--digest-algo", "--default-new-key-algo", "--trusted-key",
+    "--set-notation", "--sig-notation", "--comment", "--agent-program",
+    "--dirmngr-program", "--exit-on-status-write-error", "--passphrase",
+    "--encrypt-to", "--hidden-recipient", "--recipient-file",
+    "--hidden-recipient-file", "--default-recipient", "--ask-cert-level",
+    "--default-cert-level", "--max-output", "--override-session-key-fd",
+    "-u", "-z", "-r", "-R", "-f", "-F", "-N",
+    NULL
+  };
+
+
+static int
+takes_arg (const char *opt)
+{
+  const char *const *p;
+
+  for (p = options_with_arg; *p; p++)
+    if (!strcmp (*p, opt))
+      return 1;
+  return 0;
+}
+
+
+static int
+gpg_main (int argc, char **argv)
+{
+  const char *command = NULL;
+  const char *output = NULL;
+  int with_secret = 0;
+  char **files;
+  int nfiles = 0;
+  int i, rc;
+
+  files = calloc (argc + 1, sizeof *files);
+  if (!files)
+    return 2;
+
+  for (i = 1; i < argc; i++)
+    {
+      const char *arg = argv[i];
+      const char *value = NULL;
+      char *eq;
+      char opt[64];
+
+      if (!strcmp (arg, "--"))
+        {
+          for (i++; i < argc; i++)
+            files[nfiles++] = argv[i];
+          break;
+        }
+      if (arg[0] != '-' || !arg[1] || (arg[1] == '&' && arg[2]))
+        {
+          files[nfiles++] = argv[i];
+          continue;
+        }
+
+      /* Split "--opt=value".  */
+      snprintf (opt, sizeof opt, "%s", arg);
+      eq = strchr (opt, '=');
+      if (eq && opt[1] == '-')
+        {
+          *eq = 0;
+          value = arg + (eq - opt) + 1;
+        }
+
+#define NEXTARG() (value? value : i + 1 < argc? argv[++i] : "")
+      if (!strcmp (opt, "--version"))
+        command = "version";
+      else if (!strcmp (opt, "--status-fd"))
+        {
+          int fd = atoi (NEXTARG ());
+
+          statusfp = fd == 1? stdout : fd == 2? stderr : fdopen (fd, "w");
+        }
+      else if (!strcmp (opt, "--output") || !strcmp (opt, "-o"))
+        output = NEXTARG ();
+      else if (!strcmp (opt, "--homedir"))
+        NEXTARG ();
+      else if (!strcmp (opt, "--armor") || !strcmp (opt, "-a"))
+        armor = 1;
+      else if (!strcmp (opt, "--with-secret"))
+        with_secret = 1;
+      else if (!strcmp (opt, "--list-keys") || !strcmp (opt, "-k")
+               || !strcmp (opt, "--list-public-keys"))
+        command = "list-keys";
+      else if (!strcmp (opt, "--list-secret-keys") || !strcmp (opt, "-K"))
+        command = "list-secret-keys";
+      else if (!strcmp (opt, "--list-sigs") || !strcmp (opt, "--check-sigs"))
+        command = "list-sigs";
+      else if (!strcmp (opt, "--encrypt") || !strcmp (opt, "-e"))
+        command = command && !strcmp (command, "sign")? "sign" : "encrypt";
+      else if (!strcmp (opt, "--symmetric") || !strcmp (opt, "-c"))
+        command = "encrypt";
+      else if (!strcmp (opt, "--decrypt") || !strcmp (opt, "-d"))
+        command = "decrypt";
+      else if (!strcmp (opt, "--sign") || !strcmp (opt, "-s"))
+        command = command && !strcmp (command, "encrypt")? "encrypt" : "sign";
+      else if (!strcmp (opt, "--clearsign") || !strcmp (opt, "--clear-sign"))
+        command = "clearsign";
+      else if (!strcmp (opt, "--detach-sign") || !strcmp (opt, "-b"))
+        command = "detach-sign";
+      else if (!strcmp (opt, "--verify"))
+        command = "verify";
+      else if (!strcmp (opt, "--encrypt-files"))
+        command = "encrypt-files";
+      else if (!strcmp (opt, "--decrypt-files"))
+        command = "decrypt-files";
+      else if (opt[1] != '-' && opt[2])
+        {
+          /* Combined short options like "-se".  We only care about
+             the command letters.  */
+          if (strchr (opt, 'd'))
+            command = "decrypt";
+          else if (strchr (opt, 'e'))
+            command = "encrypt";
+          else if (strchr (opt, 's'))
+            command = "sign";
+        }
+      else if (opt[0] == '-' && opt[1] == '-' && !takes_arg (opt)
+               && (!strncmp (opt, "--import", 8) || !strncmp (opt, "--export", 8)
+                   || !strncmp (opt, "--edit", 6) || !strncmp (opt, "--delete", 8)
+                   || !strncmp (opt, "--gen-key", 9)
+                   || !strncmp (opt, "--quick-", 8)
+                   || !strncmp (opt, "--recv", 6) || !strncmp (opt, "--send", 6)
+                   || !strncmp (opt, "--search", 8)
+                   || !strncmp (opt, "--refresh", 9)
+                   || !strncmp (opt, "--card", 6)
+                   || !strncmp (opt, "--passwd", 8)))
+        command = argv[i] + 2;
+      else if (takes_arg (opt) && !value)
+        i++;
+#undef NEXTARG
+    }
+
+  if (!command)
+    command = nfiles? "decrypt" : "list-keys";
+
+  if (!strcmp (command, "version"))
+    {
+      printf ("gpg (GnuPG) 2.2.40\n"
+              "libgcrypt 1.8.10\n"
+              "Home: ~/.gnupg\n"
+              "Supported algorithms:\n"
+              "Pubkey: RSA, ELG, DSA, ECDH, ECDSA, EDDSA\n");
+      free (files);
+      return 0;
+    }
+
+  sleep_us (conf.latency * 1000);
+
+  rc = 0;
+  if (!strcmp (command, "list-keys"))
+    list_keys (stdout, files, nfiles, "pub", 0, with_secret, 0);
+  else if (!strcmp (command, "list-sigs"))
+    list_keys (stdout, files, nfiles, "pub", 0, with_secret, 1);
+  else if (!strcmp (command, "list-secret-keys"))
+    list_keys (stdout, files, nfiles, "sec", 1, 1, 0);
+  else if (!strcmp (command, "encrypt"))
+    rc = do_encrypt (nfiles? files[0] : NULL, output);
+  else if (!strcmp (command, "decrypt"))
+    rc = do_decrypt (nfiles? files[0] : NULL, output);
+  else if (!strcmp (command, "sign"))
+    rc = do_sign (nfiles? files[0] : NULL, output, 'S');
+  else if (!strcmp (command, "clearsign"))
+    rc = do_sign (nfiles? files[0] : NULL, output, 'C');
+  else if (!strcmp (command, "detach-sign"))
+    rc = do_sign (nfiles? files[0] : NULL, output, 'D');
+  else if (!strcmp (command, "verify"))
+    rc = do_verify (nfiles? files[0] : NULL,
+                    nfiles > 1? files[1] : NULL, output);
+  else if (!strcmp (command, "encrypt-files"))
+    rc = do_files (0);
+  else if (!strcmp (command, "decrypt-files"))
+    rc = do_files (1);
+  else if (!strcmp (command, "recv-keys"))
+    rc = do_recv_keys (files, nfiles);
+  else
+    {
+      fprintf (stderr, PGM ": command '%s' is not supported\n", command);
+      /* GPG_ERR_NOT_SUPPORTED.  */
+      status ("FAILURE %s 60", command);
+      rc = 2;
+    }
+
+  if (fflush (stdout))
+    rc = 2;
+  free (files);
+  return rc;
+}
+
+
+
+/* The gpgsm server.  */
+
+/* Write an Assuan line.  */
+static void
+assuan_line (const char *format, ...) __attribute__ ((format (printf, 1, 2)));
+
+static void
+assuan_line (const char *format, ...)
+{
+  va_list arg_ptr;
+
+  va_start (arg_ptr, format);
+  vfprintf (stdout, format, arg_ptr);
+  va_end (arg_ptr);
+  putc ('\n', stdout);
+  fflush (stdout);
+}
+
+
+/* Send the colon listing in BUFFER of LENGTH as data lines.  */
+static void
+assuan_data (const char *buffer, size_t length)
+{
+  size_t n = 0;
+
+  for (; length; buffer++, length--)
+    {
+      if (!n)
+        fputs ("D ", stdout);
+      if (*buffer == '%' || *buffer == '\r' || *buffer == '\n')
+        n += fprintf (stdout, "%%%02X", (unsigned char) *buffer);
+      else
+        {
+          putc (*buffer, stdout);
+          n++;
+        }
+      if (n >= 900 || length == 1)
+        {
+          putc ('\n', stdout);
+          n = 0;
+        }
+    }
+  fflush (stdout);
+}
+
+
+/* Parse "FD=N" from LINE.  Returns -1 if not found.  */
+static int
+parse_fd (const char *line)
+{
+  const char *p = strstr (line, "FD=");
+
+  return p? atoi (p + 3) : -1;
+}
+
+
+/* Read and discard all data from FD.  */
+static void
+drain (int fd)
+{
+  char buffer[4096];
+
+  if (fd < 0)
+    return;
+  while (read (fd, buffer, sizeof buffer) > 0)
+    ;
+}
+
+
+static void
+close_fd (int *fdp)
+{
+  if (*fdp > 2)
+    close (*fdp);
+  *fdp = -1;
+}
+
+
+static int
+gpgsm_server (void)
+{
+  char line[1002];
+  int input_fd = -1;
+  int output_fd = -1;
+  int message_fd = -1;
+
+  statusfp = NULL;
+  sleep_us (conf.latency * 1000);
+  assuan_line ("OK Pleased to meet you");
+
+  while (fgets (line, sizeof line, stdin))
+    {
+      char *p;
+      size_t len = strlen (line);
+
+      while (len && (line[len - 1] == '\n' || line[len - 1] == '\r'))
+        line[--len] = 0;
+      for (p = line; *p && *p != ' '; p++)
+        *p = toupper ((unsigned char) *p);
+
+      if (!strncmp (line, "BYE", 3))
+        {
+          assuan_line ("OK closing connection");
+          break;
+        }
+      else if (!strncmp (line, "INPUT", 5))
+        input_fd = parse_fd (line);
+      else if (!strncmp (line, "OUTPUT", 6))
+        output_fd = parse_fd (line);
+      else if (!strncmp (line, "MESSAGE", 7))
+        message_fd = parse_fd (line);
+      else if (!strncmp (line, "LISTKEYS", 8)
+               || !strncmp (line, "LISTSECRETKEYS", 14)
+               || !strncmp (line, "DUMPKEYS", 8))
+        {
+          char *buffer = NULL;
+          size_t length = 0;
+          char *patterns[1];
+          FILE *fp = open_memstream (&buffer, &length);
+
+          if (!fp)
+            {
+              assuan_line ("ERR 86 Out of core");
+              continue;
+            }
+          p = strchr (line, ' ');
+          if (p)
+            p++;
+          patterns[0] = p;
+          list_keys (fp, patterns, p && *p, "crt",
+                     line[4] == 'S', 1, 0);
+          fclose (fp);
+          assuan_data (buffer, length);
+          free (buffer);
+        }
+      else if (!strncmp (line, "ENCRYPT", 7) || !strncmp (line, "DECRYPT", 7)
+               || !strncmp (line, "SIGN", 4))
+        {
+          int decrypt = line[0] == 'D';
+
+          if (input_fd < 0 || output_fd < 0)
+            {
+              assuan_line ("ERR 67109141 IPC parameter error");
+              continue;
+            }
+          if (!decrypt)
+            assuan_line ("S BEGIN_ENCRYPTION 2 9");
+          if (copy_data (input_fd, output_fd))
+            {
+              close_fd (&input_fd);
+              close_fd (&output_fd);
+              assuan_line ("ERR 67108921 Write error");
+              continue;
+            }
+          close_fd (&input_fd);
+          close_fd (&output_fd);
+          if (line[0] == 'S')
+            ;
+          else if (decrypt)
+            {
+              assuan_line ("S DECRYPTION_INFO 2 9 0");
+              assuan_line ("S DECRYPTION_OKAY");
+            }
+          else
+            assuan_line ("S END_ENCRYPTION");
+        }
+      else if (!strncmp (line, "VERIFY", 6))
+        {
+          char fpr[41];
+
+          make_fpr (fpr, 0, 0);
+          drain (input_fd);
+          drain (message_fd);
+          close_fd (&input_fd);
+          close_fd (&message_fd);
+          close_fd (&output_fd);
+          assuan_line ("S NEWSIG");
+          assuan_line ("S GOODSIG %s CN=Test Key 0,O=Example", fpr + 24);
+          assuan_line ("S VALIDSIG %s 2019-01-01 %lu", fpr, KEY_CREATED);
+          assuan_line ("S TRUST_FULLY 0 chain");
+        }
+      else if (!strncmp (line, "GETINFO", 7))
+        {
+          if (strstr (line, "version"))
+            assuan_line ("D 2.2.40");
+        }
+      else if (!*line || *line == '#')
+        continue;
+      else if (strncmp (line, "OPTION", 6) && strncmp (line, "RESET", 5)
+               && strncmp (line, "RECIPIENT", 9) && strncmp (line, "SIGNER", 6)
+               && strncmp (line, "NOP", 3))
+        {
+          /* GPG_ERR_ASS_UNKNOWN_CMD.  */
+          assuan_line ("ERR 67109139 Unknown IPC command");
+          continue;
+        }
+      assuan_line ("OK");
+    }
+  return 0;
+}
+
+
+
+int
+main (int argc, char **argv)
+{
+  int i;
+
+  conf.keys = getenv_ulong ("GPA_STUB_KEYS", 100);
+  conf.uids = getenv_ulong ("GPA_STUB_UIDS", 1);
+  conf.sigs = getenv_ulong ("GPA_STUB_SIGS", 0);
+  conf.secret = getenv_ulong ("GPA_STUB_SECRET", 1);
+  conf.latency = getenv_ulong ("GPA_STUB_LATENCY", 0);
+  conf.key_delay = getenv_ulong ("GPA_STUB_KEY_DELAY", 0);
+  conf.rate = getenv_ulong ("GPA_STUB_RATE", 0);
+  conf.recv_delay = getenv_ulong ("GPA_STUB_RECV_DELAY", 0);
+  if (!conf.uids)
+    conf.uids = 1;
+
+  for (i = 1; i < argc; i++)
+    if (!strcmp (argv[i], "--server"))
+      return gpgsm_server ();
+
+  return gpg_main (argc, argv);
+}
@@ -40,6 +40,8 @@
 #include "settingsdlg.h"
 #include "confdialog.h"
 #include "icons.h"
+#include "gpatrace.h"
+#include "keyref.h"
 
 #ifdef __MINGW32__
 #include "hidewnd.h"
@@ -76,11 +78,13 @@ typedef struct
   gboolean disable_x509;
   gboolean no_remote;
   gboolean enable_logging;
+  int stall_threshold;
+  gchar *trace_filename;
+  gchar *gpg_binary;
+  gchar *gpgsm_binary;
   gchar *options_filename;
 } gpa_args_t;
 
-static char *dummy_arg;
-
 static gpa_args_t args;
 
 static GtkApplication *gpa_application;
@@ -96,6 +100,20 @@ static const char *copyright =
 
 static GtkWidget *backend_config_dialog = NULL;
 
+/* The startup phases with the time they ended in microseconds since
+   the start of main.  */
+#define MAX_STARTUP_PHASES 16
+static struct
+{
+  const char *name;
+  gint64 time;
+} startup_phases[MAX_STARTUP_PHASES];
+static int n_startup_phases;
+static gint64 startup_time;
+
+/* True if the agent has already been started.  */
+static gboolean agent_started;
+
 
 static void print_version (void);
 
@@ -139,10 +157,14 @@ static GOptionEntry option_entries[] =
       &debug_edit_fsm, NULL, NULL },
     { "enable-logging", 0, G_OPTION_FLAG_HIDDEN, G_OPTION_ARG_NONE,
       &args.enable_logging, NULL, NULL },
+    { "debug-stalls", 0, G_OPTION_FLAG_HIDDEN, G_OPTION_ARG_INT,
+      &args.stall_threshold, NULL, NULL },
+    { "trace", 0, G_OPTION_FLAG_HIDDEN, G_OPTION_ARG_FILENAME,
+      &args.trace_filename, NULL, NULL },
     { "gpg-binary", 0, G_OPTION_FLAG_HIDDEN, G_OPTION_ARG_FILENAME,
-      &dummy_arg, NULL, NULL },
+      &args.gpg_binary, NULL, NULL },
     { "gpgsm-binary", 0, G_OPTION_FLAG_HIDDEN, G_OPTION_ARG_FILENAME,
-      &dummy_arg, NULL, NULL },
+      &args.gpgsm_binary, NULL, NULL },
     { NULL }
   };
 
@@ -439,6 +461,79 @@ open_requested_window (int argc, char **argv, int use_server)
 }
 
 
+/* Record that the startup phase NAME has ended.  */
+void
+gpa_startup_phase (const char *name)
+{
+  if (n_startup_phases >= MAX_STARTUP_PHASES)
+    return;
+
+  startup_phases[n_startup_phases].name = name;
+  startup_phases[n_startup_phases].time = (g_get_monotonic_time ()
+                                           - startup_time);
+  if (verbose)
+    g_message ("startup phase %-12s %7.1f ms (%7.1f ms total)", name,
+               (startup_phases[n_startup_phases].time
+                - (n_startup_phases?
+                   startup_phases[n_startup_phases - 1].time : 0)) / 1000.0,
+               startup_phases[n_startup_phases].time / 1000.0);
+  n_startup_phases++;
+}
+
+
+/* Return a malloced string with one line for each startup phase
+   giving its name, its duration and the time since the start of GPA,
+   both in microseconds.  */
+char *
+gpa_startup_report (void)
+{
+  GString *string = g_string_new (NULL);
+  gint64 prev = 0;
+  int idx;
+
+  for (idx = 0; idx < n_startup_phases; idx++)
+    {
+      g_string_append_printf (string, "%s %" G_GINT64_FORMAT
+                              " %" G_GINT64_FORMAT "\n",
+                              startup_phases[idx].name,
+                              startup_phases[idx].time - prev,
+                              startup_phases[idx].time);
+      prev = startup_phases[idx].time;
+    }
+  return g_string_free (string, FALSE);
+}
+
+
+/* Initialize the parts which are not required for the first window
+   or the UI server.  This is run from an idle handler after
+   startup.  */
+static gboolean
+deferred_init_cb (gpointer user_data)
+{
+  /* Start the agent if needed.  We need to do this because the card
+     manager uses direct assuan commands to the agent and thus expects
+     that the agent has been startet. */
+  if (!agent_started)
+    gpa_start_agent ();
+  agent_started = TRUE;
+
+  /* Make sure there are reasonable defaults for the default key and
+     keyserver.  Note that checking the gpg version makes gpgme probe
+     all engines.  */
+  gpa_options_update_default_key (gpa_options_get_instance ());
+  if (!gpa_options_get_default_keyserver (gpa_options_get_instance ())
+      && !is_gpg_version_at_least ("2.1.0"))
+    {
+      GList *keyservers = keyserver_get_as_glist ();
+      gpa_options_set_default_keyserver (gpa_options_get_instance (),
+					 keyservers->data);
+    }
+
+  gpa_startup_phase ("deferred");
+  return FALSE;
+}
+
+
 struct gpa_start_data {
   int argc;
   char **argv;
@@ -447,6 +542,7 @@ struct gpa_start_data {
 
 static void activate (GtkApplication *app, gpointer user_data)
 {
+  static int initialized;
   GList *list;
 
   struct gpa_start_data *start_data = (struct gpa_start_data *) user_data;
@@ -466,6 +562,14 @@ static void activate (GtkApplication *app, gpointer user_data)
       if (!args.start_only_server)
       open_requested_window (argc, argv, 0);
     }
+
+  /* A remote activation only presents the window again.  */
+  if (!initialized)
+    {
+      initialized = 1;
+      gpa_startup_phase ("ready");
+      g_idle_add_full (G_PRIORITY_LOW, deferred_init_cb, NULL, NULL);
+    }
 }
 
 
@@ -474,6 +578,19 @@ GtkApplication *get_gpa_application()
   return gpa_application;
 }
 
+#ifdef GPA_BENCH
+/* Set the application object used by the benchmark driver.  */
+void
+gpa_bench_set_application (GtkApplication *application)
+{
+  gpa_application = application;
+}
+
+/* The benchmark driver links all of GPA and has its own main.  */
+# define main gpa_main
+int gpa_main (int argc, char *argv[]);
+#endif /*GPA_BENCH*/
+
 int
 main (int argc, char *argv[])
 {
@@ -483,6 +600,8 @@ main (int argc, char *argv[])
   char *keyservers_configname = NULL;
   int status;
 
+  startup_time = g_get_monotonic_time ();
+
   /* Under W32 logging is disabled by default to prevent MS Windows NT
      from opening a console.  */
 #ifndef G_OS_WIN32
@@ -508,6 +627,7 @@ main (int argc, char *argv[])
       g_print ("option parsing failed: %s\n", err->message);
       exit (1);
     }
+  gpa_startup_phase ("options");
 
   if (!args.enable_logging)
     {
@@ -531,6 +651,20 @@ main (int argc, char *argv[])
     }
 
   gtk_init (&argc, &argv);
+  gpa_startup_phase ("gtk");
+
+  /* Report main loop handlers which take longer than the given number
+     of milliseconds.  */
+  if (args.stall_threshold > 0)
+    gpa_init_stallwatch (args.stall_threshold);
+
+  /* Write a trace of the operations for a trace viewer.  */
+  if (args.trace_filename)
+    gpa_trace_open (args.trace_filename);
+
+  /* Account key references; only in builds with key accounting.  */
+  gpa_init_keyref ();
+
 #ifdef G_OS_WIN32
   gtk_settings_set_string_property(gtk_settings_get_default(),
                                    "gtk-theme-name",
@@ -546,6 +680,7 @@ main (int argc, char *argv[])
     g_error_free (err);
 
   gpa_register_stock_items ();
+  gpa_startup_phase ("icons");
 
 #ifdef IS_DEVELOPMENT_VERSION
   fprintf (stderr, "NOTE: This is a development version!\n");
@@ -553,6 +688,12 @@ main (int argc, char *argv[])
 
   /* Initialize GPGME.  */
   gpgme_check_version (NULL);
+  /* Allow running against other engines; for example the stub engine
+     used for performance tests.  */
+  if (args.gpg_binary)
+    gpgme_set_engine_info (GPGME_PROTOCOL_OpenPGP, args.gpg_binary, NULL);
+  if (args.gpgsm_binary)
+    gpgme_set_engine_info (GPGME_PROTOCOL_CMS, args.gpgsm_binary, NULL);
 #ifdef USE_SIMPLE_GETTEXT
   /* FIXME */
 #else
@@ -579,10 +720,7 @@ main (int argc, char *argv[])
   }
 #endif
 
-  /* Start the agent if needed.  We need to do this because the card
-     manager uses direct assuan commands to the agent and thus expects
-     that the agent has been startet. */
-  gpa_start_agent ();
+  gpa_startup_phase ("gpgme");
 
   gnupg_homedir = default_homedir ();
 
@@ -598,6 +736,7 @@ main (int argc, char *argv[])
     configname = args.options_filename;
   gpa_options_set_file (gpa_options_get_instance (), configname);
   g_free (configname);
+  gpa_startup_phase ("config");
 
   if (args.stop_running_server)
     {
@@ -647,26 +786,26 @@ main (int argc, char *argv[])
       /* Start a new instance on error.  */
       break;
     }
+  gpa_startup_phase ("server");
+
+  /* The card manager talks directly to the agent; thus start it now
+     instead of deferring it.  */
+  if (args.start_card_manager)
+    {
+      gpa_start_agent ();
+      agent_started = TRUE;
+    }
 
   /* Locate the list of keyservers.  */
   keyservers_configname = g_build_filename (gnupg_homedir, "keyservers", NULL);
 
   /* Read the list of available keyservers.  */
   keyserver_read_list (keyservers_configname);
-
-  gpa_options_update_default_key (gpa_options_get_instance ());
-  /* Now, make sure there are reasonable defaults for the default key
-    and keyserver.  */
-  if (!is_gpg_version_at_least ("2.1.0")
-      && !gpa_options_get_default_keyserver (gpa_options_get_instance ()))
-    {
-      GList *keyservers = keyserver_get_as_glist ();
-      gpa_options_set_default_keyserver (gpa_options_get_instance (),
-					 keyservers->data);
-    }
+  gpa_startup_phase ("keyservers");
 
   /* Initialize the file watch facility.  */
   gpa_init_filewatch ();
+  gpa_startup_phase ("filewatch");
 
   struct gpa_start_data start_data;
   start_data.argv = argv;
@@ -677,6 +816,9 @@ main (int argc, char *argv[])
 
   status = g_application_run (G_APPLICATION (gpa_application), start_data.argc, start_data.argv);
 
+  gpa_stallwatch_dump ();
+  gpa_trace_close ();
+
   g_object_unref (gpa_application);
 
   return status;
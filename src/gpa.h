@@ -121,8 +121,17 @@ gpa_filewatch_id_t gpa_add_filewatch (const char *filename,
                                       gpa_filewatch_cb_t cb,
                                       void *cb_data);
 
+void gpa_init_stallwatch (unsigned int threshold_ms);
+void gpa_stallwatch_dump (void);
+
 GtkApplication *get_gpa_application();
 
+void gpa_startup_phase (const char *name);
+char *gpa_startup_report (void);
+#ifdef GPA_BENCH
+void gpa_bench_set_application (GtkApplication *application);
+#endif
+
 /*-- utils.c --*/
 /* We are so used to these function thus provide them.  */
 void *xmalloc (size_t n);
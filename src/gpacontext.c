@@ -25,6 +25,7 @@
 #include "gpa.h"
 #include "gpgmetools.h"
 #include "gpacontext.h"
+#include "gpatrace.h"
 
 /* GObject type functions */
 
@@ -200,6 +201,8 @@ gpa_context_init (GpaContext *context)
   context->io_cbs->event_priv = context;
   /* Set the callbacks */
   gpgme_set_io_cbs (context->ctx, context->io_cbs);
+
+  gpa_trace_context (context);
 }
 
 
@@ -340,7 +343,19 @@ gpa_io_cb (GIOChannel *source, GIOCondition condition, gpointer data)
 
   /* We have to use the GPGME provided "file descriptor" here.  It may
      not be a system file descriptor after all.  */
-  cb->fnc (cb->fnc_data, cb->fd);
+  if (gpa_trace_enabled ())
+    {
+      /* The callback may remove and free CB.  */
+      GpaContext *context = cb->context;
+      int fd = cb->fd;
+      int dir = cb->dir;
+      gint64 start = gpa_trace_now ();
+
+      cb->fnc (cb->fnc_data, fd);
+      gpa_trace_io (context, fd, dir, start);
+    }
+  else
+    cb->fnc (cb->fnc_data, cb->fd);
 
   return TRUE;
 }
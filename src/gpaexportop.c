@@ -157,6 +157,7 @@ gpa_export_operation_class_init (GpaExportOperationClass *klass)
   /* Virtual methods */
   klass->get_destination = NULL;
   klass->complete_export = NULL;
+  klass->start_export = NULL;
 
   /* Properties */
   g_object_class_install_property (object_class,
@@ -219,6 +220,10 @@ gpa_export_operation_idle_cb (gpointer data)
       gpgme_protocol_t prot = GPGME_PROTOCOL_UNKNOWN;
       gboolean secret;
 
+      if (GPA_EXPORT_OPERATION_GET_CLASS (op)->start_export
+          && GPA_EXPORT_OPERATION_GET_CLASS (op)->start_export (op))
+        return FALSE;
+
       gpgme_set_armor (GPA_OPERATION (op)->context->ctx, armor);
       /* Create the set of keys to export */
       patterns = g_malloc0 (sizeof(gchar*)*(g_list_length(op->keys)+1));
@@ -62,6 +62,13 @@ struct _GpaExportOperationClass {
    * etc.
    */
   void (*complete_export) (GpaExportOperation *op);
+
+  /* Optional.  Called instead of the export once the destination has
+   * been set up, for operations which export the keys themselves.
+   * Returns FALSE to use the normal export.  Otherwise the operation
+   * has to emit the "completed" signal when done.
+   */
+  gboolean (*start_export) (GpaExportOperation *op);
 };
 
 GType gpa_export_operation_get_type (void) G_GNUC_CONST;
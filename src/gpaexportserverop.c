@@ -20,6 +20,7 @@
 
 #include <config.h>
 
+#include <string.h>
 #include <gpgme.h>
 #include <unistd.h>
 #include "gpa.h"
@@ -30,6 +31,8 @@
 #include "confdialog.h"
 #include "gpaexportserverop.h"
 
+
+
 static GObjectClass *parent_class = NULL;
 
 static gboolean
@@ -38,6 +41,8 @@ gpa_export_server_operation_get_destination (GpaExportOperation *operation,
 						gboolean *armor);
 static void
 gpa_export_server_operation_complete_export (GpaExportOperation *operation);
+static gboolean
+gpa_export_server_operation_start_export (GpaExportOperation *operation);
 
 /* GObject boilerplate */
 
@@ -50,6 +55,11 @@ gpa_export_server_operation_finalize (GObject *object)
     {
       g_free (op->server);
     }
+  gpa_server_batch_release (op->batch);
+  if (op->failures)
+    g_string_free (op->failures, TRUE);
+  if (op->progress_dialog)
+    gtk_widget_destroy (op->progress_dialog);
 
   G_OBJECT_CLASS (parent_class)->finalize (object);
 }
@@ -58,6 +68,13 @@ static void
 gpa_export_server_operation_init (GpaExportServerOperation *op)
 {
   op->server = NULL;
+  op->progress_dialog = NULL;
+  op->batch = NULL;
+  op->total = 0;
+  op->sent = 0;
+  op->failed = 0;
+  op->failures = NULL;
+  op->canceled = FALSE;
 }
 
 static GObject*
@@ -89,6 +106,7 @@ gpa_export_server_operation_class_init (GpaExportServerOperationClass *klass)
   object_class->finalize = gpa_export_server_operation_finalize;
   export_class->get_destination = gpa_export_server_operation_get_destination;
   export_class->complete_export = gpa_export_server_operation_complete_export;
+  export_class->start_export = gpa_export_server_operation_start_export;
 }
 
 GType
@@ -197,76 +215,192 @@ gpa_export_server_operation_get_destination (GpaExportOperation *operation,
 }
 
 
-/* GnuPG 2.1 method to send keys to the keyserver.  KEYLIST has a list
-   of keys to be sent.  Returns true on success. */
-static gboolean
-send_keys (GpaExportServerOperation *op, GList *keylist)
+static void
+send_keys_done_cb (gpg_error_t err, gpgme_data_t data, gpointer opaque)
 {
-  gpg_error_t err;
-  GList *item;
-  gpgme_key_t *keyarray;
-  gpgme_key_t key;
-  int i;
+  GpaExportServerOperation *op = opaque;
 
-  keyarray = g_malloc0_n (g_list_length (keylist)+1, sizeof *keyarray);
-  i = 0;
-  for (item = keylist; item; i++, item = g_list_next (item))
-    {
-      key = (gpgme_key_t) item->data;
-      if (!key || key->protocol != GPGME_PROTOCOL_OpenPGP)
-        continue;
-      gpgme_key_ref (key);
-      keyarray[i++] = key;
-    }
+  gpgme_data_release (data);
+  if (!err)
+    gpa_window_message (_("The keys have been sent to the server."),
+                        GPA_OPERATION (op)->window);
+  g_object_unref (op);
+}
+
+
+/* Send the exported keys with the keyserver helper.  This is only
+   used with GnuPG versions before 2.1.  All keys are in one armored
+   block and thus sent with one run of the helper.  The operation
+   completes before the helper has finished and keeps a reference
+   until then.  */
+static void
+gpa_export_server_operation_complete_export (GpaExportOperation *operation)
+{
+  GpaExportServerOperation *op = GPA_EXPORT_SERVER_OPERATION (operation);
+  gpgme_key_t key = (gpgme_key_t) operation->keys->data;
+
+  op->server = g_strdup (gpa_options_get_default_keyserver
+                         (gpa_options_get_instance ()));
+  g_object_ref (op);
+  if (!server_send_keys (op->server, key->subkeys->keyid, operation->dest,
+                         GPA_OPERATION (op)->window, send_keys_done_cb, op))
+    g_object_unref (op);
+}
 
-  gpgme_set_protocol (GPA_OPERATION (op)->context->ctx, GPGME_PROTOCOL_OpenPGP);
-  err = gpgme_op_export_keys (GPA_OPERATION (op)->context->ctx,
-                              keyarray, GPGME_KEYLIST_MODE_EXTERN, NULL);
-  for (i=0; keyarray[i]; i++)
-    gpgme_key_unref (keyarray[i]);
-  g_free (keyarray);
 
-  if (err)
+/* GnuPG 2.1 does not use the keyserver helpers anymore, thus the keys
+   are sent with the real API.  */
+
+static void
+update_progress (GpaExportServerOperation *op)
+{
+  GtkProgressBar *pbar;
+  char *text;
+
+  pbar = GTK_PROGRESS_BAR (GPA_PROGRESS_DIALOG (op->progress_dialog)->pbar);
+  text = g_strdup_printf (_("%u of %u keys"), op->sent + op->failed,
+                          op->total);
+  gtk_progress_bar_set_text (pbar, text);
+  gtk_progress_bar_set_fraction (pbar, (double) (op->sent + op->failed)
+                                 / op->total);
+  g_free (text);
+}
+
+
+static void
+finish (GpaExportServerOperation *op)
+{
+  gpg_error_t err = 0;
+
+  gtk_widget_hide (op->progress_dialog);
+
+  if (op->failed)
     {
       gpa_show_warn (GPA_OPERATION (op)->window, NULL,
-                        "%s\n\n(%s <%s>)",
-                        _("Error sending key(s) to the server."),
-                        gpg_strerror (err), gpg_strsource (err));
-      return FALSE;
+                     _("%u of %u keys could not be sent to the server:"
+                       "\n\n%s"),
+                     op->failed, op->total, op->failures->str);
+      err = gpg_error (GPG_ERR_GENERAL);
     }
+  else if (op->canceled)
+    err = gpg_error (GPG_ERR_CANCELED);
+  else
+    gpa_window_message (_("The keys have been sent to the server."),
+                        GPA_OPERATION (op)->window);
 
-  return TRUE;
+  g_signal_emit_by_name (GPA_OPERATION (op), "completed", err);
 }
 
 
+static gpg_error_t
+send_start_cb (GpaContext *context, gpgme_key_t *keys, void *opaque)
+{
+  gpgme_set_protocol (context->ctx, GPGME_PROTOCOL_OpenPGP);
+  return gpgme_op_export_keys_start (context->ctx, keys,
+                                     GPGME_EXPORT_MODE_EXTERN, NULL);
+}
+
 
+/* Account for the finished request for the COUNT keys in KEYS.  */
 static void
-gpa_export_server_operation_complete_export (GpaExportOperation *operation)
+send_done_cb (GpaContext *context, gpgme_key_t *keys, guint count,
+              gpg_error_t err, void *opaque)
 {
-  GpaExportServerOperation *op = GPA_EXPORT_SERVER_OPERATION (operation);
-  int okay = 0;
+  GpaExportServerOperation *op = opaque;
 
-  if (is_gpg_version_at_least ("2.1.0"))
+  if (!err)
+    op->sent += count;
+  else if (gpg_err_code (err) == GPG_ERR_CANCELED)
+    ;
+  else if (count > 1)
     {
-      /* GnuPG 2.1.0 does not anymore use the keyserver helpers and
-         thus we need to use the real API for sending keys.  */
-      if (send_keys (op, operation->keys))
-        okay = 1;
+      /* We don't know which of the keys failed.  Retry them one by
+         one to get the status of each key.  */
+      gpa_server_batch_retry_keys (op->batch, keys, count);
     }
   else
     {
-      gpgme_key_t key = (gpgme_key_t) operation->keys->data;
+      gpgme_key_t key = keys[0];
+      gchar *userid = gpa_gpgme_key_get_userid (key->uids);
+
+      op->failed++;
+      g_string_append_printf (op->failures, "0x%s %s: %s\n",
+                              gpa_gpgme_key_get_short_keyid (key),
+                              userid, gpg_strerror (err));
+      g_free (userid);
+    }
+
+  update_progress (op);
+}
+
+
+static void
+send_finish_cb (void *opaque)
+{
+  finish (opaque);
+}
+
+
+static void
+progress_response_cb (GtkDialog *dialog, gint response,
+                      GpaExportServerOperation *op)
+{
+  if (op->canceled)
+    return;
+  op->canceled = TRUE;
+  gpa_server_batch_cancel (op->batch);
+}
+
 
-      op->server = g_strdup (gpa_options_get_default_keyserver
-                             (gpa_options_get_instance ()));
-      if (server_send_keys (op->server, key->subkeys->keyid, operation->dest,
-                             GPA_OPERATION (op)->window))
-        okay = 1;
+static gboolean
+gpa_export_server_operation_start_export (GpaExportOperation *operation)
+{
+  GpaExportServerOperation *op = GPA_EXPORT_SERVER_OPERATION (operation);
+  GPtrArray *keys;
+  GList *item;
+
+  if (!is_gpg_version_at_least ("2.1.0"))
+    return FALSE;
+
+  op->batch = gpa_server_batch_new (send_start_cb, send_done_cb,
+                                    send_finish_cb, op);
+  keys = g_ptr_array_new ();
+  for (item = operation->keys; item; item = g_list_next (item))
+    {
+      gpgme_key_t key = item->data;
+
+      if (key && key->protocol == GPGME_PROTOCOL_OpenPGP)
+        g_ptr_array_add (keys, key);
     }
+  op->total = keys->len;
+  gpa_server_batch_add_keys (op->batch, (gpgme_key_t *) keys->pdata,
+                             keys->len);
+  g_ptr_array_free (keys, TRUE);
 
-  if (okay)
-    gpa_window_message (_("The keys have been sent to the server."),
-                        GPA_OPERATION (op)->window);
+  if (!op->total)
+    {
+      g_signal_emit_by_name (GPA_OPERATION (op), "completed", 0);
+      return TRUE;
+    }
+
+  op->failures = g_string_new (NULL);
+
+  op->progress_dialog = gpa_progress_dialog_new (GPA_OPERATION (op)->window,
+                                                 GPA_OPERATION (op)->context);
+  gpa_progress_dialog_set_label (GPA_PROGRESS_DIALOG (op->progress_dialog),
+                                 _("Sending keys to the keyserver..."));
+  gtk_progress_bar_set_show_text
+    (GTK_PROGRESS_BAR (GPA_PROGRESS_DIALOG (op->progress_dialog)->pbar), TRUE);
+  gtk_dialog_set_response_sensitive (GTK_DIALOG (op->progress_dialog),
+                                     GTK_RESPONSE_CANCEL, TRUE);
+  g_signal_connect (G_OBJECT (op->progress_dialog), "response",
+                    G_CALLBACK (progress_response_cb), op);
+  gtk_widget_show_all (op->progress_dialog);
+
+  update_progress (op);
+  gpa_server_batch_run (op->batch);
+
+  return TRUE;
 }
 
 /* API */
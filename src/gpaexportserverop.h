@@ -26,6 +26,7 @@
 #include <glib.h>
 #include <glib-object.h>
 #include "gpaexportop.h"
+#include "serverbatch.h"
 
 /* GObject stuff */
 #define GPA_EXPORT_SERVER_OPERATION_TYPE	  (gpa_export_server_operation_get_type ())
@@ -42,6 +43,17 @@ struct _GpaExportServerOperation {
   GpaExportOperation parent;
 
   gchar *server;
+
+  /* With GnuPG 2.1 the keys are sent in batches scheduled by
+     BATCH.  */
+  GtkWidget *progress_dialog;
+  gpa_server_batch_t batch;
+
+  guint total;
+  guint sent;
+  guint failed;
+  GString *failures;    /* One line per key which could not be sent.  */
+  gboolean canceled;
 };
 
 struct _GpaExportServerOperationClass {
@@ -53,7 +65,7 @@ GType gpa_export_server_operation_get_type (void) G_GNUC_CONST;
 
 /* API */
 
-/* Creates a new export to file operation.
+/* Creates a new operation sending the KEYS to the keyserver.
  */
 GpaExportServerOperation*
 gpa_export_server_operation_new (GtkWidget *window, GList *keys);
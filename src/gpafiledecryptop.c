@@ -273,6 +273,52 @@ destination_filename (const gchar *filename)
   return plain_filename;
 }
 
+
+/* Classify FILE_ITEM for the multi-file backend.  gpg only strips
+   the known extensions; other files need to be asked for.  */
+static int
+multifile_classify (GpaFileOperation *fop, gpa_file_item_t file_item,
+                    char **r_filename_out)
+{
+  const gchar *extension;
+
+  extension = g_strrstr (file_item->filename_in, ".");
+  if (!extension || !(g_str_equal (extension, ".asc")
+                      || g_str_equal (extension, ".gpg")
+                      || g_str_equal (extension, ".pgp")))
+    return -1;
+  if (is_cms_file (file_item->filename_in))
+    return -1;
+
+  *r_filename_out = destination_filename (file_item->filename_in);
+  return 0;
+}
+
+
+/* Start a single gpg process for the next group of small files.
+   Returns false if the files shall be processed one by one.  */
+static gboolean
+gpa_file_decrypt_operation_start_multifile (GpaFileDecryptOperation *op)
+{
+  GList *items;
+  gpg_error_t err;
+  int klass;
+
+  items = gpa_multifile_select (GPA_FILE_OPERATION (op), multifile_classify,
+                                &klass);
+  if (!items)
+    return FALSE;
+
+  /* In verify mode signed files are done again by the regular
+     backend to show their signatures.  */
+  err = gpa_multifile_start (GPA_FILE_OPERATION (op),
+                             op->verify ? GPA_MULTIFILE_DECRYPT_VERIFY
+                             : GPA_MULTIFILE_DECRYPT, items, NULL);
+  g_list_free (items);
+
+  return !err;
+}
+
 static gpg_error_t
 gpa_file_decrypt_operation_start (GpaFileDecryptOperation *op,
 				  gpa_file_item_t file_item)
@@ -317,16 +363,15 @@ gpa_file_decrypt_operation_start (GpaFileDecryptOperation *op,
 	/* FIXME: Error value.  */
 	return gpg_error (GPG_ERR_GENERAL);
 
-      op->plain_fd = gpa_open_output (file_item->filename_out, &op->plain,
-				      GPA_OPERATION (op)->window,
-                                      &filename_used);
+      op->plain_fd = gpa_open_output_with_policy
+        (file_item->filename_out, &op->plain, GPA_OPERATION (op)->window,
+         GPA_FILE_OPERATION (op)->conflict, &filename_used, &err);
       if (op->plain_fd == -1)
 	{
 	  gpgme_data_release (op->cipher);
 	  close (op->cipher_fd);
           xfree (filename_used);
-	  /* FIXME: Error value.  */
-	  return gpg_error (GPG_ERR_GENERAL);
+	  return err;
 	}
 
       xfree (file_item->filename_out);
@@ -372,31 +417,51 @@ gpa_file_decrypt_operation_next (GpaFileDecryptOperation *op)
 {
   gpg_error_t err;
 
-  if (! GPA_FILE_OPERATION (op)->current)
+  for (;;)
     {
-      if (op->verify && op->signed_files)
-	{
-	  op->err = 0;
-	  gtk_widget_show_all (op->dialog);
-	}
-      else
-	g_signal_emit_by_name (GPA_OPERATION (op), "completed", 0);
-      return;
+      /* Skip all files which have already been processed.  */
+      while (GPA_FILE_OPERATION (op)->current
+             && gpa_file_operation_skip_file
+             (GPA_FILE_OPERATION (op), GPA_FILE_OPERATION (op)->current->data))
+        GPA_FILE_OPERATION (op)->current = g_list_next
+          (GPA_FILE_OPERATION (op)->current);
+
+      if (! GPA_FILE_OPERATION (op)->current)
+        {
+          err = gpa_file_operation_batch_error (GPA_FILE_OPERATION (op));
+          if (op->verify && op->signed_files)
+            {
+              op->err = err;
+              gtk_widget_show_all (op->dialog);
+            }
+          else
+            g_signal_emit_by_name (GPA_OPERATION (op), "completed", err);
+          return;
+        }
+
+      if (gpa_file_decrypt_operation_start_multifile (op))
+        return;
+
+      err = gpa_file_decrypt_operation_start
+        (op, GPA_FILE_OPERATION (op)->current->data);
+      if (!err)
+        return;
+      if (! gpa_file_operation_file_failed
+          (GPA_FILE_OPERATION (op), GPA_FILE_OPERATION (op)->current->data,
+           err))
+        break;
+      GPA_FILE_OPERATION (op)->current = g_list_next
+        (GPA_FILE_OPERATION (op)->current);
     }
 
-  err = gpa_file_decrypt_operation_start
-    (op, GPA_FILE_OPERATION (op)->current->data);
-  if (err)
+  if (op->verify && op->signed_files)
     {
-      if (op->verify && op->signed_files)
-	{
-	  /* All files have been verified: show the results dialog */
-	  op->err = err;
-	  gtk_widget_show_all (op->dialog);
-	}
-      else
-	g_signal_emit_by_name (GPA_OPERATION (op), "completed", err);
+      /* All files have been verified: show the results dialog */
+      op->err = err;
+      gtk_widget_show_all (op->dialog);
     }
+  else
+    g_signal_emit_by_name (GPA_OPERATION (op), "completed", err);
 }
 
 
@@ -407,6 +472,17 @@ gpa_file_decrypt_operation_done_cb (GpaContext *context,
 {
   gpa_file_item_t file_item = GPA_FILE_OPERATION (op)->current->data;
 
+  if (gpa_multifile_running (GPA_FILE_OPERATION (op)))
+    {
+      gtk_widget_hide (GPA_FILE_OPERATION (op)->progress_dialog);
+      err = gpa_multifile_finish (GPA_FILE_OPERATION (op), err);
+      if (err)
+        g_signal_emit_by_name (GPA_OPERATION (op), "completed", err);
+      else
+        gpa_file_decrypt_operation_next (op);
+      return;
+    }
+
   if (file_item->direct_in)
     {
       size_t len;
@@ -446,17 +522,24 @@ gpa_file_decrypt_operation_done_cb (GpaContext *context,
       if (! file_item->direct_in)
 	{
 	  /* If an error happened, (or the user canceled) delete the
-	     created file and abort further decryptions.  */
+	     created file and, unless told to continue on error,
+	     abort further decryptions.  */
 	  g_unlink (file_item->filename_out);
 	  g_free (file_item->filename_out);
 	  file_item->filename_out = NULL;
 	}
-      /* FIXME:CLIPBOARD: Server finish?  */
-      g_signal_emit_by_name (GPA_OPERATION (op), "completed", err);
+      if (! gpa_file_operation_file_failed (GPA_FILE_OPERATION (op),
+                                            file_item, err))
+        {
+          /* FIXME:CLIPBOARD: Server finish?  */
+          g_signal_emit_by_name (GPA_OPERATION (op), "completed", err);
+          return;
+        }
     }
   else
     {
       /* We've just created a file */
+      gpa_file_operation_file_done (GPA_FILE_OPERATION (op), file_item);
       g_signal_emit_by_name (GPA_OPERATION (op), "created_file", file_item);
 
       if (op->verify)
@@ -477,12 +560,12 @@ gpa_file_decrypt_operation_done_cb (GpaContext *context,
 	      op->signed_files++;
 	    }
 	}
-
-      /* Go to the next file in the list and decrypt it */
-      GPA_FILE_OPERATION (op)->current = g_list_next
-	(GPA_FILE_OPERATION (op)->current);
-      gpa_file_decrypt_operation_next (op);
     }
+
+  /* Go to the next file in the list and decrypt it */
+  GPA_FILE_OPERATION (op)->current = g_list_next
+    (GPA_FILE_OPERATION (op)->current);
+  gpa_file_decrypt_operation_next (op);
 }
 
 
@@ -503,6 +586,10 @@ gpa_file_decrypt_operation_done_error_cb (GpaContext *context, gpg_error_t err,
 {
   gpa_file_item_t file_item = GPA_FILE_OPERATION (op)->current->data;
 
+  /* The multi-file backend reports its own errors.  */
+  if (gpa_multifile_running (GPA_FILE_OPERATION (op)))
+    return;
+
   switch (gpg_err_code (err))
     {
     case GPG_ERR_NO_ERROR:
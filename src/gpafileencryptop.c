@@ -39,6 +39,7 @@
 #include "gpafileencryptop.h"
 #include "encryptdlg.h"
 #include "gpawidgets.h"
+#include "filetype.h"
 
 /* Internal functions */
 static void gpa_file_encrypt_operation_done_error_cb (GpaContext *context,
@@ -259,8 +260,46 @@ gpa_file_encrypt_operation_new_for_server (GList *files, void *server_ctx)
 }
 
 
+/* Set the compression policy of OP.  This preselects the policy in
+   the encrypt dialog.  */
+void
+gpa_file_encrypt_operation_set_compress (GpaFileEncryptOperation *op,
+                                         gpa_compress_policy_t policy)
+{
+  g_return_if_fail (GPA_IS_FILE_ENCRYPT_OPERATION (op));
+
+  gpa_file_encrypt_dialog_set_compress
+    (GPA_FILE_ENCRYPT_DIALOG (op->encrypt_dialog), policy);
+}
+
+
 /* Internal */
 
+/* Return true if FILE_ITEM shall be encrypted without compression.
+   Compressing data which is already compressed costs a lot of CPU
+   for no gain; thus in automatic mode the head of the data is
+   sampled.  */
+static gboolean
+skip_compression (GpaFileEncryptOperation *op, gpa_file_item_t file_item)
+{
+  switch (gpa_file_encrypt_dialog_get_compress
+          (GPA_FILE_ENCRYPT_DIALOG (op->encrypt_dialog)))
+    {
+    case GPA_COMPRESS_NEVER:
+      return TRUE;
+    case GPA_COMPRESS_ALWAYS:
+      return FALSE;
+    default:
+      break;
+    }
+
+  if (file_item->direct_in)
+    return is_incompressible_data (file_item->direct_in,
+                                   file_item->direct_in_len);
+  return is_incompressible_file (file_item->filename_in);
+}
+
+
 static gchar*
 destination_filename (const gchar *filename, gboolean armor)
 {
@@ -281,11 +320,78 @@ destination_filename (const gchar *filename, gboolean armor)
 }
 
 
+/* Classify FILE_ITEM for the multi-file backend.  gpg uses the same
+   output file names as we do.  Files to be encrypted without
+   compression are put into their own group.  */
+static int
+multifile_classify (GpaFileOperation *fop, gpa_file_item_t file_item,
+                    char **r_filename_out)
+{
+  GpaFileEncryptOperation *op = GPA_FILE_ENCRYPT_OPERATION (fop);
+
+  *r_filename_out = destination_filename
+    (file_item->filename_in,
+     gpgme_get_armor (GPA_OPERATION (op)->context->ctx));
+  return skip_compression (op, file_item)? 1 : 0;
+}
+
+
+/* Start a single gpg process for the next group of small files.
+   Returns false if the files shall be processed one by one.  */
+static gboolean
+gpa_file_encrypt_operation_start_multifile (GpaFileEncryptOperation *op)
+{
+  gpgme_ctx_t ctx = GPA_OPERATION (op)->context->ctx;
+  GList *items;
+  GPtrArray *args;
+  gpg_error_t err;
+  int klass, idx;
+
+  /* gpg can't sign with --encrypt-files and gpgsm has no such
+     mode.  */
+  if (gpa_file_encrypt_dialog_get_sign
+      (GPA_FILE_ENCRYPT_DIALOG (op->encrypt_dialog))
+      || gpgme_get_protocol (ctx) != GPGME_PROTOCOL_OpenPGP)
+    return FALSE;
+
+  items = gpa_multifile_select (GPA_FILE_OPERATION (op), multifile_classify,
+                                &klass);
+  if (!items)
+    return FALSE;
+
+  /* The keys have already been confirmed by the user.  */
+  args = g_ptr_array_new ();
+  g_ptr_array_add (args, "--always-trust");
+  if (gpgme_get_armor (ctx))
+    g_ptr_array_add (args, "--armor");
+  if (klass)
+    {
+      g_ptr_array_add (args, "--compress-algo");
+      g_ptr_array_add (args, "none");
+    }
+  for (idx = 0; op->rset && op->rset[idx]; idx++)
+    if (op->rset[idx]->subkeys && op->rset[idx]->subkeys->fpr)
+      {
+        g_ptr_array_add (args, "--recipient");
+        g_ptr_array_add (args, op->rset[idx]->subkeys->fpr);
+      }
+  g_ptr_array_add (args, NULL);
+
+  err = gpa_multifile_start (GPA_FILE_OPERATION (op), GPA_MULTIFILE_ENCRYPT,
+                             items, (const char **) args->pdata);
+  g_ptr_array_free (args, TRUE);
+  g_list_free (items);
+
+  return !err;
+}
+
+
 static gpg_error_t
 gpa_file_encrypt_operation_start (GpaFileEncryptOperation *op,
 				  gpa_file_item_t file_item)
 {
   gpg_error_t err;
+  gpgme_encrypt_flags_t flags;
 
   if (file_item->direct_in)
     {
@@ -321,17 +427,16 @@ gpa_file_encrypt_operation_start (GpaFileEncryptOperation *op,
 	/* FIXME: Error value.  */
 	return gpg_error (GPG_ERR_GENERAL);
 
-      op->cipher_fd = gpa_open_output (file_item->filename_out, &op->cipher,
-				       GPA_OPERATION (op)->window,
-                                       &filename_used);
+      op->cipher_fd = gpa_open_output_with_policy
+        (file_item->filename_out, &op->cipher, GPA_OPERATION (op)->window,
+         GPA_FILE_OPERATION (op)->conflict, &filename_used, &err);
       if (op->cipher_fd == -1)
 	{
 	  gpgme_data_release (op->plain);
 	  close (op->plain_fd);
 	  op->plain_fd = -1;
           xfree (filename_used);
-	  /* FIXME: Error value.  */
-	  return gpg_error (GPG_ERR_GENERAL);
+	  return err;
 	}
 
       xfree (file_item->filename_out);
@@ -341,14 +446,17 @@ gpa_file_encrypt_operation_start (GpaFileEncryptOperation *op,
   /* Start the operation.  */
   /* Always trust keys, because any untrusted keys were already
      confirmed by the user.  */
+  flags = GPGME_ENCRYPT_ALWAYS_TRUST;
+  if (skip_compression (op, file_item))
+    flags |= GPGME_ENCRYPT_NO_COMPRESS;
   if (gpa_file_encrypt_dialog_get_sign
       (GPA_FILE_ENCRYPT_DIALOG (op->encrypt_dialog)))
     err = gpgme_op_encrypt_sign_start (GPA_OPERATION (op)->context->ctx,
-				       op->rset, GPGME_ENCRYPT_ALWAYS_TRUST,
+				       op->rset, flags,
 				       op->plain, op->cipher);
   else
     err = gpgme_op_encrypt_start (GPA_OPERATION (op)->context->ctx,
-				  op->rset, GPGME_ENCRYPT_ALWAYS_TRUST,
+				  op->rset, flags,
 				  op->plain, op->cipher);
 
   if (err)
@@ -382,16 +490,40 @@ gpa_file_encrypt_operation_next (GpaFileEncryptOperation *op)
 {
   gpg_error_t err;
 
-  if (! GPA_FILE_OPERATION (op)->current)
+  for (;;)
     {
-      g_signal_emit_by_name (GPA_OPERATION (op), "completed", 0);
-      return;
-    }
+      /* Skip all files which have already been processed.  */
+      while (GPA_FILE_OPERATION (op)->current
+             && gpa_file_operation_skip_file
+             (GPA_FILE_OPERATION (op), GPA_FILE_OPERATION (op)->current->data))
+        GPA_FILE_OPERATION (op)->current = g_list_next
+          (GPA_FILE_OPERATION (op)->current);
+
+      if (! GPA_FILE_OPERATION (op)->current)
+        {
+          g_signal_emit_by_name
+            (GPA_OPERATION (op), "completed",
+             gpa_file_operation_batch_error (GPA_FILE_OPERATION (op)));
+          return;
+        }
 
-  err = gpa_file_encrypt_operation_start
-    (op, GPA_FILE_OPERATION (op)->current->data);
-  if (err)
-    g_signal_emit_by_name (GPA_OPERATION (op), "completed", err);
+      if (gpa_file_encrypt_operation_start_multifile (op))
+        return;
+
+      err = gpa_file_encrypt_operation_start
+        (op, GPA_FILE_OPERATION (op)->current->data);
+      if (!err)
+        return;
+      if (! gpa_file_operation_file_failed
+          (GPA_FILE_OPERATION (op), GPA_FILE_OPERATION (op)->current->data,
+           err))
+        {
+          g_signal_emit_by_name (GPA_OPERATION (op), "completed", err);
+          return;
+        }
+      GPA_FILE_OPERATION (op)->current = g_list_next
+        (GPA_FILE_OPERATION (op)->current);
+    }
 }
 
 
@@ -402,6 +534,17 @@ gpa_file_encrypt_operation_done_cb (GpaContext *context,
 {
   gpa_file_item_t file_item = GPA_FILE_OPERATION (op)->current->data;
 
+  if (gpa_multifile_running (GPA_FILE_OPERATION (op)))
+    {
+      gtk_widget_hide (GPA_FILE_OPERATION (op)->progress_dialog);
+      err = gpa_multifile_finish (GPA_FILE_OPERATION (op), err);
+      if (err)
+        g_signal_emit_by_name (GPA_OPERATION (op), "completed", err);
+      else
+        gpa_file_encrypt_operation_next (op);
+      return;
+    }
+
   if (file_item->direct_in)
     {
       size_t len;
@@ -443,23 +586,30 @@ gpa_file_encrypt_operation_done_cb (GpaContext *context,
       if (! file_item->direct_in)
 	{
 	  /* If an error happened, (or the user canceled) delete the
-	    created file and abort further encryptions.  */
+	     created file and, unless told to continue on error,
+	     abort further encryptions.  */
 	  g_unlink (file_item->filename_out);
 	  g_free (file_item->filename_out);
 	  file_item->filename_out = NULL;
 	}
-      g_signal_emit_by_name (GPA_OPERATION (op), "completed", err);
+      if (! gpa_file_operation_file_failed (GPA_FILE_OPERATION (op),
+                                            file_item, err))
+        {
+          g_signal_emit_by_name (GPA_OPERATION (op), "completed", err);
+          return;
+        }
     }
   else
     {
       /* We've just created a file */
+      gpa_file_operation_file_done (GPA_FILE_OPERATION (op), file_item);
       g_signal_emit_by_name (GPA_OPERATION (op), "created_file", file_item);
-
-      /* Go to the next file in the list and encrypt it */
-      GPA_FILE_OPERATION (op)->current = g_list_next
-	(GPA_FILE_OPERATION (op)->current);
-      gpa_file_encrypt_operation_next (op);
     }
+
+  /* Go to the next file in the list and encrypt it */
+  GPA_FILE_OPERATION (op)->current = g_list_next
+    (GPA_FILE_OPERATION (op)->current);
+  gpa_file_encrypt_operation_next (op);
 }
 
 /*
@@ -749,6 +899,24 @@ static void gpa_file_encrypt_operation_response_cb (GtkDialog *dialog,
       if (success)
 	success = set_recipients (op, recipients);
 
+      /* Everything which affects the output goes into the manifest
+         so that a change of any parameter re-encrypts all files.  */
+      if (success)
+        {
+          char *params;
+
+          params = g_strdup_printf
+            ("encrypt armor=%d sign=%d protocol=%d compress=%d", armor,
+             gpa_file_encrypt_dialog_get_sign
+             (GPA_FILE_ENCRYPT_DIALOG (op->encrypt_dialog)),
+             gpgme_get_protocol (GPA_OPERATION (op)->context->ctx),
+             gpa_file_encrypt_dialog_get_compress
+             (GPA_FILE_ENCRYPT_DIALOG (op->encrypt_dialog)));
+          gpa_file_operation_set_manifest_params (GPA_FILE_OPERATION (op),
+                                                  op->rset, params);
+          g_free (params);
+        }
+
       /* Actually run the operation or abort.  */
       if (success)
 	gpa_file_encrypt_operation_next (op);
@@ -772,6 +940,10 @@ static void
 gpa_file_encrypt_operation_done_error_cb (GpaContext *context, gpg_error_t err,
 					  GpaFileEncryptOperation *op)
 {
+  /* The multi-file backend reports its own errors.  */
+  if (gpa_multifile_running (GPA_FILE_OPERATION (op)))
+    return;
+
   switch (gpg_err_code (err))
     {
     case GPG_ERR_NO_ERROR:
@@ -86,4 +86,8 @@ GpaFileEncryptOperation *gpa_file_encrypt_sign_operation_new
 GpaFileEncryptOperation*
 gpa_file_encrypt_operation_new_for_server (GList *files, void *server_ctx);
 
+/* Set the compression policy of OP.  */
+void gpa_file_encrypt_operation_set_compress (GpaFileEncryptOperation *op,
+                                              gpa_compress_policy_t policy);
+
 #endif
@@ -106,6 +106,10 @@ gpa_file_operation_finalize (GObject *object)
   g_list_foreach (op->input_files, (GFunc) free_file_item, NULL);
   g_list_free (op->input_files);
   gtk_widget_destroy (op->progress_dialog);
+  gpa_manifest_release (op->manifest);
+  g_free (op->manifest_params);
+  gpa_journal_close (op->journal, FALSE);
+  gpa_multifile_release (op->multifile);
   
   G_OBJECT_CLASS (parent_class)->finalize (object);
 }
@@ -116,6 +120,14 @@ gpa_file_operation_init (GpaFileOperation *op)
   op->input_files = NULL;
   op->current = NULL;
   op->progress_dialog = NULL;
+  op->manifest = NULL;
+  op->manifest_params = NULL;
+  op->journal = NULL;
+  op->journal_temporary = FALSE;
+  op->continue_on_error = FALSE;
+  op->batch_err = 0;
+  op->multifile = NULL;
+  op->conflict = GPA_CONFLICT_ASK;
 }
 
 static GObject*
@@ -138,6 +150,27 @@ gpa_file_operation_constructor (GType type,
   return object;
 }
 
+/* Default handler for the "completed" signal.  Write the manifest so
+   that it is up to date even if the operation is kept around.  A
+   temporary journal is not needed anymore after a successful run.
+   After a failure or when canceled it is kept, so that the remaining
+   and the failed files can be processed by resuming the operation.
+   A journal is only written once the first file has been processed,
+   thus canceling before that leaves nothing behind.  */
+static void
+gpa_file_operation_completed (GpaOperation *operation, gpg_error_t err)
+{
+  GpaFileOperation *op = GPA_FILE_OPERATION (operation);
+
+  gpa_manifest_commit (op->manifest);
+  if (op->journal && op->journal_temporary && !err)
+    {
+      gpa_journal_close (op->journal, TRUE);
+      op->journal = NULL;
+    }
+}
+
+
 static void
 gpa_file_operation_class_init (GpaFileOperationClass *klass)
 {
@@ -150,6 +183,7 @@ gpa_file_operation_class_init (GpaFileOperationClass *klass)
   object_class->set_property = gpa_file_operation_set_property;
   object_class->get_property = gpa_file_operation_get_property;
 
+  GPA_OPERATION_CLASS (klass)->completed = gpa_file_operation_completed;
   klass->created_file = NULL;
 
   /* Signals */
@@ -230,3 +264,197 @@ gpa_file_operation_current_file (GpaFileOperation *op)
   else
     return NULL;
 }
+
+
+/* Use the manifest FILENAME to skip input files which have not
+   changed since the last run with the same parameters.  */
+void
+gpa_file_operation_set_manifest (GpaFileOperation *op, const char *filename)
+{
+  g_return_if_fail (op != NULL);
+  g_return_if_fail (GPA_IS_FILE_OPERATION (op));
+
+  gpa_manifest_release (op->manifest);
+  op->manifest = filename? gpa_manifest_new (filename) : NULL;
+}
+
+
+/* Set the parameters of this run.  KEYS is the NULL terminated array
+   of recipients or NULL, the signers are taken from the context and
+   PARAMS describes all other options which affect the output.  */
+void
+gpa_file_operation_set_manifest_params (GpaFileOperation *op,
+                                        gpgme_key_t *keys,
+                                        const char *params)
+{
+  g_return_if_fail (op != NULL);
+  g_return_if_fail (GPA_IS_FILE_OPERATION (op));
+
+  if (!op->manifest)
+    return;
+
+  g_free (op->manifest_params);
+  op->manifest_params
+    = gpa_manifest_hash_params (GPA_OPERATION (op)->context->ctx,
+                                keys, params);
+}
+
+
+/* Keep an append-only journal FILENAME of the finished files for the
+   operation KIND.  With RESUME set, files already finished according
+   to an existing journal are skipped.  With TEMPORARY set, the
+   journal is deleted if the operation completes without error.  */
+gpg_error_t
+gpa_file_operation_set_journal (GpaFileOperation *op, const char *filename,
+                                const char *kind, gboolean resume,
+                                gboolean temporary)
+{
+  g_return_val_if_fail (op != NULL, gpg_error (GPG_ERR_INV_VALUE));
+  g_return_val_if_fail (GPA_IS_FILE_OPERATION (op),
+                        gpg_error (GPG_ERR_INV_VALUE));
+
+  gpa_journal_close (op->journal, FALSE);
+  op->journal = NULL;
+  if (!filename)
+    return 0;
+
+  op->journal = gpa_journal_open (filename, kind, op->input_files, resume);
+  if (!op->journal)
+    return gpg_error (GPG_ERR_GENERAL);
+  op->journal_temporary = temporary;
+  return 0;
+}
+
+
+/* Like gpa_file_operation_set_journal but use the already opened
+   JOURNAL, which is then owned by OP.  */
+void
+gpa_file_operation_take_journal (GpaFileOperation *op,
+                                 gpa_journal_t journal, gboolean temporary)
+{
+  g_return_if_fail (op != NULL);
+  g_return_if_fail (GPA_IS_FILE_OPERATION (op));
+
+  gpa_journal_close (op->journal, FALSE);
+  op->journal = journal;
+  op->journal_temporary = temporary;
+}
+
+
+/* Do not abort the remaining files if one file fails.  */
+void
+gpa_file_operation_set_continue_on_error (GpaFileOperation *op,
+                                          gboolean value)
+{
+  g_return_if_fail (op != NULL);
+  g_return_if_fail (GPA_IS_FILE_OPERATION (op));
+
+  op->continue_on_error = value;
+}
+
+
+/* Set the POLICY for output files which already exist.  */
+void
+gpa_file_operation_set_conflict_policy (GpaFileOperation *op,
+                                        gpa_conflict_policy_t policy)
+{
+  g_return_if_fail (op != NULL);
+  g_return_if_fail (GPA_IS_FILE_OPERATION (op));
+
+  op->conflict = policy;
+}
+
+
+/* Return true if FILE_ITEM can be skipped because it has already been
+   processed, either in an interrupted run recorded in the journal or
+   in an earlier run with unchanged input recorded in the manifest.
+   In the latter case its output file name is set.  */
+gboolean
+gpa_file_operation_skip_file (GpaFileOperation *op,
+                              gpa_file_item_t file_item)
+{
+  char *filename_out;
+
+  g_return_val_if_fail (op != NULL, FALSE);
+  g_return_val_if_fail (GPA_IS_FILE_OPERATION (op), FALSE);
+
+  if (file_item->direct_in)
+    return FALSE;
+
+  if (gpa_multifile_is_finished (op, file_item))
+    return TRUE;
+
+  if (gpa_journal_is_done (op->journal, file_item->filename_in))
+    return TRUE;
+
+  if (!op->manifest
+      || !gpa_manifest_is_unchanged (op->manifest, file_item->filename_in,
+                                     op->manifest_params, &filename_out))
+    return FALSE;
+
+  g_free (file_item->filename_out);
+  file_item->filename_out = filename_out;
+  return TRUE;
+}
+
+
+/* Record that FILE_ITEM has been processed successfully.  */
+void
+gpa_file_operation_file_done (GpaFileOperation *op,
+                              gpa_file_item_t file_item)
+{
+  g_return_if_fail (op != NULL);
+  g_return_if_fail (GPA_IS_FILE_OPERATION (op));
+
+  if (file_item->direct_in)
+    return;
+
+  if (op->manifest)
+    gpa_manifest_update (op->manifest, file_item->filename_in,
+                         op->manifest_params, file_item->filename_out);
+  gpa_journal_record_done (op->journal, file_item->filename_in,
+                           file_item->filename_out);
+}
+
+
+/* Record that processing FILE_ITEM failed with ERR.  Returns true if
+   the operation shall continue with the next file.  A canceled
+   operation never continues; a file skipped due to the conflict
+   policy always does.  */
+gboolean
+gpa_file_operation_file_failed (GpaFileOperation *op,
+                                gpa_file_item_t file_item, gpg_error_t err)
+{
+  g_return_val_if_fail (op != NULL, FALSE);
+  g_return_val_if_fail (GPA_IS_FILE_OPERATION (op), FALSE);
+
+  /* An existing output file with the skip policy is not an error;
+     the input file is simply not processed.  */
+  if (gpg_err_code (err) == GPG_ERR_EEXIST
+      && op->conflict == GPA_CONFLICT_SKIP)
+    return TRUE;
+
+  if (!file_item->direct_in)
+    gpa_journal_record_failure (op->journal, file_item->filename_in, err);
+
+  if (!op->continue_on_error || gpg_err_code (err) == GPG_ERR_CANCELED)
+    return FALSE;
+
+  if (!op->batch_err)
+    op->batch_err = err;
+  return TRUE;
+}
+
+
+/* Return the error to be used for the "completed" signal after the
+   last file has been processed.  This is the first error which did
+   not abort the operation.  */
+gpg_error_t
+gpa_file_operation_batch_error (GpaFileOperation *op)
+{
+  g_return_val_if_fail (op != NULL, gpg_error (GPG_ERR_INV_VALUE));
+  g_return_val_if_fail (GPA_IS_FILE_OPERATION (op),
+                        gpg_error (GPG_ERR_INV_VALUE));
+
+  return op->batch_err;
+}
@@ -27,6 +27,9 @@
 #include <glib-object.h>
 #include "gpaoperation.h"
 #include "gpaprogressdlg.h"
+#include "filemanifest.h"
+#include "filejournal.h"
+#include "filemulti.h"
 
 /* GObject stuff */
 #define GPA_FILE_OPERATION_TYPE	  (gpa_file_operation_get_type ())
@@ -63,6 +66,28 @@ struct _GpaFileOperation {
   GList *input_files;
   GList *current;
   GtkWidget *progress_dialog;
+
+  /* If not NULL, the manifest used to skip unchanged files.  */
+  gpa_manifest_t manifest;
+  /* The hash over the parameters of this run as stored in the
+     manifest.  */
+  char *manifest_params;
+
+  /* If not NULL, the journal recording the finished files.  */
+  gpa_journal_t journal;
+  /* Delete the journal if the operation completes without error.  */
+  gboolean journal_temporary;
+
+  /* If set, a failed file does not abort the remaining files.  */
+  gboolean continue_on_error;
+  /* The first error seen with CONTINUE_ON_ERROR set.  */
+  gpg_error_t batch_err;
+
+  /* The state of the multi-file backend or NULL.  */
+  gpa_multifile_t multifile;
+
+  /* What to do if an output file already exists.  */
+  gpa_conflict_policy_t conflict;
 };
 
 struct _GpaFileOperationClass {
@@ -88,4 +113,75 @@ gpa_file_operation_input_files (GpaFileOperation *op);
 const gchar *
 gpa_file_operation_current_file (GpaFileOperation *op);
 
+/* Use the manifest FILENAME to skip input files which have not
+   changed since the last run with the same parameters.
+ */
+void
+gpa_file_operation_set_manifest (GpaFileOperation *op, const char *filename);
+
+/* Set the parameters of this run.  Must be called before the first
+   file is processed.
+ */
+void
+gpa_file_operation_set_manifest_params (GpaFileOperation *op,
+                                        gpgme_key_t *keys,
+                                        const char *params);
+
+/* Keep an append-only journal FILENAME of the finished files for the
+   operation KIND.  With RESUME set, files already finished according
+   to an existing journal are skipped.  With TEMPORARY set, the
+   journal is deleted if the operation completes without error;
+   after a failure or when canceled it is kept for resuming.
+ */
+gpg_error_t
+gpa_file_operation_set_journal (GpaFileOperation *op, const char *filename,
+                                const char *kind, gboolean resume,
+                                gboolean temporary);
+
+/* Like gpa_file_operation_set_journal but use the already opened
+   JOURNAL, which is then owned by OP.
+ */
+void
+gpa_file_operation_take_journal (GpaFileOperation *op,
+                                 gpa_journal_t journal, gboolean temporary);
+
+/* Do not abort the remaining files if one file fails.
+ */
+void
+gpa_file_operation_set_continue_on_error (GpaFileOperation *op,
+                                          gboolean value);
+
+/* Set the POLICY for output files which already exist.  The default
+   is to ask the user.
+ */
+void
+gpa_file_operation_set_conflict_policy (GpaFileOperation *op,
+                                        gpa_conflict_policy_t policy);
+
+/* Return true if FILE_ITEM can be skipped because it has already been
+   processed.  In that case its output file name is set.
+ */
+gboolean
+gpa_file_operation_skip_file (GpaFileOperation *op,
+                              gpa_file_item_t file_item);
+
+/* Record that FILE_ITEM has been processed successfully.
+ */
+void
+gpa_file_operation_file_done (GpaFileOperation *op,
+                              gpa_file_item_t file_item);
+
+/* Record that processing FILE_ITEM failed with ERR.  Returns true if
+   the operation shall continue with the next file.
+ */
+gboolean
+gpa_file_operation_file_failed (GpaFileOperation *op,
+                                gpa_file_item_t file_item, gpg_error_t err);
+
+/* Return the error to be used for the "completed" signal after the
+   last file has been processed.
+ */
+gpg_error_t
+gpa_file_operation_batch_error (GpaFileOperation *op);
+
 #endif
@@ -298,16 +298,15 @@ gpa_file_sign_operation_start (GpaFileSignOperation *op,
 	/* FIXME: Error value.  */
 	return gpg_error (GPG_ERR_GENERAL);
 
-      op->sig_fd = gpa_open_output (file_item->filename_out, &op->sig,
-				    GPA_OPERATION (op)->window,
-                                    &filename_used);
+      op->sig_fd = gpa_open_output_with_policy
+        (file_item->filename_out, &op->sig, GPA_OPERATION (op)->window,
+         GPA_FILE_OPERATION (op)->conflict, &filename_used, &err);
       if (op->sig_fd == -1)
 	{
 	  gpgme_data_release (op->plain);
 	  close (op->plain_fd);
           xfree (filename_used);
-	  /* FIXME: Error value.  */
-	  return gpg_error (GPG_ERR_GENERAL);
+	  return err;
 	}
 
       xfree (file_item->filename_out);
@@ -339,16 +338,37 @@ gpa_file_sign_operation_next (GpaFileSignOperation *op)
 {
   gpg_error_t err;
 
-  if (! GPA_FILE_OPERATION (op)->current)
+  for (;;)
     {
-      g_signal_emit_by_name (GPA_OPERATION (op), "completed", 0);
-      return;
-    }
+      /* Skip all files which have already been processed.  */
+      while (GPA_FILE_OPERATION (op)->current
+             && gpa_file_operation_skip_file
+             (GPA_FILE_OPERATION (op), GPA_FILE_OPERATION (op)->current->data))
+        GPA_FILE_OPERATION (op)->current = g_list_next
+          (GPA_FILE_OPERATION (op)->current);
+
+      if (! GPA_FILE_OPERATION (op)->current)
+        {
+          g_signal_emit_by_name
+            (GPA_OPERATION (op), "completed",
+             gpa_file_operation_batch_error (GPA_FILE_OPERATION (op)));
+          return;
+        }
 
-  err = gpa_file_sign_operation_start (op,
-				       GPA_FILE_OPERATION (op)->current->data);
-  if (err)
-    g_signal_emit_by_name (GPA_OPERATION (op), "completed", err);
+      err = gpa_file_sign_operation_start
+        (op, GPA_FILE_OPERATION (op)->current->data);
+      if (!err)
+        return;
+      if (! gpa_file_operation_file_failed
+          (GPA_FILE_OPERATION (op), GPA_FILE_OPERATION (op)->current->data,
+           err))
+        {
+          g_signal_emit_by_name (GPA_OPERATION (op), "completed", err);
+          return;
+        }
+      GPA_FILE_OPERATION (op)->current = g_list_next
+        (GPA_FILE_OPERATION (op)->current);
+    }
 }
 
 
@@ -400,21 +420,29 @@ gpa_file_sign_operation_done_cb (GpaContext *context,
 	{
 	  /* If an error happened, (or the user canceled) delete the
 	     created file and abort further signions.  */
-	  g_unlink (op->sig_filename);
-	  g_free (op->sig_filename);
+	  g_unlink (file_item->filename_out);
+	  g_free (file_item->filename_out);
+	  file_item->filename_out = NULL;
 	}
-      g_signal_emit_by_name (GPA_OPERATION (op), "completed", err);
+      if (! gpa_file_operation_file_failed (GPA_FILE_OPERATION (op),
+                                            file_item, err))
+        {
+          g_signal_emit_by_name (GPA_OPERATION (op), "completed", err);
+          return;
+        }
     }
   else
     {
       /* We've just created a file */
+      gpa_file_operation_file_done (GPA_FILE_OPERATION (op), file_item);
       g_signal_emit_by_name (GPA_OPERATION (op), "created_file",
 			     file_item);
-      /* Go to the next file in the list and sign it */
-      GPA_FILE_OPERATION (op)->current = g_list_next
-	(GPA_FILE_OPERATION (op)->current);
-      gpa_file_sign_operation_next (op);
     }
+
+  /* Go to the next file in the list and sign it */
+  GPA_FILE_OPERATION (op)->current = g_list_next
+    (GPA_FILE_OPERATION (op)->current);
+  gpa_file_sign_operation_next (op);
 }
 
 
@@ -497,6 +525,18 @@ gpa_file_sign_operation_response_cb (GtkDialog *dialog,
       gpgme_set_armor (GPA_OPERATION (op)->context->ctx, armor);
       /* Set the signers for the context */
       success = set_signers (op, signers);
+      /* Everything which affects the output goes into the manifest.  */
+      if (success)
+        {
+          char *params;
+
+          params = g_strdup_printf
+            ("sign armor=%d mode=%d protocol=%d", armor, op->sign_type,
+             gpgme_get_protocol (GPA_OPERATION (op)->context->ctx));
+          gpa_file_operation_set_manifest_params (GPA_FILE_OPERATION (op),
+                                                  NULL, params);
+          g_free (params);
+        }
       /* Actually run the operation or abort.  */
       if (success)
 	gpa_file_sign_operation_next (op);
@@ -119,6 +119,21 @@ gpa_import_bykeyid_operation_get_type (void)
 }
 
 
+/* Internal */
+
+static void
+get_key_done_cb (gpg_error_t err, gpgme_data_t data, gpointer opaque)
+{
+  GpaImportOperation *operation = opaque;
+
+  if (!err)
+    operation->source = data;
+  else
+    gpgme_data_release (data);
+  gpa_import_operation_source_ready (operation, err);
+}
+
+
 /* Virtual methods */
 
 static gboolean
@@ -153,14 +168,16 @@ gpa_import_bykeyid_operation_get_source (GpaImportOperation *operation)
     }
   else
     {
-
+      operation->source_pending = TRUE;
       if (server_get_key (gpa_options_get_default_keyserver
 			  (gpa_options_get_instance ()),
 			  op->key->subkeys->keyid,
-                          &operation->source, GPA_OPERATION (op)->window))
+                          GPA_OPERATION (op)->window,
+                          get_key_done_cb, op))
 	{
 	  return TRUE;
 	}
+      operation->source_pending = FALSE;
     }
   return FALSE;
 }
@@ -23,11 +23,16 @@
 
 #include <gpgme.h>
 #include <unistd.h>
+#include <sys/stat.h>
 #include "gpa.h"
 #include "i18n.h"
 #include "gtktools.h"
+#include "filetype.h"
 #include "gpaimportfileop.h"
 
+/* Files of at least this size are imported in chunks.  */
+#define BULK_IMPORT_THRESHOLD (16 * 1024 * 1024)
+
 static GObjectClass *parent_class = NULL;
 
 static gboolean
@@ -151,6 +156,17 @@ gpa_import_file_operation_get_source (GpaImportOperation *operation)
                                       GPA_OPERATION (op)->window)) == -1);
   gtk_widget_destroy (dialog);
 
+  /* Large keyrings are imported in chunks.  */
+  if (response == GTK_RESPONSE_OK)
+    {
+      struct stat st;
+
+      if (!fstat (op->fd, &st) && st.st_size >= BULK_IMPORT_THRESHOLD
+          && !is_cms_file (op->file))
+        gpa_import_operation_set_bulk_source (operation, op->fd,
+                                              st.st_size);
+    }
+
   return (response == GTK_RESPONSE_OK);
 }
 
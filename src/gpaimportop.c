@@ -28,6 +28,14 @@
 #include "filetype.h"
 #include "gpgmetools.h"
 
+/* The size of the chunks of a bulk import.  */
+#define BULK_CHUNK_SIZE (4 * 1024 * 1024)
+
+/* The maximum number of changed keys for which the key list is
+   updated key by key after a bulk import.  With more changed keys
+   the whole list is reloaded.  */
+#define BULK_REFRESH_LIMIT 1000
+
 static GObjectClass *parent_class = NULL;
 
 /* Signals */
@@ -35,6 +43,7 @@ enum
 {
   IMPORTED_KEYS,
   IMPORTED_SECRET_KEYS,
+  UPDATED_KEYS,
   LAST_SIGNAL
 };
 static guint signals [LAST_SIGNAL] = { 0 };
@@ -64,6 +73,11 @@ gpa_import_operation_finalize (GObject *object)
       g_free (op->source2);
       op->source2 = NULL;
     }
+  gpa_key_chunker_release (op->chunker);
+  if (op->changed)
+    g_hash_table_destroy (op->changed);
+  if (op->progress_dialog)
+    gtk_widget_destroy (op->progress_dialog);
 
   G_OBJECT_CLASS (parent_class)->finalize (object);
 }
@@ -73,6 +87,15 @@ gpa_import_operation_init (GpaImportOperation *op)
 {
   op->source = NULL;
   op->source2 = NULL;
+  op->source_pending = FALSE;
+  op->chunker = NULL;
+  op->chunker_size = 0;
+  op->progress_dialog = NULL;
+  memset (&op->counters, 0, sizeof op->counters);
+  op->changed = NULL;
+  op->too_many = FALSE;
+  op->canceled = FALSE;
+  op->bulk_err = 0;
 }
 
 static GObject*
@@ -132,6 +155,15 @@ gpa_import_operation_class_init (GpaImportOperationClass *klass)
 		  NULL, NULL,
 		  g_cclosure_marshal_VOID__VOID,
 		  G_TYPE_NONE, 0);
+  klass->updated_keys = NULL;
+  signals[UPDATED_KEYS] =
+    g_signal_new ("updated_keys",
+		  G_TYPE_FROM_CLASS (object_class),
+		  G_SIGNAL_RUN_FIRST,
+		  G_STRUCT_OFFSET (GpaImportOperationClass, updated_keys),
+		  NULL, NULL,
+		  g_cclosure_marshal_VOID__POINTER,
+		  G_TYPE_NONE, 1, G_TYPE_POINTER);
 
 }
 
@@ -165,39 +197,223 @@ gpa_import_operation_get_type (void)
 
 /* Private functions */
 
+static void
+bulk_update_progress (GpaImportOperation *op)
+{
+  GtkProgressBar *pbar;
+  guint64 offset;
+  char *text;
+
+  pbar = GTK_PROGRESS_BAR (GPA_PROGRESS_DIALOG (op->progress_dialog)->pbar);
+  offset = gpa_key_chunker_get_offset (op->chunker);
+  text = g_strdup_printf (_("%i keys read, %i imported, %i unchanged"),
+                          op->counters.considered, op->counters.imported,
+                          op->counters.unchanged);
+  gtk_progress_bar_set_text (pbar, text);
+  if (op->chunker_size)
+    gtk_progress_bar_set_fraction (pbar, MIN (1.0, (double) offset
+                                              / op->chunker_size));
+  g_free (text);
+}
+
+
+static void
+bulk_finish (GpaImportOperation *op, gpg_error_t err)
+{
+  gtk_widget_hide (op->progress_dialog);
+  if (op->bulk_err && !op->canceled)
+    gpa_gpgme_warn (op->bulk_err, NULL, GPA_OPERATION (op)->context);
+
+  GPA_IMPORT_OPERATION_GET_CLASS (op)->complete_import (op);
+
+  /* Secret keys change more than the key list, thus reload it.  */
+  if (op->counters.secret_imported)
+    g_signal_emit_by_name (GPA_OPERATION (op), "imported_secret_keys");
+  else if (op->too_many)
+    g_signal_emit_by_name (GPA_OPERATION (op), "imported_keys");
+  else if (g_hash_table_size (op->changed))
+    {
+      const char **fprs;
+
+      fprs = (const char **) g_hash_table_get_keys_as_array (op->changed,
+                                                             NULL);
+      g_signal_emit_by_name (GPA_OPERATION (op), "updated_keys", fprs);
+      g_free (fprs);
+    }
+
+  if (!op->canceled || op->counters.considered)
+    gpa_gpgme_show_import_results (GPA_OPERATION (op)->window,
+                                   &op->counters);
+  g_signal_emit_by_name (GPA_OPERATION (op), "completed", err);
+}
+
+
+/* Start the import of the next chunk of a bulk import.  */
+static void
+bulk_import_next (GpaImportOperation *op)
+{
+  gpg_error_t err;
+  gpgme_data_t data;
+
+  if (op->canceled)
+    {
+      bulk_finish (op, gpg_error (GPG_ERR_CANCELED));
+      return;
+    }
+
+  err = gpa_key_chunker_next (op->chunker, &data);
+  if (gpg_err_code (err) == GPG_ERR_EOF)
+    {
+      bulk_finish (op, 0);
+      return;
+    }
+  if (!err)
+    {
+      gpgme_data_release (op->source);
+      op->source = data;
+      err = gpgme_op_import_start (GPA_OPERATION (op)->context->ctx,
+                                   op->source);
+    }
+  if (err)
+    {
+      gpa_gpgme_warning (err);
+      bulk_finish (op, err);
+      return;
+    }
+  bulk_update_progress (op);
+}
+
+
+static void
+bulk_chunk_done (GpaImportOperation *op, gpg_error_t err)
+{
+  gpgme_import_result_t res;
+  gpgme_import_status_t imp;
+
+  if (gpg_err_code (err) == GPG_ERR_CANCELED)
+    {
+      bulk_finish (op, err);
+      return;
+    }
+
+  /* A bad chunk does not stop the import; the first error is shown
+     at the end.  */
+  if (err)
+    {
+      if (!op->bulk_err)
+        op->bulk_err = err;
+    }
+  else
+    {
+      res = gpgme_op_import_result (GPA_OPERATION (op)->context->ctx);
+      gpa_gpgme_update_import_results (&op->counters, 0, 0, res);
+      for (imp = res->imports; imp && !op->too_many; imp = imp->next)
+        if (!imp->result && imp->status && imp->fpr)
+          {
+            g_hash_table_add (op->changed, g_strdup (imp->fpr));
+            if (g_hash_table_size (op->changed) > BULK_REFRESH_LIMIT)
+              op->too_many = TRUE;
+          }
+    }
+
+  bulk_update_progress (op);
+  bulk_import_next (op);
+}
+
+
+static void
+bulk_response_cb (GtkDialog *dialog, gint response, GpaImportOperation *op)
+{
+  if (op->canceled)
+    return;
+  op->canceled = TRUE;
+
+  /* Cancelling may complete the operation right away.  */
+  g_object_ref (op);
+  if (gpa_context_busy (GPA_OPERATION (op)->context))
+    gpgme_cancel (GPA_OPERATION (op)->context->ctx);
+  g_object_unref (op);
+}
+
+
+static void
+bulk_start (GpaImportOperation *op)
+{
+  gpgme_ctx_t ctx = GPA_OPERATION (op)->context->ctx;
+
+  gpgme_set_protocol (ctx, GPGME_PROTOCOL_OpenPGP);
+  /* Do not check the trustdb after each chunk.  Listing the changed
+     keys at the end does a single check.  Older versions of gpgme
+     do not know this flag.  */
+  gpgme_set_ctx_flag (ctx, "no-auto-check-trustdb", "1");
+
+  op->changed = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                       g_free, NULL);
+
+  op->progress_dialog = gpa_progress_dialog_new (GPA_OPERATION (op)->window,
+                                                 NULL);
+  gpa_progress_dialog_set_label (GPA_PROGRESS_DIALOG (op->progress_dialog),
+                                 _("Importing keys..."));
+  gtk_progress_bar_set_show_text
+    (GTK_PROGRESS_BAR (GPA_PROGRESS_DIALOG (op->progress_dialog)->pbar), TRUE);
+  gtk_dialog_set_response_sensitive (GTK_DIALOG (op->progress_dialog),
+                                     GTK_RESPONSE_CANCEL, TRUE);
+  g_signal_connect (G_OBJECT (op->progress_dialog), "response",
+                    G_CALLBACK (bulk_response_cb), op);
+  gtk_widget_show_all (op->progress_dialog);
+
+  bulk_import_next (op);
+}
+
+
+static void
+gpa_import_operation_start (GpaImportOperation *op)
+{
+  gpg_error_t err;
+
+  if (op->chunker)
+    {
+      bulk_start (op);
+      return;
+    }
+
+  if (op->source)
+    {
+      gpgme_set_protocol (GPA_OPERATION (op)->context->ctx,
+                          is_cms_data_ext (op->source)?
+                          GPGME_PROTOCOL_CMS : GPGME_PROTOCOL_OpenPGP);
+      err = gpgme_op_import_start (GPA_OPERATION (op)->context->ctx,
+                                   op->source);
+    }
+  else if (op->source2)
+    {
+      /* The only protocol where an array of keys is used in GPA
+         is OpenPGP.  */
+      gpgme_set_protocol (GPA_OPERATION (op)->context->ctx,
+                          GPGME_PROTOCOL_OpenPGP);
+      err = gpgme_op_import_keys_start (GPA_OPERATION (op)->context->ctx,
+                                        op->source2);
+    }
+  else
+    err = gpg_error (GPG_ERR_BUG);
+  if (err)
+    {
+      gpa_gpgme_warning (err);
+      g_signal_emit_by_name (GPA_OPERATION (op), "completed", err);
+    }
+}
+
+
 static gboolean
 gpa_import_operation_idle_cb (gpointer data)
 {
   GpaImportOperation *op = data;
 
+  op->source_pending = FALSE;
   if (GPA_IMPORT_OPERATION_GET_CLASS (op)->get_source (op))
     {
-      gpg_error_t err;
-
-      if (op->source)
-        {
-          gpgme_set_protocol (GPA_OPERATION (op)->context->ctx,
-                              is_cms_data_ext (op->source)?
-                              GPGME_PROTOCOL_CMS : GPGME_PROTOCOL_OpenPGP);
-          err = gpgme_op_import_start (GPA_OPERATION (op)->context->ctx,
-                                       op->source);
-        }
-      else if (op->source2)
-        {
-          /* The only protocol where an array of keys is used in GPA
-             is OpenPGP.  */
-          gpgme_set_protocol (GPA_OPERATION (op)->context->ctx,
-                              GPGME_PROTOCOL_OpenPGP);
-          err = gpgme_op_import_keys_start (GPA_OPERATION (op)->context->ctx,
-                                            op->source2);
-        }
-      else
-        err = gpg_error (GPG_ERR_BUG);
-      if (err)
-	{
-	  gpa_gpgme_warning (err);
-	  g_signal_emit_by_name (GPA_OPERATION (op), "completed", err);
-	}
+      if (!op->source_pending)
+        gpa_import_operation_start (op);
     }
   else
     /* Abort the operation.  */
@@ -212,6 +428,12 @@ static void
 gpa_import_operation_done_cb (GpaContext *context, gpg_error_t err,
 			      GpaImportOperation *op)
 {
+  if (op->chunker)
+    {
+      bulk_chunk_done (op, err);
+      return;
+    }
+
   if (! err)
     {
       struct gpa_import_result_s result;
@@ -242,6 +464,10 @@ static void
 gpa_import_operation_done_error_cb (GpaContext *context, gpg_error_t err,
 				    GpaImportOperation *op)
 {
+  /* Bulk imports report errors at the end.  */
+  if (op->chunker)
+    return;
+
   switch (gpg_err_code (err))
     {
     case GPG_ERR_NO_ERROR:
@@ -252,3 +478,28 @@ gpa_import_operation_done_error_cb (GpaContext *context, gpg_error_t err,
       break;
     }
 }
+
+
+/* API */
+
+void
+gpa_import_operation_source_ready (GpaImportOperation *op, gpg_error_t err)
+{
+  op->source_pending = FALSE;
+  if (!err)
+    gpa_import_operation_start (op);
+  else
+    g_signal_emit_by_name (GPA_OPERATION (op), "completed", err);
+}
+
+
+void
+gpa_import_operation_set_bulk_source (GpaImportOperation *op,
+                                      int fd, guint64 size)
+{
+  gpgme_data_release (op->source);
+  op->source = NULL;
+  gpa_key_chunker_release (op->chunker);
+  op->chunker = gpa_key_chunker_new (fd, BULK_CHUNK_SIZE);
+  op->chunker_size = size;
+}
@@ -26,6 +26,8 @@
 #include <glib-object.h>
 #include "gpaoperation.h"
 #include "gpaprogressdlg.h"
+#include "gpgmetools.h"
+#include "keychunk.h"
 
 /* GObject stuff */
 #define GPA_IMPORT_OPERATION_TYPE	  (gpa_import_operation_get_type ())
@@ -43,13 +45,28 @@ struct _GpaImportOperation {
 
   gpgme_data_t source;    /* Either a data object with the full key  */
   gpgme_key_t *source2;   /* or an array of key descriptions.  */
+
+  /* Set by get_source if the source is retrieved asynchronously.  */
+  gboolean source_pending;
+
+  /* For a bulk import the source is read and imported in chunks.  */
+  gpa_key_chunker_t chunker;
+  guint64 chunker_size;
+  GtkWidget *progress_dialog;
+  struct gpa_import_result_s counters;
+  GHashTable *changed;    /* Fingerprints of the changed keys.  */
+  gboolean too_many;      /* Too many changed keys to remember.  */
+  gboolean canceled;
+  gpg_error_t bulk_err;
 };
 
 struct _GpaImportOperationClass {
   GpaOperationClass parent_class;
 
   /* Get the data from which the keys should be imported.  Returns
-   * FALSE if the operation should be aborted.
+   * FALSE if the operation should be aborted.  An implementation
+   * which needs to wait for the data sets SOURCE_PENDING and calls
+   * gpa_import_operation_source_ready later.
    */
   gboolean (*get_source) (GpaImportOperation *op);
 
@@ -62,8 +79,23 @@ struct _GpaImportOperationClass {
   /* "Some keys were imported" signal.
    */
   void (*imported_keys) (GpaImportOperation *op);
+
+  /* "The keys with the fingerprints in the NULL terminated array
+   * were changed" signal.  Only used for bulk imports.
+   */
+  void (*updated_keys) (GpaImportOperation *op, const char **fprs);
 };
 
 GType gpa_import_operation_get_type (void) G_GNUC_CONST;
 
+/* Start the import of the source retrieved asynchronously by
+   get_source, or abort the operation with ERR.  */
+void gpa_import_operation_source_ready (GpaImportOperation *op,
+                                        gpg_error_t err);
+
+/* Import the keyring of SIZE bytes from FD in chunks instead of the
+   data in SOURCE.  To be called by get_source for large inputs.  */
+void gpa_import_operation_set_bulk_source (GpaImportOperation *op,
+                                           int fd, guint64 size);
+
 #endif
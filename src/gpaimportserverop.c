@@ -25,15 +25,28 @@
 #include "gpa.h"
 #include "i18n.h"
 #include "gtktools.h"
+#include "convert.h"
+#include "keyref.h"
 #include "gparecvkeydlg.h"
 #include "gpaimportserverop.h"
 #include "server-access.h"
 
-/* The number of keys we allow to import at once.  If we have more
-   than this we terminate the dialog and ask the user to give a better
-   specification of the key.  A better way to do this would be to pop
-   up a dialog to allow the user to select matching keys.  */
-#define MAX_KEYSEARCH_RESULTS 5
+/* The number of matching keys shown at once.  More keys are shown on
+   request, one page at a time.  */
+#define KEYSEARCH_PAGE_SIZE 50
+
+/* The response of the "More" button of the results dialog.  */
+#define RESPONSE_MORE 1
+
+/* The columns of the list of matching keys.  */
+enum
+  {
+    RESULT_KEYID,
+    RESULT_CREATED,
+    RESULT_USERID,
+    RESULT_KEY,
+    RESULT_N_COLUMNS
+  };
 
 
 static GObjectClass *parent_class = NULL;
@@ -48,12 +61,36 @@ gpa_import_server_operation_complete_import (GpaImportOperation *operation);
 static void
 gpa_import_server_operation_finalize (GObject *object)
 {
+  GpaImportServerOperation *op = GPA_IMPORT_SERVER_OPERATION (object);
+  guint i;
+
+  if (op->results_dialog)
+    gtk_widget_destroy (op->results_dialog);
+  if (op->found)
+    {
+      for (i = 0; i < op->found->len; i++)
+        gpa_key_unref (g_ptr_array_index (op->found, i),
+                       GPA_KEY_OWNER_SERVER);
+      g_ptr_array_free (op->found, TRUE);
+    }
+  if (op->search_context)
+    g_object_unref (op->search_context);
+
   G_OBJECT_CLASS (parent_class)->finalize (object);
 }
 
 static void
 gpa_import_server_operation_init (GpaImportServerOperation *op)
 {
+  op->search_context = NULL;
+  op->results_dialog = NULL;
+  op->results_label = NULL;
+  op->results_view = NULL;
+  op->results = NULL;
+  op->found = NULL;
+  op->limit = 0;
+  op->searching = FALSE;
+  op->response = GTK_RESPONSE_NONE;
 }
 
 static GObject*
@@ -117,30 +154,305 @@ gpa_import_server_operation_get_type (void)
 
 /* Internal */
 
-/* Search for keys with KEYID.  Return true on success and set the
-   SOURCE2 instance variable.  */
+/* Tell the user how far the search has come.  */
+static void
+update_results_label (GpaImportServerOperation *op)
+{
+  GtkTreeModel *model = GTK_TREE_MODEL (op->results);
+  guint shown = gtk_tree_model_iter_n_children (model, NULL);
+  gchar *text;
+
+  if (op->searching)
+    text = g_strdup_printf (_("Searching...  %u keys found so far."),
+                            op->found->len);
+  else if (shown < op->found->len)
+    text = g_strdup_printf (_("Showing %u of %u matching keys.  "
+                              "Select the keys to import."),
+                            shown, op->found->len);
+  else
+    text = g_strdup_printf (_("%u keys match your search pattern.  "
+                              "Select the keys to import."),
+                            op->found->len);
+  gtk_label_set_text (GTK_LABEL (op->results_label), text);
+  g_free (text);
+
+  gtk_dialog_set_response_sensitive (GTK_DIALOG (op->results_dialog),
+                                     RESPONSE_MORE, shown < op->found->len);
+}
+
+
+/* Show the found keys up to the current limit.  */
+static void
+fill_results (GpaImportServerOperation *op)
+{
+  guint i;
+
+  if (!op->results_dialog)
+    return;
+
+  i = gtk_tree_model_iter_n_children (GTK_TREE_MODEL (op->results), NULL);
+  for (; i < op->found->len && i < op->limit; i++)
+    {
+      gpgme_key_t key = g_ptr_array_index (op->found, i);
+      GtkTreeIter iter;
+      gchar *userid, *created;
+
+      userid = gpa_gpgme_key_get_userid (key->uids);
+      created = gpa_creation_date_string (key->subkeys->timestamp);
+      gtk_list_store_append (op->results, &iter);
+      gtk_list_store_set (op->results, &iter,
+                          RESULT_KEYID, gpa_gpgme_key_get_short_keyid (key),
+                          RESULT_CREATED, created,
+                          RESULT_USERID, userid,
+                          RESULT_KEY, key,
+                          -1);
+      g_free (created);
+      g_free (userid);
+    }
+  update_results_label (op);
+}
+
+
+/* Set the SOURCE2 instance variable to the keys selected by the
+   user.  */
+static void
+take_selected_keys (GpaImportServerOperation *op)
+{
+  GtkTreeSelection *selection;
+  GList *rows, *item;
+  gpgme_key_t *keyarray;
+  int i = 0;
+
+  selection = gtk_tree_view_get_selection (GTK_TREE_VIEW (op->results_view));
+  rows = gtk_tree_selection_get_selected_rows (selection, NULL);
+  keyarray = g_new0 (gpgme_key_t, g_list_length (rows) + 1);
+  for (item = rows; item; item = g_list_next (item))
+    {
+      GtkTreeIter iter;
+      gpgme_key_t key;
+
+      if (!gtk_tree_model_get_iter (GTK_TREE_MODEL (op->results), &iter,
+                                    item->data))
+        continue;
+      gtk_tree_model_get (GTK_TREE_MODEL (op->results), &iter,
+                          RESULT_KEY, &key, -1);
+      gpgme_key_ref (key);
+      keyarray[i++] = key;
+    }
+  g_list_free_full (rows, (GDestroyNotify) gtk_tree_path_free);
+
+  GPA_IMPORT_OPERATION (op)->source2 = keyarray;
+}
+
+
+/* Close the results dialog and import the selected keys or abort
+   the operation.  */
+static void
+finish_search (GpaImportServerOperation *op, gboolean okay)
+{
+  if (op->results_dialog)
+    gtk_widget_destroy (op->results_dialog);
+  gpa_import_operation_source_ready (GPA_IMPORT_OPERATION (op),
+                                     okay? 0 : gpg_error (GPG_ERR_CANCELED));
+}
+
+
+static void
+search_next_key_cb (GpaContext *context, gpgme_key_t key,
+                    GpaImportServerOperation *op)
+{
+  gpa_key_acquired (key, GPA_KEY_OWNER_SERVER);
+  g_ptr_array_add (op->found, key);
+  fill_results (op);
+}
+
+
+static void
+search_done_cb (GpaContext *context, gpg_error_t err,
+                GpaImportServerOperation *op)
+{
+  GtkWidget *window = GPA_OPERATION (op)->window;
+
+  op->searching = FALSE;
+  if (!op->results_dialog && op->response == GTK_RESPONSE_NONE)
+    op->response = GTK_RESPONSE_CANCEL;
+
+  /* The user already decided while we were searching.  */
+  if (op->response == GTK_RESPONSE_OK)
+    {
+      finish_search (op, TRUE);
+      return;
+    }
+  else if (op->response != GTK_RESPONSE_NONE)
+    {
+      finish_search (op, FALSE);
+      return;
+    }
+
+  if (gpg_err_code (err) == GPG_ERR_EOF)
+    err = 0;
+  if (err)
+    gpa_gpgme_warn (err, NULL, context);
+
+  if (!op->found->len)
+    {
+      if (!err)
+        gpa_show_warn (window, context, _("No keys were found."));
+      finish_search (op, FALSE);
+    }
+  else if (op->found->len == 1)
+    {
+      /* There is nothing to choose from.  */
+      gtk_tree_selection_select_all (gtk_tree_view_get_selection
+                                     (GTK_TREE_VIEW (op->results_view)));
+      take_selected_keys (op);
+      finish_search (op, TRUE);
+    }
+  else
+    update_results_label (op);
+}
+
+
+static void
+results_response_cb (GtkDialog *dialog, gint response,
+                     GpaImportServerOperation *op)
+{
+  if (response == RESPONSE_MORE)
+    {
+      op->limit += KEYSEARCH_PAGE_SIZE;
+      fill_results (op);
+      return;
+    }
+
+  if (op->response != GTK_RESPONSE_NONE)
+    return;
+  if (response == GTK_RESPONSE_OK)
+    take_selected_keys (op);
+  else
+    response = GTK_RESPONSE_CANCEL;
+
+  if (op->searching)
+    {
+      /* Stop the search and continue once it is done.  */
+      op->response = response;
+      gtk_widget_hide (op->results_dialog);
+      gpgme_cancel (op->search_context->ctx);
+    }
+  else
+    finish_search (op, response == GTK_RESPONSE_OK);
+}
+
+
+static void
+results_selection_changed_cb (GtkTreeSelection *selection,
+                              GpaImportServerOperation *op)
+{
+  gtk_dialog_set_response_sensitive
+    (GTK_DIALOG (op->results_dialog), GTK_RESPONSE_OK,
+     gtk_tree_selection_count_selected_rows (selection) > 0);
+}
+
+
+/* Create the dialog listing the matching keys as they arrive.  */
+static void
+create_results_dialog (GpaImportServerOperation *op)
+{
+  GtkWidget *dialog;
+  GtkWidget *vbox;
+  GtkWidget *scroller;
+  GtkWidget *view;
+  GtkCellRenderer *renderer;
+  GtkTreeSelection *selection;
+
+  dialog = gtk_dialog_new_with_buttons
+    (NULL, GTK_WINDOW (GPA_OPERATION (op)->window),
+     GTK_DIALOG_DESTROY_WITH_PARENT,
+     _("_More"), RESPONSE_MORE,
+     _("_Cancel"), GTK_RESPONSE_CANCEL,
+     _("_Import"), GTK_RESPONSE_OK,
+     NULL);
+  gpa_window_set_title (GTK_WINDOW (dialog), _("Keyserver Search"));
+  gtk_dialog_set_default_response (GTK_DIALOG (dialog), GTK_RESPONSE_OK);
+  gtk_dialog_set_response_sensitive (GTK_DIALOG (dialog), GTK_RESPONSE_OK,
+                                     FALSE);
+  gtk_dialog_set_response_sensitive (GTK_DIALOG (dialog), RESPONSE_MORE,
+                                     FALSE);
+  gtk_container_set_border_width (GTK_CONTAINER (dialog), 5);
+
+  vbox = gtk_dialog_get_content_area (GTK_DIALOG (dialog));
+  gtk_container_set_border_width (GTK_CONTAINER (vbox), 5);
+
+  op->results_label = gtk_label_new (NULL);
+  gtk_widget_set_halign (op->results_label, GTK_ALIGN_START);
+  gtk_box_pack_start (GTK_BOX (vbox), op->results_label, FALSE, FALSE, 5);
+
+  scroller = gtk_scrolled_window_new (NULL, NULL);
+  gtk_scrolled_window_set_policy (GTK_SCROLLED_WINDOW (scroller),
+                                  GTK_POLICY_AUTOMATIC,
+                                  GTK_POLICY_AUTOMATIC);
+  gtk_scrolled_window_set_shadow_type (GTK_SCROLLED_WINDOW (scroller),
+                                       GTK_SHADOW_IN);
+  gtk_widget_set_size_request (scroller, 500, 250);
+  gtk_box_pack_start (GTK_BOX (vbox), scroller, TRUE, TRUE, 0);
+
+  op->results = gtk_list_store_new (RESULT_N_COLUMNS, G_TYPE_STRING,
+                                    G_TYPE_STRING, G_TYPE_STRING,
+                                    G_TYPE_POINTER);
+  view = gtk_tree_view_new_with_model (GTK_TREE_MODEL (op->results));
+  g_object_unref (op->results);
+  renderer = gtk_cell_renderer_text_new ();
+  gtk_tree_view_insert_column_with_attributes
+    (GTK_TREE_VIEW (view), -1, _("Key ID"), renderer,
+     "text", RESULT_KEYID, NULL);
+  gtk_tree_view_insert_column_with_attributes
+    (GTK_TREE_VIEW (view), -1, _("Created"), renderer,
+     "text", RESULT_CREATED, NULL);
+  gtk_tree_view_insert_column_with_attributes
+    (GTK_TREE_VIEW (view), -1, _("User Name"), renderer,
+     "text", RESULT_USERID, NULL);
+  gtk_container_add (GTK_CONTAINER (scroller), view);
+  op->results_view = view;
+
+  selection = gtk_tree_view_get_selection (GTK_TREE_VIEW (view));
+  gtk_tree_selection_set_mode (selection, GTK_SELECTION_MULTIPLE);
+  g_signal_connect (G_OBJECT (selection), "changed",
+                    G_CALLBACK (results_selection_changed_cb), op);
+  g_signal_connect (G_OBJECT (dialog), "response",
+                    G_CALLBACK (results_response_cb), op);
+
+  op->results_dialog = dialog;
+  /* The dialog is destroyed along with its parent.  */
+  g_signal_connect (G_OBJECT (dialog), "destroy",
+                    G_CALLBACK (gtk_widget_destroyed), &op->results_dialog);
+}
+
+
+/* Start a search for keys with KEYID.  The matching keys are shown
+   as they arrive and the user selects the ones to import.  Return
+   true if the search has been started.  */
 static gboolean
-search_keys (GpaImportOperation *operation, const char *keyid)
+search_keys (GpaImportServerOperation *op, const char *keyid)
 {
   gpg_error_t err;
-  gboolean result = FALSE;
   GpaContext *context;
-  gpgme_key_t key;
-  gpgme_key_t *keyarray;
-  int i, nkeys;
   gpgme_keylist_mode_t listmode;
   char *mbox = NULL;
 
   if (!keyid || !*keyid)
     return FALSE;
 
-  keyarray = g_malloc0_n (MAX_KEYSEARCH_RESULTS + 1, sizeof *keyarray);
-
-
   /* We need to use a separate context because the operation's context
      has already been setup and the done signal would relate to the
      actual import operation done later.  */
-  context = gpa_context_new ();
+  if (!op->search_context)
+    {
+      op->search_context = gpa_context_new ();
+      g_signal_connect (G_OBJECT (op->search_context), "next_key",
+                        G_CALLBACK (search_next_key_cb), op);
+      g_signal_connect (G_OBJECT (op->search_context), "done",
+                        G_CALLBACK (search_done_cb), op);
+    }
+  context = op->search_context;
   gpgme_set_protocol (context->ctx, GPGME_PROTOCOL_OpenPGP);
   /* Switch to extern-only or locate list mode.  We use --locate-key
    * iff KEYID is a single mail address.  */
@@ -163,50 +475,37 @@ search_keys (GpaImportOperation *operation, const char *keyid)
 
   /* List keys matching the given keyid.  Actually all kind of search
      specifications can be given.  */
-  nkeys = 0;
   err = gpgme_op_keylist_start (context->ctx, keyid, 0);
-  while (!err && !(err = gpgme_op_keylist_next (context->ctx, &key)))
+  gpgme_free (mbox);
+  if (err)
     {
-      if (nkeys >= MAX_KEYSEARCH_RESULTS)
-        {
-          gpa_show_warn (GPA_OPERATION (operation)->window, context,
-                            _("More than %d keys match your search pattern.\n"
-                              "Use the long keyid or a fingerprint "
-                              "for a better match"), nkeys);
-          gpgme_key_unref (key);
-          err = gpg_error (GPG_ERR_TRUNCATED);
-          break;
-        }
-      keyarray[nkeys++] = key;
+      gpa_gpgme_warn (err, NULL, context);
+      return FALSE;
     }
-  gpgme_op_keylist_end (context->ctx);
-  if (gpg_err_code (err) == GPG_ERR_EOF)
-    err = 0;
 
-  if (!err && !nkeys)
-    {
-      gpa_show_warn (GPA_OPERATION (operation)->window, context,
-                     _("No keys were found."));
-    }
-  else if (!err)
-    {
-      operation->source2 = keyarray;
-      keyarray = NULL;
-      result = TRUE;
-    }
-  else if (gpg_err_code (err) != GPG_ERR_TRUNCATED)
-    gpa_gpgme_warn (err, NULL, context);
+  op->found = g_ptr_array_new ();
+  op->limit = KEYSEARCH_PAGE_SIZE;
+  op->searching = TRUE;
+  op->response = GTK_RESPONSE_NONE;
+  create_results_dialog (op);
+  update_results_label (op);
+  gtk_widget_show_all (op->results_dialog);
+  GPA_IMPORT_OPERATION (op)->source_pending = TRUE;
 
-  g_object_unref (context);
-  if (keyarray)
-    {
-      for (i=0; keyarray[i]; i++)
-        gpgme_key_unref (keyarray[i]);
-      g_free (keyarray);
-    }
+  return TRUE;
+}
 
-  gpgme_free (mbox);
-  return result;
+
+static void
+get_key_done_cb (gpg_error_t err, gpgme_data_t data, gpointer opaque)
+{
+  GpaImportOperation *operation = opaque;
+
+  if (!err)
+    operation->source = data;
+  else
+    gpgme_data_release (data);
+  gpa_import_operation_source_ready (operation, err);
 }
 
 
@@ -246,26 +545,27 @@ gpa_import_server_operation_get_source (GpaImportOperation *operation)
          that there is currently no way to create a list of keys from
          the keyids to be passed to the import function we run a
          --search-keys first to get the list of matching keys and pass
-         them to the actual import function (which does a --recv-keys).  */
-      /* Fixme: As with server_get_key (below), this is a blocking
-         operation. */
-      if (search_keys (operation, keyid))
+         them to the actual import function (which does a --recv-keys).
+         The search runs in the background and the user selects the
+         keys to import from its results.  */
+      if (search_keys (op, keyid))
         {
-          /* Okay, found key(s).  */
 	  g_free (keyid);
 	  return TRUE;
         }
     }
   else if (response == GTK_RESPONSE_OK)
     {
+      operation->source_pending = TRUE;
       if (server_get_key (gpa_options_get_default_keyserver
 			  (gpa_options_get_instance ()),
-			  keyid,
-                          &operation->source, GPA_OPERATION (op)->window))
+			  keyid, GPA_OPERATION (op)->window,
+                          get_key_done_cb, operation))
 	{
 	  g_free (keyid);
 	  return TRUE;
 	}
+      operation->source_pending = FALSE;
     }
   g_free (keyid);
   return FALSE;
@@ -42,6 +42,20 @@ struct _GpaImportServerOperation {
   GpaImportOperation parent;
 
   char *key_id;
+
+  /* The keyserver search and the dialog showing its results.  */
+  GpaContext *search_context;
+  GtkWidget *results_dialog;
+  GtkWidget *results_label;
+  GtkWidget *results_view;
+  GtkListStore *results;
+
+  /* The keys found so far and the number of them shown.  */
+  GPtrArray *found;
+  guint limit;
+
+  gboolean searching;
+  gint response;        /* The response given while searching.  */
 };
 
 struct _GpaImportServerOperationClass {
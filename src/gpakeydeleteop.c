@@ -31,24 +31,73 @@
 #endif
 
 #include "gpa.h"
+#include "i18n.h"
+#include "gtktools.h"
+#include "keytable.h"
 #include "gpakeydeleteop.h"
 
+/* The maximum number of fingerprints passed to one gpg process.
+   This keeps the command line well below the limit of Windows.  */
+#define DELETE_BATCH_SIZE 200
+
+/* The keys deleted by one engine call.  Either the keys with the
+   fingerprints FPRS are deleted by a gpg process or KEY is deleted
+   by gpgme.  */
+struct delete_batch_s
+{
+  gchar **fprs;
+  gboolean secret;
+  gpgme_key_t key;
+};
+
+/* Signals */
+enum
+{
+  DELETED_KEYS,
+  LAST_SIGNAL
+};
+
 /* Internal functions */
 static gboolean gpa_key_delete_operation_idle_cb (gpointer data);
+static void gpa_key_delete_operation_next (GpaKeyDeleteOperation *op);
 static void gpa_key_delete_operation_done_error_cb (GpaContext *context,
 						    gpg_error_t err,
 						    GpaKeyDeleteOperation *op);
 static void gpa_key_delete_operation_done_cb (GpaContext *context,
 					      gpg_error_t err,
 					      GpaKeyDeleteOperation *op);
+static void gpa_key_delete_operation_next_key_cb (GpaContext *context,
+						  gpgme_key_t key,
+						  GpaKeyDeleteOperation *op);
 
 /* GObject */
 
 static GObjectClass *parent_class = NULL;
+static guint signals [LAST_SIGNAL] = { 0 };
+
+static void
+release_batch (struct delete_batch_s *batch)
+{
+  if (!batch)
+    return;
+
+  g_strfreev (batch->fprs);
+  if (batch->key)
+    gpgme_key_unref (batch->key);
+  g_free (batch);
+}
 
 static void
 gpa_key_delete_operation_finalize (GObject *object)
 {
+  GpaKeyDeleteOperation *op = GPA_KEY_DELETE_OPERATION (object);
+
+  if (op->progress_dialog)
+    gtk_widget_destroy (op->progress_dialog);
+  g_queue_free_full (op->batches, (GDestroyNotify) release_batch);
+  release_batch (op->batch);
+  g_hash_table_destroy (op->remaining);
+
   G_OBJECT_CLASS (parent_class)->finalize (object);
 }
 
@@ -56,6 +105,17 @@ gpa_key_delete_operation_finalize (GObject *object)
 static void
 gpa_key_delete_operation_init (GpaKeyDeleteOperation *op)
 {
+  op->progress_dialog = NULL;
+  op->batches = g_queue_new ();
+  op->batch = NULL;
+  op->verifying = FALSE;
+  op->remaining = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                         g_free, NULL);
+  op->total = 0;
+  op->deleted = 0;
+  op->failed = 0;
+  op->canceled = FALSE;
+  op->reload = FALSE;
 }
 
 static GObject*
@@ -78,6 +138,9 @@ gpa_key_delete_operation_constructor (GType type,
 		    G_CALLBACK (gpa_key_delete_operation_done_error_cb), op);
   g_signal_connect (G_OBJECT (GPA_OPERATION (op)->context), "done",
 		    G_CALLBACK (gpa_key_delete_operation_done_cb), op);
+  /* The keys still present after a batch are listed.  */
+  g_signal_connect (G_OBJECT (GPA_OPERATION (op)->context), "next_key",
+		    G_CALLBACK (gpa_key_delete_operation_next_key_cb), op);
   /* Start with the first key after going back into the main loop */
   g_idle_add (gpa_key_delete_operation_idle_cb, op);
 
@@ -93,6 +156,17 @@ gpa_key_delete_operation_class_init (GpaKeyDeleteOperationClass *klass)
 
   object_class->constructor = gpa_key_delete_operation_constructor;
   object_class->finalize = gpa_key_delete_operation_finalize;
+
+  /* Signals */
+  signals[DELETED_KEYS] =
+    g_signal_new ("deleted_keys",
+		  G_TYPE_FROM_CLASS (object_class),
+		  G_SIGNAL_RUN_FIRST,
+		  G_STRUCT_OFFSET (GpaKeyDeleteOperationClass, deleted_keys),
+		  NULL, NULL,
+		  g_cclosure_marshal_VOID__POINTER,
+		  G_TYPE_NONE, 1,
+		  G_TYPE_POINTER);
 }
 
 GType
@@ -142,24 +216,246 @@ gpa_key_delete_operation_new (GtkWidget *window, GList *keys)
 
 /* Internal */
 
+/* Queue the fingerprints in FPRS in batches of DELETE_BATCH_SIZE.  */
+static void
+queue_batches (GpaKeyDeleteOperation *op, GPtrArray *fprs, gboolean secret)
+{
+  guint i, j, n;
+
+  for (i = 0; i < fprs->len; i += n)
+    {
+      struct delete_batch_s *batch = g_malloc0 (sizeof *batch);
+
+      n = MIN (DELETE_BATCH_SIZE, fprs->len - i);
+      batch->fprs = g_new0 (gchar *, n + 1);
+      for (j = 0; j < n; j++)
+        batch->fprs[j] = g_strdup (fprs->pdata[i + j]);
+      batch->secret = secret;
+      g_queue_push_tail (op->batches, batch);
+    }
+}
+
+
+/* Split the keys of OP into batches.  Several OpenPGP keys are
+   deleted by gpg processes taking many fingerprints, keys with a
+   secret key separately from the others.  A single key and X.509
+   keys are deleted one by one by gpgme.  */
+static void
+make_batches (GpaKeyDeleteOperation *op)
+{
+  GList *keys = gpa_key_operation_keys (GPA_KEY_OPERATION (op));
+  GPtrArray *public_fprs = g_ptr_array_new ();
+  GPtrArray *secret_fprs = g_ptr_array_new ();
+  const char *homedir;
+  gboolean spawn;
+  GList *item;
+
+  spawn = (keys && keys->next
+           && gpa_get_gpg_engine (GPA_OPERATION (op)->context->ctx, &homedir));
+  for (item = keys; item; item = g_list_next (item))
+    {
+      gpgme_key_t key = item->data;
+
+      op->total++;
+      if (spawn && key->protocol == GPGME_PROTOCOL_OpenPGP
+          && key->subkeys && key->subkeys->fpr)
+        {
+          if (gpa_keytable_lookup_key (gpa_keytable_get_secret_instance (),
+                                       key->subkeys->fpr))
+            g_ptr_array_add (secret_fprs, key->subkeys->fpr);
+          else
+            g_ptr_array_add (public_fprs, key->subkeys->fpr);
+        }
+      else
+        {
+          struct delete_batch_s *batch = g_malloc0 (sizeof *batch);
+
+          gpgme_key_ref (key);
+          batch->key = key;
+          g_queue_push_tail (op->batches, batch);
+        }
+    }
+  queue_batches (op, secret_fprs, TRUE);
+  queue_batches (op, public_fprs, FALSE);
+
+  g_ptr_array_free (secret_fprs, TRUE);
+  g_ptr_array_free (public_fprs, TRUE);
+}
+
+
+/* Start the engine for the current batch of OP.  */
 static gpg_error_t
-gpa_key_delete_operation_start (GpaKeyDeleteOperation *op)
+start_batch (GpaKeyDeleteOperation *op)
 {
+  gpgme_ctx_t ctx = GPA_OPERATION (op)->context->ctx;
+  struct delete_batch_s *batch = op->batch;
+  const char *gpg, *homedir;
+  GPtrArray *argv;
   gpg_error_t err;
-  gpgme_key_t key;
+  int i;
+
+  if (batch->key)
+    {
+      gpgme_set_protocol (ctx, batch->key->protocol);
+#if GPGME_VERSION_NUMBER >= 0x010a00  /* GPGME >= 1.10.0 */
+      /* The user has already confirmed the deletion.  */
+      return gpgme_op_delete_ext_start (ctx, batch->key,
+                                        (GPGME_DELETE_ALLOW_SECRET
+                                         | GPGME_DELETE_FORCE));
+#else
+      return gpgme_op_delete_start (ctx, batch->key, TRUE);
+#endif
+    }
+
+  gpg = gpa_get_gpg_engine (ctx, &homedir);
+  if (!gpg)
+    return gpg_error (GPG_ERR_NOT_SUPPORTED);
+
+  argv = g_ptr_array_new ();
+  g_ptr_array_add (argv, (char *) gpg);
+  g_ptr_array_add (argv, "--batch");
+  g_ptr_array_add (argv, "--no-tty");
+  g_ptr_array_add (argv, "--yes");
+  if (homedir)
+    {
+      g_ptr_array_add (argv, "--homedir");
+      g_ptr_array_add (argv, (char *) homedir);
+    }
+  g_ptr_array_add (argv, batch->secret ? "--delete-secret-and-public-keys"
+                   : "--delete-keys");
+  g_ptr_array_add (argv, "--");
+  for (i = 0; batch->fprs[i]; i++)
+    g_ptr_array_add (argv, batch->fprs[i]);
+  g_ptr_array_add (argv, NULL);
+
+  err = gpgme_set_protocol (ctx, GPGME_PROTOCOL_SPAWN);
+  if (!err)
+    err = gpgme_op_spawn_start (ctx, gpg, (const char **) argv->pdata,
+                                NULL, NULL, NULL, 0);
+  g_ptr_array_free (argv, TRUE);
+
+  return err;
+}
+
+
+/* List the keys of the finished batch of OP which are still there.
+   gpg does not tell which of the keys it could delete.  */
+static gpg_error_t
+start_verify (GpaKeyDeleteOperation *op)
+{
+  gpgme_ctx_t ctx = GPA_OPERATION (op)->context->ctx;
+
+  g_hash_table_remove_all (op->remaining);
+  op->verifying = TRUE;
+  gpgme_set_protocol (ctx, GPGME_PROTOCOL_OpenPGP);
+  gpgme_set_keylist_mode (ctx, GPGME_KEYLIST_MODE_LOCAL);
+  return gpgme_op_keylist_ext_start (ctx, (const char **) op->batch->fprs,
+                                     0, 0);
+}
+
+
+/* Pass the keys of the finished batch of OP which are gone to the
+   "deleted_keys" handlers.  */
+static void
+report_batch (GpaKeyDeleteOperation *op)
+{
+  GPtrArray *deleted = g_ptr_array_new ();
+  int i;
+
+  for (i = 0; op->batch->fprs[i]; i++)
+    if (g_hash_table_contains (op->remaining, op->batch->fprs[i]))
+      op->failed++;
+    else
+      g_ptr_array_add (deleted, op->batch->fprs[i]);
 
-  key = gpa_key_operation_current_key (GPA_KEY_OPERATION (op));
-  g_return_val_if_fail (key, gpg_error (GPG_ERR_CANCELED));
+  if (deleted->len)
+    {
+      op->deleted += deleted->len;
+      g_ptr_array_add (deleted, NULL);
+      g_signal_emit (op, signals[DELETED_KEYS], 0, deleted->pdata);
+    }
+  g_ptr_array_free (deleted, TRUE);
+}
+
+
+static void
+update_progress (GpaKeyDeleteOperation *op)
+{
+  GtkProgressBar *pbar;
+  char *text;
+
+  if (!op->progress_dialog)
+    return;
+
+  pbar = GTK_PROGRESS_BAR (GPA_PROGRESS_DIALOG (op->progress_dialog)->pbar);
+  text = g_strdup_printf (_("%u of %u keys deleted"), op->deleted, op->total);
+  gtk_progress_bar_set_text (pbar, text);
+  gtk_progress_bar_set_fraction (pbar, (double) (op->deleted + op->failed)
+                                 / op->total);
+  g_free (text);
+}
+
+
+static void
+gpa_key_delete_operation_finish (GpaKeyDeleteOperation *op, gpg_error_t err)
+{
+  if (op->progress_dialog)
+    gtk_widget_hide (op->progress_dialog);
+
+  if (op->failed)
+    {
+      char *text = g_strdup_printf (ngettext ("%u key could not be deleted.",
+                                              "%u keys could not be deleted.",
+                                              op->failed), op->failed);
+      gpa_window_error (text, GPA_OPERATION (op)->window);
+      g_free (text);
+    }
+
+  /* The deleted keys have already been reported, unless we do not
+     know which ones are gone.  */
+  if (op->reload)
+    g_signal_emit_by_name (GPA_OPERATION (op), "changed_wot");
+  g_signal_emit_by_name (GPA_OPERATION (op), "completed", err);
+}
+
+
+static void
+progress_response_cb (GtkDialog *dialog, gint response,
+                      GpaKeyDeleteOperation *op)
+{
+  /* The running gpg is not killed, so that we learn which of its
+     keys are gone.  */
+  op->canceled = TRUE;
+  gtk_dialog_set_response_sensitive (dialog, GTK_RESPONSE_CANCEL, FALSE);
+}
+
+
+static gpg_error_t
+gpa_key_delete_operation_start (GpaKeyDeleteOperation *op)
+{
+  GList *keys = gpa_key_operation_keys (GPA_KEY_OPERATION (op));
 
-  if (! gpa_delete_dialog_run (GPA_OPERATION (op)->window, key))
+  g_return_val_if_fail (keys, gpg_error (GPG_ERR_CANCELED));
+
+  if (! gpa_delete_dialog_run_multiple (GPA_OPERATION (op)->window, keys))
     return gpg_error (GPG_ERR_CANCELED);
 
-  gpgme_set_protocol (GPA_OPERATION (op)->context->ctx, key->protocol);
-  err = gpgme_op_delete_start (GPA_OPERATION(op)->context->ctx, key, TRUE);
-  if (err)
+  make_batches (op);
+
+  if (op->total > 1)
     {
-      gpa_gpgme_warning (err);
-      return err;
+      op->progress_dialog = gpa_progress_dialog_new
+        (GPA_OPERATION (op)->window, NULL);
+      gpa_progress_dialog_set_label
+        (GPA_PROGRESS_DIALOG (op->progress_dialog), _("Deleting keys..."));
+      gtk_progress_bar_set_show_text
+        (GTK_PROGRESS_BAR (GPA_PROGRESS_DIALOG (op->progress_dialog)->pbar),
+         TRUE);
+      gtk_dialog_set_response_sensitive (GTK_DIALOG (op->progress_dialog),
+                                         GTK_RESPONSE_CANCEL, TRUE);
+      g_signal_connect (G_OBJECT (op->progress_dialog), "response",
+                        G_CALLBACK (progress_response_cb), op);
+      gtk_widget_show_all (op->progress_dialog);
     }
 
   return 0;
@@ -174,25 +470,34 @@ gpa_key_delete_operation_idle_cb (gpointer data)
   err = gpa_key_delete_operation_start (op);
   if (err)
     g_signal_emit_by_name (GPA_OPERATION (op), "completed", err);
+  else
+    gpa_key_delete_operation_next (op);
 
   return FALSE;
 }
 
 
+/* Start the next batch of OP or complete it.  */
 static void
 gpa_key_delete_operation_next (GpaKeyDeleteOperation *op)
 {
   gpg_error_t err = 0;
 
-  if (GPA_KEY_OPERATION (op)->current)
+  release_batch (op->batch);
+  op->batch = NULL;
+
+  update_progress (op);
+  if (op->canceled)
+    err = gpg_error (GPG_ERR_CANCELED);
+  else if ((op->batch = g_queue_pop_head (op->batches)))
     {
-      err = gpa_key_delete_operation_start (op);
+      err = start_batch (op);
       if (! err)
 	return;
+      gpa_gpgme_warning (err);
     }
 
-  g_signal_emit_by_name (GPA_OPERATION (op), "changed_wot");
-  g_signal_emit_by_name (GPA_OPERATION (op), "completed", err);
+  gpa_key_delete_operation_finish (op, err);
 }
 
 static void gpa_key_delete_operation_done_error_cb (GpaContext *context,
@@ -215,7 +520,49 @@ static void gpa_key_delete_operation_done_cb (GpaContext *context,
 					      gpg_error_t err,
 					      GpaKeyDeleteOperation *op)
 {
-  GPA_KEY_OPERATION (op)->current = g_list_next
-    (GPA_KEY_OPERATION (op)->current);
+  struct delete_batch_s *batch = op->batch;
+
+  if (! batch)
+    return;
+
+  if (batch->key)
+    {
+      if (! err)
+	{
+	  const char *fprs[2] = { batch->key->subkeys->fpr, NULL };
+
+	  op->deleted++;
+	  g_signal_emit (op, signals[DELETED_KEYS], 0, fprs);
+	}
+      else if (gpg_err_code (err) == GPG_ERR_CANCELED)
+	op->canceled = TRUE;
+    }
+  else if (! op->verifying)
+    {
+      /* Even if gpg failed some of the keys may be gone.  */
+      err = start_verify (op);
+      if (! err)
+	return;
+      gpa_gpgme_warning (err);
+      op->reload = TRUE;
+    }
+  else
+    {
+      op->verifying = FALSE;
+      if (err)
+	op->reload = TRUE;
+      else
+	report_batch (op);
+    }
+
   gpa_key_delete_operation_next (op);
 }
+
+static void
+gpa_key_delete_operation_next_key_cb (GpaContext *context, gpgme_key_t key,
+				      GpaKeyDeleteOperation *op)
+{
+  if (op->verifying && key->subkeys && key->subkeys->fpr)
+    g_hash_table_add (op->remaining, g_strdup (key->subkeys->fpr));
+  gpgme_key_unref (key);
+}
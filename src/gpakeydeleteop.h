@@ -25,6 +25,7 @@
 #include <glib-object.h>
 #include "gpa.h"
 #include "gpakeyop.h"
+#include "gpaprogressdlg.h"
 #include "keydeletedlg.h"
 
 /* GObject stuff */
@@ -38,19 +39,47 @@
 typedef struct _GpaKeyDeleteOperation GpaKeyDeleteOperation;
 typedef struct _GpaKeyDeleteOperationClass GpaKeyDeleteOperationClass;
 
+struct delete_batch_s;
+
 struct _GpaKeyDeleteOperation {
   GpaKeyOperation parent;
+
+  GtkWidget *progress_dialog;
+
+  /* The pending batches and the running one.  */
+  GQueue *batches;
+  struct delete_batch_s *batch;
+  gboolean verifying;
+
+  /* The fingerprints of the keys of the running batch which are
+     still in the keyring after it.  */
+  GHashTable *remaining;
+
+  guint total;
+  guint deleted;
+  guint failed;
+  gboolean canceled;
+
+  /* Set if the outcome of a batch is unknown and the key list needs
+     to be reloaded.  */
+  gboolean reload;
 };
 
 struct _GpaKeyDeleteOperationClass {
   GpaKeyOperationClass parent_class;
+
+  /* Signal handlers */
+  void (*deleted_keys) (GpaKeyDeleteOperation *op, const char **fprs);
 };
 
 GType gpa_key_delete_operation_get_type (void) G_GNUC_CONST;
 
 /* API */
 
-/* Creates a new key deletion operation.
+/* Creates a new key deletion operation.  After a single confirmation
+ * the OpenPGP keys are deleted by a few gpg processes.  The
+ * fingerprints of the deleted keys are passed to the "deleted_keys"
+ * signal.
  */
 GpaKeyDeleteOperation*
 gpa_key_delete_operation_new (GtkWidget *window, GList *keys);
@@ -35,6 +35,7 @@
 #include "expirydlg.h"
 #include "gpgmeedit.h"
 #include "gtktools.h"
+#include "keytable.h"
 
 /* Internal functions */
 static gboolean gpa_key_expire_operation_idle_cb (gpointer data);
@@ -61,6 +62,11 @@ static GObjectClass *parent_class = NULL;
 static void
 gpa_key_expire_operation_finalize (GObject *object)
 {
+  GpaKeyExpireOperation *op = GPA_KEY_EXPIRE_OPERATION (object);
+
+  if (op->date)
+    g_date_free (op->date);
+
   G_OBJECT_CLASS (parent_class)->finalize (object);
 }
 
@@ -69,6 +75,10 @@ static void
 gpa_key_expire_operation_init (GpaKeyExpireOperation *op)
 {
   op->modified_keys = 0;
+  op->date = NULL;
+  op->asked = FALSE;
+  op->subkeys = FALSE;
+  op->doing_subkeys = FALSE;
 }
 
 static GObject*
@@ -150,7 +160,8 @@ gpa_key_expire_operation_get_type (void)
 
 /* API */
 
-/* Creates a new key deletion operation.
+/* Creates a new operation changing the expiry date of KEYS.  The
+ * date is asked for once.
  */
 GpaKeyExpireOperation*
 gpa_key_expire_operation_new (GtkWidget *window, GList *keys)
@@ -165,26 +176,77 @@ gpa_key_expire_operation_new (GtkWidget *window, GList *keys)
   return op;
 }
 
+/* Same as gpa_key_expire_operation_new, but also changes the expiry
+ * date of the valid subkeys if gpg supports that.
+ */
+GpaKeyExpireOperation*
+gpa_key_expire_operation_new_with_subkeys (GtkWidget *window, GList *keys)
+{
+  GpaKeyExpireOperation *op;
+
+  op = gpa_key_expire_operation_new (window, keys);
+  op->subkeys = TRUE;
+
+  return op;
+}
+
 /* Internal */
 
+/* Skip the keys without a secret key, whose expiry date can't be
+   changed.  */
+static void
+gpa_key_expire_operation_skip_public (GpaKeyExpireOperation *op)
+{
+  GpaKeyOperation *key_op = GPA_KEY_OPERATION (op);
+
+  while (key_op->current)
+    {
+      gpgme_key_t key = key_op->current->data;
+
+      if (key->subkeys && key->subkeys->fpr
+	  && gpa_keytable_lookup_key (gpa_keytable_get_secret_instance (),
+				      key->subkeys->fpr))
+	break;
+      key_op->current = g_list_next (key_op->current);
+    }
+}
+
+
+static void
+gpa_key_expire_operation_warning (GpaKeyExpireOperation *op, gpg_error_t err)
+{
+  if (gpg_err_code (err) == GPG_ERR_INV_TIME)
+    gpa_show_warn (GPA_OPERATION (op)->window, GPA_OPERATION (op)->context,
+		   _("Invalid time given.\n"
+		     "(you may not set the expiration time to the past.)"));
+  else
+    gpa_gpgme_warning (err);
+}
+
+
 static gpg_error_t
 gpa_key_expire_operation_start (GpaKeyExpireOperation *op)
 {
   gpg_error_t err;
   gpgme_key_t key;
-  GDate *date;
 
   key = gpa_key_operation_current_key (GPA_KEY_OPERATION (op));
   g_return_val_if_fail (key, gpg_error (GPG_ERR_CANCELED));
 
-  if (! gpa_expiry_dialog_run (GPA_OPERATION (op)->window, key, &date))
-    return gpg_error (GPG_ERR_CANCELED);
+  /* The same date is used for all keys.  */
+  if (! op->asked)
+    {
+      if (! gpa_expiry_dialog_run (GPA_OPERATION (op)->window, key,
+				   &op->date))
+	return gpg_error (GPG_ERR_CANCELED);
+      op->asked = TRUE;
+    }
 
-  err = gpa_gpgme_edit_expire_start (GPA_OPERATION(op)->context, key, date);
-  op->date = date;
+  err = gpa_gpgme_edit_expire_start (GPA_OPERATION(op)->context, key,
+				     op->date);
   if (err)
     {
-      gpa_gpgme_warning (err);
+      gpa_key_expire_operation_warning (op, err);
       return err;
     }
 
@@ -196,10 +258,12 @@ static gboolean
 gpa_key_expire_operation_idle_cb (gpointer data)
 {
   GpaKeyExpireOperation *op = data;
-  gpg_error_t err;
+  gpg_error_t err = 0;
 
-  err = gpa_key_expire_operation_start (op);
-  if (err)
+  gpa_key_expire_operation_skip_public (op);
+  if (GPA_KEY_OPERATION (op)->current)
+    err = gpa_key_expire_operation_start (op);
+  if (err || ! GPA_KEY_OPERATION (op)->current)
     g_signal_emit_by_name (GPA_OPERATION (op), "completed", err);
 
   return FALSE;
@@ -211,6 +275,7 @@ gpa_key_expire_operation_next (GpaKeyExpireOperation *op)
 {
   gpg_error_t err = 0;
 
+  gpa_key_expire_operation_skip_public (op);
   if (GPA_KEY_OPERATION (op)->current)
     {
       err = gpa_key_expire_operation_start (op);
@@ -257,17 +322,29 @@ gpa_key_expire_operation_done_cb (GpaContext *context,
                                   gpg_error_t err,
                                   GpaKeyExpireOperation *op)
 {
-  if (! err)
-    /* The expiration was changed.  */
-    g_signal_emit_by_name (op, "new_expiration",
-			   GPA_KEY_OPERATION (op)->current->data, op->date);
+  gpgme_key_t key = GPA_KEY_OPERATION (op)->current->data;
 
-  /* Clean previous date.  */
-  if (op->date)
+  if (! err && ! op->doing_subkeys)
     {
-      g_date_free (op->date);
-      op->date = NULL;
+      /* The expiration was changed.  */
+      g_signal_emit_by_name (op, "new_expiration", key, op->date);
+
+      /* Now change the subkeys of this key with a single call.  */
+      if (op->subkeys && key->subkeys->next
+	  && gpa_gpgme_have_quick_setexpire ())
+	{
+	  err = gpa_gpgme_set_expire_start (GPA_OPERATION (op)->context,
+					    key, op->date, TRUE);
+	  if (! err)
+	    {
+	      op->doing_subkeys = TRUE;
+	      return;
+	    }
+	  gpa_key_expire_operation_warning (op, err);
+	}
     }
+  op->doing_subkeys = FALSE;
+
   /* Go to the next key.  */
   GPA_KEY_OPERATION (op)->current = g_list_next
     (GPA_KEY_OPERATION (op)->current);
@@ -41,7 +41,14 @@ struct _GpaKeyExpireOperation {
   GpaKeyOperation parent;
 
   int modified_keys;
+
+  /* The new expiry date, asked for once for all keys.  */
   GDate *date;
+  gboolean asked;
+
+  /* Set if the subkeys are changed as well and while they are.  */
+  gboolean subkeys;
+  gboolean doing_subkeys;
 };
 
 struct _GpaKeyExpireOperationClass {
@@ -56,9 +63,16 @@ GType gpa_key_expire_operation_get_type (void) G_GNUC_CONST;
 
 /* API */
 
-/* Creates a new key deletion operation.
+/* Creates a new operation changing the expiry date of KEYS.  The
+ * date is asked for once.
  */
 GpaKeyExpireOperation*
 gpa_key_expire_operation_new (GtkWidget *window, GList *keys);
 
+/* Same as gpa_key_expire_operation_new, but also changes the expiry
+ * date of the valid subkeys if gpg supports that.
+ */
+GpaKeyExpireOperation*
+gpa_key_expire_operation_new_with_subkeys (GtkWidget *window, GList *keys);
+
 #endif
@@ -25,6 +25,7 @@
 #include "keytable.h"
 #include "gtktools.h"
 #include "convert.h"
+#include "keyref.h"
 
 /* Callbacks */
 
@@ -41,7 +42,7 @@ gpa_key_selector_finalize (GObject *object)
   GpaKeySelector *sel = GPA_KEY_SELECTOR (object);
 
   /* Dereference all keys in the list */
-  g_list_foreach (sel->keys, (GFunc) gpgme_key_unref, NULL);
+  gpa_key_unref_list (sel->keys, GPA_KEY_OWNER_KEYSELECTOR);
   g_list_free (sel->keys);
 
   G_OBJECT_CLASS (parent_class)->finalize (object);
@@ -220,9 +221,14 @@ gpa_key_selector_next_key (gpgme_key_t key, gpointer data)
   gchar *created;
   gchar *userid;
 
+  gpa_key_transfer (key, GPA_KEY_OWNER_KEYTABLE, GPA_KEY_OWNER_KEYSELECTOR);
+
   if (key && selector->only_usable_keys
       && (key->revoked || key->disabled || key->expired || key->invalid))
-    return;
+    {
+      gpa_key_unref (key, GPA_KEY_OWNER_KEYSELECTOR);
+      return;
+    }
 
   selector->keys = g_list_prepend (selector->keys, key);
   store = GTK_LIST_STORE (gtk_tree_view_get_model (GTK_TREE_VIEW (selector)));
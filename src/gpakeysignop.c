@@ -36,6 +36,13 @@
 #include "gpgmeedit.h"
 #include "gtktools.h"
 
+/* Signals */
+enum
+{
+  UPDATED_KEYS,
+  LAST_SIGNAL
+};
+
 /* Internal functions */
 static gboolean gpa_key_sign_operation_idle_cb (gpointer data);
 static void gpa_key_sign_operation_done_error_cb (GpaContext *context,
@@ -48,6 +55,7 @@ static void gpa_key_sign_operation_done_cb (GpaContext *context,
 /* GObject */
 
 static GObjectClass *parent_class = NULL;
+static guint signals [LAST_SIGNAL] = { 0 };
 
 static void
 gpa_key_sign_operation_finalize (GObject *object)
@@ -57,6 +65,9 @@ gpa_key_sign_operation_finalize (GObject *object)
     {
       gpgme_key_unref (op->signer_key);
     }
+  if (op->progress_dialog)
+    gtk_widget_destroy (op->progress_dialog);
+  g_ptr_array_free (op->signed_fprs, TRUE);
   G_OBJECT_CLASS (parent_class)->finalize (object);
 }
 
@@ -66,6 +77,16 @@ gpa_key_sign_operation_init (GpaKeySignOperation *op)
 {
   op->signer_key = NULL;
   op->signed_keys = 0;
+  op->bulk = FALSE;
+  op->sign_locally = FALSE;
+  op->progress_dialog = NULL;
+  op->total = 0;
+  op->already_signed = 0;
+  op->failed = 0;
+  op->err = 0;
+  op->canceled = FALSE;
+  op->signed_fprs = g_ptr_array_new_with_free_func (g_free);
+  op->changed_wot = FALSE;
 }
 
 static GObject*
@@ -103,6 +124,17 @@ gpa_key_sign_operation_class_init (GpaKeySignOperationClass *klass)
 
   object_class->constructor = gpa_key_sign_operation_constructor;
   object_class->finalize = gpa_key_sign_operation_finalize;
+
+  /* Signals */
+  signals[UPDATED_KEYS] =
+    g_signal_new ("updated_keys",
+		  G_TYPE_FROM_CLASS (object_class),
+		  G_SIGNAL_RUN_FIRST,
+		  G_STRUCT_OFFSET (GpaKeySignOperationClass, updated_keys),
+		  NULL, NULL,
+		  g_cclosure_marshal_VOID__POINTER,
+		  G_TYPE_NONE, 1,
+		  G_TYPE_POINTER);
 }
 
 GType
@@ -135,7 +167,8 @@ gpa_key_sign_operation_get_type (void)
 
 /* API */
 
-/* Creates a new key deletion operation.
+/* Creates a new operation signing KEYS with the default key.  Several
+ * keys are signed after a single confirmation.
  */
 GpaKeySignOperation*
 gpa_key_sign_operation_new (GtkWidget *window, GList *keys)
@@ -180,6 +213,180 @@ gpa_key_sign_operation_start (GpaKeySignOperation *op)
 }
 
 
+static void
+gpa_key_sign_operation_bulk_progress (GpaKeySignOperation *op)
+{
+  GtkProgressBar *pbar;
+  guint handled = op->signed_keys + op->already_signed + op->failed;
+  char *text;
+
+  pbar = GTK_PROGRESS_BAR (GPA_PROGRESS_DIALOG (op->progress_dialog)->pbar);
+  text = g_strdup_printf (_("%u of %u keys signed"), op->signed_keys,
+			  op->total);
+  gtk_progress_bar_set_text (pbar, text);
+  gtk_progress_bar_set_fraction (pbar, (double) handled / op->total);
+  g_free (text);
+}
+
+
+/* Report the outcome of a bulk operation and update the key list
+   once.  */
+static void
+gpa_key_sign_operation_bulk_finish (GpaKeySignOperation *op)
+{
+  gtk_widget_hide (op->progress_dialog);
+
+  if (op->already_signed || op->failed)
+    {
+      GString *text = g_string_new (NULL);
+
+      g_string_append_printf (text, _("%u of %u keys have been signed."),
+			      op->signed_keys, op->total);
+      if (op->already_signed)
+	{
+	  g_string_append_c (text, '\n');
+	  g_string_append_printf (text, ngettext
+				  ("%u key had already been signed.",
+				   "%u keys had already been signed.",
+				   op->already_signed), op->already_signed);
+	}
+      if (op->failed)
+	{
+	  g_string_append_c (text, '\n');
+	  g_string_append_printf (text, ngettext
+				  ("%u key could not be signed: %s",
+				   "%u keys could not be signed: %s",
+				   op->failed), op->failed,
+				  gpg_strerror (op->err));
+	}
+      if (op->failed)
+	gpa_window_error (text->str, GPA_OPERATION (op)->window);
+      else
+	gpa_window_message (text->str, GPA_OPERATION (op)->window);
+      g_string_free (text, TRUE);
+    }
+
+  if (op->changed_wot)
+    g_signal_emit_by_name (GPA_OPERATION (op), "changed_wot");
+  else if (op->signed_fprs->len)
+    {
+      g_ptr_array_add (op->signed_fprs, NULL);
+      g_signal_emit (op, signals[UPDATED_KEYS], 0, op->signed_fprs->pdata);
+    }
+  g_signal_emit_by_name (GPA_OPERATION (op), "completed",
+			 op->canceled ? gpg_error (GPG_ERR_CANCELED) : 0);
+}
+
+
+/* Sign the current key of a bulk operation, or finish it if there
+   is none left.  */
+static void
+gpa_key_sign_operation_bulk_next (GpaKeySignOperation *op)
+{
+  GpaKeyOperation *key_op = GPA_KEY_OPERATION (op);
+  gpg_error_t err;
+
+  gpa_key_sign_operation_bulk_progress (op);
+  while (key_op->current && ! op->canceled)
+    {
+      gpgme_key_t key = key_op->current->data;
+
+      if (key->protocol == GPGME_PROTOCOL_OpenPGP)
+	{
+	  err = gpa_gpgme_edit_sign_start (GPA_OPERATION (op)->context, key,
+					   op->signer_key, op->sign_locally);
+	  if (! err)
+	    return;
+	  op->failed++;
+	  if (! op->err)
+	    op->err = err;
+	}
+      key_op->current = g_list_next (key_op->current);
+    }
+
+  gpa_key_sign_operation_bulk_finish (op);
+}
+
+
+/* Account for the signature of the current key of a bulk
+   operation.  */
+static void
+gpa_key_sign_operation_bulk_done (GpaKeySignOperation *op, gpg_error_t err)
+{
+  gpgme_key_t key = GPA_KEY_OPERATION (op)->current->data;
+
+  switch (gpg_err_code (err))
+    {
+    case GPG_ERR_NO_ERROR:
+      op->signed_keys++;
+      g_ptr_array_add (op->signed_fprs, g_strdup (key->subkeys->fpr));
+      /* The key is valid now, which makes its ownertrust count.  */
+      if (key->owner_trust >= GPGME_VALIDITY_MARGINAL)
+	op->changed_wot = TRUE;
+      break;
+    case GPG_ERR_CONFLICT:
+      op->already_signed++;
+      break;
+    case GPG_ERR_CANCELED:
+      op->canceled = TRUE;
+      break;
+    case GPG_ERR_BAD_PASSPHRASE:
+      /* Don't ask for the passphrase again for each key.  */
+      op->canceled = TRUE;
+      /* Fall through.  */
+    default:
+      op->failed++;
+      if (! op->err)
+	op->err = err;
+      break;
+    }
+
+  GPA_KEY_OPERATION (op)->current = g_list_next
+    (GPA_KEY_OPERATION (op)->current);
+  gpa_key_sign_operation_bulk_next (op);
+}
+
+
+static void
+gpa_key_sign_operation_bulk_response_cb (GtkDialog *dialog, gint response,
+					 GpaKeySignOperation *op)
+{
+  /* The running signature is completed.  */
+  op->canceled = TRUE;
+  gtk_dialog_set_response_sensitive (dialog, GTK_RESPONSE_CANCEL, FALSE);
+}
+
+
+/* Ask once for all keys of OP and start signing them.  */
+static gpg_error_t
+gpa_key_sign_operation_bulk_start (GpaKeySignOperation *op)
+{
+  GList *keys = gpa_key_operation_keys (GPA_KEY_OPERATION (op));
+
+  if (! gpa_key_sign_run_dialog_multiple (GPA_OPERATION (op)->window,
+					  keys, &op->sign_locally))
+    return gpg_error (GPG_ERR_CANCELED);
+
+  op->bulk = TRUE;
+  op->total = g_list_length (keys);
+
+  op->progress_dialog = gpa_progress_dialog_new (GPA_OPERATION (op)->window,
+						 NULL);
+  gpa_progress_dialog_set_label (GPA_PROGRESS_DIALOG (op->progress_dialog),
+				 _("Signing keys..."));
+  gtk_progress_bar_set_show_text
+    (GTK_PROGRESS_BAR (GPA_PROGRESS_DIALOG (op->progress_dialog)->pbar), TRUE);
+  gtk_dialog_set_response_sensitive (GTK_DIALOG (op->progress_dialog),
+				     GTK_RESPONSE_CANCEL, TRUE);
+  g_signal_connect (G_OBJECT (op->progress_dialog), "response",
+		    G_CALLBACK (gpa_key_sign_operation_bulk_response_cb), op);
+  gtk_widget_show_all (op->progress_dialog);
+
+  gpa_key_sign_operation_bulk_next (op);
+  return 0;
+}
+
+
 static gboolean
 gpa_key_sign_operation_idle_cb (gpointer data)
 {
@@ -198,7 +405,10 @@ gpa_key_sign_operation_idle_cb (gpointer data)
     }
   gpgme_key_ref (op->signer_key);
 
-  err = gpa_key_sign_operation_start (op);
+  if (gpa_key_operation_keys (GPA_KEY_OPERATION (op))->next)
+    err = gpa_key_sign_operation_bulk_start (op);
+  else
+    err = gpa_key_sign_operation_start (op);
   if (err)
     g_signal_emit_by_name (GPA_OPERATION (op), "completed", err);
 
@@ -229,6 +439,10 @@ gpa_key_sign_operation_done_error_cb (GpaContext *context,
                                       gpg_error_t err,
                                       GpaKeySignOperation *op)
 {
+  /* A bulk operation reports all errors at the end.  */
+  if (op->bulk)
+    return;
+
   switch (gpg_err_code (err))
     {
     case GPG_ERR_NO_ERROR:
@@ -265,6 +479,12 @@ gpa_key_sign_operation_done_cb (GpaContext *context,
                                 gpg_error_t err,
                                 GpaKeySignOperation *op)
 {
+  if (op->bulk)
+    {
+      gpa_key_sign_operation_bulk_done (op, err);
+      return;
+    }
+
   GPA_KEY_OPERATION (op)->current = g_list_next
     (GPA_KEY_OPERATION (op)->current);
   gpa_key_sign_operation_next (op);
@@ -25,6 +25,7 @@
 #include <glib-object.h>
 #include "gpa.h"
 #include "gpakeyop.h"
+#include "gpaprogressdlg.h"
 
 /* GObject stuff */
 #define GPA_KEY_SIGN_OPERATION_TYPE	  (gpa_key_sign_operation_get_type ())
@@ -42,17 +43,37 @@ struct _GpaKeySignOperation {
 
   gpgme_key_t signer_key;
   int signed_keys;
+
+  /* For several keys the options are asked for once and the keys are
+     signed one after the other without further questions.  */
+  gboolean bulk;
+  gboolean sign_locally;
+  GtkWidget *progress_dialog;
+  guint total;
+  guint already_signed;
+  guint failed;
+  gpg_error_t err;
+  gboolean canceled;
+
+  /* The fingerprints of the signed keys, and whether their new
+     validity may change the validity of other keys.  */
+  GPtrArray *signed_fprs;
+  gboolean changed_wot;
 };
 
 struct _GpaKeySignOperationClass {
   GpaKeyOperationClass parent_class;
+
+  /* Signal handlers */
+  void (*updated_keys) (GpaKeySignOperation *op, const char **fprs);
 };
 
 GType gpa_key_sign_operation_get_type (void) G_GNUC_CONST;
 
 /* API */
 
-/* Creates a new key deletion operation.
+/* Creates a new operation signing KEYS with the default key.  Several
+ * keys are signed after a single confirmation.
  */
 GpaKeySignOperation*
 gpa_key_sign_operation_new (GtkWidget *window, GList *keys);
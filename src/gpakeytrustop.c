@@ -31,11 +31,19 @@
 #endif
 
 #include "gpa.h"
+#include "i18n.h"
 #include "gpakeytrustop.h"
 #include "ownertrustdlg.h"
 #include "gpgmeedit.h"
 #include "gtktools.h"
 
+/* Signals */
+enum
+{
+  UPDATED_KEYS,
+  LAST_SIGNAL
+};
+
 /* Internal functions */
 static gboolean gpa_key_trust_operation_idle_cb (gpointer data);
 static void gpa_key_trust_operation_done_error_cb (GpaContext *context,
@@ -44,14 +52,23 @@ static void gpa_key_trust_operation_done_error_cb (GpaContext *context,
 static void gpa_key_trust_operation_done_cb (GpaContext *context,
 					      gpg_error_t err,
 					      GpaKeyTrustOperation *op);
+static void gpa_key_trust_operation_next_key_cb (GpaContext *context,
+						  gpgme_key_t key,
+						  GpaKeyTrustOperation *op);
 
 /* GObject */
 
 static GObjectClass *parent_class = NULL;
+static guint signals [LAST_SIGNAL] = { 0 };
 
 static void
 gpa_key_trust_operation_finalize (GObject *object)
 {
+  GpaKeyTrustOperation *op = GPA_KEY_TRUST_OPERATION (object);
+
+  gpgme_data_release (op->table);
+  g_ptr_array_free (op->changed, TRUE);
+
   G_OBJECT_CLASS (parent_class)->finalize (object);
 }
 
@@ -60,6 +77,13 @@ static void
 gpa_key_trust_operation_init (GpaKeyTrustOperation *op)
 {
   op->modified_keys = 0;
+  op->bulk = FALSE;
+  op->table = NULL;
+  op->changed = g_ptr_array_new_with_free_func (g_free);
+  op->changed_wot = FALSE;
+  op->trust = GPGME_VALIDITY_UNKNOWN;
+  op->verifying = FALSE;
+  op->unchanged = 0;
 }
 
 static GObject*
@@ -82,6 +106,8 @@ gpa_key_trust_operation_constructor (GType type,
 		    G_CALLBACK (gpa_key_trust_operation_done_error_cb), op);
   g_signal_connect (G_OBJECT (GPA_OPERATION (op)->context), "done",
 		    G_CALLBACK (gpa_key_trust_operation_done_cb), op);
+  g_signal_connect (G_OBJECT (GPA_OPERATION (op)->context), "next_key",
+		    G_CALLBACK (gpa_key_trust_operation_next_key_cb), op);
   /* Start with the first key after going back into the main loop */
   g_idle_add (gpa_key_trust_operation_idle_cb, op);
 
@@ -97,6 +123,17 @@ gpa_key_trust_operation_class_init (GpaKeyTrustOperationClass *klass)
 
   object_class->constructor = gpa_key_trust_operation_constructor;
   object_class->finalize = gpa_key_trust_operation_finalize;
+
+  /* Signals */
+  signals[UPDATED_KEYS] =
+    g_signal_new ("updated_keys",
+		  G_TYPE_FROM_CLASS (object_class),
+		  G_SIGNAL_RUN_FIRST,
+		  G_STRUCT_OFFSET (GpaKeyTrustOperationClass, updated_keys),
+		  NULL, NULL,
+		  g_cclosure_marshal_VOID__POINTER,
+		  G_TYPE_NONE, 1,
+		  G_TYPE_POINTER);
 }
 
 GType
@@ -129,7 +166,8 @@ gpa_key_trust_operation_get_type (void)
 
 /* API */
 
-/* Creates a new key deletion operation.
+/* Creates a new operation setting the ownertrust of KEYS.  The
+ * ownertrust of several keys is set at once.
  */
 GpaKeyTrustOperation*
 gpa_key_trust_operation_new (GtkWidget *window, GList *keys)
@@ -146,6 +184,140 @@ gpa_key_trust_operation_new (GtkWidget *window, GList *keys)
 
 /* Internal */
 
+/* Return the value of TRUST in an ownertrust table as written by
+   "gpg --export-ownertrust".  "Unknown" is stored the same way as
+   the "I don't know" of "gpg --edit-key".  */
+static int
+ownertrust_value (gpgme_validity_t trust)
+{
+  switch (trust)
+    {
+    case GPGME_VALIDITY_NEVER:
+      return 3;
+    case GPGME_VALIDITY_MARGINAL:
+      return 4;
+    case GPGME_VALIDITY_FULL:
+      return 5;
+    case GPGME_VALIDITY_ULTIMATE:
+      return 6;
+    default:
+      return 2;
+    }
+}
+
+
+/* Return true if keys with the ownertrust TRUST are used to validate
+   other keys.  */
+static gboolean
+trust_counts (gpgme_validity_t trust)
+{
+  return (trust == GPGME_VALIDITY_MARGINAL || trust == GPGME_VALIDITY_FULL
+          || trust == GPGME_VALIDITY_ULTIMATE);
+}
+
+
+/* Ask for one ownertrust for all keys of OP and import it for the
+   keys whose ownertrust changes with a single gpg process.  */
+static gpg_error_t
+gpa_key_trust_operation_bulk_start (GpaKeyTrustOperation *op)
+{
+  gpgme_ctx_t ctx = GPA_OPERATION (op)->context->ctx;
+  GList *keys = gpa_key_operation_keys (GPA_KEY_OPERATION (op));
+  const char *gpg, *homedir;
+  gpgme_validity_t trust;
+  GString *table;
+  GPtrArray *argv;
+  GList *item;
+  gpg_error_t err;
+
+  if (! gpa_ownertrust_run_dialog_multiple (keys, GPA_OPERATION (op)->window,
+					    &trust))
+    return gpg_error (GPG_ERR_CANCELED);
+
+  op->bulk = TRUE;
+  op->trust = trust;
+  table = g_string_new (NULL);
+  for (item = keys; item; item = g_list_next (item))
+    {
+      gpgme_key_t key = item->data;
+
+      if (key->protocol != GPGME_PROTOCOL_OpenPGP
+	  || !key->subkeys || !key->subkeys->fpr
+	  || ownertrust_value (key->owner_trust) == ownertrust_value (trust))
+	continue;
+
+      g_string_append_printf (table, "%s:%d:\n", key->subkeys->fpr,
+			      ownertrust_value (trust));
+      g_ptr_array_add (op->changed, g_strdup (key->subkeys->fpr));
+      if (trust_counts (key->owner_trust) || trust_counts (trust))
+	op->changed_wot = TRUE;
+    }
+  if (! op->changed->len)
+    {
+      g_string_free (table, TRUE);
+      return gpg_error (GPG_ERR_CANCELED);
+    }
+
+  gpg = gpa_get_gpg_engine (ctx, &homedir);
+  if (! gpg)
+    {
+      g_string_free (table, TRUE);
+      gpa_gpgme_warning (gpg_error (GPG_ERR_NOT_SUPPORTED));
+      return gpg_error (GPG_ERR_NOT_SUPPORTED);
+    }
+
+  err = gpgme_data_new_from_mem (&op->table, table->str, table->len, 1);
+  g_string_free (table, TRUE);
+  if (err)
+    {
+      gpa_gpgme_warning (err);
+      return err;
+    }
+
+  argv = g_ptr_array_new ();
+  g_ptr_array_add (argv, (char *) gpg);
+  g_ptr_array_add (argv, "--batch");
+  g_ptr_array_add (argv, "--no-tty");
+  if (homedir)
+    {
+      g_ptr_array_add (argv, "--homedir");
+      g_ptr_array_add (argv, (char *) homedir);
+    }
+  g_ptr_array_add (argv, "--import-ownertrust");
+  g_ptr_array_add (argv, NULL);
+
+  err = gpgme_set_protocol (ctx, GPGME_PROTOCOL_SPAWN);
+  if (! err)
+    err = gpgme_op_spawn_start (ctx, gpg, (const char **) argv->pdata,
+				op->table, NULL, NULL, 0);
+  g_ptr_array_free (argv, TRUE);
+  if (err)
+    {
+      gpa_gpgme_warning (err);
+      return err;
+    }
+
+  return 0;
+}
+
+
+/* List the changed keys of OP to check their new ownertrust.  The
+   spawned gpg does not report whether the import succeeded.  */
+static gpg_error_t
+start_verify (GpaKeyTrustOperation *op)
+{
+  gpgme_ctx_t ctx = GPA_OPERATION (op)->context->ctx;
+
+  op->verifying = TRUE;
+  op->unchanged = op->changed->len;
+  g_ptr_array_add (op->changed, NULL);
+  gpgme_set_protocol (ctx, GPGME_PROTOCOL_OpenPGP);
+  gpgme_set_keylist_mode (ctx, GPGME_KEYLIST_MODE_LOCAL);
+  return gpgme_op_keylist_ext_start (ctx, (const char **) op->changed->pdata,
+                                     0, 0);
+}
+
+
 static gpg_error_t
 gpa_key_trust_operation_start (GpaKeyTrustOperation *op)
 {
@@ -174,9 +346,13 @@ static gboolean
 gpa_key_trust_operation_idle_cb (gpointer data)
 {
   GpaKeyTrustOperation *op = data;
+  GList *keys = gpa_key_operation_keys (GPA_KEY_OPERATION (op));
   gpg_error_t err;
 
-  err = gpa_key_trust_operation_start (op);
+  if (keys && keys->next)
+    err = gpa_key_trust_operation_bulk_start (op);
+  else
+    err = gpa_key_trust_operation_start (op);
   if (err)
     g_signal_emit_by_name (GPA_OPERATION (op), "completed", err);
 
@@ -223,7 +399,51 @@ static void gpa_key_trust_operation_done_cb (GpaContext *context,
 					      gpg_error_t err,
 					      GpaKeyTrustOperation *op)
 {
+  if (op->bulk && ! op->verifying)
+    {
+      if (! err)
+	err = start_verify (op);
+      if (err)
+	g_signal_emit_by_name (GPA_OPERATION (op), "completed", err);
+      return;
+    }
+  else if (op->bulk)
+    {
+      if (! err && op->unchanged)
+	{
+	  gchar *message = g_strdup_printf
+	    (ngettext ("The ownertrust of %u key could not be changed.",
+		       "The ownertrust of %u keys could not be changed.",
+		       op->unchanged), op->unchanged);
+
+	  gpa_window_error (message, GPA_OPERATION (op)->window);
+	  g_free (message);
+	  err = gpg_error (GPG_ERR_GENERAL);
+	}
+
+      /* Without a change of the web of trust only the keys themselves
+	 need to be listed again, which the check has already done for
+	 the trustdb.  */
+      if (op->changed_wot)
+	g_signal_emit_by_name (GPA_OPERATION (op), "changed_wot");
+      else
+	g_signal_emit (op, signals[UPDATED_KEYS], 0, op->changed->pdata);
+      g_signal_emit_by_name (GPA_OPERATION (op), "completed", err);
+      return;
+    }
+
   GPA_KEY_OPERATION (op)->current = g_list_next
     (GPA_KEY_OPERATION (op)->current);
   gpa_key_trust_operation_next (op);
 }
+
+static void
+gpa_key_trust_operation_next_key_cb (GpaContext *context, gpgme_key_t key,
+				     GpaKeyTrustOperation *op)
+{
+  if (op->verifying
+      && ownertrust_value (key->owner_trust) == ownertrust_value (op->trust)
+      && op->unchanged)
+    op->unchanged--;
+  gpgme_key_unref (key);
+}
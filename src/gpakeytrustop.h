@@ -41,17 +41,36 @@ struct _GpaKeyTrustOperation {
   GpaKeyOperation parent;
 
   int modified_keys;
+
+  /* For several keys an ownertrust table with the fingerprints in
+     CHANGED is imported by a single gpg process.  */
+  gboolean bulk;
+  gpgme_data_t table;
+  GPtrArray *changed;
+
+  /* Set if the change may affect the validity of other keys.  */
+  gboolean changed_wot;
+
+  /* The new ownertrust.  After the import the changed keys are
+     listed to count those whose ownertrust is still different.  */
+  gpgme_validity_t trust;
+  gboolean verifying;
+  guint unchanged;
 };
 
 struct _GpaKeyTrustOperationClass {
   GpaKeyOperationClass parent_class;
+
+  /* Signal handlers */
+  void (*updated_keys) (GpaKeyTrustOperation *op, const char **fprs);
 };
 
 GType gpa_key_trust_operation_get_type (void) G_GNUC_CONST;
 
 /* API */
 
-/* Creates a new key deletion operation.
+/* Creates a new operation setting the ownertrust of KEYS.  The
+ * ownertrust of several keys is set at once.
  */
 GpaKeyTrustOperation*
 gpa_key_trust_operation_new (GtkWidget *window, GList *keys);
@@ -26,6 +26,7 @@
 #include "gpgmetools.h"
 #include "i18n.h"
 #include "gpa-marshal.h"
+#include "gpatrace.h"
 
 #ifndef G_PARAM_STATIC_STRINGS
 #define G_PARAM_STATIC_STRINGS (G_PARAM_STATIC_NAME | G_PARAM_STATIC_NICK \
@@ -131,6 +132,7 @@ gpa_operation_constructor (GType                  type,
   op = GPA_OPERATION (object);
   /* Initialize */
   op->context = gpa_context_new ();
+  gpa_trace_operation (op);
 
   return object;
 }
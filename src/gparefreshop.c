@@ -0,0 +1,400 @@
+/* gparefreshop.c - The GpaRefreshOperation object.
+ * Copyright (C) 2026 g10 Code GmbH
+ *
+ * This file is part of GPA
+ *
+ * GPA is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GPA is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+   The keys are requested from the keyserver in batches, each batch
+   with one gpg --recv-keys run, as scheduled by serverbatch.c.  The
+   results of all batches are added up and shown once at the end.
+   Then the changed keys are listed again, or the whole keyring is
+   reloaded if too many keys have changed.
+ */
+
+#include <config.h>
+
+#include <string.h>
+#include <gpgme.h>
+#include "gpa.h"
+#include "i18n.h"
+#include "gtktools.h"
+#include "keyref.h"
+#include "gpaprogressdlg.h"
+#include "gparefreshop.h"
+
+
+/* The maximum number of changed keys for which the key list is
+   updated key by key.  With more changed keys the whole list is
+   reloaded.  */
+#define REFRESH_UPDATE_LIMIT 1000
+
+static GObjectClass *parent_class = NULL;
+
+/* Signals */
+enum
+{
+  IMPORTED_KEYS,
+  UPDATED_KEYS,
+  LAST_SIGNAL
+};
+static guint signals [LAST_SIGNAL] = { 0 };
+
+
+/* GObject boilerplate */
+
+static void
+gpa_refresh_operation_finalize (GObject *object)
+{
+  GpaRefreshOperation *op = GPA_REFRESH_OPERATION (object);
+  guint i;
+
+  gpa_server_batch_release (op->batch);
+  for (i = 0; i < op->keys->len; i++)
+    gpa_key_unref (g_ptr_array_index (op->keys, i), GPA_KEY_OWNER_SERVER);
+  g_ptr_array_free (op->keys, TRUE);
+  g_hash_table_destroy (op->changed);
+  gtk_widget_destroy (op->progress_dialog);
+
+  G_OBJECT_CLASS (parent_class)->finalize (object);
+}
+
+
+static void
+gpa_refresh_operation_init (GpaRefreshOperation *op)
+{
+  op->progress_dialog = NULL;
+  op->keys = g_ptr_array_new ();
+  op->list_all = FALSE;
+  op->done = 0;
+  op->batch = NULL;
+  op->canceled = FALSE;
+  op->changed = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  op->too_many = FALSE;
+  op->err = 0;
+  memset (&op->result, 0, sizeof op->result);
+}
+
+
+static void
+update_progress (GpaRefreshOperation *op)
+{
+  GtkProgressBar *pbar;
+  char *text;
+
+  pbar = GTK_PROGRESS_BAR (GPA_PROGRESS_DIALOG (op->progress_dialog)->pbar);
+  if (!op->keys->len)
+    return;
+
+  text = g_strdup_printf (_("%u of %u keys"), op->done, op->keys->len);
+  gtk_progress_bar_set_text (pbar, text);
+  gtk_progress_bar_set_fraction (pbar, (double) op->done / op->keys->len);
+  g_free (text);
+}
+
+
+static void
+finish (GpaRefreshOperation *op)
+{
+  gtk_widget_hide (op->progress_dialog);
+
+  if (op->err && !op->canceled)
+    gpa_gpgme_warning (op->err);
+  if (op->result.considered)
+    gpa_gpgme_show_import_results (GPA_OPERATION (op)->window, &op->result);
+
+  /* Update the key list only once for all the batches.  */
+  if (op->too_many)
+    g_signal_emit (op, signals[IMPORTED_KEYS], 0);
+  else if (g_hash_table_size (op->changed))
+    {
+      const char **fprs;
+
+      fprs = (const char **) g_hash_table_get_keys_as_array (op->changed,
+                                                             NULL);
+      g_signal_emit (op, signals[UPDATED_KEYS], 0, fprs);
+      g_free (fprs);
+    }
+
+  g_signal_emit_by_name (GPA_OPERATION (op), "completed",
+                         op->canceled? gpg_error (GPG_ERR_CANCELED) : op->err);
+}
+
+
+static gpg_error_t
+request_start_cb (GpaContext *context, gpgme_key_t *keys, void *opaque)
+{
+  gpgme_set_protocol (context->ctx, GPGME_PROTOCOL_OpenPGP);
+  return gpgme_op_import_keys_start (context->ctx, keys);
+}
+
+
+static void
+request_done_cb (GpaContext *context, gpgme_key_t *keys, guint count,
+                 gpg_error_t err, void *opaque)
+{
+  GpaRefreshOperation *op = opaque;
+  gpgme_import_result_t res;
+  gpgme_import_status_t imp;
+
+  /* A failed batch may still have imported some of the keys.  */
+  res = context? gpgme_op_import_result (context->ctx) : NULL;
+  if (res)
+    {
+      gpa_gpgme_update_import_results (&op->result, 0, 0, res);
+      for (imp = res->imports; imp && !op->too_many; imp = imp->next)
+        if (!imp->result && imp->status && imp->fpr)
+          {
+            g_hash_table_add (op->changed, g_strdup (imp->fpr));
+            if (g_hash_table_size (op->changed) > REFRESH_UPDATE_LIMIT)
+              op->too_many = TRUE;
+          }
+    }
+  if (err && gpg_err_code (err) != GPG_ERR_CANCELED && !op->err)
+    op->err = err;
+
+  op->done += count;
+  update_progress (op);
+}
+
+
+static void
+request_finish_cb (void *opaque)
+{
+  finish (opaque);
+}
+
+
+static void
+start_requests (GpaRefreshOperation *op)
+{
+  op->batch = gpa_server_batch_new (request_start_cb, request_done_cb,
+                                    request_finish_cb, op);
+  gpa_server_batch_add_keys (op->batch, (gpgme_key_t *) op->keys->pdata,
+                             op->keys->len);
+  update_progress (op);
+  gpa_server_batch_run (op->batch);
+}
+
+
+static void
+list_next_key_cb (GpaContext *context, gpgme_key_t key,
+                  GpaRefreshOperation *op)
+{
+  gpa_key_acquired (key, GPA_KEY_OWNER_SERVER);
+  g_ptr_array_add (op->keys, key);
+}
+
+
+static void
+list_done_cb (GpaContext *context, gpg_error_t err, GpaRefreshOperation *op)
+{
+  if (op->canceled)
+    err = gpg_error (GPG_ERR_CANCELED);
+  if (err)
+    {
+      if (gpg_err_code (err) != GPG_ERR_CANCELED)
+        gpa_gpgme_warning (err);
+      gtk_widget_hide (op->progress_dialog);
+      g_signal_emit_by_name (GPA_OPERATION (op), "completed", err);
+      return;
+    }
+
+  start_requests (op);
+}
+
+
+static void
+progress_response_cb (GtkDialog *dialog, gint response,
+                      GpaRefreshOperation *op)
+{
+  if (op->canceled)
+    return;
+  op->canceled = TRUE;
+
+  /* Cancelling may complete the operation right away.  */
+  g_object_ref (op);
+  if (gpa_context_busy (GPA_OPERATION (op)->context))
+    gpgme_cancel (GPA_OPERATION (op)->context->ctx);
+  if (op->batch)
+    gpa_server_batch_cancel (op->batch);
+  g_object_unref (op);
+}
+
+
+static gboolean
+gpa_refresh_operation_idle_cb (gpointer data)
+{
+  GpaRefreshOperation *op = data;
+  GpaContext *context = GPA_OPERATION (op)->context;
+  gpg_error_t err;
+
+  /* Older versions of gpg can't fetch keys by fingerprint.  */
+  if (!is_gpg_version_at_least ("2.1.0"))
+    {
+      gpa_window_error (_("Refreshing several keys at once requires "
+                          "GnuPG 2.1 or later."), GPA_OPERATION (op)->window);
+      g_signal_emit_by_name (GPA_OPERATION (op), "completed",
+                             gpg_error (GPG_ERR_NOT_SUPPORTED));
+      return FALSE;
+    }
+
+  gtk_widget_show_all (op->progress_dialog);
+
+  if (!op->list_all)
+    {
+      start_requests (op);
+      return FALSE;
+    }
+
+  gpgme_set_protocol (context->ctx, GPGME_PROTOCOL_OpenPGP);
+  gpgme_set_keylist_mode (context->ctx, GPGME_KEYLIST_MODE_LOCAL);
+  err = gpgme_op_keylist_start (context->ctx, NULL, 0);
+  if (err)
+    {
+      gpa_gpgme_warning (err);
+      gtk_widget_hide (op->progress_dialog);
+      g_signal_emit_by_name (GPA_OPERATION (op), "completed", err);
+    }
+
+  return FALSE;
+}
+
+
+static GObject*
+gpa_refresh_operation_constructor (GType type,
+                                   guint n_construct_properties,
+                                   GObjectConstructParam *construct_properties)
+{
+  GObject *object;
+  GpaRefreshOperation *op;
+
+  /* Invoke parent's constructor */
+  object = parent_class->constructor (type,
+				      n_construct_properties,
+				      construct_properties);
+  op = GPA_REFRESH_OPERATION (object);
+
+  /* The context of the operation itself is only used to list the
+     keys.  */
+  g_signal_connect (G_OBJECT (GPA_OPERATION (op)->context), "next_key",
+		    G_CALLBACK (list_next_key_cb), op);
+  g_signal_connect (G_OBJECT (GPA_OPERATION (op)->context), "done",
+		    G_CALLBACK (list_done_cb), op);
+
+  op->progress_dialog = gpa_progress_dialog_new (GPA_OPERATION (op)->window,
+						 GPA_OPERATION (op)->context);
+  gpa_progress_dialog_set_label (GPA_PROGRESS_DIALOG (op->progress_dialog),
+				 _("Refreshing keys from the keyserver..."));
+  gtk_progress_bar_set_show_text
+    (GTK_PROGRESS_BAR (GPA_PROGRESS_DIALOG (op->progress_dialog)->pbar), TRUE);
+  gtk_dialog_set_response_sensitive (GTK_DIALOG (op->progress_dialog),
+                                     GTK_RESPONSE_CANCEL, TRUE);
+  g_signal_connect (G_OBJECT (op->progress_dialog), "response",
+		    G_CALLBACK (progress_response_cb), op);
+
+  /* Begin working when we are back into the main loop */
+  g_idle_add (gpa_refresh_operation_idle_cb, op);
+
+  return object;
+}
+
+
+static void
+gpa_refresh_operation_class_init (GpaRefreshOperationClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  parent_class = g_type_class_peek_parent (klass);
+
+  object_class->constructor = gpa_refresh_operation_constructor;
+  object_class->finalize    = gpa_refresh_operation_finalize;
+
+  /* Signals */
+  klass->imported_keys = NULL;
+  signals[IMPORTED_KEYS] =
+    g_signal_new ("imported_keys",
+		  G_TYPE_FROM_CLASS (object_class),
+		  G_SIGNAL_RUN_FIRST,
+		  G_STRUCT_OFFSET (GpaRefreshOperationClass, imported_keys),
+		  NULL, NULL,
+		  g_cclosure_marshal_VOID__VOID,
+		  G_TYPE_NONE, 0);
+  klass->updated_keys = NULL;
+  signals[UPDATED_KEYS] =
+    g_signal_new ("updated_keys",
+		  G_TYPE_FROM_CLASS (object_class),
+		  G_SIGNAL_RUN_FIRST,
+		  G_STRUCT_OFFSET (GpaRefreshOperationClass, updated_keys),
+		  NULL, NULL,
+		  g_cclosure_marshal_VOID__POINTER,
+		  G_TYPE_NONE, 1, G_TYPE_POINTER);
+}
+
+
+GType
+gpa_refresh_operation_get_type (void)
+{
+  static GType type = 0;
+
+  if (!type)
+    {
+      static const GTypeInfo info =
+      {
+        sizeof (GpaRefreshOperationClass),
+        (GBaseInitFunc) NULL,
+        (GBaseFinalizeFunc) NULL,
+        (GClassInitFunc) gpa_refresh_operation_class_init,
+        NULL,           /* class_finalize */
+        NULL,           /* class_data */
+        sizeof (GpaRefreshOperation),
+        0,              /* n_preallocs */
+        (GInstanceInitFunc) gpa_refresh_operation_init,
+      };
+
+      type = g_type_register_static (GPA_OPERATION_TYPE,
+                                     "GpaRefreshOperation",
+                                     &info, 0);
+    }
+
+  return type;
+}
+
+
+/* API */
+
+GpaRefreshOperation *
+gpa_refresh_operation_new (GtkWidget *window, GList *keys)
+{
+  GpaRefreshOperation *op;
+
+  op = g_object_new (GPA_REFRESH_OPERATION_TYPE,
+		     "window", window, NULL);
+
+  op->list_all = !keys;
+  for (; keys; keys = keys->next)
+    {
+      gpgme_key_t key = keys->data;
+
+      if (key->protocol != GPGME_PROTOCOL_OpenPGP
+          || !key->subkeys || !key->subkeys->fpr)
+        continue;
+      gpa_key_ref (key, GPA_KEY_OWNER_SERVER);
+      g_ptr_array_add (op->keys, key);
+    }
+
+  return op;
+}
@@ -0,0 +1,102 @@
+/* gparefreshop.h - The GpaRefreshOperation object.
+ * Copyright (C) 2026 g10 Code GmbH
+ *
+ * This file is part of GPA
+ *
+ * GPA is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GPA is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GPA_REFRESH_OP_H
+#define GPA_REFRESH_OP_H
+#ifdef ENABLE_KEYSERVER_SUPPORT
+
+#include "gpa.h"
+#include <glib.h>
+#include <glib-object.h>
+#include "gpaoperation.h"
+#include "gpgmetools.h"
+#include "serverbatch.h"
+
+/* GObject stuff */
+#define GPA_REFRESH_OPERATION_TYPE \
+  (gpa_refresh_operation_get_type ())
+
+#define GPA_REFRESH_OPERATION(obj)                                      \
+  (G_TYPE_CHECK_INSTANCE_CAST ((obj), GPA_REFRESH_OPERATION_TYPE,       \
+                               GpaRefreshOperation))
+
+#define GPA_REFRESH_OPERATION_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_CAST ((klass), GPA_REFRESH_OPERATION_TYPE, \
+                            GpaRefreshOperationClass))
+
+#define GPA_IS_REFRESH_OPERATION(obj) \
+  (G_TYPE_CHECK_INSTANCE_TYPE ((obj), GPA_REFRESH_OPERATION_TYPE))
+
+#define GPA_IS_REFRESH_OPERATION_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_TYPE ((klass), GPA_REFRESH_OPERATION_TYPE))
+
+#define GPA_REFRESH_OPERATION_GET_CLASS(obj) \
+  (G_TYPE_INSTANCE_GET_CLASS ((obj), GPA_REFRESH_OPERATION_TYPE, \
+                              GpaRefreshOperationClass))
+
+typedef struct _GpaRefreshOperation      GpaRefreshOperation;
+typedef struct _GpaRefreshOperationClass GpaRefreshOperationClass;
+
+struct _GpaRefreshOperation
+{
+  GpaOperation parent;
+
+  GtkWidget *progress_dialog;
+
+  /* The keys to refresh.  If the operation has been created without
+     keys they are listed from the keyring first.  */
+  GPtrArray *keys;
+  gboolean list_all;
+
+  /* The number of keys whose request has finished.  */
+  guint done;
+
+  /* The scheduler of the requests.  */
+  gpa_server_batch_t batch;
+
+  gboolean canceled;
+  GHashTable *changed;    /* Fingerprints of the changed keys.  */
+  gboolean too_many;      /* Too many changed keys to remember.  */
+  gpg_error_t err;
+  struct gpa_import_result_s result;
+};
+
+
+struct _GpaRefreshOperationClass
+{
+  GpaOperationClass parent_class;
+
+  /* Signal handlers */
+  void (*imported_keys) (GpaRefreshOperation *op);
+  void (*updated_keys) (GpaRefreshOperation *op, const char **fprs);
+};
+
+
+GType gpa_refresh_operation_get_type (void) G_GNUC_CONST;
+
+/* API */
+
+/* Creates a new operation refreshing the OpenPGP keys in KEYS from
+   the keyserver, or all OpenPGP keys if KEYS is NULL.  The operation
+   takes its own references to the keys.  */
+GpaRefreshOperation *
+gpa_refresh_operation_new (GtkWidget *window, GList *keys);
+
+#endif /*ENABLE_KEYSERVER_SUPPORT*/
+#endif /*GPA_REFRESH_OP_H*/
@@ -37,6 +37,7 @@ struct _GpaStreamEncryptOperation
   GSList *recipients;
   gpgme_key_t *keys;
   gpgme_protocol_t selected_protocol;
+  gpa_compress_policy_t compress;
 };
 
 
@@ -323,6 +324,7 @@ static void
 start_encryption (GpaStreamEncryptOperation *op)
 {
   gpg_error_t err;
+  gpgme_encrypt_flags_t flags;
   int prep_only = 0;
 
   if (!op->keys || !op->keys[0])
@@ -368,8 +370,13 @@ start_encryption (GpaStreamEncryptOperation *op)
 
       /* We always trust the keys because the recipient selection
          dialog has already sorted unusable out.  */
+      flags = GPGME_ENCRYPT_ALWAYS_TRUST;
+      /* The input stream can't be sampled, thus the automatic policy
+         leaves the decision to the engine.  */
+      if (op->compress == GPA_COMPRESS_NEVER)
+        flags |= GPGME_ENCRYPT_NO_COMPRESS;
       err = gpgme_op_encrypt_start (GPA_OPERATION (op)->context->ctx,
-                                    op->keys, GPGME_ENCRYPT_ALWAYS_TRUST,
+                                    op->keys, flags,
                                     GPA_STREAM_OPERATION (op)->input_stream,
                                     GPA_STREAM_OPERATION (op)->output_stream);
       if (err)
@@ -523,3 +530,15 @@ gpa_stream_encrypt_operation_get_keys (GpaStreamEncryptOperation *op,
     *r_protocol = op->selected_protocol;
   return gpa_gpgme_copy_keyarray (op->keys);
 }
+
+
+/* Set the compression policy for OP.  Must be called before the
+   operation starts.  */
+void
+gpa_stream_encrypt_operation_set_compress (GpaStreamEncryptOperation *op,
+                                           gpa_compress_policy_t policy)
+{
+  g_return_if_fail (op);
+
+  op->compress = policy;
+}
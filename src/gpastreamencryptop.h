@@ -74,6 +74,10 @@ gpa_stream_encrypt_operation_new (GtkWidget *window,
 gpgme_key_t *gpa_stream_encrypt_operation_get_keys 
 (GpaStreamEncryptOperation *op, gpgme_protocol_t *r_protocol);
 
+/* Set the compression policy for OP.  */
+void gpa_stream_encrypt_operation_set_compress
+(GpaStreamEncryptOperation *op, gpa_compress_policy_t policy);
+
 
 
 #endif /*GPA_STREAM_ENCRYPT_OP_H*/
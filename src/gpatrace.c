@@ -0,0 +1,386 @@
+/* gpatrace.c - Trace-event recording.
+   Copyright (C) 2026 g10 Code GmbH
+
+   This file is part of GPA.
+
+   GPA is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   GPA is distributed in the hope that it will be useful, but WITHOUT
+   ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+   or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public
+   License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, see <http://www.gnu.org/licenses/>.  */
+
+/*
+   The trace is written in the JSON array format of the Chrome trace
+   event specification.  Operations, gpgme operations, dialogs and
+   server commands overlap and are thus written as async events with
+   the address of the object as id.  The gpgme I/O callbacks are
+   written as complete events on one track per file descriptor; key
+   listing batches are the next_key signals emitted during one I/O
+   callback and are written on the main track.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <gtk/gtk.h>
+
+#include "gpa.h"
+#include "gpacontext.h"
+#include "gpaoperation.h"
+#include "gpatrace.h"
+
+
+/* The track of the main loop.  I/O callbacks use the file descriptor
+   plus this offset as track.  */
+#define MAIN_TRACK 0
+#define FD_TRACK_OFFSET 1000
+
+/* The stream the trace is written to; NULL if tracing is off.  */
+static FILE *trace_fp;
+
+/* The time the trace was opened.  */
+static gint64 trace_start;
+
+/* True if no event has been written yet.  */
+static gboolean first_event;
+
+/* The set of tracks which have been named.  */
+static GHashTable *named_tracks;
+
+/* Map UI server connections to the name of their current
+   command.  */
+static GHashTable *server_commands;
+
+/* The number of keys received since the last I/O callback.  */
+static unsigned int batch_keys;
+
+/* Counters to name the key listing batches.  */
+static unsigned long batch_count;
+
+
+
+static void
+write_string (const char *string)
+{
+  putc ('\"', trace_fp);
+  for (; string && *string; string++)
+    {
+      if (*string == '\"' || *string == '\\')
+        fprintf (trace_fp, "\\%c", *string);
+      else if ((unsigned char) *string < 0x20)
+        fprintf (trace_fp, "\\u%04x", *string);
+      else
+        putc (*string, trace_fp);
+    }
+  putc ('\"', trace_fp);
+}
+
+
+/* Write the common part of an event.  The caller must finish the
+   object with a closing brace.  */
+static void
+begin_event (const char *phase, const char *cat, const char *name,
+             int track, gint64 ts)
+{
+  fputs (first_event? "\n" : ",\n", trace_fp);
+  first_event = FALSE;
+  fprintf (trace_fp, "{\"ph\":\"%s\",\"cat\":", phase);
+  write_string (cat);
+  fputs (",\"name\":", trace_fp);
+  write_string (name);
+  fprintf (trace_fp, ",\"pid\":1,\"tid\":%d,\"ts\":%" G_GINT64_FORMAT,
+           track, ts - trace_start);
+}
+
+
+/* Write an async begin or end event for the object ID.  If ERR is
+   not zero, it is recorded with the event.  */
+static void
+async_event (gboolean begin, const char *cat, const char *name,
+             const void *id, gpg_error_t err)
+{
+  if (!trace_fp)
+    return;
+
+  begin_event (begin? "b" : "e", cat, name, MAIN_TRACK, gpa_trace_now ());
+  fprintf (trace_fp, ",\"id\":\"%p\"", id);
+  if (err)
+    {
+      fputs (",\"args\":{\"error\":", trace_fp);
+      write_string (gpg_strerror (err));
+      putc ('}', trace_fp);
+    }
+  putc ('}', trace_fp);
+
+  /* Flush at the end of spans so that a trace of a session which
+     crashes is still useful.  */
+  if (!begin)
+    fflush (trace_fp);
+}
+
+
+/* Give the track TRACK the name NAME unless that has already been
+   done.  */
+static void
+name_track (int track, const char *name)
+{
+  if (g_hash_table_contains (named_tracks, GINT_TO_POINTER (track)))
+    return;
+  g_hash_table_add (named_tracks, GINT_TO_POINTER (track));
+
+  begin_event ("M", "__metadata", "thread_name", track, trace_start);
+  fputs (",\"args\":{\"name\":", trace_fp);
+  write_string (name);
+  fputs ("}}", trace_fp);
+}
+
+
+
+/* Dialogs are traced from being mapped until they are unmapped.  */
+static gboolean
+dialog_hook (GSignalInvocationHint *ihint, guint n_param_values,
+             const GValue *param_values, gpointer data)
+{
+  GObject *object = g_value_get_object (param_values);
+  const char *title;
+  char *name;
+
+  if (!trace_fp || !GTK_IS_DIALOG (object))
+    return TRUE;
+
+  title = gtk_window_get_title (GTK_WINDOW (object));
+  name = g_strdup_printf ("%s%s%s", G_OBJECT_TYPE_NAME (object),
+                          title? ": " : "", title? title : "");
+  async_event (GPOINTER_TO_INT (data), "dialog", name, object, 0);
+  g_free (name);
+
+  return TRUE;
+}
+
+
+/* Start writing a trace to FILENAME.  Returns false on error.  */
+gboolean
+gpa_trace_open (const char *filename)
+{
+  gpointer klass;
+
+  if (trace_fp)
+    return TRUE;
+
+  trace_fp = g_fopen (filename, "w");
+  if (!trace_fp)
+    {
+      g_message ("can't create trace file '%s': %s",
+                 filename, strerror (errno));
+      return FALSE;
+    }
+  trace_start = g_get_monotonic_time ();
+  first_event = TRUE;
+  named_tracks = g_hash_table_new (g_direct_hash, g_direct_equal);
+  server_commands = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+                                           NULL, g_free);
+
+  fputs ("[", trace_fp);
+  name_track (MAIN_TRACK, "main loop");
+
+  klass = g_type_class_ref (GTK_TYPE_WIDGET);
+  g_signal_add_emission_hook (g_signal_lookup ("map", GTK_TYPE_WIDGET), 0,
+                              dialog_hook, GINT_TO_POINTER (TRUE), NULL);
+  g_signal_add_emission_hook (g_signal_lookup ("unmap", GTK_TYPE_WIDGET), 0,
+                              dialog_hook, GINT_TO_POINTER (FALSE), NULL);
+  g_type_class_unref (klass);
+
+  return TRUE;
+}
+
+
+/* Finish and close the trace.  */
+void
+gpa_trace_close (void)
+{
+  if (!trace_fp)
+    return;
+
+  fputs ("\n]\n", trace_fp);
+  if (fclose (trace_fp))
+    g_message ("error writing the trace file: %s", strerror (errno));
+  trace_fp = NULL;
+  g_hash_table_destroy (named_tracks);
+  g_hash_table_destroy (server_commands);
+}
+
+
+/* Return true if a trace is being written.  */
+gboolean
+gpa_trace_enabled (void)
+{
+  return !!trace_fp;
+}
+
+
+/* Return the current time in microseconds.  */
+gint64
+gpa_trace_now (void)
+{
+  return g_get_monotonic_time ();
+}
+
+
+
+static void
+operation_completed_cb (GpaOperation *op, gpg_error_t err, gpointer data)
+{
+  async_event (FALSE, "operation", G_OBJECT_TYPE_NAME (op), op, err);
+}
+
+
+/* Record the lifetime of OP from now until it emits "completed".  */
+void
+gpa_trace_operation (GpaOperation *op)
+{
+  if (!trace_fp)
+    return;
+
+  async_event (TRUE, "operation", G_OBJECT_TYPE_NAME (op), op, 0);
+  g_signal_connect (G_OBJECT (op), "completed",
+                    G_CALLBACK (operation_completed_cb), NULL);
+}
+
+
+static void
+context_start_cb (GpaContext *context, gpointer data)
+{
+  async_event (TRUE, "gpgme", "gpgme operation", context, 0);
+}
+
+
+static void
+context_done_cb (GpaContext *context, gpg_error_t err, gpointer data)
+{
+  async_event (FALSE, "gpgme", "gpgme operation", context, err);
+}
+
+
+static void
+context_next_key_cb (GpaContext *context, gpgme_key_t key, gpointer data)
+{
+  batch_keys++;
+}
+
+
+static void
+context_progress_cb (GpaContext *context, int current, int total,
+                     gpointer data)
+{
+  if (!trace_fp)
+    return;
+
+  begin_event ("i", "gpgme", "progress", MAIN_TRACK, gpa_trace_now ());
+  fprintf (trace_fp, ",\"s\":\"t\",\"args\":{\"current\":%d,\"total\":%d}}",
+           current, total);
+}
+
+
+/* Record the gpgme operations and key listings of CONTEXT.  */
+void
+gpa_trace_context (GpaContext *context)
+{
+  if (!trace_fp)
+    return;
+
+  g_signal_connect (G_OBJECT (context), "start",
+                    G_CALLBACK (context_start_cb), NULL);
+  g_signal_connect (G_OBJECT (context), "done",
+                    G_CALLBACK (context_done_cb), NULL);
+  g_signal_connect (G_OBJECT (context), "next_key",
+                    G_CALLBACK (context_next_key_cb), NULL);
+  g_signal_connect (G_OBJECT (context), "progress",
+                    G_CALLBACK (context_progress_cb), NULL);
+}
+
+
+/* Record a gpgme I/O callback of CONTEXT for FD and direction DIR
+   which started at START.  */
+void
+gpa_trace_io (GpaContext *context, int fd, int dir, gint64 start)
+{
+  gint64 now;
+  char name[40];
+
+  if (!trace_fp)
+    return;
+
+  now = gpa_trace_now ();
+  snprintf (name, sizeof name, "fd %d", fd);
+  name_track (FD_TRACK_OFFSET + fd, name);
+
+  begin_event ("X", "io", dir? "read" : "write", FD_TRACK_OFFSET + fd, start);
+  fprintf (trace_fp, ",\"dur\":%" G_GINT64_FORMAT
+           ",\"args\":{\"context\":\"%p\"}}", now - start, context);
+
+  if (batch_keys)
+    {
+      snprintf (name, sizeof name, "key batch %lu", ++batch_count);
+      begin_event ("X", "keylist", name, MAIN_TRACK, start);
+      fprintf (trace_fp, ",\"dur\":%" G_GINT64_FORMAT
+               ",\"args\":{\"keys\":%u}}", now - start, batch_keys);
+      batch_keys = 0;
+    }
+}
+
+
+
+static gpg_error_t
+server_pre_cmd_cb (assuan_context_t ctx, const char *command)
+{
+  if (trace_fp)
+    {
+      g_hash_table_insert (server_commands, ctx, g_strdup (command));
+      async_event (TRUE, "server", command, ctx, 0);
+    }
+  return 0;
+}
+
+
+static void
+server_post_cmd_cb (assuan_context_t ctx, gpg_error_t err)
+{
+  const char *command;
+
+  if (!trace_fp)
+    return;
+
+  command = g_hash_table_lookup (server_commands, ctx);
+  if (command)
+    {
+      async_event (FALSE, "server", command, ctx, err);
+      g_hash_table_remove (server_commands, ctx);
+    }
+}
+
+
+/* Record the commands of the UI server connection CTX.  */
+void
+gpa_trace_server (assuan_context_t ctx)
+{
+  if (!trace_fp)
+    return;
+
+  assuan_register_pre_cmd_notify (ctx, server_pre_cmd_cb);
+  assuan_register_post_cmd_notify (ctx, server_post_cmd_cb);
+}
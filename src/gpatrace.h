@@ -0,0 +1,61 @@
+/* gpatrace.h - Trace-event recording.
+   Copyright (C) 2026 g10 Code GmbH
+
+   This file is part of GPA.
+
+   GPA is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   GPA is distributed in the hope that it will be useful, but WITHOUT
+   ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+   or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public
+   License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, see <http://www.gnu.org/licenses/>.  */
+
+#ifndef GPATRACE_H
+#define GPATRACE_H
+
+#include <glib.h>
+#include <assuan.h>
+
+/* The trace records operations, gpgme I/O callbacks, key listing
+   batches, dialogs and UI server commands in the Chrome trace-event
+   JSON format which can be loaded into chrome://tracing or the
+   Perfetto UI.  */
+
+/* Forward declarations to avoid including the GObject headers.  */
+struct _GpaOperation;
+struct _GpaContext;
+
+/* Start writing a trace to FILENAME.  Returns false on error.  */
+gboolean gpa_trace_open (const char *filename);
+
+/* Finish and close the trace.  */
+void gpa_trace_close (void);
+
+/* Return true if a trace is being written.  */
+gboolean gpa_trace_enabled (void);
+
+/* Return the current time in microseconds for use with
+   gpa_trace_io.  */
+gint64 gpa_trace_now (void);
+
+/* Record the lifetime of OP from now until it emits "completed".  */
+void gpa_trace_operation (struct _GpaOperation *op);
+
+/* Record the gpgme operations and key listings of CONTEXT.  */
+void gpa_trace_context (struct _GpaContext *context);
+
+/* Record a gpgme I/O callback of CONTEXT for FD and direction DIR
+   which started at START.  */
+void gpa_trace_io (struct _GpaContext *context, int fd, int dir,
+                   gint64 start);
+
+/* Record the commands of the UI server connection CTX.  */
+void gpa_trace_server (assuan_context_t ctx);
+
+#endif /*GPATRACE_H*/
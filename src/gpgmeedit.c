@@ -885,6 +885,98 @@ edit_passwd_fnc_transit (int current_state, status_type_t status,
 }
 
 
+/*
+ * Backends using the gpgme functions for the --quick commands of gpg.
+ * They need neither an edit state machine nor a round trip for each
+ * prompt and are used instead of the state machines above if gpgme
+ * and gpg are recent enough.  If gpgme tells us that the engine does
+ * not support them, the state machines are used as well.
+ */
+
+/* Return true if gpgme_op_keysign can be used.  */
+static gboolean
+have_quick_keysign (void)
+{
+  return is_gpg_version_at_least ("2.1.12");
+}
+
+
+/* Return true if gpgme_op_passwd can be used for OpenPGP keys.  */
+static gboolean
+have_quick_passwd (void)
+{
+  return is_gpg_version_at_least ("2.1.0");
+}
+
+
+/* Return true if gpgme_op_setexpire can be used.  */
+gboolean
+gpa_gpgme_have_quick_setexpire (void)
+{
+#if GPGME_VERSION_NUMBER >= 0x010e01  /* GPGME >= 1.14.1 */
+  return (gpgme_check_version ("1.14.1")
+	  && is_gpg_version_at_least ("2.1.22"));
+#else
+  return FALSE;
+#endif
+}
+
+
+#if GPGME_VERSION_NUMBER >= 0x010e01  /* GPGME >= 1.14.1 */
+/* Store the number of seconds from now until the start of DATE (UTC)
+   at R_SECONDS, or 0 if DATE is NULL.  */
+static gpg_error_t
+expire_seconds (GDate *date, unsigned long *r_seconds)
+{
+  GDateTime *then, *now;
+  gint64 diff;
+
+  *r_seconds = 0;
+  if (!date)
+    return 0;
+
+  then = g_date_time_new_utc (g_date_get_year (date),
+			      g_date_get_month (date),
+			      g_date_get_day (date), 0, 0, 0);
+  now = g_date_time_new_now_utc ();
+  diff = g_date_time_difference (then, now) / G_TIME_SPAN_SECOND;
+  g_date_time_unref (then);
+  g_date_time_unref (now);
+
+  if (diff <= 0)
+    return gpg_error (GPG_ERR_INV_TIME);
+  *r_seconds = diff;
+  return 0;
+}
+#endif
+
+
+/* Change the expiry date of the primary key of KEY, or of all its
+   valid subkeys if SUBKEYS is true, with a single gpg call.  Returns
+   GPG_ERR_NOT_SUPPORTED if gpgme or gpg are too old for this.  */
+gpg_error_t
+gpa_gpgme_set_expire_start (GpaContext *ctx, gpgme_key_t key, GDate *date,
+			    gboolean subkeys)
+{
+#if GPGME_VERSION_NUMBER >= 0x010e01  /* GPGME >= 1.14.1 */
+  unsigned long seconds;
+  gpg_error_t err;
+
+  if (!gpa_gpgme_have_quick_setexpire ())
+    return gpg_error (GPG_ERR_NOT_SUPPORTED);
+
+  err = expire_seconds (date, &seconds);
+  if (err)
+    return err;
+
+  return gpgme_op_setexpire_start (ctx->ctx, key, seconds,
+				   subkeys ? "*" : NULL, 0);
+#else
+  return gpg_error (GPG_ERR_NOT_SUPPORTED);
+#endif
+}
+
+
 /* Release the edit parameters needed for setting owner trust. The
    prototype is that of a GpaContext's "done" signal handler.  */
 static void
@@ -1006,6 +1098,10 @@ gpa_gpgme_edit_expire_start (GpaContext *ctx, gpgme_key_t key, GDate *date)
   gpg_error_t err;
   gpgme_data_t out = NULL;
 
+  err = gpa_gpgme_set_expire_start (ctx, key, date, FALSE);
+  if (gpg_err_code (err) != GPG_ERR_NOT_SUPPORTED)
+    return err;
+
   err = gpgme_data_new (&out);
   if (gpg_err_code (err) != GPG_ERR_NO_ERROR)
     {
@@ -1078,8 +1174,22 @@ gpa_gpgme_edit_sign_start (GpaContext *ctx, gpgme_key_t key,
   err = gpgme_signers_add (ctx->ctx, secret_key);
   if (gpg_err_code (err) != GPG_ERR_NO_ERROR)
     {
+      gpgme_data_release (out);
       return err;
     }
+
+  /* Sign all user IDs.  */
+  if (have_quick_keysign ())
+    {
+      err = gpgme_op_keysign_start (ctx->ctx, key, NULL, 0,
+				    local ? GPGME_KEYSIGN_LOCAL : 0);
+      if (gpg_err_code (err) != GPG_ERR_NOT_SUPPORTED)
+	{
+	  gpgme_data_release (out);
+	  return err;
+	}
+    }
+
   parms = gpa_gpgme_edit_sign_parms_new (ctx, "0", local, out);
   err = gpgme_op_interact_start (ctx->ctx, key, 0, edit_fnc, parms, out);
   return err;
@@ -1174,6 +1284,14 @@ gpa_gpgme_edit_passwd_start (GpaContext *ctx, gpgme_key_t key)
   gpg_error_t err;
   gpgme_data_t out;
 
+  /* The agent asks for the old and the new passphrase itself.  */
+  if (key->protocol == GPGME_PROTOCOL_OpenPGP && have_quick_passwd ())
+    {
+      err = gpgme_op_passwd_start (ctx->ctx, key, 0);
+      if (gpg_err_code (err) != GPG_ERR_NOT_SUPPORTED)
+	return err;
+    }
+
   err = gpgme_data_new (&out);
   if (gpg_err_code (err) != GPG_ERR_NO_ERROR)
     {
@@ -37,6 +37,15 @@ gpg_error_t gpa_gpgme_edit_trust_start (GpaContext *ctx, gpgme_key_t key,
 gpg_error_t gpa_gpgme_edit_expire_start (GpaContext *ctx, gpgme_key_t key, 
 					 GDate *date);
 
+/* Return true if the expiry date of subkeys can be changed.  */
+gboolean gpa_gpgme_have_quick_setexpire (void);
+
+/* Change the expiry date of a key, or of all its subkeys, with a
+   single gpg call.  Returns GPG_ERR_NOT_SUPPORTED if gpg or gpgme are
+   too old.  */
+gpg_error_t gpa_gpgme_set_expire_start (GpaContext *ctx, gpgme_key_t key,
+					GDate *date, gboolean subkeys);
+
 /* Sign this key with the given private key. If local is true, make a local
  * signature. */
 gpg_error_t gpa_gpgme_edit_sign_start (GpaContext *ctx, gpgme_key_t key,
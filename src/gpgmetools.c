@@ -30,6 +30,7 @@
 #include "gpa.h"
 #include "gtktools.h"
 #include "gpgmetools.h"
+#include "keyref.h"
 
 #include <fcntl.h>
 #ifdef G_OS_UNIX
@@ -276,6 +277,125 @@ gpa_open_output (const char *filename, gpgme_data_t *data, GtkWidget *parent,
 }
 
 
+/* Return a malloced copy of FILENAME with "-SEQ" inserted before the
+   extension of its last component.  */
+static char *
+numbered_filename (const char *filename, unsigned int seq)
+{
+  const char *base, *ext;
+
+  base = strrchr (filename, G_DIR_SEPARATOR);
+  base = base? base + 1 : filename;
+  ext = strrchr (base, '.');
+  if (!ext || ext == base)
+    ext = base + strlen (base);
+
+  return g_strdup_printf ("%.*s-%u%s", (int) (ext - filename), filename,
+                          seq, ext);
+}
+
+
+int
+gpa_open_output_with_policy (const char *filename, gpgme_data_t *data,
+                             GtkWidget *parent, gpa_conflict_policy_t policy,
+                             char **filename_used, gpg_error_t *r_err)
+{
+  char *name = NULL;
+  unsigned int seq;
+  int target = -1;
+  gpg_error_t err;
+
+  *filename_used = NULL;
+  *r_err = 0;
+
+  switch (policy)
+    {
+    case GPA_CONFLICT_ASK:
+      target = gpa_open_output (filename, data, parent, filename_used);
+      if (target == -1)
+        *r_err = gpg_error (GPG_ERR_GENERAL);
+      return target;
+
+    case GPA_CONFLICT_OVERWRITE:
+      *filename_used = xstrdup (filename);
+      target = gpa_open_output_direct (filename, data, parent);
+      if (target == -1)
+        *r_err = gpg_error (GPG_ERR_GENERAL);
+      return target;
+
+    default:
+      break;
+    }
+
+  /* Create the file exclusively so that we never clobber a file
+     which shows up while we are running.  */
+  for (seq = 0; seq < 1000; seq++)
+    {
+      name = seq? numbered_filename (filename, seq) : xstrdup (filename);
+      target = g_open (name, O_WRONLY | O_CREAT | O_EXCL | O_BINARY, 0666);
+      if (target != -1)
+        break;
+      err = gpg_error_from_syserror ();
+      xfree (name);
+      name = NULL;
+      if (gpg_err_code (err) != GPG_ERR_EEXIST)
+        {
+          *r_err = err;
+          return -1;
+        }
+      if (policy != GPA_CONFLICT_RENAME)
+        break;
+    }
+  if (target == -1)
+    {
+      *r_err = gpg_error (GPG_ERR_EEXIST);
+      return -1;
+    }
+
+  err = gpgme_data_new_from_fd (data, target);
+  if (err)
+    {
+      close (target);
+      g_unlink (name);
+      xfree (name);
+      *r_err = err;
+      return -1;
+    }
+
+  *filename_used = name;
+  return target;
+}
+
+
+gboolean
+gpa_conflict_policy_from_string (const char *name,
+                                 gpa_conflict_policy_t *r_policy)
+{
+  static const struct
+  {
+    const char *name;
+    gpa_conflict_policy_t policy;
+  } table[] =
+    {
+      { "ask",       GPA_CONFLICT_ASK },
+      { "overwrite", GPA_CONFLICT_OVERWRITE },
+      { "skip",      GPA_CONFLICT_SKIP },
+      { "rename",    GPA_CONFLICT_RENAME },
+      { "fail",      GPA_CONFLICT_FAIL }
+    };
+  unsigned int idx;
+
+  for (idx = 0; idx < G_N_ELEMENTS (table); idx++)
+    if (name && !strcmp (name, table[idx].name))
+      {
+        *r_policy = table[idx].policy;
+        return TRUE;
+      }
+
+  return FALSE;
+}
+
+
 int
 gpa_open_input (const char *filename, gpgme_data_t *data, GtkWidget *parent)
 {
@@ -514,6 +634,26 @@ get_gpgconf_path (void)
 }
 
 
+/* Return the gpg binary configured in CTX and store its home
+   directory at R_HOMEDIR, which is NULL for the default.  Returns
+   NULL if there is no OpenPGP engine.  */
+const char *
+gpa_get_gpg_engine (gpgme_ctx_t ctx, const char **r_homedir)
+{
+  gpgme_engine_info_t info;
+
+  *r_homedir = NULL;
+  for (info = gpgme_ctx_get_engine_info (ctx); info; info = info->next)
+    if (info->protocol == GPGME_PROTOCOL_OpenPGP)
+      {
+        *r_homedir = info->home_dir;
+        return info->file_name;
+      }
+
+  return NULL;
+}
+
+
 /* Retrieve the path to the GPG-CONNECT-AGENT executable.  Note that
    the caller must free the returned string.  */
 static char *
@@ -1351,7 +1491,7 @@ gpa_gpgme_copy_keyarray (gpgme_key_t *keys)
   newarray = g_new (gpgme_key_t, idx);
   for (idx=0; keys[idx]; idx++)
     {
-      gpgme_key_ref (keys[idx]);
+      gpa_key_ref (keys[idx], GPA_KEY_OWNER_OTHER);
       newarray[idx] = keys[idx];
     }
   newarray[idx] = NULL;
@@ -1369,7 +1509,7 @@ gpa_gpgme_release_keyarray (gpgme_key_t *keys)
       int idx;
 
       for (idx=0; keys[idx]; idx++)
-        gpgme_key_unref (keys[idx]);
+        gpa_key_unref (keys[idx], GPA_KEY_OWNER_OTHER);
       g_free (keys);
     }
 }
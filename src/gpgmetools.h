@@ -42,6 +42,28 @@ typedef enum
   } gpa_keygen_algo_t;
 
 
+/* Policy for compressing data before encryption.  With
+   GPA_COMPRESS_AUTO compression is skipped for data which appears to
+   be already compressed.  */
+typedef enum
+  {
+    GPA_COMPRESS_AUTO,
+    GPA_COMPRESS_ALWAYS,
+    GPA_COMPRESS_NEVER
+  } gpa_compress_policy_t;
+
+
+/* Policy for output files which already exist.  */
+typedef enum
+  {
+    GPA_CONFLICT_ASK,        /* Ask the user (the default).  */
+    GPA_CONFLICT_OVERWRITE,  /* Replace the file.  */
+    GPA_CONFLICT_SKIP,       /* Do not process the input file.  */
+    GPA_CONFLICT_RENAME,     /* Insert a number into the file name.  */
+    GPA_CONFLICT_FAIL        /* Fail with GPG_ERR_EEXIST.  */
+  } gpa_conflict_policy_t;
+
+
 
 typedef struct
 {
@@ -145,6 +167,21 @@ int gpa_open_output_direct (const char *filename, gpgme_data_t *data,
 int gpa_open_output (const char *filename, gpgme_data_t *data,
 		     GtkWidget *parent, char **filename_used);
 
+/* Like gpa_open_output but handle an existing FILENAME according to
+   POLICY.  Only GPA_CONFLICT_ASK shows dialogs.  On error -1 is
+   returned and the error code is stored at R_ERR; GPG_ERR_EEXIST
+   means that the file exists and POLICY does not allow to use it.  */
+int gpa_open_output_with_policy (const char *filename, gpgme_data_t *data,
+                                 GtkWidget *parent,
+                                 gpa_conflict_policy_t policy,
+                                 char **filename_used, gpg_error_t *r_err);
+
+/* Parse the conflict policy NAME ("ask", "overwrite", "skip",
+   "rename" or "fail") into R_POLICY.  Returns false for an unknown
+   name.  */
+gboolean gpa_conflict_policy_from_string (const char *name,
+                                          gpa_conflict_policy_t *r_policy);
+
 /* Create a new gpgme_data_t from a file for reading, and return the
    file descriptor for the file.  Always reports all errors to the user.  */
 int gpa_open_input (const char *filename, gpgme_data_t *data,
@@ -251,6 +288,10 @@ void gpa_switch_to_gpg2 (const char *gpg_binary, const char *gpgsm_binary);
 /* Return true if the gpg engine has at least version NEED_VERSION.  */
 int is_gpg_version_at_least (const char *need_version);
 
+/* Return the gpg binary configured in CTX and store its home
+   directory at R_HOMEDIR.  */
+const char *gpa_get_gpg_engine (gpgme_ctx_t ctx, const char **r_homedir);
+
 /* Run a simple gpg command.  */
 gpg_error_t gpa_start_simple_gpg_command (gboolean (*cb)
                                           (void *opaque, char *line),
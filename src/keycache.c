@@ -0,0 +1,149 @@
+/* keycache.c - A cache of detailed keys.
+   Copyright (C) 2026 g10 Code GmbH
+
+   This file is part of GPA.
+
+   GPA is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   GPA is distributed in the hope that it will be useful, but WITHOUT
+   ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+   or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public
+   License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, see <http://www.gnu.org/licenses/>.  */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <glib.h>
+
+#include "gpa.h"
+#include "keyref.h"
+#include "keycache.h"
+
+
+/* The cache keeps its keys in a queue with the most recently used
+   key at the head.  The table maps the fingerprints to the links of
+   the queue.  */
+struct gpa_key_cache_s
+{
+  unsigned int size;
+  GQueue queue;
+  GHashTable *table;
+};
+
+
+
+/* Create a new cache holding up to SIZE keys.  */
+gpa_key_cache_t
+gpa_key_cache_new (unsigned int size)
+{
+  gpa_key_cache_t cache;
+
+  cache = g_malloc0 (sizeof *cache);
+  cache->size = size? size : 1;
+  g_queue_init (&cache->queue);
+  /* The fingerprints are owned by the keys.  */
+  cache->table = g_hash_table_new (g_str_hash, g_str_equal);
+
+  return cache;
+}
+
+
+/* Release CACHE and all keys in it.  */
+void
+gpa_key_cache_release (gpa_key_cache_t cache)
+{
+  if (!cache)
+    return;
+
+  gpa_key_cache_clear (cache);
+  g_hash_table_destroy (cache->table);
+  g_free (cache);
+}
+
+
+/* Return the fingerprint KEY is cached under.  */
+static const char *
+key_fpr (gpgme_key_t key)
+{
+  return key->subkeys->fpr;
+}
+
+
+static void
+remove_link (gpa_key_cache_t cache, GList *link)
+{
+  gpgme_key_t key = link->data;
+
+  g_hash_table_remove (cache->table, key_fpr (key));
+  g_queue_delete_link (&cache->queue, link);
+  gpa_key_unref (key, GPA_KEY_OWNER_KEYCACHE);
+}
+
+
+/* Return a new reference to the key with fingerprint FPR or NULL if
+   it is not in CACHE.  */
+gpgme_key_t
+gpa_key_cache_get (gpa_key_cache_t cache, const char *fpr)
+{
+  GList *link;
+
+  link = fpr? g_hash_table_lookup (cache->table, fpr) : NULL;
+  if (!link)
+    return NULL;
+
+  /* Move it to the head of the queue.  */
+  g_queue_unlink (&cache->queue, link);
+  g_queue_push_head_link (&cache->queue, link);
+
+  gpgme_key_ref (link->data);
+  return link->data;
+}
+
+
+/* Return true if the key with fingerprint FPR is in CACHE without
+   marking it as used.  */
+int
+gpa_key_cache_contains (gpa_key_cache_t cache, const char *fpr)
+{
+  return fpr && g_hash_table_contains (cache->table, fpr);
+}
+
+
+/* Store KEY in CACHE, replacing a previous version.  The cache takes
+   its own reference.  */
+void
+gpa_key_cache_put (gpa_key_cache_t cache, gpgme_key_t key)
+{
+  GList *link;
+
+  if (!key || !key->subkeys || !key->subkeys->fpr)
+    return;
+
+  link = g_hash_table_lookup (cache->table, key_fpr (key));
+  if (link)
+    remove_link (cache, link);
+  while (cache->queue.length >= cache->size)
+    remove_link (cache, cache->queue.tail);
+
+  gpa_key_ref (key, GPA_KEY_OWNER_KEYCACHE);
+  g_queue_push_head (&cache->queue, key);
+  g_hash_table_insert (cache->table, (char *) key_fpr (key),
+                       cache->queue.head);
+}
+
+
+/* Remove all keys from CACHE, for example after the keyring has been
+   changed.  */
+void
+gpa_key_cache_clear (gpa_key_cache_t cache)
+{
+  while (cache->queue.head)
+    remove_link (cache, cache->queue.head);
+}
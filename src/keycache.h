@@ -0,0 +1,50 @@
+/* keycache.h - A cache of detailed keys.
+   Copyright (C) 2026 g10 Code GmbH
+
+   This file is part of GPA.
+
+   GPA is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   GPA is distributed in the hope that it will be useful, but WITHOUT
+   ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+   or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public
+   License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, see <http://www.gnu.org/licenses/>.  */
+
+#ifndef KEYCACHE_H
+#define KEYCACHE_H
+
+#include <gpgme.h>
+
+/* A cache of keys listed with signatures, mapping fingerprints to
+   keys.  When full, the least recently used key is dropped.  */
+typedef struct gpa_key_cache_s *gpa_key_cache_t;
+
+/* Create a new cache holding up to SIZE keys.  */
+gpa_key_cache_t gpa_key_cache_new (unsigned int size);
+
+/* Release CACHE and all keys in it.  */
+void gpa_key_cache_release (gpa_key_cache_t cache);
+
+/* Return a new reference to the key with fingerprint FPR or NULL if
+   it is not in CACHE.  */
+gpgme_key_t gpa_key_cache_get (gpa_key_cache_t cache, const char *fpr);
+
+/* Return true if the key with fingerprint FPR is in CACHE without
+   marking it as used.  */
+int gpa_key_cache_contains (gpa_key_cache_t cache, const char *fpr);
+
+/* Store KEY in CACHE, replacing a previous version.  The cache takes
+   its own reference.  */
+void gpa_key_cache_put (gpa_key_cache_t cache, gpgme_key_t key);
+
+/* Remove all keys from CACHE, for example after the keyring has been
+   changed.  */
+void gpa_key_cache_clear (gpa_key_cache_t cache);
+
+#endif /*KEYCACHE_H*/
@@ -0,0 +1,497 @@
+/* keychunk.c - Split keyrings into chunks of whole keys.
+   Copyright (C) 2026 g10 Code GmbH
+
+   This file is part of GPA.
+
+   GPA is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   GPA is distributed in the hope that it will be useful, but WITHOUT
+   ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+   or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public
+   License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, see <http://www.gnu.org/licenses/>.  */
+
+/*
+   Only the packet headers of a binary keyring are parsed (RFC 4880,
+   section 4.2); a chunk ends before the first public or secret key
+   packet after CHUNK_SIZE bytes.  Armored keyrings are decoded on
+   the fly (RFC 4880, section 6.2) and the packets of all their armor
+   blocks are split the same way; the chunks are thus always binary.
+   The armor checksum is not verified; gpg checks the packets
+   anyway.  If a packet length can't be determined or a packet is
+   larger than CHUNK_SIZE, the rest of the input is streamed to gpg
+   as the last chunk, which also reports any problem.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <errno.h>
+#include <string.h>
+
+#include <glib.h>
+
+#ifdef G_OS_UNIX
+#include <unistd.h>
+#else
+#include <io.h>
+#endif
+
+#include "gpa.h"
+#include "keychunk.h"
+
+
+#define PKT_SECRET_KEY  5
+#define PKT_PUBLIC_KEY  6
+
+#define ARMOR_BEGIN  "-----BEGIN PGP "
+#define ARMOR_END    "-----END PGP "
+
+/* The states of the armor decoder.  */
+enum armor_state
+  {
+    ARMOR_OUTSIDE,      /* Looking for the next BEGIN line.  */
+    ARMOR_HEADER,       /* In the armor headers.  */
+    ARMOR_BODY          /* In the base64 data.  */
+  };
+
+struct gpa_key_chunker_s
+{
+  int fd;
+  gsize chunk_size;
+  GByteArray *buffer;   /* Binary data not yet returned.  */
+  int armored;          /* -1 if not yet known.  */
+  int eof;
+  gpg_error_t err;
+  guint64 offset;
+
+  /* For armored input the input not yet decoded, starting at
+     RAW_POS, and the number of input bytes decoded.  */
+  GByteArray *raw;
+  gsize raw_pos;
+  guint64 raw_offset;
+  enum armor_state armor_state;
+  int seen_armor;
+  gint b64_state;
+  guint b64_save;
+
+  /* Set once the rest of the input is returned as a stream.  */
+  int streaming;
+};
+
+#define BYTE(c,i) ((c)->buffer->data[(i)])
+
+
+
+/* Create a new reader for the file descriptor FD, which must be
+   positioned at the start of the keyring.  The chunks are about
+   CHUNK_SIZE bytes long.  FD is not closed by the reader.  */
+gpa_key_chunker_t
+gpa_key_chunker_new (int fd, gsize chunk_size)
+{
+  gpa_key_chunker_t chunker;
+
+  chunker = g_malloc0 (sizeof *chunker);
+  chunker->fd = fd;
+  chunker->chunk_size = chunk_size;
+  chunker->buffer = g_byte_array_new ();
+  chunker->raw = g_byte_array_new ();
+  chunker->armored = -1;
+
+  return chunker;
+}
+
+
+/* Release CHUNKER.  */
+void
+gpa_key_chunker_release (gpa_key_chunker_t chunker)
+{
+  if (!chunker)
+    return;
+
+  g_byte_array_free (chunker->buffer, TRUE);
+  g_byte_array_free (chunker->raw, TRUE);
+  g_free (chunker);
+}
+
+
+/* Append the next block of the input to ARRAY.  Returns false at
+   the end of the input or on error.  */
+static gboolean
+read_input (gpa_key_chunker_t chunker, GByteArray *array)
+{
+  guchar tmp[65536];
+  gssize n;
+
+  if (chunker->eof)
+    return FALSE;
+
+  do
+    n = read (chunker->fd, tmp, sizeof tmp);
+  while (n < 0 && errno == EINTR);
+  if (n < 0)
+    {
+      chunker->err = gpg_error_from_syserror ();
+      chunker->eof = 1;
+      return FALSE;
+    }
+  if (!n)
+    {
+      chunker->eof = 1;
+      return FALSE;
+    }
+  g_byte_array_append (array, tmp, n);
+
+  return TRUE;
+}
+
+
+/* Decode the armored LINE of length LEN, which has no line ending,
+   and append the data to the buffer.  */
+static void
+dearmor_line (gpa_key_chunker_t chunker, const char *line, gsize len)
+{
+  guchar out[1024 / 4 * 3 + 3];
+  gsize n;
+
+  while (len && (line[len - 1] == '\r' || line[len - 1] == ' '
+                 || line[len - 1] == '\t'))
+    len--;
+
+  switch (chunker->armor_state)
+    {
+    case ARMOR_OUTSIDE:
+      if (len >= strlen (ARMOR_BEGIN)
+          && !memcmp (line, ARMOR_BEGIN, strlen (ARMOR_BEGIN)))
+        {
+          chunker->armor_state = ARMOR_HEADER;
+          chunker->seen_armor = 1;
+        }
+      break;
+
+    case ARMOR_HEADER:
+      /* The headers end with an empty line.  */
+      if (!len)
+        {
+          chunker->armor_state = ARMOR_BODY;
+          chunker->b64_state = 0;
+          chunker->b64_save = 0;
+        }
+      break;
+
+    case ARMOR_BODY:
+      if (len >= strlen (ARMOR_END)
+          && !memcmp (line, ARMOR_END, strlen (ARMOR_END)))
+        chunker->armor_state = ARMOR_OUTSIDE;
+      else if (len && *line != '=')
+        {
+          /* Base64 lines are a multiple of four characters long, thus
+             only the checksum line starts with '='.  */
+          while (len)
+            {
+              n = MIN (len, 1024);
+              g_byte_array_append (chunker->buffer, out,
+                                   g_base64_decode_step
+                                   (line, n, out, &chunker->b64_state,
+                                    &chunker->b64_save));
+              line += n;
+              len -= n;
+            }
+        }
+      break;
+    }
+}
+
+
+/* Decode armored input until some data has been added to the
+   buffer.  Returns false if the input ended before.  */
+static gboolean
+dearmor_more (gpa_key_chunker_t chunker)
+{
+  GByteArray *raw = chunker->raw;
+  guint oldlen = chunker->buffer->len;
+  guchar *line, *eol;
+  gsize len;
+
+  while (chunker->buffer->len == oldlen)
+    {
+      line = raw->data + chunker->raw_pos;
+      eol = memchr (line, '\n', raw->len - chunker->raw_pos);
+      if (eol)
+        len = eol - line;
+      else
+        {
+          /* Drop the decoded lines before reading more.  */
+          g_byte_array_remove_range (raw, 0, chunker->raw_pos);
+          chunker->raw_pos = 0;
+          if (read_input (chunker, raw))
+            continue;
+          if (!raw->len)
+            return FALSE;
+          /* The last line has no line ending.  */
+          line = raw->data;
+          len = raw->len;
+        }
+
+      dearmor_line (chunker, (char *) line, len);
+      len += eol? 1 : 0;
+      chunker->raw_pos += len;
+      chunker->raw_offset += len;
+    }
+
+  return TRUE;
+}
+
+
+/* Read until at least NEED bytes are buffered.  Returns false if the
+   input ended before.  */
+static gboolean
+fill (gpa_key_chunker_t chunker, guint64 need)
+{
+  while (chunker->buffer->len < need)
+    if (chunker->armored? !dearmor_more (chunker)
+        : !read_input (chunker, chunker->buffer))
+      return FALSE;
+
+  return TRUE;
+}
+
+
+/* Return the length of the packet starting at POS including its
+   header and store its tag at R_TAG.  Returns -1 if the length can't
+   be determined or a partial length packet is larger than the chunk
+   size.  */
+static gint64
+packet_length (gpa_key_chunker_t chunker, guint64 pos, int *r_tag)
+{
+  guint64 off, len, total;
+  int c, i, n;
+
+  if (!fill (chunker, pos + 2))
+    return -1;
+
+  c = BYTE (chunker, pos);
+  if (!(c & 0x80))
+    return -1;
+
+  if ((c & 0x40))
+    {
+      /* New format.  The body may consist of several partial
+         bodies.  */
+      int partial;
+
+      *r_tag = c & 0x3f;
+      off = pos + 1;
+      total = 1;
+      do
+        {
+          if (off - pos > chunker->chunk_size || !fill (chunker, off + 1))
+            return -1;
+          c = BYTE (chunker, off);
+          partial = 0;
+          if (c < 192)
+            {
+              n = 1;
+              len = c;
+            }
+          else if (c < 224)
+            {
+              if (!fill (chunker, off + 2))
+                return -1;
+              n = 2;
+              len = ((c - 192) << 8) + BYTE (chunker, off + 1) + 192;
+            }
+          else if (c == 255)
+            {
+              if (!fill (chunker, off + 5))
+                return -1;
+              n = 5;
+              for (len = 0, i = 1; i < 5; i++)
+                len = (len << 8) | BYTE (chunker, off + i);
+            }
+          else
+            {
+              n = 1;
+              len = 1 << (c & 0x1f);
+              partial = 1;
+            }
+          total += n + len;
+          off += n + len;
+        }
+      while (partial);
+
+      return total;
+    }
+
+  /* Old format.  */
+  *r_tag = (c >> 2) & 0x0f;
+  switch (c & 3)
+    {
+    case 0: n = 1; break;
+    case 1: n = 2; break;
+    case 2: n = 4; break;
+    default:
+      /* Indeterminate length.  */
+      return -1;
+    }
+  if (!fill (chunker, pos + 1 + n))
+    return -1;
+  for (len = 0, i = 0; i < n; i++)
+    len = (len << 8) | BYTE (chunker, pos + 1 + i);
+
+  return 1 + n + len;
+}
+
+
+/* Return the length of the next chunk of a binary keyring.  If the
+   rest of the input shall be streamed, 0 is returned and R_STREAM is
+   set.  */
+static guint64
+binary_chunk (gpa_key_chunker_t chunker, int *r_stream)
+{
+  guint64 pos = 0;
+  gint64 len;
+  int tag;
+
+  *r_stream = 0;
+  while (fill (chunker, pos + 1))
+    {
+      len = packet_length (chunker, pos, &tag);
+      if (len < 0 || (guint64) len > chunker->chunk_size)
+        {
+          /* Return the packets before and give the rest to gpg
+             without reading it into memory.  */
+          if (!pos)
+            *r_stream = 1;
+          return pos;
+        }
+      if ((tag == PKT_PUBLIC_KEY || tag == PKT_SECRET_KEY)
+          && pos >= chunker->chunk_size)
+        return pos;
+      pos += len;
+    }
+
+  return MIN (pos, chunker->buffer->len);
+}
+
+
+/* Remove LEN bytes returned to gpg from the buffer.  */
+static void
+consume (gpa_key_chunker_t chunker, guint64 len)
+{
+  g_byte_array_remove_range (chunker->buffer, 0, len);
+  if (!chunker->armored)
+    chunker->offset += len;
+  else
+    {
+      /* Base64 takes four characters for three bytes.  */
+      guint64 pending = (guint64) chunker->buffer->len * 4 / 3;
+
+      chunker->offset = (chunker->raw_offset > pending
+                         ? chunker->raw_offset - pending : 0);
+    }
+}
+
+
+/* The read callback of the data object streaming the rest of the
+   input.  */
+static ssize_t
+stream_read_cb (void *handle, void *buffer, size_t size)
+{
+  gpa_key_chunker_t chunker = handle;
+  size_t n;
+
+  if (!chunker->buffer->len && !fill (chunker, 1))
+    {
+      if (chunker->err)
+        {
+          errno = gpg_err_code_to_errno (gpg_err_code (chunker->err));
+          return -1;
+        }
+      return 0;
+    }
+
+  n = MIN (size, chunker->buffer->len);
+  memcpy (buffer, chunker->buffer->data, n);
+  consume (chunker, n);
+
+  return n;
+}
+
+static struct gpgme_data_cbs stream_cbs =
+  {
+    stream_read_cb,
+    NULL,
+    NULL,
+    NULL
+  };
+
+
+/* Store a new data object with the next chunk at R_DATA.  Returns
+   GPG_ERR_EOF if the keyring has been read completely.  */
+gpg_error_t
+gpa_key_chunker_next (gpa_key_chunker_t chunker, gpgme_data_t *r_data)
+{
+  guint64 len;
+  int stream;
+  gpg_error_t err;
+
+  *r_data = NULL;
+  if (chunker->streaming)
+    return gpg_error (GPG_ERR_EOF);
+
+  /* Binary OpenPGP data always starts with a packet tag, which has
+     the high bit set.  Everything else is taken as armored.  */
+  if (chunker->armored == -1)
+    {
+      if (!read_input (chunker, chunker->raw))
+        return chunker->err? chunker->err : gpg_error (GPG_ERR_EOF);
+      chunker->armored = !(chunker->raw->data[0] & 0x80);
+      if (!chunker->armored)
+        {
+          GByteArray *tmp = chunker->buffer;
+
+          chunker->buffer = chunker->raw;
+          chunker->raw = tmp;
+        }
+    }
+
+  len = binary_chunk (chunker, &stream);
+  if (chunker->err)
+    return chunker->err;
+  if (stream)
+    {
+      /* The data object must be released before CHUNKER.  */
+      err = gpgme_data_new_from_cbs (r_data, &stream_cbs, chunker);
+      if (!err)
+        chunker->streaming = 1;
+      return err;
+    }
+  if (!len && chunker->armored && !chunker->seen_armor)
+    return gpg_error (GPG_ERR_NO_DATA);
+  if (!len)
+    return gpg_error (GPG_ERR_EOF);
+
+  err = gpgme_data_new_from_mem (r_data, (char *) chunker->buffer->data,
+                                 len, 1);
+  if (err)
+    return err;
+  consume (chunker, len);
+
+  return 0;
+}
+
+
+/* Return the number of input bytes returned in chunks so far.  For
+   armored input this is an estimate.  */
+guint64
+gpa_key_chunker_get_offset (gpa_key_chunker_t chunker)
+{
+  return chunker->offset;
+}
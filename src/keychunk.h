@@ -0,0 +1,50 @@
+/* keychunk.h - Split keyrings into chunks of whole keys.
+   Copyright (C) 2026 g10 Code GmbH
+
+   This file is part of GPA.
+
+   GPA is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   GPA is distributed in the hope that it will be useful, but WITHOUT
+   ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+   or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public
+   License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, see <http://www.gnu.org/licenses/>.  */
+
+#ifndef KEYCHUNK_H
+#define KEYCHUNK_H
+
+#include <glib.h>
+#include <gpgme.h>
+
+/* A reader returning the keys of a binary or armored keyring in
+   chunks of about the same size.  The keyrings are split before key
+   packets, so that no key is split; armored keyrings are decoded and
+   returned as binary chunks.  */
+typedef struct gpa_key_chunker_s *gpa_key_chunker_t;
+
+/* Create a new reader for the file descriptor FD, which must be
+   positioned at the start of the keyring.  The chunks are about
+   CHUNK_SIZE bytes long.  FD is not closed by the reader.  */
+gpa_key_chunker_t gpa_key_chunker_new (int fd, gsize chunk_size);
+
+/* Release CHUNKER.  */
+void gpa_key_chunker_release (gpa_key_chunker_t chunker);
+
+/* Store a new data object with the next chunk at R_DATA.  Returns
+   GPG_ERR_EOF if the keyring has been read completely.  The last
+   chunk may read from CHUNKER while gpg consumes it, thus the data
+   object must be released before CHUNKER.  */
+gpg_error_t gpa_key_chunker_next (gpa_key_chunker_t chunker,
+                                  gpgme_data_t *r_data);
+
+/* Return the number of input bytes returned in chunks so far.  For
+   armored input this is an estimate.  */
+guint64 gpa_key_chunker_get_offset (gpa_key_chunker_t chunker);
+
+#endif /*KEYCHUNK_H*/
@@ -163,3 +163,112 @@ gpa_delete_dialog_run (GtkWidget * parent, gpgme_key_t key)
       return FALSE;
     }
 } /* gpa_delete_dialog_run */
+
+
+/* The number of keys named in the summary dialog.  */
+#define SUMMARY_MAX_NAMES 10
+
+/* Run a single confirmation dialog for deleting all KEYS as a modal
+ * dialog and return TRUE if the user chose Yes.  Only the number of
+ * keys and the first few user IDs are shown.  If any of the keys has
+ * a secret key, a second warning has to be confirmed as well.
+ */
+gboolean
+gpa_delete_dialog_run_multiple (GtkWidget *parent, GList *keys)
+{
+  GtkWidget *window;
+  GtkWidget *vbox;
+  GtkWidget *label;
+  GString *names;
+  GList *item;
+  guint nkeys = g_list_length (keys);
+  guint nsecret = 0;
+  guint n;
+  gchar *text;
+  gboolean result;
+
+  if (nkeys == 1)
+    return gpa_delete_dialog_run (parent, keys->data);
+
+  names = g_string_new (NULL);
+  for (item = keys, n = 0; item; item = g_list_next (item), n++)
+    {
+      gpgme_key_t key = item->data;
+
+      if (gpa_keytable_lookup_key (gpa_keytable_get_secret_instance (),
+                                   key->subkeys->fpr))
+        nsecret++;
+      if (n < SUMMARY_MAX_NAMES)
+        {
+          gchar *uid = gpa_gpgme_key_get_userid (key->uids);
+
+          g_string_append_printf (names, "%s\n", uid);
+          g_free (uid);
+        }
+    }
+  if (nkeys > SUMMARY_MAX_NAMES)
+    g_string_append_printf (names, ngettext ("and %u more key",
+                                             "and %u more keys",
+                                             nkeys - SUMMARY_MAX_NAMES),
+                            nkeys - SUMMARY_MAX_NAMES);
+
+  window = gtk_dialog_new_with_buttons (_("Remove Keys"), GTK_WINDOW (parent),
+                                        GTK_DIALOG_MODAL,
+                                        _("_Yes"),
+                                        GTK_RESPONSE_YES,
+                                        _("_No"),
+                                        GTK_RESPONSE_NO,
+                                        NULL);
+  gtk_dialog_set_default_response (GTK_DIALOG (window), GTK_RESPONSE_NO);
+  gtk_container_set_border_width (GTK_CONTAINER (window), 5);
+
+  vbox = gtk_dialog_get_content_area (GTK_DIALOG (window));
+  gtk_container_set_border_width (GTK_CONTAINER (vbox), 5);
+
+  text = g_strdup_printf (_("You have selected %u keys for removal:"), nkeys);
+  label = gtk_label_new (text);
+  g_free (text);
+  gtk_widget_set_halign (GTK_WIDGET (label), 0.0);
+  gtk_box_pack_start (GTK_BOX (vbox), label, FALSE, FALSE, 5);
+
+  label = gtk_label_new (g_strchomp (names->str));
+  g_string_free (names, TRUE);
+  gtk_label_set_selectable (GTK_LABEL (label), TRUE);
+  gtk_widget_set_halign (GTK_WIDGET (label), 0.0);
+  gtk_widget_set_margin_start (GTK_WIDGET (label), 10);
+  gtk_box_pack_start (GTK_BOX (vbox), label, FALSE, FALSE, 5);
+
+  if (nsecret)
+    {
+      text = g_strdup_printf (ngettext
+                              ("%u of these keys has a secret key."
+                               " Deleting it cannot be undone,"
+                               " unless you have a backup copy.",
+                               "%u of these keys have a secret key."
+                               " Deleting them cannot be undone,"
+                               " unless you have a backup copy.",
+                               nsecret), nsecret);
+      label = gtk_label_new (text);
+      g_free (text);
+    }
+  else
+    label = gtk_label_new (_("These keys are public keys."
+                             " Deleting them cannot be undone easily,"
+                             " although you may be able to get new copies"
+                             " from the owners or from a key server."));
+  gtk_widget_set_halign (GTK_WIDGET (label), 0.0);
+  gtk_label_set_line_wrap (GTK_LABEL (label), TRUE);
+  gtk_box_pack_start (GTK_BOX (vbox), label, FALSE, FALSE, 5);
+
+  label = gtk_label_new (_("Are you sure you want to delete these keys?"));
+  gtk_box_pack_start (GTK_BOX (vbox), label, FALSE, FALSE, 5);
+
+  gtk_widget_show_all (window);
+
+  result = gtk_dialog_run (GTK_DIALOG (window)) == GTK_RESPONSE_YES;
+  if (result && nsecret)
+    result = confirm_delete_secret (window);
+  gtk_widget_destroy (window);
+
+  return result;
+}
@@ -24,4 +24,7 @@
 #include <gtk/gtk.h>
 gboolean gpa_delete_dialog_run (GtkWidget * parent, gpgme_key_t key);
 
+/* Ask once for the removal of all KEYS.  */
+gboolean gpa_delete_dialog_run_multiple (GtkWidget *parent, GList *keys);
+
 #endif /* KEYDELETEDLG_H */
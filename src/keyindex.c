@@ -0,0 +1,367 @@
+/* keyindex.c - A search index over keys.
+   Copyright (C) 2026 g10 Code GmbH
+
+   This file is part of GPA.
+
+   GPA is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   GPA is distributed in the hope that it will be useful, but WITHOUT
+   ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+   or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public
+   License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, see <http://www.gnu.org/licenses/>.  */
+
+/*
+   For each key a lowercased text with its user IDs, key IDs and
+   fingerprints is stored, one per line.  Every three byte sequence
+   of the text (trigram) maps to the sorted list of the keys whose
+   text contains it.  A search intersects the lists of all trigrams
+   of the query and then checks the remaining candidates with a plain
+   substring search.  Queries shorter than three bytes scan all
+   texts.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <string.h>
+
+#include <glib.h>
+
+#include "gpa.h"
+#include "keyindex.h"
+
+
+/* One indexed key.  */
+struct entry_s
+{
+  gpgme_key_t key;
+  const char *text;
+};
+
+struct gpa_key_index_s
+{
+  GArray *entries;          /* Array of struct entry_s.  */
+  GHashTable *ids;          /* Map keys to their entry index plus 1.  */
+  GHashTable *postings;     /* Map trigrams to GArrays of guint.  */
+  GStringChunk *strings;    /* Storage for the texts.  */
+};
+
+
+#define TRIGRAM(s) GUINT_TO_POINTER (((guint) (guchar) (s)[0] << 16)  \
+                                     | ((guint) (guchar) (s)[1] << 8) \
+                                     | (guint) (guchar) (s)[2])
+
+
+static void
+free_posting (gpointer data)
+{
+  g_array_free (data, TRUE);
+}
+
+
+/* Create a new empty index.  */
+gpa_key_index_t
+gpa_key_index_new (void)
+{
+  gpa_key_index_t index;
+
+  index = g_malloc0 (sizeof *index);
+  index->entries = g_array_new (FALSE, FALSE, sizeof (struct entry_s));
+  index->ids = g_hash_table_new (g_direct_hash, g_direct_equal);
+  index->postings = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+                                           NULL, free_posting);
+  index->strings = g_string_chunk_new (64 * 1024);
+
+  return index;
+}
+
+
+/* Release INDEX.  */
+void
+gpa_key_index_release (gpa_key_index_t index)
+{
+  if (!index)
+    return;
+
+  g_array_free (index->entries, TRUE);
+  g_hash_table_destroy (index->ids);
+  g_hash_table_destroy (index->postings);
+  g_string_chunk_free (index->strings);
+  g_free (index);
+}
+
+
+/* Remove KEY from INDEX.  Its entry stays in the postings but is
+   cleared, so that the ids of the other keys do not change.  */
+void
+gpa_key_index_remove (gpa_key_index_t index, gpgme_key_t key)
+{
+  guint id = GPOINTER_TO_UINT (g_hash_table_lookup (index->ids, key));
+
+  if (!id)
+    return;
+
+  g_array_index (index->entries, struct entry_s, id - 1).key = NULL;
+  g_hash_table_remove (index->ids, key);
+}
+
+
+/* Remove all keys from INDEX.  */
+void
+gpa_key_index_clear (gpa_key_index_t index)
+{
+  g_array_set_size (index->entries, 0);
+  g_hash_table_remove_all (index->ids);
+  g_hash_table_remove_all (index->postings);
+  g_string_chunk_clear (index->strings);
+}
+
+
+/* Append STRING lowercased to TEXT.  User IDs are not always UTF-8,
+   in which case only ASCII letters are folded.  */
+static void
+append_lower (GString *text, const char *string)
+{
+  char *lower;
+
+  if (!string || !*string)
+    return;
+
+  if (g_utf8_validate (string, -1, NULL))
+    lower = g_utf8_strdown (string, -1);
+  else
+    lower = g_ascii_strdown (string, -1);
+  g_string_append (text, lower);
+  g_string_append_c (text, '\n');
+  g_free (lower);
+}
+
+
+/* Return the text searched for KEY.  */
+static GString *
+key_text (gpgme_key_t key)
+{
+  GString *text = g_string_sized_new (128);
+  gpgme_user_id_t uid;
+  gpgme_subkey_t subkey;
+
+  for (uid = key->uids; uid; uid = uid->next)
+    append_lower (text, uid->uid);
+  for (subkey = key->subkeys; subkey; subkey = subkey->next)
+    {
+      append_lower (text, subkey->keyid);
+      append_lower (text, subkey->fpr);
+    }
+
+  return text;
+}
+
+
+/* Add KEY to INDEX.  */
+void
+gpa_key_index_add (gpa_key_index_t index, gpgme_key_t key)
+{
+  struct entry_s entry;
+  GString *text;
+  guint id;
+  gsize i;
+
+  if (!key || g_hash_table_contains (index->ids, key))
+    return;
+
+  text = key_text (key);
+  id = index->entries->len;
+  entry.key = key;
+  entry.text = g_string_chunk_insert_len (index->strings,
+                                          text->str, text->len);
+  g_array_append_val (index->entries, entry);
+  g_hash_table_insert (index->ids, key, GUINT_TO_POINTER (id + 1));
+
+  for (i = 0; i + 3 <= text->len; i++)
+    {
+      gpointer trigram = TRIGRAM (text->str + i);
+      GArray *posting;
+
+      posting = g_hash_table_lookup (index->postings, trigram);
+      if (!posting)
+        {
+          posting = g_array_sized_new (FALSE, FALSE, sizeof (guint), 4);
+          g_hash_table_insert (index->postings, trigram, posting);
+        }
+      /* The ids are increasing, thus a repeated trigram of this key
+         is always the last element.  */
+      if (!posting->len
+          || g_array_index (posting, guint, posting->len - 1) != id)
+        g_array_append_val (posting, id);
+    }
+
+  g_string_free (text, TRUE);
+}
+
+
+/* Return true if KEY has been added to INDEX.  */
+int
+gpa_key_index_contains (gpa_key_index_t index, gpgme_key_t key)
+{
+  return index && g_hash_table_contains (index->ids, key);
+}
+
+
+/* Return a malloced search string for QUERY as expected by the
+   functions below or NULL if QUERY is empty.  A leading "0x" is
+   removed and so are the spaces in a fingerprint.  */
+char *
+gpa_key_index_normalize (const char *query)
+{
+  char *result, *s, *d;
+  int hex = 1;
+  int ndigits = 0;
+
+  if (!query)
+    return NULL;
+
+  if (g_utf8_validate (query, -1, NULL))
+    result = g_utf8_strdown (query, -1);
+  else
+    result = g_ascii_strdown (query, -1);
+  g_strstrip (result);
+  if (result[0] == '0' && result[1] == 'x' && result[2])
+    memmove (result, result + 2, strlen (result + 2) + 1);
+
+  for (s = result; *s; s++)
+    if (g_ascii_isxdigit (*s))
+      ndigits++;
+    else if (*s != ' ')
+      hex = 0;
+  if (hex && ndigits >= 16)
+    {
+      for (s = d = result; *s; s++)
+        if (*s != ' ')
+          *d++ = *s;
+      *d = 0;
+    }
+
+  if (!*result)
+    {
+      g_free (result);
+      return NULL;
+    }
+  return result;
+}
+
+
+static gint
+compare_postings (gconstpointer a, gconstpointer b)
+{
+  const GArray *pa = *(GArray * const *) a;
+  const GArray *pb = *(GArray * const *) b;
+
+  return pa->len < pb->len? -1 : pa->len > pb->len? 1 : 0;
+}
+
+
+/* Remove all ids from CANDIDATES which are not in POSTING.  Both
+   arrays are sorted.  */
+static void
+intersect (GArray *candidates, const GArray *posting)
+{
+  guint i, j, n;
+
+  for (i = j = n = 0; i < candidates->len && j < posting->len; )
+    {
+      guint a = g_array_index (candidates, guint, i);
+      guint b = g_array_index (posting, guint, j);
+
+      if (a < b)
+        i++;
+      else if (a > b)
+        j++;
+      else
+        {
+          g_array_index (candidates, guint, n++) = a;
+          i++;
+          j++;
+        }
+    }
+  g_array_set_size (candidates, n);
+}
+
+
+/* Return a set of the keys in INDEX matching the normalized QUERY.
+   The caller must destroy the hash table.  */
+GHashTable *
+gpa_key_index_search (gpa_key_index_t index, const char *query)
+{
+  GHashTable *result = g_hash_table_new (g_direct_hash, g_direct_equal);
+  size_t len = strlen (query);
+  GPtrArray *postings;
+  GArray *candidates;
+  guint i;
+
+  if (len < 3)
+    {
+      for (i = 0; i < index->entries->len; i++)
+        {
+          struct entry_s *entry = &g_array_index (index->entries,
+                                                  struct entry_s, i);
+          if (entry->key && strstr (entry->text, query))
+            g_hash_table_add (result, entry->key);
+        }
+      return result;
+    }
+
+  postings = g_ptr_array_new ();
+  for (i = 0; i + 3 <= len; i++)
+    {
+      GArray *posting = g_hash_table_lookup (index->postings,
+                                             TRIGRAM (query + i));
+      if (!posting)
+        {
+          g_ptr_array_free (postings, TRUE);
+          return result;
+        }
+      g_ptr_array_add (postings, posting);
+    }
+
+  /* Start with the shortest list to keep the intersections small.  */
+  g_ptr_array_sort (postings, compare_postings);
+  candidates = g_array_new (FALSE, FALSE, sizeof (guint));
+  g_array_append_vals (candidates, ((GArray *) postings->pdata[0])->data,
+                       ((GArray *) postings->pdata[0])->len);
+  for (i = 1; i < postings->len && candidates->len; i++)
+    intersect (candidates, postings->pdata[i]);
+
+  for (i = 0; i < candidates->len; i++)
+    {
+      struct entry_s *entry;
+
+      entry = &g_array_index (index->entries, struct entry_s,
+                              g_array_index (candidates, guint, i));
+      if (entry->key && strstr (entry->text, query))
+        g_hash_table_add (result, entry->key);
+    }
+
+  g_array_free (candidates, TRUE);
+  g_ptr_array_free (postings, TRUE);
+  return result;
+}
+
+
+/* Return true if KEY matches the normalized QUERY.  This is for keys
+   not in an index.  */
+int
+gpa_key_index_match_key (gpgme_key_t key, const char *query)
+{
+  GString *text = key_text (key);
+  int match = !!strstr (text->str, query);
+
+  g_string_free (text, TRUE);
+  return match;
+}
@@ -0,0 +1,60 @@
+/* keyindex.h - A search index over keys.
+   Copyright (C) 2026 g10 Code GmbH
+
+   This file is part of GPA.
+
+   GPA is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   GPA is distributed in the hope that it will be useful, but WITHOUT
+   ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+   or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public
+   License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, see <http://www.gnu.org/licenses/>.  */
+
+#ifndef KEYINDEX_H
+#define KEYINDEX_H
+
+#include <glib.h>
+#include <gpgme.h>
+
+/* An index of the user IDs, key IDs and fingerprints of keys for
+   substring searches.  The index does not take references; the keys
+   must be kept alive by the owner of the index.  */
+typedef struct gpa_key_index_s *gpa_key_index_t;
+
+/* Create a new empty index.  */
+gpa_key_index_t gpa_key_index_new (void);
+
+/* Release INDEX.  */
+void gpa_key_index_release (gpa_key_index_t index);
+
+/* Add KEY to INDEX.  */
+void gpa_key_index_add (gpa_key_index_t index, gpgme_key_t key);
+
+/* Remove KEY from INDEX.  */
+void gpa_key_index_remove (gpa_key_index_t index, gpgme_key_t key);
+
+/* Remove all keys from INDEX.  */
+void gpa_key_index_clear (gpa_key_index_t index);
+
+/* Return true if KEY has been added to INDEX.  */
+int gpa_key_index_contains (gpa_key_index_t index, gpgme_key_t key);
+
+/* Return a malloced search string for QUERY as expected by the
+   functions below or NULL if QUERY is empty.  */
+char *gpa_key_index_normalize (const char *query);
+
+/* Return a set of the keys in INDEX matching the normalized QUERY.
+   The caller must destroy the hash table.  */
+GHashTable *gpa_key_index_search (gpa_key_index_t index, const char *query);
+
+/* Return true if KEY matches the normalized QUERY.  This is for keys
+   not in an index.  */
+int gpa_key_index_match_key (gpgme_key_t key, const char *query);
+
+#endif /*KEYINDEX_H*/
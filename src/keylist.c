@@ -30,6 +30,7 @@
 #include "keytable.h"
 #include "icons.h"
 #include "format-dn.h"
+#include "keyref.h"
 
 
 /* Properties */
@@ -68,6 +69,8 @@ typedef enum
   GPA_KEYLIST_COLUMN_EXPIRY_TS,
   GPA_KEYLIST_COLUMN_OWNERTRUST_VALUE,
   GPA_KEYLIST_COLUMN_VALIDITY_VALUE,
+  /* The collation key of the user ID, owned by the row.  */
+  GPA_KEYLIST_COLUMN_USERID_KEY,
   GPA_KEYLIST_N_COLUMNS
 } GpaKeyListColumn;
 
@@ -76,6 +79,10 @@ typedef enum
 static void add_trustdb_dialog (GpaKeyList * keylist);
 static void gpa_keylist_next (gpgme_key_t key, gpointer data);
 static void gpa_keylist_end (gpointer data);
+static gboolean filter_visible (GtkTreeModel *model, GtkTreeIter *iter,
+                                gpointer data);
+static GtkTreeModel *create_sorted_model (GpaKeyList *list);
+static void clear_store (GpaKeyList *list);
 
 
 
@@ -175,10 +182,17 @@ gpa_keylist_finalize (GObject *object)
   GpaKeyList *list = GPA_KEYLIST (object);
 
   /* Dereference all keys in the list */
-  g_list_foreach (list->keys, (GFunc) gpgme_key_unref, NULL);
+  gpa_key_unref_list (list->keys, GPA_KEY_OWNER_KEYLIST);
   g_list_free (list->keys);
   list->keys = NULL;
   gpa_gpgme_release_keyarray (list->initial_keys);
+  g_free (list->filter_query);
+  if (list->filter_matches)
+    g_hash_table_destroy (list->filter_matches);
+  gpa_key_index_release (list->own_index);
+  g_object_unref (list->filter);
+  clear_store (list);
+  g_object_unref (list->store);
 
   G_OBJECT_CLASS (parent_class)->finalize (object);
 }
@@ -189,9 +203,11 @@ gpa_keylist_init (GTypeInstance *instance, void *class_ptr)
 {
   GpaKeyList *list = GPA_KEYLIST (instance);
   GtkListStore *store;
+  GtkTreeModel *sorted;
   GtkTreeSelection *selection;
 
-  /* Setup the model.  */
+  /* Setup the model.  The view shows a sorted copy of a filter over
+     the store.  */
   store = gtk_list_store_new (GPA_KEYLIST_N_COLUMNS,
 			      G_TYPE_STRING,
 			      G_TYPE_STRING,
@@ -205,10 +221,17 @@ gpa_keylist_init (GTypeInstance *instance, void *class_ptr)
 			      G_TYPE_ULONG,
 			      G_TYPE_ULONG,
 			      G_TYPE_ULONG,
-			      G_TYPE_LONG);
+			      G_TYPE_LONG,
+			      G_TYPE_POINTER);
+  list->store = store;
+  list->filter = gtk_tree_model_filter_new (GTK_TREE_MODEL (store), NULL);
+  gtk_tree_model_filter_set_visible_func (GTK_TREE_MODEL_FILTER (list->filter),
+                                          filter_visible, list, NULL);
 
   /* Setup the view.  */
-  gtk_tree_view_set_model (GTK_TREE_VIEW (list), GTK_TREE_MODEL (store));
+  sorted = create_sorted_model (list);
+  gtk_tree_view_set_model (GTK_TREE_VIEW (list), sorted);
+  g_object_unref (sorted);
   gpa_keylist_set_brief (list);
   selection = gtk_tree_view_get_selection (GTK_TREE_VIEW (list));
   gtk_tree_selection_set_mode (selection, GTK_SELECTION_MULTIPLE);
@@ -221,9 +244,11 @@ gpa_keylist_init (GTypeInstance *instance, void *class_ptr)
       int idx;
       gpgme_key_t key;
 
+      list->own_index = gpa_key_index_new ();
       for (idx=0; (key = list->initial_keys[idx]); idx++)
         {
-          gpgme_key_ref (key);
+          /* Pass a reference the same way the key table does.  */
+          gpa_key_ref (key, GPA_KEY_OWNER_KEYTABLE);
           gpa_keylist_next (key, list);
         }
       gpa_keylist_end (list);
@@ -425,6 +450,102 @@ is_zero_fpr (const char *fpr)
 }
 
 
+/* Return the index covering the keys of LIST.  */
+static gpa_key_index_t
+keylist_index (GpaKeyList *list)
+{
+  if (list->own_index)
+    return list->own_index;
+  return gpa_keytable_get_index (gpa_keytable_get_public_instance ());
+}
+
+
+/* Decide whether the row at ITER is shown with the current filter.
+   Keys which are not yet in the index, because their listing has
+   not finished, are matched directly.  */
+static gboolean
+filter_visible (GtkTreeModel *model, GtkTreeIter *iter, gpointer data)
+{
+  GpaKeyList *list = data;
+  gpgme_key_t key;
+
+  if (!list->filter_query)
+    return TRUE;
+
+  gtk_tree_model_get (model, iter, GPA_KEYLIST_COLUMN_KEY, &key, -1);
+  if (!key)
+    return FALSE;
+  if (list->filter_matches && g_hash_table_contains (list->filter_matches, key))
+    return TRUE;
+  if (gpa_key_index_contains (keylist_index (list), key))
+    return FALSE;
+  return gpa_key_index_match_key (key, list->filter_query);
+}
+
+
+/* Compare the rows at A and B by the collation keys of their user
+   IDs.  */
+static gint
+compare_collate_keys (GtkTreeModel *model, GtkTreeIter *a, GtkTreeIter *b,
+                      gpointer data)
+{
+  const char *key_a, *key_b;
+
+  gtk_tree_model_get (model, a, GPA_KEYLIST_COLUMN_USERID_KEY, &key_a, -1);
+  gtk_tree_model_get (model, b, GPA_KEYLIST_COLUMN_USERID_KEY, &key_b, -1);
+
+  return strcmp (key_a? key_a : "", key_b? key_b : "");
+}
+
+
+/* Return a new sortable model over the filter of LIST.  */
+static GtkTreeModel *
+create_sorted_model (GpaKeyList *list)
+{
+  GtkTreeModel *sorted;
+
+  sorted = gtk_tree_model_sort_new_with_model (list->filter);
+  gtk_tree_sortable_set_sort_func (GTK_TREE_SORTABLE (sorted),
+                                   GPA_KEYLIST_COLUMN_USERID_KEY,
+                                   compare_collate_keys, NULL, NULL);
+  return sorted;
+}
+
+
+/* Look up the keys matching the filter and update the view.  */
+static void
+update_filter (GpaKeyList *list)
+{
+  GtkTreeModel *sorted;
+  gint sort_id;
+  GtkSortType order;
+  gboolean is_sorted;
+
+  if (list->filter_matches)
+    {
+      g_hash_table_destroy (list->filter_matches);
+      list->filter_matches = NULL;
+    }
+  if (list->filter_query)
+    list->filter_matches = gpa_key_index_search (keylist_index (list),
+                                                 list->filter_query);
+
+  /* Refiltering through an attached sort model would resort it for
+     every changed row.  It is much faster to build a new one.  */
+  sorted = gtk_tree_view_get_model (GTK_TREE_VIEW (list));
+  is_sorted = gtk_tree_sortable_get_sort_column_id
+    (GTK_TREE_SORTABLE (sorted), &sort_id, &order);
+  gtk_tree_view_set_model (GTK_TREE_VIEW (list), NULL);
+  gtk_tree_model_filter_refilter (GTK_TREE_MODEL_FILTER (list->filter));
+  sorted = create_sorted_model (list);
+  if (is_sorted)
+    gtk_tree_sortable_set_sort_column_id (GTK_TREE_SORTABLE (sorted),
+                                          sort_id, order);
+  gtk_tree_view_set_model (GTK_TREE_VIEW (list), sorted);
+  g_object_unref (sorted);
+}
+
+
 /* Note that this function takes ownership of KEY.  */
 static void
 gpa_keylist_next (gpgme_key_t key, gpointer data)
@@ -433,7 +554,7 @@ gpa_keylist_next (gpgme_key_t key, gpointer data)
   GtkListStore *store;
   GtkTreeIter iter;
   const gchar *ownertrust, *validity;
-  gchar *userid, *created, *expiry;
+  gchar *userid, *created, *expiry, *userid_key;
   gboolean has_secret;
   long int val_value;
   const char *keytype;
@@ -441,14 +562,20 @@ gpa_keylist_next (gpgme_key_t key, gpointer data)
   /* Remove the dialog if it is being displayed */
   remove_trustdb_dialog (list);
 
+  gpa_key_transfer (key, GPA_KEY_OWNER_KEYTABLE, GPA_KEY_OWNER_KEYLIST);
+
   if (list->disposed)
-    return;  /* Should not access our store anymore.  */
+    {
+      /* Should not access our store anymore.  */
+      gpa_key_unref (key, GPA_KEY_OWNER_KEYLIST);
+      return;
+    }
 
   /* Filter out keys we don't want.  */
   if (key && list->protocol != GPGME_PROTOCOL_UNKNOWN
       && key->protocol != list->protocol)
     {
-      gpgme_key_unref (key);
+      gpa_key_unref (key, GPA_KEY_OWNER_KEYLIST);
       return;
     }
 
@@ -462,7 +589,7 @@ gpa_keylist_next (gpgme_key_t key, gpointer data)
         ;
       else
         {
-          gpgme_key_unref (key);
+          gpa_key_unref (key, GPA_KEY_OWNER_KEYLIST);
           return;
         }
     }
@@ -470,13 +597,15 @@ gpa_keylist_next (gpgme_key_t key, gpointer data)
   if (key && list->only_usable_keys
       && (key->revoked || key->disabled || key->expired || key->invalid))
     {
-      gpgme_key_unref (key);
+      gpa_key_unref (key, GPA_KEY_OWNER_KEYLIST);
       return;
     }
 
   /* Append the key to the list.  */
   list->keys = g_list_append (list->keys, key);
-  store = GTK_LIST_STORE (gtk_tree_view_get_model (GTK_TREE_VIEW (list)));
+  if (list->own_index)
+    gpa_key_index_add (list->own_index, key);
+  store = list->store;
   /* Get the column values */
   keytype = (key->protocol == GPGME_PROTOCOL_OpenPGP? "P" :
              key->protocol == GPGME_PROTOCOL_CMS? "X" : "?");
@@ -488,6 +617,9 @@ gpa_keylist_next (gpgme_key_t key, gpointer data)
     userid = gpa_format_dn (key->uids? key->uids->uid : NULL);
   else
     userid = gpa_gpgme_key_get_userid (key->uids);
+  /* Compute the locale dependent sort key once, so that sorting by
+     user name only compares bytes.  */
+  userid_key = g_utf8_collate_key (userid, -1);
   if (list->public_only)
     has_secret = 0;
   else
@@ -495,9 +627,6 @@ gpa_keylist_next (gpgme_key_t key, gpointer data)
                   && gpa_keytable_lookup_key
                   (gpa_keytable_get_secret_instance(), key->subkeys->fpr));
 
-  /* Append the key to the list */
-  gtk_list_store_append (store, &iter);
-
   /* Set an appropiate value for sorting revoked and expired keys. This
    * includes a hack for forcing a value to a range outside the
    * usual validity values */
@@ -510,7 +639,9 @@ gpa_keylist_next (gpgme_key_t key, gpointer data)
   else
       val_value = GPGME_VALIDITY_UNKNOWN;
 
-  gtk_list_store_set (store, &iter,
+  /* Append the key to the list.  All values are set at once so that
+     the filter sees the complete row.  */
+  gtk_list_store_insert_with_values (store, &iter, -1,
 		      GPA_KEYLIST_COLUMN_KEYTYPE, keytype,
 		      GPA_KEYLIST_COLUMN_CREATED, created,
 		      GPA_KEYLIST_COLUMN_EXPIRY, expiry,
@@ -531,6 +662,7 @@ gpa_keylist_next (gpgme_key_t key, gpointer data)
 		      /* Set revoked and expired keys to "never trust"
 		         for sorting.  */
 		      GPA_KEYLIST_COLUMN_VALIDITY_VALUE, val_value,
+		      GPA_KEYLIST_COLUMN_USERID_KEY, userid_key,
                       /* Store the image only if enabled.  */
 		      list->public_only ? -1 : GPA_KEYLIST_COLUMN_IMAGE,
                       list->public_only ? NULL : get_key_pixbuf (key),
@@ -548,6 +680,10 @@ gpa_keylist_end (gpointer data)
   GpaKeyList *list = data;
 
   remove_trustdb_dialog (list);
+
+  /* The index now includes the new keys.  */
+  if (list->filter_query && !list->disposed)
+    update_filter (list);
 }
 
 
@@ -688,7 +824,8 @@ setup_columns (GpaKeyList *keylist, gboolean detailed)
      _("The User Name is the name and often also the email address "
        " of the certificate."));
   gtk_tree_view_append_column (GTK_TREE_VIEW (keylist), column);
-  gtk_tree_view_column_set_sort_column_id (column, GPA_KEYLIST_COLUMN_USERID);
+  gtk_tree_view_column_set_sort_column_id (column,
+                                           GPA_KEYLIST_COLUMN_USERID_KEY);
   gtk_tree_view_column_set_sort_indicator (column, TRUE);
 
   gtk_tree_view_set_enable_search (GTK_TREE_VIEW(keylist), TRUE);
@@ -881,7 +1018,7 @@ gpa_keylist_get_selected_key (GpaKeyList *keylist)
   gtk_tree_model_get_value (model, &iter, GPA_KEYLIST_COLUMN_KEY, &value);
   key = g_value_get_pointer (&value);
   g_value_unset (&value);
-  gpgme_key_ref (key);
+  gpa_key_ref (key, GPA_KEY_OWNER_KEYLIST);
 
   g_list_foreach (list, (GFunc) gtk_tree_path_free, NULL);
   g_list_free (list);
@@ -890,6 +1027,61 @@ gpa_keylist_get_selected_key (GpaKeyList *keylist)
 }
 
 
+/* Store the keys in the rows before and after the single selected
+   row at R_PREV and R_NEXT; NULL if there is no such row.  No
+   references are provided.  */
+void
+gpa_keylist_get_neighbour_keys (GpaKeyList *keylist,
+                                gpgme_key_t *r_prev, gpgme_key_t *r_next)
+{
+  GtkTreeSelection *selection;
+  GtkTreeModel *model;
+  GList *list;
+  GtkTreePath *path;
+  GtkTreeIter iter;
+
+  *r_prev = *r_next = NULL;
+
+  selection = gtk_tree_view_get_selection (GTK_TREE_VIEW (keylist));
+  if (gtk_tree_selection_count_selected_rows (selection) != 1)
+    return;
+
+  model = gtk_tree_view_get_model (GTK_TREE_VIEW (keylist));
+  list = gtk_tree_selection_get_selected_rows (selection, &model);
+  if (!list)
+    return;
+  path = list->data;
+
+  if (gtk_tree_model_get_iter (model, &iter, path)
+      && gtk_tree_model_iter_next (model, &iter))
+    gtk_tree_model_get (model, &iter, GPA_KEYLIST_COLUMN_KEY, r_next, -1);
+  if (gtk_tree_path_prev (path)
+      && gtk_tree_model_get_iter (model, &iter, path))
+    gtk_tree_model_get (model, &iter, GPA_KEYLIST_COLUMN_KEY, r_prev, -1);
+
+  g_list_foreach (list, (GFunc) gtk_tree_path_free, NULL);
+  g_list_free (list);
+}
+
+
+/* Show only the keys whose user IDs, key IDs or fingerprints
+   contain TEXT.  With TEXT being NULL or empty show all keys.  */
+void
+gpa_keylist_set_filter (GpaKeyList *keylist, const char *text)
+{
+  char *query = gpa_key_index_normalize (text);
+
+  if (!g_strcmp0 (query, keylist->filter_query))
+    {
+      g_free (query);
+      return;
+    }
+  g_free (keylist->filter_query);
+  keylist->filter_query = query;
+  update_filter (keylist);
+}
+
+
 /* Begin a reload of the keyring. */
 void
 gpa_keylist_start_reload (GpaKeyList * keylist)
@@ -897,9 +1089,8 @@ gpa_keylist_start_reload (GpaKeyList * keylist)
   GtkTreeSelection *selection =
     gtk_tree_view_get_selection (GTK_TREE_VIEW (keylist));
   gtk_tree_selection_unselect_all (selection);
-  gtk_list_store_clear (GTK_LIST_STORE (gtk_tree_view_get_model
-					(GTK_TREE_VIEW (keylist))));
-  g_list_foreach (keylist->keys, (GFunc) gpgme_key_unref, NULL);
+  clear_store (keylist);
+  gpa_key_unref_list (keylist->keys, GPA_KEY_OWNER_KEYLIST);
   g_list_free (keylist->keys);
   keylist->keys = NULL;
   add_trustdb_dialog (keylist);
@@ -931,6 +1122,102 @@ gpa_keylist_new_key (GpaKeyList * keylist, const char *fpr)
 }
 
 
+/* Remove all rows of the store of LIST.  */
+static void
+clear_store (GpaKeyList *list)
+{
+  GtkTreeModel *model = GTK_TREE_MODEL (list->store);
+  GtkTreeIter iter;
+  gboolean valid;
+
+  valid = gtk_tree_model_get_iter_first (model, &iter);
+  while (valid)
+    {
+      gchar *userid_key;
+
+      gtk_tree_model_get (model, &iter,
+                          GPA_KEYLIST_COLUMN_USERID_KEY, &userid_key, -1);
+      g_free (userid_key);
+      valid = gtk_tree_model_iter_next (model, &iter);
+    }
+  gtk_list_store_clear (list->store);
+}
+
+
+/* Remove the rows of the keys with the fingerprints in the NULL
+   terminated array FPRS.  */
+static void
+remove_rows (GpaKeyList *keylist, const char **fprs)
+{
+  GHashTable *set;
+  GtkTreeModel *model = GTK_TREE_MODEL (keylist->store);
+  GtkTreeIter iter;
+  gboolean valid;
+  int i;
+
+  set = g_hash_table_new (g_str_hash, g_str_equal);
+  for (i = 0; fprs[i]; i++)
+    g_hash_table_add (set, (char *) fprs[i]);
+
+  valid = gtk_tree_model_get_iter_first (model, &iter);
+  while (valid)
+    {
+      gpgme_key_t key;
+      gchar *userid_key;
+
+      gtk_tree_model_get (model, &iter, GPA_KEYLIST_COLUMN_KEY, &key,
+                          GPA_KEYLIST_COLUMN_USERID_KEY, &userid_key, -1);
+      if (key && key->subkeys && key->subkeys->fpr
+          && g_hash_table_contains (set, key->subkeys->fpr))
+        {
+          valid = gtk_list_store_remove (keylist->store, &iter);
+          g_free (userid_key);
+          keylist->keys = g_list_remove (keylist->keys, key);
+          if (keylist->own_index)
+            gpa_key_index_remove (keylist->own_index, key);
+          gpa_key_unref (key, GPA_KEY_OWNER_KEYLIST);
+        }
+      else
+        valid = gtk_tree_model_iter_next (model, &iter);
+    }
+  g_hash_table_destroy (set);
+}
+
+
+/* Reload only the keys with the fingerprints in the NULL terminated
+   array FPRS, for example after they have been imported.  */
+void
+gpa_keylist_update_keys (GpaKeyList *keylist, const char **fprs)
+{
+  if (!fprs || !*fprs)
+    return;
+
+  /* Remove the old versions of the keys.  The new ones are appended
+     by gpa_keylist_next.  */
+  remove_rows (keylist, fprs);
+
+  /* Listing the keys updates the trustdb once if needed.  */
+  add_trustdb_dialog (keylist);
+  gpa_keytable_load_keys (gpa_keytable_get_public_instance (), fprs,
+                          gpa_keylist_next, gpa_keylist_end, keylist);
+}
+
+
+/* Remove the keys with the fingerprints in the NULL terminated array
+   FPRS, for example after they have been deleted.  Nothing is listed
+   again.  */
+void
+gpa_keylist_remove_keys (GpaKeyList *keylist, const char **fprs)
+{
+  if (!fprs || !*fprs)
+    return;
+
+  remove_rows (keylist, fprs);
+  gpa_keytable_remove_keys (gpa_keytable_get_public_instance (), fprs);
+  gpa_keytable_remove_keys (gpa_keytable_get_secret_instance (), fprs);
+}
+
+
 /* Let the keylist know that a new sceret key has been imported. */
 void
 gpa_keylist_imported_secret_key (GpaKeyList *keylist)
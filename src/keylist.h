@@ -22,6 +22,7 @@
 #define GPA_KEYLIST_H
 
 #include <gtk/gtk.h>
+#include "keyindex.h"
 
 /* GObject stuff */
 #define GPA_KEYLIST_TYPE	  (gpa_keylist_get_type ())
@@ -56,6 +57,15 @@ struct _GpaKeyList {
   int requested_usage;
   gboolean only_usable_keys;
 
+  /* The model below the filter and the filter itself.  */
+  GtkListStore *store;
+  GtkTreeModel *filter;
+  /* The normalized filter text or NULL, and the keys matching it.  */
+  char *filter_query;
+  GHashTable *filter_matches;
+  /* The search index for INITIAL_KEYS.  */
+  gpa_key_index_t own_index;
+
   int disposed;
 };
 
@@ -114,6 +124,17 @@ GList *gpa_keylist_get_selected_keys (GpaKeyList *keylist,
    than one key has been selected.  */
 gpgme_key_t gpa_keylist_get_selected_key (GpaKeyList *keylist);
 
+/* Store the keys in the rows before and after the single selected
+   row at R_PREV and R_NEXT; NULL if there is no such row.  No
+   references are provided.  */
+void gpa_keylist_get_neighbour_keys (GpaKeyList *keylist,
+                                     gpgme_key_t *r_prev,
+                                     gpgme_key_t *r_next);
+
+/* Show only the keys whose user IDs, key IDs or fingerprints
+   contain TEXT.  With TEXT being NULL or empty show all keys.  */
+void gpa_keylist_set_filter (GpaKeyList *keylist, const char *text);
+
 /* Begin a reload of the keyring. */
 void gpa_keylist_start_reload (GpaKeyList * keylist);
 
@@ -121,6 +142,14 @@ void gpa_keylist_start_reload (GpaKeyList * keylist);
    available. */
 void gpa_keylist_new_key (GpaKeyList * keylist, const char *fpr);
 
+/* Reload only the keys with the fingerprints in the NULL terminated
+   array FPRS, for example after they have been imported.  */
+void gpa_keylist_update_keys (GpaKeyList *keylist, const char **fprs);
+
+/* Remove the keys with the fingerprints in the NULL terminated array
+   FPRS, for example after they have been deleted.  */
+void gpa_keylist_remove_keys (GpaKeyList *keylist, const char **fprs);
+
 /* Let the keylist know that a new sceret key has been imported.  */
 void gpa_keylist_imported_secret_key (GpaKeyList * keylist);
 
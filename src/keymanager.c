@@ -53,6 +53,7 @@
 #include "gpakeydeleteop.h"
 #include "gpakeysignop.h"
 #include "gpakeytrustop.h"
+#include "gpakeyexpireop.h"
 
 #include "gpaexportfileop.h"
 #include "gpaexportclipop.h"
@@ -62,6 +63,7 @@
 #include "gpaimportclipop.h"
 #include "gpaimportserverop.h"
 #include "gpaimportbykeyidop.h"
+#include "gparefreshop.h"
 
 #include "gpabackupop.h"
 
@@ -71,12 +73,22 @@
 #include "gpa-key-details.h"
 
 #include "keymanager.h"
+#include "keyref.h"
+#include "keycache.h"
 
 
 #if ! GTK_CHECK_VERSION (2, 10, 0)
 #define GTK_STOCK_SELECT_ALL "gtk-select-all"
 #endif
 
+/* The number of keys with signatures kept for the details pane.  */
+#define KEY_CACHE_SIZE 64
+
+/* The time in milliseconds to wait for further selection changes
+   before a key is listed while the listing of the previously
+   selected key is still running.  */
+#define FETCH_DELAY 150
+
 
 /* Object's class definition.  */
 struct _GpaKeyManagerClass
@@ -118,9 +130,22 @@ struct _GpaKeyManager
   /* The currently selected key.  */
   gpgme_key_t current_key;
 
+  /* The fingerprint and protocol of the selected key while
+     CURRENT_KEY is being retrieved or has been retrieved.  */
+  char *current_fpr;
+  gpgme_protocol_t current_protocol;
+
   /* Context used for retrieving the current key.  */
   GpaContext *ctx;
 
+  /* Source id of the delayed retrieval of the current key or 0.  */
+  guint fetch_timeout_id;
+
+  /* The recently used keys with signatures and the context used to
+     retrieve the keys next to the selected one in advance.  */
+  gpa_key_cache_t key_cache;
+  GpaContext *prefetch_ctx;
+
   /* Hack: warn the selection callback to ignore changes. Don't, ever,
      assign a value directly.  Raise and lower it with increments.  */
   int freeze_selection;
@@ -141,6 +166,7 @@ typedef gboolean (*sensitivity_func_t) (gpointer);
 /* Local prototypes */
 static int idle_update_details (gpointer param);
 static void keyring_update_details (GpaKeyManager *self);
+static void fetch_current_key (GpaKeyManager *self);
 
 static void gpa_key_manager_finalize (GObject *object);
 
@@ -258,12 +284,38 @@ key_manager_has_single_selection_OpenPGP (gpointer param)
       gpgme_key_t key = gpa_keylist_get_selected_key (self->keylist);
       if (key && key->protocol == GPGME_PROTOCOL_OpenPGP)
         result = 1;
-      gpgme_key_unref (key);
+      gpa_key_unref (key, GPA_KEY_OWNER_KEYMANAGER);
     }
 
   return result;
 }
 
+/* Return TRUE if the key list widget of the key manager has a
+   selection with an OpenPGP key.  Only a single selected key is
+   checked for its protocol.  Usable as a sensitivity callback.  */
+static gboolean
+key_manager_has_selection_OpenPGP (gpointer param)
+{
+  GpaKeyManager *self = param;
+
+  if (gpa_keylist_has_single_selection (self->keylist))
+    return key_manager_has_single_selection_OpenPGP (param);
+  return gpa_keylist_has_selection (self->keylist);
+}
+
+/* Return TRUE if the key list widget of the key manager has a
+   selection which may contain a private key.  Only a single selected
+   key is checked.  Usable as a sensitivity callback.  */
+static gboolean
+key_manager_has_private_in_selection (gpointer param)
+{
+  GpaKeyManager *self = param;
+
+  if (gpa_keylist_has_single_selection (self->keylist))
+    return gpa_keylist_has_single_secret_selection (self->keylist);
+  return gpa_keylist_has_selection (self->keylist);
+}
+
 /* Return TRUE if the key list widget of the key manager has
    exactly one selected item and it is a private key.  Usable as a
    sensitivity callback.  */
@@ -285,6 +337,30 @@ key_manager_current_key (GpaKeyManager *self)
 }
 
 
+/* Drop the cached keys after the keyring has been changed.  Running
+   retrievals are aborted as they may return outdated keys; a
+   retrieval of the current key is started again.  */
+static void
+invalidate_key_cache (GpaKeyManager *self)
+{
+  gboolean refetch = FALSE;
+
+  if (gpa_context_busy (self->prefetch_ctx))
+    gpgme_op_keylist_end (self->prefetch_ctx->ctx);
+  if (gpa_context_busy (self->ctx))
+    {
+      gpgme_op_keylist_end (self->ctx->ctx);
+      refetch = TRUE;
+    }
+  gpa_key_cache_clear (self->key_cache);
+
+  /* A pending fetch timeout starts the retrieval anyway.  */
+  if (refetch && self->current_fpr && !self->current_key
+      && !self->fetch_timeout_id)
+    fetch_current_key (self);
+}
+
+
 
 /* Action callbacks.  */
 
@@ -293,6 +369,8 @@ static void
 gpa_key_manager_changed_wot_cb (gpointer data)
 {
   GpaKeyManager *self = data;
+
+  invalidate_key_cache (self);
   gpa_keylist_start_reload (self->keylist);
 }
 
@@ -302,15 +380,38 @@ gpa_key_manager_changed_wot_secret_cb (gpointer data)
 {
   GpaKeyManager *self = data;
 
+  invalidate_key_cache (self);
   gpa_keylist_imported_secret_key (self->keylist);
   gpa_keylist_start_reload (self->keylist);
 }
 
+static void
+gpa_key_manager_updated_keys_cb (GpaOperation *op, const char **fprs,
+                                 gpointer data)
+{
+  GpaKeyManager *self = data;
+
+  invalidate_key_cache (self);
+  gpa_keylist_update_keys (self->keylist, fprs);
+}
+
+static void
+gpa_key_manager_deleted_keys_cb (GpaKeyDeleteOperation *op, const char **fprs,
+                                 gpointer data)
+{
+  GpaKeyManager *self = data;
+
+  invalidate_key_cache (self);
+  gpa_keylist_remove_keys (self->keylist, fprs);
+}
+
 static void
 gpa_key_manager_key_modified (GpaKeyEditDialog *dialog, gpgme_key_t key,
 				 gpointer data)
 {
   GpaKeyManager *self = data;
+
+  invalidate_key_cache (self);
   gpa_keylist_start_reload (self->keylist);
 }
 
@@ -320,6 +421,7 @@ gpa_key_manager_new_key_cb (gpointer data, const gchar *fpr)
 {
   GpaKeyManager *self = data;
 
+  invalidate_key_cache (self);
   gpa_keylist_new_key (GPA_KEYLIST (self->keylist), fpr);
 
   gpa_options_update_default_key (gpa_options_get_instance ());
@@ -347,11 +449,28 @@ register_import_operation (GpaKeyManager *self, GpaImportOperation *op)
     (G_OBJECT (op), "imported_secret_keys",
      G_CALLBACK (gpa_key_manager_changed_wot_secret_cb),
      self);
+  g_signal_connect (G_OBJECT (op), "updated_keys",
+		    G_CALLBACK (gpa_key_manager_updated_keys_cb), self);
   g_signal_connect (G_OBJECT (op), "completed",
 		    G_CALLBACK (g_object_unref), self);
 }
 
 
+#ifdef ENABLE_KEYSERVER_SUPPORT
+static void
+register_refresh_operation (GpaKeyManager *self, GpaRefreshOperation *op)
+{
+  g_signal_connect_swapped (G_OBJECT (op), "imported_keys",
+			    G_CALLBACK (gpa_key_manager_changed_wot_cb),
+			    self);
+  g_signal_connect (G_OBJECT (op), "updated_keys",
+		    G_CALLBACK (gpa_key_manager_updated_keys_cb), self);
+  g_signal_connect (G_OBJECT (op), "completed",
+		    G_CALLBACK (g_object_unref), self);
+}
+#endif /*ENABLE_KEYSERVER_SUPPORT*/
+
+
 static void
 register_generate_operation (GpaKeyManager *self, GpaGenKeyOperation *op)
 {
@@ -381,6 +500,8 @@ key_manager_delete (GSimpleAction *simple, GVariant *parameter, gpointer param)
   GpaKeyDeleteOperation *op = gpa_key_delete_operation_new (GTK_WIDGET (self),
 							    selection);
   register_key_operation (self, GPA_KEY_OPERATION (op));
+  g_signal_connect (G_OBJECT (op), "deleted_keys",
+		    G_CALLBACK (gpa_key_manager_deleted_keys_cb), self);
 }
 
 
@@ -459,6 +580,8 @@ key_manager_sign (GSimpleAction *simple, GVariant *parameter, gpointer param)
     {
       op = gpa_key_sign_operation_new (GTK_WIDGET (self), selection);
       register_key_operation (self, GPA_KEY_OPERATION (op));
+      g_signal_connect (G_OBJECT (op), "updated_keys",
+			G_CALLBACK (gpa_key_manager_updated_keys_cb), self);
     }
 }
 
@@ -485,6 +608,25 @@ key_manager_edit (GSimpleAction *simple, GVariant *parameter, gpointer param)
 }
 
 
+/* Change the expiry date of the selected keys and their subkeys.  */
+static void
+key_manager_expire (GSimpleAction *simple, GVariant *parameter, gpointer param)
+{
+  GpaKeyManager *self = param;
+  GList *selection;
+  GpaKeyExpireOperation *op;
+
+  selection = gpa_keylist_get_selected_keys (self->keylist,
+                                             GPGME_PROTOCOL_OpenPGP);
+  if (selection)
+    {
+      op = gpa_key_expire_operation_new_with_subkeys (GTK_WIDGET (self),
+                                                      selection);
+      register_key_operation (self, GPA_KEY_OPERATION (op));
+    }
+}
+
+
 static void
 key_manager_trust (GSimpleAction *simple, GVariant *parameter, gpointer param)
 {
@@ -492,17 +634,14 @@ key_manager_trust (GSimpleAction *simple, GVariant *parameter, gpointer param)
   GList *selection;
   GpaKeyTrustOperation *op;
 
-  /* FIXME: Key trust operation currently does not support more than
-     one key at a time.  */
-  if (! key_manager_has_single_selection (self))
-    return;
-
   selection = gpa_keylist_get_selected_keys (self->keylist,
                                              GPGME_PROTOCOL_OpenPGP);
   if (selection)
     {
       op = gpa_key_trust_operation_new (GTK_WIDGET (self), selection);
       register_key_operation (self, GPA_KEY_OPERATION (op));
+      g_signal_connect (G_OBJECT (op), "updated_keys",
+			G_CALLBACK (gpa_key_manager_updated_keys_cb), self);
     }
 }
 
@@ -551,28 +690,49 @@ key_manager_retrieve (GSimpleAction *simple, GVariant *parameter, gpointer param
 #endif /*ENABLE_KEYSERVER_SUPPORT*/
 
 
-/* Refresh keys from the keyserver.  */
+/* Refresh the selected keys from the keyserver.  */
 #ifdef ENABLE_KEYSERVER_SUPPORT
 static void
 key_manager_refresh_keys (GSimpleAction *simple, GVariant *parameter, gpointer param)
 {
   GpaKeyManager *self = param;
-  GpaImportByKeyidOperation *op;
   GList *selection;
 
-  /* FIXME: The refresh-from-server operation currently only supports
-     one key at a time.  */
-  if (!key_manager_has_single_selection (self))
-    return;
-
   selection = gpa_keylist_get_selected_keys (self->keylist,
                                              GPGME_PROTOCOL_OPENPGP);
-  if (selection)
+  if (!selection)
+    return;
+
+  if (!selection->next && !is_gpg_version_at_least ("2.1.0"))
     {
+      /* Older versions of gpg can only fetch a single key.  */
+      GpaImportByKeyidOperation *op;
+
       op = gpa_import_bykeyid_operation_new (GTK_WIDGET (self),
                                              (gpgme_key_t) selection->data);
       register_import_operation (self, GPA_IMPORT_OPERATION (op));
     }
+  else
+    {
+      GpaRefreshOperation *op;
+
+      op = gpa_refresh_operation_new (GTK_WIDGET (self), selection);
+      register_refresh_operation (self, op);
+    }
+  g_list_free (selection);
+}
+
+
+/* Refresh all OpenPGP keys from the keyserver.  */
+static void
+key_manager_refresh_all_keys (GSimpleAction *simple, GVariant *parameter,
+                              gpointer param)
+{
+  GpaKeyManager *self = param;
+  GpaRefreshOperation *op;
+
+  op = gpa_refresh_operation_new (GTK_WIDGET (self), NULL);
+  register_refresh_operation (self, op);
 }
 #endif /*ENABLE_KEYSERVER_SUPPORT*/
 
@@ -586,11 +746,6 @@ key_manager_send (GSimpleAction *simple, GVariant *parameter, gpointer param)
   GList *selection;
   GpaExportServerOperation *op;
 
-  /* FIXME: The export-to-server operation currently only supports
-     exporting one key at a time.  */
-  if (! key_manager_has_single_selection (self))
-    return;
-
   selection = gpa_keylist_get_selected_keys (self->keylist,
                                              GPGME_PROTOCOL_OPENPGP);
   if (selection)
@@ -667,6 +822,67 @@ keyring_selection_update_actions (GpaKeyManager *self)
 }
 
 
+/* Start a listing of the keys matching PATTERNS with all the
+   signatures and validated for the sake of X.509.  */
+static gpg_error_t
+start_detailed_keylist (GpaContext *ctx, gpgme_protocol_t protocol,
+                        const char **patterns)
+{
+  gpg_error_t err;
+  int old_mode;
+
+  old_mode = gpgme_get_keylist_mode (ctx->ctx);
+
+  /* Note that we should not save and restore the old protocol
+     because the protocol should not be changed before the
+     gpgme_op_keylist_end.  Saving and restoring the keylist mode is
+     okay. */
+  gpgme_set_keylist_mode (ctx->ctx,
+                          (old_mode
+#ifdef GPGME_KEYLIST_MODE_WITH_TOFU
+                           | GPGME_KEYLIST_MODE_WITH_TOFU
+#endif
+                           | GPGME_KEYLIST_MODE_SIGS
+                           | GPGME_KEYLIST_MODE_VALIDATE));
+  gpgme_set_protocol (ctx->ctx, protocol);
+  err = gpgme_op_keylist_ext_start (ctx->ctx, patterns, FALSE, 0);
+
+  gpgme_set_keylist_mode (ctx->ctx, old_mode);
+  return err;
+}
+
+
+/* Retrieve the keys next to the selected one unless they are already
+   cached so that browsing through the list does not need to wait for
+   gpg.  */
+static void
+prefetch_neighbour_keys (GpaKeyManager *self)
+{
+  gpgme_key_t keys[2];
+  const char *patterns[3];
+  gpg_error_t err;
+  int idx, n;
+
+  if (gpa_context_busy (self->prefetch_ctx))
+    return;
+
+  gpa_keylist_get_neighbour_keys (self->keylist, &keys[0], &keys[1]);
+  for (idx = n = 0; idx < 2; idx++)
+    if (keys[idx] && keys[idx]->protocol == self->current_protocol
+        && keys[idx]->subkeys
+        && !gpa_key_cache_contains (self->key_cache, keys[idx]->subkeys->fpr))
+      patterns[n++] = keys[idx]->subkeys->fpr;
+  patterns[n] = NULL;
+  if (!n)
+    return;
+
+  err = start_detailed_keylist (self->prefetch_ctx, self->current_protocol,
+                                patterns);
+  if (err)
+    g_debug ("prefetching keys failed: %s", gpg_strerror (err));
+}
+
+
 /* Callback for key listings invoked with the "next_key" signal.  Used
    to receive and set the new current key.  */
 static void
@@ -674,10 +890,64 @@ key_manager_key_listed (GpaContext *ctx, gpgme_key_t key, gpointer param)
 {
   GpaKeyManager *self = param;
 
-  gpgme_key_unref (self->current_key);
+  gpa_key_cache_put (self->key_cache, key);
+
+  /* The key may belong to a selection which has already changed.  */
+  if (self->current_key || !self->current_fpr || !key->subkeys
+      || strcmp (key->subkeys->fpr, self->current_fpr))
+    {
+      gpgme_key_unref (key);
+      return;
+    }
+
+  gpa_key_acquired (key, GPA_KEY_OWNER_KEYMANAGER);
   self->current_key = key;
 
   keyring_selection_update_actions (self);
+  prefetch_neighbour_keys (self);
+}
+
+
+/* Callback for the "next_key" signal of the prefetch context.  */
+static void
+key_manager_key_prefetched (GpaContext *ctx, gpgme_key_t key, gpointer param)
+{
+  GpaKeyManager *self = param;
+
+  gpa_key_cache_put (self->key_cache, key);
+  gpgme_key_unref (key);
+}
+
+
+/* Start the retrieval of the selected key.  */
+static void
+fetch_current_key (GpaKeyManager *self)
+{
+  const char *patterns[2];
+  gpg_error_t err;
+
+  /* Abort retrieval of the previous key.  */
+  if (gpa_context_busy (self->ctx))
+    gpgme_op_keylist_end (self->ctx->ctx);
+
+  patterns[0] = self->current_fpr;
+  patterns[1] = NULL;
+  err = start_detailed_keylist (self->ctx, self->current_protocol, patterns);
+  if (gpg_err_code (err) != GPG_ERR_NO_ERROR)
+    gpa_gpgme_warning (err);
+}
+
+
+static gboolean
+fetch_timeout_cb (gpointer param)
+{
+  GpaKeyManager *self = param;
+
+  self->fetch_timeout_id = 0;
+  if (self->current_fpr && !self->current_key)
+    fetch_current_key (self);
+
+  return FALSE;
 }
 
 
@@ -697,53 +967,69 @@ key_manager_selection_changed (GtkTreeSelection *treeselection,
   if (self->current_key)
     {
       /* Remove the previous one.  */
-      gpgme_key_unref (self->current_key);
+      gpa_key_unref (self->current_key, GPA_KEY_OWNER_KEYMANAGER);
       self->current_key = NULL;
     }
-
-  /* Abort retrieval of the current key.  */
-  if (gpa_context_busy (self->ctx))
-    gpgme_op_keylist_end (self->ctx->ctx);
+  g_free (self->current_fpr);
+  self->current_fpr = NULL;
 
   /* Load the new one.  */
   if (gpa_keylist_has_single_selection (self->keylist)
       && (selection = gpa_keylist_get_selected_keys (self->keylist,
                                                      GPGME_PROTOCOL_UNKNOWN)))
     {
-      gpg_error_t err;
       gpgme_key_t key;
-      int old_mode;
 
       key = (gpgme_key_t) selection->data;
-      old_mode = gpgme_get_keylist_mode (self->ctx->ctx);
-
-      /* With all the signatures and validating for the sake of X.509.
-         Note that we should not save and restore the old protocol
-         because the protocol should not be changed before the
-         gpgme_op_keylist_end.  Saving and restoring the keylist mode
-         is okay. */
-      gpgme_set_keylist_mode (self->ctx->ctx,
-			      (old_mode
-#ifdef GPGME_KEYLIST_MODE_WITH_TOFU
-                               | GPGME_KEYLIST_MODE_WITH_TOFU
-#endif
-                               | GPGME_KEYLIST_MODE_SIGS
-                               | GPGME_KEYLIST_MODE_VALIDATE));
-      gpgme_set_protocol (self->ctx->ctx, key->protocol);
-      err = gpgme_op_keylist_start (self->ctx->ctx, key->subkeys->fpr,
-				    FALSE);
-      if (gpg_err_code (err) != GPG_ERR_NO_ERROR)
-	gpa_gpgme_warning (err);
-
-      gpgme_set_keylist_mode (self->ctx->ctx, old_mode);
+      self->current_fpr = g_strdup (key->subkeys->fpr);
+      self->current_protocol = key->protocol;
       g_list_free (selection);
 
+      self->current_key = gpa_key_cache_get (self->key_cache,
+                                             self->current_fpr);
+      if (self->current_key)
+        {
+          gpa_key_acquired (self->current_key, GPA_KEY_OWNER_KEYMANAGER);
+          if (self->fetch_timeout_id)
+            {
+              g_source_remove (self->fetch_timeout_id);
+              self->fetch_timeout_id = 0;
+            }
+          keyring_selection_update_actions (self);
+          prefetch_neighbour_keys (self);
+          return;
+        }
+
+      /* While the previous key is still being retrieved the user is
+         probably moving through the list; wait until the selection
+         settles before starting yet another gpg.  */
+      if (self->fetch_timeout_id || gpa_context_busy (self->ctx))
+        {
+          if (self->fetch_timeout_id)
+            g_source_remove (self->fetch_timeout_id);
+          self->fetch_timeout_id = g_timeout_add (FETCH_DELAY,
+                                                  fetch_timeout_cb, self);
+        }
+      else
+        fetch_current_key (self);
+
       /* Make sure the actions that depend on a current key are
 	 disabled.  */
       disable_selection_sensitive_actions (self);
     }
   else
-    keyring_selection_update_actions (self);
+    {
+      /* Abort retrieval of the current key.  */
+      if (self->fetch_timeout_id)
+        {
+          g_source_remove (self->fetch_timeout_id);
+          self->fetch_timeout_id = 0;
+        }
+      if (gpa_context_busy (self->ctx))
+        gpgme_op_keylist_end (self->ctx->ctx);
+
+      keyring_selection_update_actions (self);
+    }
 }
 
 
@@ -962,6 +1248,8 @@ key_manager_refresh (GSimpleAction *simple, GVariant *parameter, gpointer user_d
 {
   GpaKeyManager *self = user_data;
 
+  invalidate_key_cache (self);
+
   /* Hack: To force reloading of secret keys we claim that a secret
      key has been imported.  */
   gpa_keylist_imported_secret_key (self->keylist);
@@ -1022,6 +1310,7 @@ key_manager_action_new (GpaKeyManager *self,
       { "keys_sign", key_manager_sign },
       { "keys_set_owner_trust", key_manager_trust },
       { "keys_edit_private_key", key_manager_edit },
+      { "keys_set_expiry", key_manager_expire },
       { "keys_import_keys", key_manager_import },
       { "keys_export_keys", key_manager_export},
       { "keys_backup_key", key_manager_backup},
@@ -1029,6 +1318,7 @@ key_manager_action_new (GpaKeyManager *self,
 #ifdef ENABLE_KEYSERVER_SUPPORT
       { "server_retrive", key_manager_retrieve },
       { "server_refresh", key_manager_refresh_keys },
+      { "server_refresh_all", key_manager_refresh_all_keys },
       { "server_send", key_manager_send },
 #endif
   };
@@ -1111,6 +1401,10 @@ key_manager_action_new (GpaKeyManager *self,
             "<attribute name='label' translatable='yes'>Edit Private Key</attribute>"
             "<attribute name='action'>app.keys_edit_private_key</attribute>"
           "</item>"
+          "<item>"
+            "<attribute name='label' translatable='yes'>Change Expiry Date</attribute>"
+            "<attribute name='action'>app.keys_set_expiry</attribute>"
+          "</item>"
           "</section>"
           "<section>"
           "<item>"
@@ -1153,6 +1447,14 @@ key_manager_action_new (GpaKeyManager *self,
             "<attribute name='label' translatable='yes'>Retieve Keys...</attribute>"
             "<attribute name='action'>app.server_retrive</attribute>"
           "</item>"
+          "<item>"
+            "<attribute name='label' translatable='yes'>Refresh Keys</attribute>"
+            "<attribute name='action'>app.server_refresh</attribute>"
+          "</item>"
+          "<item>"
+            "<attribute name='label' translatable='yes'>Refresh All Keys</attribute>"
+            "<attribute name='action'>app.server_refresh_all</attribute>"
+          "</item>"
           "<item>"
             "<attribute name='label' translatable='yes'>Send Keys...</attribute>"
             "<attribute name='action'>app.server_send</attribute>"
@@ -1416,6 +1718,10 @@ key_manager_action_new (GpaKeyManager *self,
             "<attribute name='label' translatable='yes'>Edit Private Key</attribute>"
             "<attribute name='action'>app.keys_edit_private_key</attribute>"
           "</item>"
+          "<item>"
+            "<attribute name='label' translatable='yes'>Change Expiry Date</attribute>"
+            "<attribute name='action'>app.keys_set_expiry</attribute>"
+          "</item>"
           "<item>"
             "<attribute name='label' translatable='yes'>Copy Private Key</attribute>"
             "<attribute name='action'>app.key_manager_copy_fpr</attribute>"
@@ -1539,18 +1845,18 @@ key_manager_action_new (GpaKeyManager *self,
 
   action = (GSimpleAction*)g_action_map_lookup_action (G_ACTION_MAP (gpa_app), "server_refresh");
   add_selection_sensitive_action (self, action,
-                                  key_manager_has_single_selection);
+                                  key_manager_has_selection);
 
   action = (GSimpleAction*)g_action_map_lookup_action (G_ACTION_MAP (gpa_app), "server_send");
   add_selection_sensitive_action (self, action,
-                                  key_manager_has_single_selection);
+                                  key_manager_has_selection);
 
 #endif // ENABLE_KEYSERVER_SUPPORT
 
 
   action = (GSimpleAction*)g_action_map_lookup_action (G_ACTION_MAP (gpa_app), "keys_set_owner_trust");
   add_selection_sensitive_action (self, action,
-                                  key_manager_has_single_selection_OpenPGP);
+                                  key_manager_has_selection_OpenPGP);
 
   action = (GSimpleAction*)g_action_map_lookup_action (G_ACTION_MAP (gpa_app), "keys_sign");
   add_selection_sensitive_action (self, action,
@@ -1560,6 +1866,10 @@ key_manager_action_new (GpaKeyManager *self,
   add_selection_sensitive_action (self, action,
                                   key_manager_has_private_selected);
 
+  action = (GSimpleAction*)g_action_map_lookup_action (G_ACTION_MAP (gpa_app), "keys_set_expiry");
+  add_selection_sensitive_action (self, action,
+                                  key_manager_has_private_in_selection);
+
   *toolbar = GTK_WIDGET (grid);
 }
 
@@ -1579,10 +1889,10 @@ idle_update_details (gpointer param)
       if (! key)
 	{
 	  /* There is a single key selected, but the current key is
-	     NULL.  This means the key has not been returned yet, so
-	     we exit the function asking GTK to run it again when
-	     there is time.  */
-	  return TRUE;
+	     NULL.  This means the key has not been returned yet;
+	     key_manager_key_listed will add the handler again.  */
+          self->details_idle_id = 0;
+	  return FALSE;
 	}
       gpa_key_details_update (self->details, key, 1);
     }
@@ -1672,6 +1982,17 @@ keyring_update_status_bar (GpaKeyManager *self)
 }
 
 
+/* Narrow the key list to the keys matching the text of the filter
+   entry.  This is the callback for its "changed" signal.  */
+static void
+key_manager_filter_changed (GtkEntry *entry, gpointer param)
+{
+  GpaKeyManager *self = param;
+
+  gpa_keylist_set_filter (self->keylist, gtk_entry_get_text (entry));
+}
+
+
 /* FIXME: Check. */
 /* The context menu of the keyring list.  This is the callback for the
    "button_press_event" signal.  */
@@ -1751,6 +2072,7 @@ construct_widgets (GpaKeyManager *self)
   GtkWidget *toolbar;
   GtkWidget *hbox;
   GtkWidget *icon;
+  GtkWidget *entry;
   GtkWidget *paned;
   GtkWidget *statusbar;
   GtkWidget *main_box;
@@ -1793,6 +2115,17 @@ construct_widgets (GpaKeyManager *self)
   gtk_widget_set_halign (GTK_WIDGET (label), GTK_ALIGN_START);
   gtk_widget_set_valign (GTK_WIDGET (label), GTK_ALIGN_CENTER);
 
+  /* The filter bar.  */
+  entry = gtk_search_entry_new ();
+  gtk_entry_set_placeholder_text (GTK_ENTRY (entry), _("Filter keys"));
+  gtk_widget_set_tooltip_text
+    (entry, _("Show only the keys whose user names, key IDs or"
+              " fingerprints contain this text."));
+  gtk_widget_set_valign (entry, GTK_ALIGN_CENTER);
+  gtk_box_pack_end (GTK_BOX (hbox), entry, FALSE, TRUE, 5);
+  g_signal_connect (G_OBJECT (entry), "changed",
+                    G_CALLBACK (key_manager_filter_changed), self);
+
   paned = gtk_paned_new (GTK_ORIENTATION_VERTICAL);
 
   main_box = gtk_box_new (GTK_ORIENTATION_HORIZONTAL, 0);
@@ -1853,6 +2186,11 @@ construct_widgets (GpaKeyManager *self)
   g_signal_connect (G_OBJECT (self->ctx), "next_key",
 		    G_CALLBACK (key_manager_key_listed), self);
 
+  self->key_cache = gpa_key_cache_new (KEY_CACHE_SIZE);
+  self->prefetch_ctx = gpa_context_new ();
+  g_signal_connect (G_OBJECT (self->prefetch_ctx), "next_key",
+		    G_CALLBACK (key_manager_key_prefetched), self);
+
 }
 
 
@@ -1898,6 +2236,18 @@ gpa_key_manager_finalize (GObject *object)
 
   g_list_free (self->selection_sensitive_actions);
   self->selection_sensitive_actions = NULL;
+  gpa_key_unref (self->current_key, GPA_KEY_OWNER_KEYMANAGER);
+  self->current_key = NULL;
+  g_free (self->current_fpr);
+  self->current_fpr = NULL;
+  if (self->fetch_timeout_id)
+    g_source_remove (self->fetch_timeout_id);
+  self->fetch_timeout_id = 0;
+  if (self->prefetch_ctx)
+    g_object_unref (self->prefetch_ctx);
+  self->prefetch_ctx = NULL;
+  gpa_key_cache_release (self->key_cache);
+  self->key_cache = NULL;
 
   G_OBJECT_CLASS (g_type_class_peek_parent
                   (GPA_KEY_MANAGER_GET_CLASS (self)))->finalize (object);
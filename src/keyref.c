@@ -0,0 +1,435 @@
+/* keyref.c - Accounting of key references.
+   Copyright (C) 2026 g10 Code GmbH
+
+   This file is part of GPA.
+
+   GPA is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   GPA is distributed in the hope that it will be useful, but WITHOUT
+   ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+   or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public
+   License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, see <http://www.gnu.org/licenses/>.  */
+
+/*
+   Each recorded reference is kept in a list per key.  A release by an
+   owner removes the most recent reference of that owner; if the owner
+   has none, the reference has been handed over without a transfer
+   record and the most recent reference of any owner is removed
+   instead.  Releases of keys which have never been recorded are only
+   counted.
+
+   The keys are looked up by their address.  The entry of a key is
+   dropped with its last reference, but a key released without
+   accounting keeps its entry, and gpgme may later reuse the address
+   for another key.  To not attribute the new key to the old entry,
+   the fingerprint is recorded too; an entry with another fingerprint
+   is counted as stale and replaced.
+
+   The memory estimate adds up the structures and strings of a key as
+   allocated by gpgme; the real usage is somewhat higher due to malloc
+   overhead.  It is computed when the key is first recorded, because a
+   key released without accounting may already have been freed when
+   the report is made.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <stdio.h>
+#include <string.h>
+
+#include <glib.h>
+#ifdef G_OS_UNIX
+# include <glib-unix.h>
+# include <signal.h>
+#endif
+
+#include "gpa.h"
+#include "keyref.h"
+
+
+#ifdef ENABLE_KEY_ACCOUNTING
+
+/* One recorded reference.  */
+struct keyref_s
+{
+  gpa_key_owner_t owner;
+  const char *site;
+};
+
+/* The estimated memory used by keys.  */
+struct keysize_s
+{
+  gsize key;
+  gsize subkeys;
+  gsize uids;
+  gsize sigs;
+};
+
+/* The references to one key.  The key itself is not accessed after
+   it has been recorded.  */
+struct keyrefs_s
+{
+  gpgme_key_t key;
+  char *fpr;
+  GSList *refs;      /* List of struct keyref_s, most recent first.  */
+  struct keysize_s size;
+};
+
+static const char *owner_names[GPA_KEY_OWNER_LAST] =
+  {
+    "keytable", "keylist", "keymanager", "keyselector", "keydetails",
+    "keycache", "recipientdlg", "server", "other"
+  };
+
+/* Map keys to struct keyrefs_s.  */
+static GHashTable *key_table;
+
+/* The number of references per owner and its maximum.  */
+static unsigned long live_refs[GPA_KEY_OWNER_LAST];
+static unsigned long peak_refs[GPA_KEY_OWNER_LAST];
+
+/* The number of keys with a reference and its maximum.  */
+static unsigned long peak_keys;
+
+/* The number of releases of keys we never saw.  */
+static unsigned long untracked_releases;
+
+/* The number of entries of keys which have been released without
+   accounting.  */
+static unsigned long stale_keys;
+
+
+
+static void
+free_keyrefs (gpointer data)
+{
+  struct keyrefs_s *keyrefs = data;
+
+  g_slist_free_full (keyrefs->refs, g_free);
+  g_free (keyrefs->fpr);
+  g_free (keyrefs);
+}
+
+
+static GHashTable *
+get_key_table (void)
+{
+  if (!key_table)
+    key_table = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+                                       NULL, free_keyrefs);
+  return key_table;
+}
+
+
+static gsize
+string_size (const char *string)
+{
+  return string? strlen (string) + 1 : 0;
+}
+
+
+/* Add the estimated memory used by KEY to SIZE.  */
+static void
+add_key_size (gpgme_key_t key, struct keysize_s *size)
+{
+  gpgme_subkey_t subkey;
+  gpgme_user_id_t uid;
+  gpgme_key_sig_t sig;
+  gpgme_sig_notation_t nota;
+
+  size->key += (sizeof *key + string_size (key->issuer_serial)
+                + string_size (key->issuer_name)
+                + string_size (key->chain_id) + string_size (key->fpr));
+
+  for (subkey = key->subkeys; subkey; subkey = subkey->next)
+    size->subkeys += (sizeof *subkey + string_size (subkey->fpr)
+                      + string_size (subkey->curve)
+                      + string_size (subkey->keygrip)
+                      + string_size (subkey->card_number));
+
+  for (uid = key->uids; uid; uid = uid->next)
+    {
+      size->uids += (sizeof *uid + string_size (uid->uid)
+                     + string_size (uid->name) + string_size (uid->email)
+                     + string_size (uid->comment)
+                     + string_size (uid->address));
+      if (uid->tofu)
+        size->uids += sizeof *uid->tofu + string_size (uid->tofu->description);
+
+      for (sig = uid->signatures; sig; sig = sig->next)
+        {
+          size->sigs += (sizeof *sig + string_size (sig->uid)
+                         + string_size (sig->name) + string_size (sig->email)
+                         + string_size (sig->comment));
+          for (nota = sig->notations; nota; nota = nota->next)
+            size->sigs += (sizeof *nota + string_size (nota->name)
+                           + string_size (nota->value));
+        }
+    }
+}
+
+
+static void
+add_ref (gpgme_key_t key, gpa_key_owner_t owner, const char *site)
+{
+  GHashTable *table = get_key_table ();
+  const char *fpr = key->subkeys? key->subkeys->fpr : NULL;
+  struct keyrefs_s *keyrefs;
+  struct keyref_s *ref;
+
+  keyrefs = g_hash_table_lookup (table, key);
+  if (keyrefs && g_strcmp0 (keyrefs->fpr, fpr))
+    {
+      /* The recorded key has been freed and its address reused.  */
+      GSList *item;
+
+      for (item = keyrefs->refs; item; item = item->next)
+        live_refs[((struct keyref_s *) item->data)->owner]--;
+      g_hash_table_remove (table, key);
+      keyrefs = NULL;
+      stale_keys++;
+    }
+  if (!keyrefs)
+    {
+      keyrefs = g_new0 (struct keyrefs_s, 1);
+      keyrefs->key = key;
+      keyrefs->fpr = g_strdup (fpr);
+      add_key_size (key, &keyrefs->size);
+      g_hash_table_insert (table, key, keyrefs);
+      if (g_hash_table_size (table) > peak_keys)
+        peak_keys = g_hash_table_size (table);
+    }
+
+  ref = g_new (struct keyref_s, 1);
+  ref->owner = owner;
+  ref->site = site;
+  keyrefs->refs = g_slist_prepend (keyrefs->refs, ref);
+
+  if (++live_refs[owner] > peak_refs[owner])
+    peak_refs[owner] = live_refs[owner];
+}
+
+
+/* Remove the most recent reference of OWNER to KEY or, failing that,
+   the most recent one of any owner.  The entry of KEY is dropped
+   with its last reference unless KEEP is set.  Returns the removed
+   reference which the caller must free, or NULL.  */
+static struct keyref_s *
+remove_ref (gpgme_key_t key, gpa_key_owner_t owner, gboolean keep)
+{
+  struct keyrefs_s *keyrefs;
+  struct keyref_s *ref;
+  GSList *item;
+
+  keyrefs = key_table? g_hash_table_lookup (key_table, key) : NULL;
+  if (!keyrefs)
+    {
+      untracked_releases++;
+      return NULL;
+    }
+
+  for (item = keyrefs->refs; item; item = item->next)
+    if (((struct keyref_s *) item->data)->owner == owner)
+      break;
+  if (!item)
+    item = keyrefs->refs;
+
+  ref = item->data;
+  keyrefs->refs = g_slist_delete_link (keyrefs->refs, item);
+  live_refs[ref->owner]--;
+  if (!keyrefs->refs && !keep)
+    g_hash_table_remove (key_table, key);
+
+  return ref;
+}
+
+
+void
+_gpa_key_ref (gpgme_key_t key, gpa_key_owner_t owner, const char *site)
+{
+  gpgme_key_ref (key);
+  add_ref (key, owner, site);
+}
+
+
+void
+_gpa_key_acquired (gpgme_key_t key, gpa_key_owner_t owner, const char *site)
+{
+  if (key)
+    add_ref (key, owner, site);
+}
+
+
+void
+_gpa_key_transfer (gpgme_key_t key, gpa_key_owner_t from,
+                   gpa_key_owner_t to, const char *site)
+{
+  if (!key)
+    return;
+  /* Keep the entry, so that the size is not computed again.  */
+  g_free (remove_ref (key, from, TRUE));
+  add_ref (key, to, site);
+}
+
+
+void
+_gpa_key_unref (gpgme_key_t key, gpa_key_owner_t owner)
+{
+  if (!key)
+    return;
+  g_free (remove_ref (key, owner, FALSE));
+  gpgme_key_unref (key);
+}
+
+
+void
+_gpa_key_unref_list (GList *list, gpa_key_owner_t owner)
+{
+  for (; list; list = list->next)
+    _gpa_key_unref (list->data, owner);
+}
+
+
+#ifdef G_OS_UNIX
+static gboolean
+report_signal_cb (gpointer user_data)
+{
+  char *report = gpa_keyref_report ();
+
+  fputs (report, stderr);
+  g_free (report);
+  return G_SOURCE_CONTINUE;
+}
+#endif /*G_OS_UNIX*/
+
+
+/* Start the accounting.  The report is printed to stderr when
+   SIGUSR2 is received.  */
+void
+gpa_init_keyref (void)
+{
+  get_key_table ();
+#ifdef G_OS_UNIX
+  g_unix_signal_add (SIGUSR2, report_signal_cb, NULL);
+#endif
+}
+
+
+
+static gint
+compare_sites (gconstpointer a, gconstpointer b, gpointer data)
+{
+  GHashTable *sites = data;
+  unsigned long na = GPOINTER_TO_UINT (g_hash_table_lookup (sites, a));
+  unsigned long nb = GPOINTER_TO_UINT (g_hash_table_lookup (sites, b));
+
+  return na < nb? 1 : na > nb? -1 : strcmp (a, b);
+}
+
+
+/* Return a malloced report of the live key references.  */
+char *
+gpa_keyref_report (void)
+{
+  GString *report = g_string_new (NULL);
+  GHashTable *table = get_key_table ();
+  GHashTable *sites;
+  GHashTableIter iter;
+  gpointer value;
+  GList *names, *item;
+  unsigned long owner_keys[GPA_KEY_OWNER_LAST] = { 0 };
+  struct keysize_s size = { 0 };
+  unsigned int nkeys = g_hash_table_size (table);
+  gsize total;
+  int owner;
+
+  /* Count the keys per owner and the references per acquisition
+     site.  The site is prefixed with the owner.  */
+  sites = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  g_hash_table_iter_init (&iter, table);
+  while (g_hash_table_iter_next (&iter, NULL, &value))
+    {
+      struct keyrefs_s *keyrefs = value;
+      gboolean seen[GPA_KEY_OWNER_LAST] = { FALSE };
+      GSList *ritem;
+
+      size.key += keyrefs->size.key;
+      size.subkeys += keyrefs->size.subkeys;
+      size.uids += keyrefs->size.uids;
+      size.sigs += keyrefs->size.sigs;
+      for (ritem = keyrefs->refs; ritem; ritem = ritem->next)
+        {
+          struct keyref_s *ref = ritem->data;
+          char *name;
+          guint count;
+
+          if (!seen[ref->owner])
+            owner_keys[ref->owner]++;
+          seen[ref->owner] = TRUE;
+
+          name = g_strdup_printf ("%-12s  %s", owner_names[ref->owner],
+                                  ref->site);
+          count = GPOINTER_TO_UINT (g_hash_table_lookup (sites, name));
+          g_hash_table_replace (sites, name, GUINT_TO_POINTER (count + 1));
+        }
+    }
+
+  g_string_append (report, "owner          refs   peak   keys\n");
+  for (owner = 0; owner < GPA_KEY_OWNER_LAST; owner++)
+    g_string_append_printf (report, "%-12s %6lu %6lu %6lu\n",
+                            owner_names[owner], live_refs[owner],
+                            peak_refs[owner], owner_keys[owner]);
+  g_string_append_printf (report, "live keys: %u (peak %lu)\n",
+                          nkeys, peak_keys);
+  g_string_append_printf (report, "untracked releases: %lu\n",
+                          untracked_releases);
+  g_string_append_printf (report, "stale keys: %lu\n", stale_keys);
+
+  total = size.key + size.subkeys + size.uids + size.sigs;
+  g_string_append_printf (report, "estimated key memory: %" G_GSIZE_FORMAT
+                          " bytes\n", total);
+  if (nkeys)
+    g_string_append_printf (report,
+                            "bytes per key: %" G_GSIZE_FORMAT
+                            " (key %" G_GSIZE_FORMAT
+                            ", subkeys %" G_GSIZE_FORMAT
+                            ", uids %" G_GSIZE_FORMAT
+                            ", sigs %" G_GSIZE_FORMAT ")\n",
+                            total / nkeys, size.key / nkeys,
+                            size.subkeys / nkeys, size.uids / nkeys,
+                            size.sigs / nkeys);
+
+  names = g_hash_table_get_keys (sites);
+  names = g_list_sort_with_data (names, compare_sites, sites);
+  if (names)
+    g_string_append (report, "outstanding references:\n"
+                     "  count  owner         site\n");
+  for (item = names; item; item = item->next)
+    g_string_append_printf (report, "%7u  %s\n",
+                            GPOINTER_TO_UINT (g_hash_table_lookup
+                                              (sites, item->data)),
+                            (char *) item->data);
+  g_list_free (names);
+  g_hash_table_destroy (sites);
+
+  return g_string_free (report, FALSE);
+}
+
+#else /*!ENABLE_KEY_ACCOUNTING*/
+
+/* Return NULL as the accounting is not enabled.  */
+char *
+gpa_keyref_report (void)
+{
+  return NULL;
+}
+
+#endif /*!ENABLE_KEY_ACCOUNTING*/
@@ -0,0 +1,95 @@
+/* keyref.h - Accounting of key references.
+   Copyright (C) 2026 g10 Code GmbH
+
+   This file is part of GPA.
+
+   GPA is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   GPA is distributed in the hope that it will be useful, but WITHOUT
+   ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+   or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public
+   License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, see <http://www.gnu.org/licenses/>.  */
+
+#ifndef KEYREF_H
+#define KEYREF_H
+
+#include <glib.h>
+#include <gpgme.h>
+
+/* The subsystems owning key references.  */
+typedef enum
+  {
+    GPA_KEY_OWNER_KEYTABLE,
+    GPA_KEY_OWNER_KEYLIST,
+    GPA_KEY_OWNER_KEYMANAGER,
+    GPA_KEY_OWNER_KEYSELECTOR,
+    GPA_KEY_OWNER_KEYDETAILS,
+    GPA_KEY_OWNER_KEYCACHE,
+    GPA_KEY_OWNER_RECIPIENTDLG,
+    GPA_KEY_OWNER_SERVER,
+    GPA_KEY_OWNER_OTHER,
+    GPA_KEY_OWNER_LAST
+  } gpa_key_owner_t;
+
+/* With --enable-key-accounting every reference taken with one of the
+   macros below is recorded together with its owner and the source
+   location where it was acquired.  Otherwise the macros map directly
+   to the gpgme functions.  */
+#ifdef ENABLE_KEY_ACCOUNTING
+
+#define GPA_KEYREF_SITE  __FILE__ ":" G_STRINGIFY (__LINE__)
+
+/* Take a new reference to KEY for OWNER.  */
+#define gpa_key_ref(key, owner) \
+  _gpa_key_ref ((key), (owner), GPA_KEYREF_SITE)
+
+/* Record that OWNER got a reference to KEY from elsewhere, for
+   example from gpgme_op_keylist_next.  */
+#define gpa_key_acquired(key, owner) \
+  _gpa_key_acquired ((key), (owner), GPA_KEYREF_SITE)
+
+/* Record that a reference to KEY has been passed from FROM to TO.  */
+#define gpa_key_transfer(key, from, to) \
+  _gpa_key_transfer ((key), (from), (to), GPA_KEYREF_SITE)
+
+/* Release a reference of OWNER to KEY.  */
+#define gpa_key_unref(key, owner) _gpa_key_unref ((key), (owner))
+
+/* Release the references of OWNER to all keys in LIST.  */
+#define gpa_key_unref_list(list, owner) _gpa_key_unref_list ((list), (owner))
+
+void _gpa_key_ref (gpgme_key_t key, gpa_key_owner_t owner, const char *site);
+void _gpa_key_acquired (gpgme_key_t key, gpa_key_owner_t owner,
+                        const char *site);
+void _gpa_key_transfer (gpgme_key_t key, gpa_key_owner_t from,
+                        gpa_key_owner_t to, const char *site);
+void _gpa_key_unref (gpgme_key_t key, gpa_key_owner_t owner);
+void _gpa_key_unref_list (GList *list, gpa_key_owner_t owner);
+
+/* Start the accounting.  The report is printed to stderr when
+   SIGUSR2 is received.  */
+void gpa_init_keyref (void);
+
+#else /*!ENABLE_KEY_ACCOUNTING*/
+
+#define gpa_key_ref(key, owner)            gpgme_key_ref (key)
+#define gpa_key_acquired(key, owner)       do { } while (0)
+#define gpa_key_transfer(key, from, to)    do { } while (0)
+#define gpa_key_unref(key, owner)          gpgme_key_unref (key)
+#define gpa_key_unref_list(list, owner) \
+  g_list_foreach ((list), (GFunc) gpgme_key_unref, NULL)
+#define gpa_init_keyref()                  do { } while (0)
+
+#endif /*!ENABLE_KEY_ACCOUNTING*/
+
+/* Return a malloced report of the live key references or NULL if the
+   accounting is not enabled.  */
+char *gpa_keyref_report (void);
+
+#endif /*KEYREF_H*/
@@ -168,3 +168,117 @@ gpa_key_sign_run_dialog (GtkWidget * parent, gpgme_key_t key,
       return FALSE;
     }
 }
+
+
+/* Run the key sign dialog for signing all KEYS with the default key
+ * as a modal dialog.  The user names and fingerprints of the keys are
+ * listed together, so that they can be compared against a list from
+ * a key signing party.  If the user clicks OK, return TRUE and set
+ * sign_locally according to the "sign locally" check box, which is
+ * asked once for all keys.
+ */
+gboolean
+gpa_key_sign_run_dialog_multiple (GtkWidget *parent, GList *keys,
+                                  gboolean *sign_locally)
+{
+  GtkWidget *window;
+  GtkWidget *vboxSign;
+  GtkWidget *check = NULL;
+  GtkWidget *scrolled;
+  GtkWidget *grid;
+  GtkWidget *label;
+  GtkResponseType response;
+  GList *item;
+  gchar *string;
+  gint row;
+
+  if (keys && !keys->next)
+    return gpa_key_sign_run_dialog (parent, keys->data, sign_locally);
+
+  window = gtk_dialog_new_with_buttons (_("Sign Keys"), GTK_WINDOW(parent),
+                                        GTK_DIALOG_MODAL,
+                                        _("_Yes"),
+                                        GTK_RESPONSE_YES,
+                                        _("_No"),
+                                        GTK_RESPONSE_NO,
+                                        NULL);
+  gtk_dialog_set_default_response (GTK_DIALOG (window), GTK_RESPONSE_YES);
+  gtk_container_set_border_width (GTK_CONTAINER (window), 5);
+  gtk_window_set_default_size (GTK_WINDOW (window), -1, 400);
+
+  vboxSign = GTK_WIDGET (gtk_dialog_get_content_area (GTK_DIALOG (window)));
+  gtk_container_set_border_width (GTK_CONTAINER (vboxSign), 5);
+
+  string = g_strdup_printf (_("Do you want to sign the following %u keys?"),
+                            g_list_length (keys));
+  label = gtk_label_new (string);
+  g_free (string);
+  gtk_box_pack_start (GTK_BOX (vboxSign), label, FALSE, TRUE, 5);
+  gtk_widget_set_halign (GTK_WIDGET (label), 0.0);
+  gtk_widget_set_valign (GTK_WIDGET (label), 0.5);
+
+  scrolled = gtk_scrolled_window_new (NULL, NULL);
+  gtk_scrolled_window_set_policy (GTK_SCROLLED_WINDOW (scrolled),
+                                  GTK_POLICY_NEVER, GTK_POLICY_AUTOMATIC);
+  gtk_box_pack_start (GTK_BOX (vboxSign), scrolled, TRUE, TRUE, 5);
+
+  grid = gtk_grid_new ();
+  gtk_grid_set_column_spacing (GTK_GRID (grid), 4);
+  gtk_grid_set_row_spacing (GTK_GRID (grid), 2);
+  gtk_container_add (GTK_CONTAINER (scrolled), grid);
+
+  /* One key on two lines: its primary user name and its
+     fingerprint.  */
+  for (item = keys, row = 0; item; item = g_list_next (item), row += 2)
+    {
+      gpgme_key_t key = item->data;
+
+      string = gpa_gpgme_key_get_userid (key->uids);
+      label = gtk_label_new (string);
+      gpa_add_tooltip (label, string);
+      g_free (string);
+      gtk_label_set_max_width_chars (GTK_LABEL (label), GPA_MAX_UID_WIDTH);
+      gtk_label_set_ellipsize (GTK_LABEL (label), PANGO_ELLIPSIZE_END);
+      gtk_grid_attach (GTK_GRID (grid), label, 0, row, 1, 1);
+      gtk_widget_set_halign (GTK_WIDGET (label), 0.0);
+
+      string = gpa_gpgme_key_format_fingerprint (key->subkeys->fpr);
+      label = gtk_label_new (string);
+      g_free (string);
+      gtk_label_set_selectable (GTK_LABEL (label), TRUE);
+      gtk_grid_attach (GTK_GRID (grid), label, 0, row + 1, 1, 1);
+      gtk_widget_set_halign (GTK_WIDGET (label), 0.0);
+      gtk_widget_set_margin_start (GTK_WIDGET (label), 10);
+      gtk_widget_set_margin_bottom (GTK_WIDGET (label), 4);
+    }
+
+  label = gtk_label_new (_("Check the names and fingerprints carefully to"
+		   " be sure that these really are the keys you want to"
+		   " sign.  All user names in these keys will be signed."));
+  gtk_box_pack_start (GTK_BOX (vboxSign), label, FALSE, TRUE, 10);
+  gtk_widget_set_halign (GTK_WIDGET (label), 0.0);
+  gtk_widget_set_valign (GTK_WIDGET (label), 1.0);
+  gtk_label_set_line_wrap (GTK_LABEL (label), TRUE);
+
+  label = gtk_label_new (_("The keys will be signed with your default"
+			   " private key."));
+  gtk_box_pack_start (GTK_BOX (vboxSign), label, FALSE, TRUE, 5);
+  gtk_widget_set_halign (GTK_WIDGET (label), 0.0);
+  gtk_widget_set_valign (GTK_WIDGET (label), 0.5);
+
+  if (! gpa_options_get_simplified_ui (gpa_options_get_instance ()))
+    {
+      check = gtk_check_button_new_with_mnemonic (_("Sign only _locally"));
+      gtk_box_pack_start (GTK_BOX (vboxSign), check, FALSE, FALSE, 0);
+      gtk_toggle_button_set_active (GTK_TOGGLE_BUTTON (check), *sign_locally);
+    }
+
+  gtk_widget_show_all (window);
+  response = gtk_dialog_run (GTK_DIALOG (window));
+  if (response == GTK_RESPONSE_YES)
+    *sign_locally = check &&
+      gtk_toggle_button_get_active (GTK_TOGGLE_BUTTON (check));
+  gtk_widget_destroy (window);
+
+  return response == GTK_RESPONSE_YES;
+}
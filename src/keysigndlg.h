@@ -26,5 +26,8 @@
 gboolean gpa_key_sign_run_dialog (GtkWidget * parent, gpgme_key_t key,
 				  gboolean * sign_locally);
 
+gboolean gpa_key_sign_run_dialog_multiple (GtkWidget *parent, GList *keys,
+                                           gboolean *sign_locally);
+
 
 #endif /* KEYSIGNDLG_H */
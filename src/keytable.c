@@ -25,6 +25,7 @@
 #include "gpgmetools.h"
 #include "keytable.h"
 #include "gtktools.h"
+#include "keyref.h"
 
 /* Internal */
 static void first_half_done_cb (GpaContext *context, gpg_error_t err,
@@ -93,7 +94,9 @@ gpa_keytable_init (GpaKeyTable *keytable)
   keytable->secret = FALSE;
   keytable->initialized = FALSE;
   keytable->new_key = FALSE;
+  keytable->fprs = NULL;
   keytable->tmp_list = NULL;
+  keytable->index = gpa_key_index_new ();
   /* Note, that the next_key and done signals are emitted by means of
      gpgme events with the help of gpacontext.c:gpa_context_event_cb.  */
   g_signal_connect (G_OBJECT (keytable->context), "next_key",
@@ -108,12 +111,58 @@ gpa_keytable_finalize (GObject *object)
   GpaKeyTable *keytable = GPA_KEYTABLE (object);
 
   g_object_unref (keytable->context);
-  g_list_foreach (keytable->keys, (GFunc) gpgme_key_unref, NULL);
+  gpa_key_index_release (keytable->index);
+  gpa_key_unref_list (keytable->keys, GPA_KEY_OWNER_KEYTABLE);
   g_list_free (keytable->keys);
+  g_strfreev (keytable->fprs);
 }
 
 /* Internal functions */
 
+/* Start listing the keys requested for KEYTABLE with the current
+   protocol.  */
+static gpg_error_t
+start_keylist (GpaKeyTable *keytable)
+{
+  if (keytable->fprs)
+    return gpgme_op_keylist_ext_start (keytable->context->ctx,
+                                       (const char **) keytable->fprs,
+                                       keytable->secret, 0);
+  else
+    return gpgme_op_keylist_start (keytable->context->ctx, keytable->fpr,
+                                   keytable->secret);
+}
+
+/* Remove the keys with the fingerprints in the NULL terminated array
+   FPRS from KEYTABLE.  */
+static void
+remove_keys (GpaKeyTable *keytable, const char **list)
+{
+  GHashTable *fprs;
+  GList *item, *next;
+  int i;
+
+  fprs = g_hash_table_new (g_str_hash, g_str_equal);
+  for (i = 0; list[i]; i++)
+    g_hash_table_add (fprs, (char *) list[i]);
+
+  for (item = keytable->keys; item; item = next)
+    {
+      gpgme_key_t key = item->data;
+
+      next = g_list_next (item);
+      if (key->subkeys && key->subkeys->fpr
+          && g_hash_table_contains (fprs, key->subkeys->fpr))
+        {
+          gpa_key_index_remove (keytable->index, key);
+          keytable->keys = g_list_delete_link (keytable->keys, item);
+          gpa_key_unref (key, GPA_KEY_OWNER_KEYTABLE);
+        }
+    }
+
+  g_hash_table_destroy (fprs);
+}
+
 static void
 reload_cache (GpaKeyTable *keytable, const char *fpr)
 {
@@ -125,11 +174,13 @@ reload_cache (GpaKeyTable *keytable, const char *fpr)
   keytable->first_half_err = 0;
   keytable->fpr = fpr;
   gpgme_set_protocol (keytable->context->ctx, GPGME_PROTOCOL_OpenPGP);
-  err = gpgme_op_keylist_start (keytable->context->ctx, fpr,
-				keytable->secret);
+  err = start_keylist (keytable);
   if (gpg_err_code (err) != GPG_ERR_NO_ERROR)
     {
       gpa_gpgme_warning (err);
+      g_strfreev (keytable->fprs);
+      keytable->fprs = NULL;
+      keytable->new_key = FALSE;
       if (keytable->end)
 	{
 	  keytable->end (keytable->data);
@@ -142,12 +193,20 @@ reload_cache (GpaKeyTable *keytable, const char *fpr)
 static void
 done_cb (GpaContext *context, gpg_error_t err, GpaKeyTable *keytable)
 {
+  GList *item;
+
   if (err || keytable->first_half_err)
     {
       if (keytable->first_half_err)
         gpa_gpgme_warning (keytable->first_half_err);
       if (err)
         gpa_gpgme_warning (err);
+      gpa_key_unref_list (keytable->tmp_list, GPA_KEY_OWNER_KEYTABLE);
+      g_list_free (keytable->tmp_list);
+      keytable->tmp_list = NULL;
+      g_strfreev (keytable->fprs);
+      keytable->fprs = NULL;
+      keytable->new_key = FALSE;
       return;
     }
   /* Reverse the list to have the keys come up in the same order they
@@ -155,22 +214,32 @@ done_cb (GpaContext *context, gpg_error_t err, GpaKeyTable *keytable)
   keytable->tmp_list = g_list_reverse (keytable->tmp_list);
   if (keytable->new_key)
     {
-      /* Append the new key(s)
+      /* Append the new key(s), replacing older versions if requested.
        */
+      if (keytable->fprs)
+        remove_keys (keytable, (const char **) keytable->fprs);
+      for (item = keytable->tmp_list; item; item = g_list_next (item))
+        gpa_key_index_add (keytable->index, item->data);
       keytable->keys = g_list_concat (keytable->keys, keytable->tmp_list);
     }
   else
     {
       /* Replace the list
        */
+      gpa_key_index_clear (keytable->index);
+      for (item = keytable->tmp_list; item; item = g_list_next (item))
+        gpa_key_index_add (keytable->index, item->data);
       if (keytable->keys)
 	{
-	  g_list_foreach (keytable->keys, (GFunc) gpgme_key_unref,
-			  NULL);
+	  gpa_key_unref_list (keytable->keys, GPA_KEY_OWNER_KEYTABLE);
 	  g_list_free (keytable->keys);
 	}
       keytable->keys = keytable->tmp_list;
     }
+  keytable->tmp_list = NULL;
+  g_strfreev (keytable->fprs);
+  keytable->fprs = NULL;
+  keytable->new_key = FALSE;
   keytable->initialized = TRUE;
   if (keytable->end)
     {
@@ -201,9 +270,7 @@ first_half_done_cb (GpaContext *context, gpg_error_t err,
   keytable->did_first_half = 1;
 
   gpgme_set_protocol (context->ctx, GPGME_PROTOCOL_CMS);
-  err = gpgme_op_keylist_start (keytable->context->ctx,
-                                keytable->fpr,
-				keytable->secret);
+  err = start_keylist (keytable);
   keytable->fpr = NULL; /* Not needed anymore.  */
   if (err)
     {
@@ -239,9 +306,11 @@ static void
 next_key_cb (GpaContext *context, gpgme_key_t key, GpaKeyTable *keytable)
 {
   keytable->tmp_list = g_list_prepend (keytable->tmp_list, key);
-  gpgme_key_ref (key);
+  gpa_key_acquired (key, GPA_KEY_OWNER_KEYTABLE);
+  /* The NEXT function takes ownership of its reference.  */
   if (keytable->next)
     {
+      gpa_key_ref (key, GPA_KEY_OWNER_KEYTABLE);
       keytable->next (key, keytable->data);
     }
 }
@@ -254,9 +323,9 @@ list_cache (GpaKeyTable *keytable)
   for (; list; list = g_list_next (list))
     {
       gpgme_key_t key = (gpgme_key_t) list->data;
-      gpgme_key_ref (key);
       if (keytable->next)
 	{
+	  gpa_key_ref (key, GPA_KEY_OWNER_KEYTABLE);
 	  keytable->next (key, keytable->data);
 	}
     }
@@ -383,6 +452,44 @@ gpa_keytable_load_new (GpaKeyTable *keytable,
   reload_cache (keytable, fpr);
 }
 
+/* Load the keys with the fingerprints in the NULL terminated array
+ * FPRS from GnuPG, replacing them in the keytable.  Only the loaded
+ * keys are passed to the "next" function.
+ */
+void
+gpa_keytable_load_keys (GpaKeyTable *keytable,
+                        const char **fprs,
+                        GpaKeyTableNextFunc next,
+                        GpaKeyTableEndFunc end,
+                        gpointer data)
+{
+  g_return_if_fail (keytable != NULL);
+  g_return_if_fail (GPA_IS_KEYTABLE (keytable));
+  g_return_if_fail (fprs != NULL);
+
+  /* Set up callbacks */
+  keytable->next = next;
+  keytable->end = end;
+  keytable->data = data;
+  /* List keys */
+  g_strfreev (keytable->fprs);
+  keytable->fprs = g_strdupv ((gchar **) fprs);
+  keytable->new_key = TRUE;
+  reload_cache (keytable, NULL);
+}
+
+/* Remove the keys with the fingerprints in the NULL terminated array
+   FPRS from the keytable, for example after they have been deleted.  */
+void
+gpa_keytable_remove_keys (GpaKeyTable *keytable, const char **fprs)
+{
+  g_return_if_fail (keytable != NULL);
+  g_return_if_fail (GPA_IS_KEYTABLE (keytable));
+  g_return_if_fail (fprs != NULL);
+
+  remove_keys (keytable, fprs);
+}
+
 /* Return the key with a given fingerprint from the keytable, NULL if
    there is none. No reference is provided.  */
 gpgme_key_t
@@ -414,3 +521,13 @@ gpa_keytable_lookup_key (GpaKeyTable *keytable, const char *fpr)
       return gpa_keytable_lookup_key (keytable, fpr);
     }
 }
+
+/* Return the search index over the keys of the keytable.  It is
+   updated before the "end" function of a listing is called.  */
+gpa_key_index_t
+gpa_keytable_get_index (GpaKeyTable *keytable)
+{
+  g_return_val_if_fail (GPA_IS_KEYTABLE (keytable), NULL);
+
+  return keytable->index;
+}
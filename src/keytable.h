@@ -28,6 +28,7 @@
 #include <gtk/gtk.h>
 #include <gpgme.h>
 #include "gpacontext.h"
+#include "keyindex.h"
 
 /* GObject stuff */
 #define GPA_KEYTABLE_TYPE	  (gpa_keytable_get_type ())
@@ -55,10 +56,14 @@ struct _GpaKeyTable {
   GpaKeyTableEndFunc end;
   gpointer data;
   const char *fpr;
+  gchar **fprs;         /* The keys to replace or NULL.  */
   int did_first_half;
   gpg_error_t first_half_err;
 
   GList *keys, *tmp_list;
+
+  /* Search index over KEYS.  */
+  gpa_key_index_t index;
 };
 
 struct _GpaKeyTableClass {
@@ -104,8 +109,27 @@ void gpa_keytable_load_new (GpaKeyTable *keytable,
 			    GpaKeyTableEndFunc end,
 			    gpointer data);
 
+/* Load the keys with the fingerprints in the NULL terminated array
+ * FPRS from GnuPG, replacing them in the keytable.  Only the loaded
+ * keys are passed to the "next" function.
+ */
+void gpa_keytable_load_keys (GpaKeyTable *keytable,
+                             const char **fprs,
+                             GpaKeyTableNextFunc next,
+                             GpaKeyTableEndFunc end,
+                             gpointer data);
+
+/* Remove the keys with the fingerprints in the NULL terminated array
+ * FPRS from the keytable, for example after they have been deleted.
+ */
+void gpa_keytable_remove_keys (GpaKeyTable *keytable, const char **fprs);
+
 /* Return the key with a given fingerprint from the keytable, NULL if
    there is none. No reference is provided.  */
 gpgme_key_t gpa_keytable_lookup_key (GpaKeyTable *keytable, const char *fpr);
 
+/* Return the search index over the keys of the keytable.  It is
+   updated before the "end" function of a listing is called.  */
+gpa_key_index_t gpa_keytable_get_index (GpaKeyTable *keytable);
+
 #endif /* KEYTABLE_H */
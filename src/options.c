@@ -33,6 +33,11 @@
 
 #include "confdialog.h" /* gpa_read_configured_keyserver */
 
+/* The defaults for the keyserver limits.  */
+#define DEFAULT_KEYSERVER_BATCH_SIZE   50
+#define DEFAULT_KEYSERVER_CONCURRENCY  2
+#define DEFAULT_KEYSERVER_RATE         30
+
 /* Internal API */
 static void gpa_options_save_settings (GpaOptions *options);
 static void gpa_options_read_settings (GpaOptions *options);
@@ -146,10 +151,14 @@ gpa_options_init (GpaOptions *options)
   options->simplified_ui = TRUE;
   options->show_advanced_options = FALSE;
   options->backup_generated = FALSE;
+  options->default_key_checked = FALSE;
   options->default_key = NULL;
   options->default_key_fpr = NULL;
   options->default_keyserver = NULL;
   options->detailed_view = FALSE;
+  options->keyserver_batch_size = DEFAULT_KEYSERVER_BATCH_SIZE;
+  options->keyserver_concurrency = DEFAULT_KEYSERVER_CONCURRENCY;
+  options->keyserver_rate = DEFAULT_KEYSERVER_RATE;
 }
 
 static void
@@ -266,6 +275,8 @@ gpa_options_set_default_key (GpaOptions *options, gpgme_key_t key)
 gpgme_key_t
 gpa_options_get_default_key (GpaOptions *options)
 {
+  if (!options->default_key_checked)
+    gpa_options_update_default_key (options);
   return options->default_key;
 }
 
@@ -332,6 +343,7 @@ gpa_options_update_default_key (GpaOptions *options)
   gpgme_key_t key = NULL;
   gpgme_ctx_t ctx = gpa_gpgme_new ();
 
+  options->default_key_checked = TRUE;
   if (! options->default_key_fpr)
     update = TRUE;
   else if (gpg_err_code (gpgme_get_key (ctx, options->default_key_fpr,
@@ -414,6 +426,26 @@ gpa_options_get_backup_generated (GpaOptions *options)
   return options->backup_generated;
 }
 
+
+unsigned int
+gpa_options_get_keyserver_batch_size (GpaOptions *options)
+{
+  return options->keyserver_batch_size;
+}
+
+unsigned int
+gpa_options_get_keyserver_concurrency (GpaOptions *options)
+{
+  return options->keyserver_concurrency;
+}
+
+unsigned int
+gpa_options_get_keyserver_rate (GpaOptions *options)
+{
+  return options->keyserver_rate;
+}
+
+
 static void
 gpa_options_save_settings (GpaOptions *options)
 {
@@ -454,6 +486,15 @@ gpa_options_save_settings (GpaOptions *options)
         {
           fprintf (options_file, "%s\n", "detailed-view");
         }
+      if (options->keyserver_batch_size != DEFAULT_KEYSERVER_BATCH_SIZE)
+        fprintf (options_file, "keyserver-batch-size %u\n",
+                 options->keyserver_batch_size);
+      if (options->keyserver_concurrency != DEFAULT_KEYSERVER_CONCURRENCY)
+        fprintf (options_file, "keyserver-concurrency %u\n",
+                 options->keyserver_concurrency);
+      if (options->keyserver_rate != DEFAULT_KEYSERVER_RATE)
+        fprintf (options_file, "keyserver-rate %u\n",
+                 options->keyserver_rate);
       fclose (options_file);
     }
 
@@ -496,6 +537,9 @@ typedef enum
    PARSE_OPTIONS_STATE_START,
    PARSE_OPTIONS_STATE_HAVE_KEY,
    PARSE_OPTIONS_STATE_HAVE_KEYSERVER,
+   PARSE_OPTIONS_STATE_HAVE_BATCH_SIZE,
+   PARSE_OPTIONS_STATE_HAVE_CONCURRENCY,
+   PARSE_OPTIONS_STATE_HAVE_RATE,
  } ParseOptionsState;
 
 /* This MUST be called ONLY from gpa_options_new (). We don't emit any
@@ -552,6 +596,18 @@ gpa_options_read_settings (GpaOptions *options)
                 {
                   options->detailed_view = TRUE;
                 }
+              else if (g_str_equal (next_word, "keyserver-batch-size"))
+                {
+                  state = PARSE_OPTIONS_STATE_HAVE_BATCH_SIZE;
+                }
+              else if (g_str_equal (next_word, "keyserver-concurrency"))
+                {
+                  state = PARSE_OPTIONS_STATE_HAVE_CONCURRENCY;
+                }
+              else if (g_str_equal (next_word, "keyserver-rate"))
+                {
+                  state = PARSE_OPTIONS_STATE_HAVE_RATE;
+                }
               break;
             case PARSE_OPTIONS_STATE_HAVE_KEY:
               options->default_key_fpr = g_strdup (next_word);
@@ -562,6 +618,21 @@ gpa_options_read_settings (GpaOptions *options)
               /* options->default_keyserver = g_strdup (next_word); */
               state = PARSE_OPTIONS_STATE_START;
               break;
+            case PARSE_OPTIONS_STATE_HAVE_BATCH_SIZE:
+              if (atoi (next_word) > 0)
+                options->keyserver_batch_size = atoi (next_word);
+              state = PARSE_OPTIONS_STATE_START;
+              break;
+            case PARSE_OPTIONS_STATE_HAVE_CONCURRENCY:
+              if (atoi (next_word) > 0)
+                options->keyserver_concurrency = atoi (next_word);
+              state = PARSE_OPTIONS_STATE_START;
+              break;
+            case PARSE_OPTIONS_STATE_HAVE_RATE:
+              if (atoi (next_word) >= 0)
+                options->keyserver_rate = atoi (next_word);
+              state = PARSE_OPTIONS_STATE_START;
+              break;
             default:
               /* Can't happen */
               return;
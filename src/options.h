@@ -45,11 +45,18 @@ struct _GpaOptions {
   gboolean show_advanced_options;
   gboolean backup_generated;
 
+  /* The default key is only determined when needed.  */
+  gboolean default_key_checked;
   gpgme_key_t default_key;
   gchar *default_key_fpr;
   gchar *default_keyserver;
 
   gboolean detailed_view;
+
+  /* Limits for bulk keyserver requests.  */
+  unsigned int keyserver_batch_size;
+  unsigned int keyserver_concurrency;
+  unsigned int keyserver_rate;
 };
 
 struct _GpaOptionsClass {
@@ -109,5 +116,13 @@ gboolean gpa_options_get_backup_generated (GpaOptions *options);
 void gpa_options_set_detailed_view (GpaOptions *options, gboolean value);
 gboolean gpa_options_get_detailed_view (GpaOptions *options);
 
+/* Return the number of keys to send in one keyserver request, the
+   number of requests to run at the same time and the maximum number
+   of requests per minute (0 for no limit).  These are only set in
+   gpa.conf.  */
+unsigned int gpa_options_get_keyserver_batch_size (GpaOptions *options);
+unsigned int gpa_options_get_keyserver_concurrency (GpaOptions *options);
+unsigned int gpa_options_get_keyserver_rate (GpaOptions *options);
+
 #endif /*OPTIONS_H*/
 
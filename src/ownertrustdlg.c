@@ -85,19 +85,20 @@ get_selected_validity (GtkWidget *unknown_radio, GtkWidget *never_radio,
     }
 }
 
-/* Run the owner trust dialog modally. */
-gboolean gpa_ownertrust_run_dialog (gpgme_key_t key, GtkWidget *parent,
-				    gpgme_validity_t *return_trust)
+/* Run the owner trust dialog modally showing KEY_INFO above the
+   choices, which start with TRUST.  Returns TRUE and stores the
+   chosen trust at RETURN_TRUST if the user clicked OK.  */
+static gboolean
+run_dialog (GtkWidget *parent, GtkWidget *key_info, gpgme_validity_t trust,
+            gpgme_validity_t *return_trust)
 {
   GtkWidget *dialog;
-  GtkWidget *key_info;
   GtkWidget *grid;
   GtkWidget *frame;
   GtkWidget *unknown_radio, *never_radio, *marginal_radio, *full_radio,
     *ultimate_radio;
   GtkWidget *label;
   GtkResponseType response;
-  gpgme_validity_t trust = key->owner_trust;
   gboolean result;
 
   /* Create the dialog */
@@ -110,8 +111,6 @@ gboolean gpa_ownertrust_run_dialog (gpgme_key_t key, GtkWidget *parent,
   gtk_dialog_set_default_response (GTK_DIALOG (dialog), GTK_RESPONSE_OK);
   gtk_container_set_border_width (GTK_CONTAINER (dialog), 5);
 
-  key_info = gpa_key_info_new (key);
-
   GtkWidget *box = gtk_dialog_get_content_area(GTK_DIALOG(dialog));
   gtk_box_pack_start(GTK_BOX (box), key_info, FALSE, FALSE, 0);
 
@@ -231,23 +230,10 @@ gboolean gpa_ownertrust_run_dialog (gpgme_key_t key, GtkWidget *parent,
   /* Return the ownertrust */
   if (response == GTK_RESPONSE_OK) 
     {
-      gpgme_validity_t new_trust = get_selected_validity (unknown_radio,
-							  never_radio, 
-							  marginal_radio,
-							  full_radio,
-							  ultimate_radio);
-      /* If the user didn't change the trust, don't edit the key */
-      if (trust == new_trust ||
-          (trust == GPGME_VALIDITY_UNDEFINED && 
-           new_trust == GPGME_VALIDITY_UNKNOWN))
-        {
-          result = FALSE;
-        }
-      else
-        {
-	  *return_trust = new_trust;
-          result = TRUE;
-        }
+      *return_trust = get_selected_validity (unknown_radio, never_radio,
+                                             marginal_radio, full_radio,
+                                             ultimate_radio);
+      result = TRUE;
     }
   else
     {
@@ -257,3 +243,57 @@ gboolean gpa_ownertrust_run_dialog (gpgme_key_t key, GtkWidget *parent,
   gtk_widget_destroy (dialog);
   return result;
 }
+
+/* Run the owner trust dialog modally. */
+gboolean gpa_ownertrust_run_dialog (gpgme_key_t key, GtkWidget *parent,
+				    gpgme_validity_t *return_trust)
+{
+  gpgme_validity_t trust = key->owner_trust;
+  gpgme_validity_t new_trust;
+
+  if (! run_dialog (parent, gpa_key_info_new (key), trust, &new_trust))
+    return FALSE;
+
+  /* If the user didn't change the trust, don't edit the key */
+  if (trust == new_trust ||
+      (trust == GPGME_VALIDITY_UNDEFINED && 
+       new_trust == GPGME_VALIDITY_UNKNOWN))
+    return FALSE;
+
+  *return_trust = new_trust;
+  return TRUE;
+}
+
+/* Run the owner trust dialog modally for all KEYS.  The choices start
+   with the ownertrust of the keys if they all have the same.  The
+   caller has to skip the keys whose ownertrust does not change.  */
+gboolean
+gpa_ownertrust_run_dialog_multiple (GList *keys, GtkWidget *parent,
+                                    gpgme_validity_t *return_trust)
+{
+  gpgme_validity_t trust;
+  GtkWidget *label;
+  GList *item;
+  gchar *text;
+
+  g_return_val_if_fail (keys, FALSE);
+
+  if (! keys->next)
+    return gpa_ownertrust_run_dialog (keys->data, parent, return_trust);
+
+  trust = ((gpgme_key_t) keys->data)->owner_trust;
+  for (item = keys->next; item; item = g_list_next (item))
+    if (((gpgme_key_t) item->data)->owner_trust != trust)
+      {
+        trust = GPGME_VALIDITY_UNKNOWN;
+        break;
+      }
+
+  text = g_strdup_printf (_("Set the ownertrust of the %u selected keys."),
+                          g_list_length (keys));
+  label = gtk_label_new (text);
+  g_free (text);
+  gtk_widget_set_halign (label, GTK_ALIGN_START);
+
+  return run_dialog (parent, label, trust, return_trust);
+}
@@ -27,4 +27,7 @@
 gboolean gpa_ownertrust_run_dialog (gpgme_key_t key, GtkWidget *parent,
 				    gpgme_validity_t *new_trust);
 
+gboolean gpa_ownertrust_run_dialog_multiple (GList *keys, GtkWidget *parent,
+                                             gpgme_validity_t *new_trust);
+
 #endif /* OWNERTRUSTDLG_H */
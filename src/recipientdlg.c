@@ -26,8 +26,10 @@
 #include "i18n.h"
 
 #include "gtktools.h"
+#include "gpacontext.h"
 #include "selectkeydlg.h"
 #include "recipientdlg.h"
+#include "keyref.h"
 
 
 struct _RecipientDlg
@@ -56,6 +58,15 @@ struct _RecipientDlg
 
   /* The selected protocol.  This is also set by update_statushint.  */
   gpgme_protocol_t selected_protocol;
+
+  /* The key lookups waiting for a context.  */
+  GQueue lookup_queue;
+
+  /* The contexts running key lookups.  */
+  struct lookup_ctx_s *lookup_ctx[MAX_LOOKUPS];
+
+  /* The number of queued and running lookups.  */
+  int pending_lookups;
 };
 
 
@@ -83,6 +94,9 @@ enum
    at a reasonable value.  */
 #define TRUNCATE_KEYSEARCH_AT 40
 
+/* The number of key lookups run concurrently.  */
+#define MAX_LOOKUPS 4
+
 
 /* An object to keep information about keys.  */
 struct keyinfo_s
@@ -119,6 +133,39 @@ struct userdata_s
 };
 
 
+/* A key lookup for one recipient.  */
+struct lookup_s
+{
+  /* The row of the recipient.  */
+  GtkTreeRowReference *row;
+
+  /* The recipient.  This is owned by the row.  */
+  struct userdata_s *info;
+
+  /* The protocol to search.  */
+  gpgme_protocol_t protocol;
+
+  /* If set, also search external sources as configured for gpg's
+     --locate-keys.  */
+  int external;
+};
+
+
+/* A context running key lookups.  */
+struct lookup_ctx_s
+{
+  RecipientDlg *dialog;
+
+  GpaContext *ctx;
+
+  /* The running lookup or NULL.  */
+  struct lookup_s *lookup;
+
+  /* The keys found so far.  */
+  struct keyinfo_s keys;
+};
+
+
 /* Identifiers for the columns of the RECPLIST.  */
 enum
   {
@@ -301,7 +348,9 @@ update_statushint (RecipientDlg *dialog)
     sel_protocol = req_protocol;
 
 
-  if (missing_keys)
+  if (missing_keys && dialog->pending_lookups)
+    hint = _("Searching keys for the recipients...");
+  else if (missing_keys)
     hint = _("You need to select a key for each recipient.\n"
              "To select a key right-click on the respective line.");
   else if ((sel_protocol == GPGME_PROTOCOL_OpenPGP
@@ -331,6 +380,8 @@ update_statushint (RecipientDlg *dialog)
       hint = _("Using S/MIME for encryption.");
       okay = 1;
     }
+  else if (dialog->pending_lookups)
+    hint = _("Searching keys for the recipients...");
   else
     hint = _("No recipients - encryption is not possible");
 
@@ -371,6 +422,7 @@ append_key_to_keyinfo (struct keyinfo_s *keyinfo, gpgme_key_t key)
         }
       keyinfo->keys[nkeys++] = key;
       keyinfo->keys[nkeys] = NULL;
+      gpa_key_acquired (key, GPA_KEY_OWNER_RECIPIENTDLG);
     }
   return nkeys;
 }
@@ -387,7 +439,7 @@ clear_keyinfo (struct keyinfo_s *keyinfo)
       if (keyinfo->keys)
         {
           for (nkeys=0; keyinfo->keys[nkeys]; nkeys++)
-            gpgme_key_unref (keyinfo->keys[nkeys]);
+            gpa_key_unref (keyinfo->keys[nkeys], GPA_KEY_OWNER_RECIPIENTDLG);
           g_free (keyinfo->keys);
           keyinfo->keys = NULL;
         }
@@ -460,104 +512,251 @@ update_recplist_row (GtkListStore *store, GtkTreeIter *iter,
 }
 
 
-/* Parse one recipient, this is the working horse of parse_recipeints. */
+static void start_lookups (RecipientDlg *dialog);
+
+
+/* Release LOOKUP.  */
 static void
-parse_one_recipient (gpgme_ctx_t ctx, GtkListStore *store, GtkTreeIter *iter,
-                     struct userdata_s *info)
+free_lookup (gpointer data)
+{
+  struct lookup_s *lookup = data;
+
+  gtk_tree_row_reference_free (lookup->row);
+  g_free (lookup);
+}
+
+
+/* Queue a lookup of the keys of the recipient in the row at ITER.  */
+static void
+queue_lookup (RecipientDlg *dialog, GtkTreeModel *model, GtkTreeIter *iter,
+              gpgme_protocol_t protocol, int external)
+{
+  struct lookup_s *lookup;
+  struct userdata_s *info;
+  GtkTreePath *path;
+
+  gtk_tree_model_get (model, iter, RECPLIST_USERDATA, &info, -1);
+  if (!info)
+    return;
+
+  lookup = g_new0 (struct lookup_s, 1);
+  path = gtk_tree_model_get_path (model, iter);
+  lookup->row = gtk_tree_row_reference_new (model, path);
+  gtk_tree_path_free (path);
+  lookup->info = info;
+  lookup->protocol = protocol;
+  lookup->external = external;
+  g_queue_push_tail (&dialog->lookup_queue, lookup);
+  dialog->pending_lookups++;
+}
+
+
+/* The "next_key" signal handler of the lookup contexts.  We own the
+   reference to KEY.  */
+static void
+lookup_next_key_cb (GpaContext *context, gpgme_key_t key, gpointer user_data)
+{
+  struct lookup_ctx_s *lctx = user_data;
+
+  if (!lctx->lookup || lctx->keys.truncated
+      || key->revoked || key->disabled || key->expired || !key->can_encrypt)
+    gpgme_key_unref (key);
+  else if (append_key_to_keyinfo (&lctx->keys, key) >= TRUNCATE_KEYSEARCH_AT)
+    {
+      /* Note that the truncation flag is not 100% correct.  In case
+         the next key would not be usable we have not actually
+         truncated the search.  */
+      lctx->keys.truncated = 1;
+    }
+}
+
+
+/* The "done" signal handler of the lookup contexts.  Store the keys
+   found and start the next lookup.  */
+static void
+lookup_done_cb (GpaContext *context, gpg_error_t err, gpointer user_data)
+{
+  struct lookup_ctx_s *lctx = user_data;
+  struct lookup_s *lookup = lctx->lookup;
+  RecipientDlg *dialog = lctx->dialog;
+  struct keyinfo_s *keyinfo;
+  GtkTreePath *path;
+  GtkTreeIter iter;
+
+  if (!lookup)
+    return;  /* Canceled.  */
+  lctx->lookup = NULL;
+  gpgme_op_keylist_end (context->ctx);
+
+  keyinfo = (lookup->protocol == GPGME_PROTOCOL_CMS
+             ? &lookup->info->x509 : &lookup->info->pgp);
+  /* The local lookups come first.  An external lookup or a late
+     local one only fills in a recipient without keys, so that a key
+     selected by the user is never replaced.  */
+  if (!keyinfo->keys || !keyinfo->keys[0])
+    {
+      clear_keyinfo (keyinfo);
+      *keyinfo = lctx->keys;
+      memset (&lctx->keys, 0, sizeof lctx->keys);
+
+      path = gtk_tree_row_reference_get_path (lookup->row);
+      if (path && gtk_tree_model_get_iter (gtk_tree_row_reference_get_model
+                                           (lookup->row), &iter, path))
+        update_recplist_row (GTK_LIST_STORE (gtk_tree_row_reference_get_model
+                                             (lookup->row)),
+                             &iter, lookup->info);
+      gtk_tree_path_free (path);
+    }
+  else
+    clear_keyinfo (&lctx->keys);
+
+  free_lookup (lookup);
+  dialog->pending_lookups--;
+  start_lookups (dialog);
+  if (!dialog->pending_lookups)
+    update_statushint (dialog);
+}
+
+
+/* Start a lookup on LCTX.  Returns true if it is running.  */
+static int
+start_one_lookup (struct lookup_ctx_s *lctx, struct lookup_s *lookup)
 {
   static int have_locate = -1;
-  gpgme_key_t key = NULL;
+  gpgme_ctx_t ctx = lctx->ctx->ctx;
   gpgme_keylist_mode_t mode;
+  gpg_error_t err;
 
   if (have_locate == -1)
     have_locate = is_gpg_version_at_least ("2.0.10");
 
-  g_return_if_fail (info);
+  /* There is no need to search external sources for a recipient
+     which has already been resolved.  */
+  if (lookup->info->ignore_recipient
+      || (lookup->external
+          && (!have_locate
+              || (lookup->info->pgp.keys && lookup->info->pgp.keys[0]))))
+    return 0;
 
-  clear_keyinfo (&info->pgp);
-  gpgme_set_protocol (ctx, GPGME_PROTOCOL_OpenPGP);
+  gpgme_set_protocol (ctx, lookup->protocol);
   mode = gpgme_get_keylist_mode (ctx);
-  if (have_locate)
-    gpgme_set_keylist_mode (ctx, (mode | (GPGME_KEYLIST_MODE_LOCAL
-                                          | GPGME_KEYLIST_MODE_EXTERN)));
-  if (!gpgme_op_keylist_start (ctx, info->mailbox, 0))
+  gpgme_set_keylist_mode (ctx, (lookup->external
+                                ? (mode | GPGME_KEYLIST_MODE_LOCAL
+                                   | GPGME_KEYLIST_MODE_EXTERN)
+                                : GPGME_KEYLIST_MODE_LOCAL));
+  lctx->lookup = lookup;
+  err = gpgme_op_keylist_start (ctx, lookup->info->mailbox, 0);
+  gpgme_set_keylist_mode (ctx, mode);
+  if (err)
     {
-      while (!gpgme_op_keylist_next (ctx, &key))
-        {
-          if (key->revoked || key->disabled || key->expired
-              || !key->can_encrypt)
-            gpgme_key_unref (key);
-          else if (append_key_to_keyinfo (&info->pgp, key)
-                   >= TRUNCATE_KEYSEARCH_AT)
-            {
-              /* Note that the truncation flag is not 100% correct.  In
-                 case the next iteration would not yield a new key we
-                 have not actually truncated the search.  */
-              info->pgp.truncated = 1;
-              break;
-            }
-        }
+      lctx->lookup = NULL;
+      return 0;
     }
-  gpgme_op_keylist_end (ctx);
-  gpgme_set_keylist_mode (ctx, mode);
+  return 1;
+}
+
+
+/* Start queued lookups on all idle contexts.  */
+static void
+start_lookups (RecipientDlg *dialog)
+{
+  struct lookup_s *lookup;
+  int i;
 
-  clear_keyinfo (&info->x509);
-  gpgme_set_protocol (ctx, GPGME_PROTOCOL_CMS);
-  if (!gpgme_op_keylist_start (ctx, info->mailbox, 0))
+  for (i = 0; i < MAX_LOOKUPS; i++)
     {
-      while (!gpgme_op_keylist_next (ctx, &key))
+      struct lookup_ctx_s *lctx = dialog->lookup_ctx[i];
+
+      if (!lctx)
         {
-          if (key->revoked || key->disabled || key->expired
-              || !key->can_encrypt)
-            gpgme_key_unref (key);
-          else if (append_key_to_keyinfo (&info->x509,key)
-                   >= TRUNCATE_KEYSEARCH_AT)
-            {
-              info->x509.truncated = 1;
-              break;
-            }
+          lctx = g_new0 (struct lookup_ctx_s, 1);
+          lctx->dialog = dialog;
+          lctx->ctx = gpa_context_new ();
+          g_signal_connect (G_OBJECT (lctx->ctx), "next_key",
+                            G_CALLBACK (lookup_next_key_cb), lctx);
+          g_signal_connect (G_OBJECT (lctx->ctx), "done",
+                            G_CALLBACK (lookup_done_cb), lctx);
+          dialog->lookup_ctx[i] = lctx;
         }
-    }
-  gpgme_op_keylist_end (ctx);
+      if (lctx->lookup)
+        continue;
 
-  update_recplist_row (store, iter, info);
+      while ((lookup = g_queue_pop_head (&dialog->lookup_queue)))
+        {
+          if (start_one_lookup (lctx, lookup))
+            break;
+          free_lookup (lookup);
+          dialog->pending_lookups--;
+        }
+      if (!lookup)
+        break;
+    }
 }
 
 
-/* Parse the list of recipients, find possible keys and update the
-   store.  */
+/* Cancel all lookups.  If RELEASE is set, also release the
+   contexts.  */
 static void
-parse_recipients (GtkListStore *store)
+cancel_lookups (RecipientDlg *dialog, int release)
 {
-  GtkTreeModel *model;
-  GtkTreeIter iter;
-  gpg_error_t err;
-  gpgme_ctx_t ctx;
+  struct lookup_s *lookup;
+  int i;
 
-  err = gpgme_new (&ctx);
-  if (err)
-    gpa_gpgme_error (err);
+  while ((lookup = g_queue_pop_head (&dialog->lookup_queue)))
+    free_lookup (lookup);
 
+  for (i = 0; i < MAX_LOOKUPS; i++)
+    {
+      struct lookup_ctx_s *lctx = dialog->lookup_ctx[i];
+
+      if (!lctx)
+        continue;
+      if (lctx->lookup)
+        {
+          /* Clear the lookup first; the done handler is called from
+             within gpgme_cancel.  */
+          free_lookup (lctx->lookup);
+          lctx->lookup = NULL;
+          gpgme_cancel (lctx->ctx->ctx);
+          gpgme_op_keylist_end (lctx->ctx->ctx);
+        }
+      clear_keyinfo (&lctx->keys);
+      if (release)
+        {
+          g_signal_handlers_disconnect_by_data (lctx->ctx, lctx);
+          g_object_unref (lctx->ctx);
+          g_free (lctx);
+          dialog->lookup_ctx[i] = NULL;
+        }
+    }
+  dialog->pending_lookups = 0;
+}
 
-  model = GTK_TREE_MODEL (store);
-  /* Walk through the list, reading each row. */
+
+/* Find possible keys for all recipients in STORE.  The local keyrings
+   are searched first for all recipients.  Then the external sources
+   are searched for recipients without a key.  The rows are updated
+   as the results arrive.  */
+static void
+parse_recipients (RecipientDlg *dialog, GtkListStore *store)
+{
+  GtkTreeModel *model = GTK_TREE_MODEL (store);
+  GtkTreeIter iter;
 
   if (gtk_tree_model_get_iter_first (model, &iter))
     do
       {
-        struct userdata_s *info;
-
-        gtk_tree_model_get (model, &iter,
-                            RECPLIST_USERDATA, &info,
-                            -1);
-
-        /* Do something with the data */
-        /*g_print ("parsing mailbox `%s'\n", info? info->mailbox:"(null)");*/
-        parse_one_recipient (ctx, store, &iter,info);
+        queue_lookup (dialog, model, &iter, GPGME_PROTOCOL_OpenPGP, 0);
+        queue_lookup (dialog, model, &iter, GPGME_PROTOCOL_CMS, 0);
       }
     while (gtk_tree_model_iter_next (model, &iter));
 
-  gpgme_release (ctx);
+  if (gtk_tree_model_get_iter_first (model, &iter))
+    do
+      queue_lookup (dialog, model, &iter, GPGME_PROTOCOL_OpenPGP, 1);
+    while (gtk_tree_model_iter_next (model, &iter));
+
+  start_lookups (dialog);
 }
 
 
@@ -674,7 +873,7 @@ select_key_response_cb (SelectKeyDlg *seldlg, int response, void *user_data)
               update_statushint (dialog);
             }
         }
-      gpgme_key_unref (key);
+      gpa_key_unref (key, GPA_KEY_OWNER_RECIPIENTDLG);
     }
 
   gtk_widget_destroy (GTK_WIDGET (seldlg));
@@ -916,6 +1115,17 @@ recipient_dlg_set_property (GObject *object, guint prop_id,
 }
 
 
+static void
+recipient_dlg_dispose (GObject *object)
+{
+  RecipientDlg *dialog = RECIPIENT_DLG (object);
+
+  cancel_lookups (dialog, 1);
+
+  G_OBJECT_CLASS (parent_class)->dispose (object);
+}
+
+
 static void
 recipient_dlg_finalize (GObject *object)
 {
@@ -927,6 +1137,7 @@ recipient_dlg_finalize (GObject *object)
 static void
 recipient_dlg_init (RecipientDlg *dialog)
 {
+  g_queue_init (&dialog->lookup_queue);
 }
 
 
@@ -1042,6 +1253,7 @@ recipient_dlg_class_init (RecipientDlgClass *klass)
   parent_class = g_type_class_peek_parent (klass);
 
   object_class->constructor = recipient_dlg_constructor;
+  object_class->dispose = recipient_dlg_dispose;
   object_class->finalize = recipient_dlg_finalize;
   object_class->set_property = recipient_dlg_set_property;
   object_class->get_property = recipient_dlg_get_property;
@@ -1138,6 +1350,7 @@ recipient_dlg_set_recipients (RecipientDlg *dialog, GSList *recipients,
   store = GTK_LIST_STORE (gtk_tree_view_get_model
                           (GTK_TREE_VIEW (dialog->clist_keys)));
 
+  cancel_lookups (dialog, 0);
   gtk_list_store_clear (store);
   for (recp = recipients; recp; recp = g_slist_next (recp))
     {
@@ -1158,7 +1371,7 @@ recipient_dlg_set_recipients (RecipientDlg *dialog, GSList *recipients,
         }
     }
 
-  parse_recipients (store);
+  parse_recipients (dialog, store);
   dialog->freeze_update_statushint--;
   update_statushint (dialog);
 }
@@ -1219,7 +1432,7 @@ recipient_dlg_get_keys (RecipientDlg *dialog, gpgme_protocol_t *r_protocol)
                 key = NULL;
               if (key)
                 {
-                  gpgme_key_ref (key);
+                  gpa_key_ref (key, GPA_KEY_OWNER_RECIPIENTDLG);
                   keyarray[idx++] = key;
                 }
             }
@@ -28,13 +28,12 @@
 #include <glib.h>
 #include <assert.h>
 #include <ctype.h>
-#include <signal.h>
+#include <string.h>
 
-/* For unlink() */
+/* For access() */
 #ifdef G_OS_UNIX
 #include <unistd.h>
-#include <sys/types.h>
-#include <sys/wait.h>
+#include <signal.h>
 #else
 #include <windows.h>
 #include <io.h>
@@ -57,9 +56,6 @@
 
 #define KEYSERVER_SCHEME_NOT_FOUND 127
 
-#define COMMAND_TEMP_NAME "gpa-com-XXXXXX"
-#define OUTPUT_TEMP_NAME "gpa-out-XXXXXX"
-
 /* Internal API */
 
 /* FIXME: THIS SHOULDN'T BE HERE
@@ -240,53 +236,45 @@ helper_path (const gchar *scheme)
   return path;
 }
 
-/* Find out the plugin protocol version */
-static int
-protocol_version (const gchar *scheme)
+/* The state of one run of a keyserver helper.  Several helpers may
+   run at the same time.  PARENT is a weak pointer and DIALOG is reset
+   when the dialog is destroyed.  */
+struct helper_s
 {
-  gchar *helper[] = {helper_path (scheme), "-V", NULL};
-  gchar *output = NULL;
-  gint version;
+  GtkWidget *parent;
+  GtkWidget *dialog;
 
-  g_spawn_sync (NULL, helper, NULL, G_SPAWN_STDERR_TO_DEV_NULL, NULL, NULL,
-		&output, NULL, NULL, NULL);
-  if (output && *output)
-    {
-      /* The version is a number, and it's value is it's ascii code minus
-       * the ascii code of 0 */
-      version = output[0] - '0';
-    }
-  else
-    {
-      version = 0;
-    }
-  g_free (output);
-  g_free (helper[0]);
-  return version;
-}
+  GPid pid;
+  gboolean exited;
+  gint exit_status;
+  gboolean canceled;
 
-/* Return the first error code found */
-static gint
-parse_helper_output (const gchar *filename)
-{
-  FILE *file = fopen (filename, "r");
-  char line[80];
-  gint error = KEYSERVER_GENERAL_ERROR;
-  char keyid[17];
+  /* The command written to the helper's stdin.  */
+  GString *input;
+  gsize input_off;
+  GIOChannel *in_channel;
+  guint in_watch;
 
-  /* Can't happen */
-  if (!file)
-    return KEYSERVER_INTERNAL_ERROR;
+  /* The output of the helper and its last incomplete line.  */
+  gpgme_data_t output;
+  GString *line;
+  GIOChannel *out_channel;
+  guint out_watch;
 
-  while (fgets(line,sizeof(line),file) != NULL)
-    if (sscanf (line,"KEY %16s FAILED %i\n", keyid, &error) == 2 )
-      {
-	break;
-      }
-  fclose (file);
+  /* The error output of the helper.  */
+  GString *errors;
+  GIOChannel *err_channel;
+  guint err_watch;
+
+  /* The protocol version and the first error code announced by the
+     helper.  */
+  int version;
+  gint error_code;
+
+  server_access_cb_t cb;
+  gpointer opaque;
+};
 
-  return error;
-}
 
 /* Return an error string for the code */
 static const gchar *
@@ -330,140 +318,324 @@ error_string (gint error_code)
 }
 
 static void
-write_command (FILE *file, const char *scheme,
+write_command (GString *command, const char *scheme,
 	       const char *host, const char *port,
-	       const char *opaque, const char *command)
+	       const char *opaque, const char *verb)
 {
-  fprintf (file, "%s\n", "VERSION 1");
-  fprintf (file, "SCHEME %s\n", scheme);
+  g_string_append (command, "VERSION 1\n");
+  g_string_append_printf (command, "SCHEME %s\n", scheme);
 
   if (opaque)
     {
-      fprintf (file, "OPAQUE %s\n", opaque);
+      g_string_append_printf (command, "OPAQUE %s\n", opaque);
     }
   else
     {
-      fprintf (file, "HOST %s\n", host);
+      g_string_append_printf (command, "HOST %s\n", host);
       if (port)
 	{
-	  fprintf (file, "PORT %s\n", port);
+	  g_string_append_printf (command, "PORT %s\n", port);
 	}
     }
-  fprintf (file, "%s\n", "OPTION include-revoked");
-  fprintf (file, "%s\n", "OPTION include-subkeys");
-  fprintf (file, "COMMAND %s\n\n", command);
+  g_string_append (command, "OPTION include-revoked\n");
+  g_string_append (command, "OPTION include-subkeys\n");
+  g_string_append_printf (command, "COMMAND %s\n\n", verb);
+}
+
+/* Append the contents of DATA to STRING.  */
+static void
+append_data (GString *string, gpgme_data_t data)
+{
+  char buffer[1024];
+  gssize nread;
+
+  gpgme_data_seek (data, 0, SEEK_SET);
+  while ((nread = gpgme_data_read (data, buffer, sizeof (buffer))) > 0)
+    g_string_append_len (string, buffer, nread);
+}
+
+/* Closing the wait dialog, by the user or together with its parent,
+   cancels the helper.  */
+static void
+wait_dialog_destroy_cb (GtkWidget *dialog, struct helper_s *helper)
+{
+  helper->dialog = NULL;
+  if (helper->exited)
+    return;
+
+  helper->canceled = TRUE;
+#ifdef G_OS_WIN32
+  TerminateProcess (helper->pid, 1);
+#else
+  kill (helper->pid, SIGTERM);
+#endif
 }
 
 static GtkWidget *
-wait_dialog (const gchar *server, GtkWidget *parent)
+wait_dialog (const gchar *server, struct helper_s *helper)
 {
   GtkWidget *dialog =
-    gtk_message_dialog_new (GTK_WINDOW (parent),
-			    GTK_DIALOG_MODAL,
-			    GTK_MESSAGE_INFO, GTK_BUTTONS_NONE,
+    gtk_message_dialog_new (GTK_WINDOW (helper->parent),
+			    GTK_DIALOG_DESTROY_WITH_PARENT,
+			    GTK_MESSAGE_INFO, GTK_BUTTONS_CANCEL,
 			    _("Connecting to server \"%s\".\n"
 			      "Please wait."), server);
-  /* FIXME: The dialog is not displayed */
+  g_signal_connect (G_OBJECT (dialog), "response",
+                    G_CALLBACK (gtk_widget_destroy), NULL);
+  g_signal_connect (G_OBJECT (dialog), "destroy",
+                    G_CALLBACK (wait_dialog_destroy_cb), helper);
   gtk_widget_show_all (dialog);
   return dialog;
 }
 
-/* Report any errors to the user. Returns TRUE if there were errors and false
- * otherwise */
-static gboolean
-check_errors (int exit_status, gchar *error_message, gchar *output_filename,
-              int version, GtkWidget *parent)
+/* Return the error for a version 1 error code of a helper.  */
+static gpg_error_t
+helper_error (gint error_code)
+{
+  switch (error_code)
+    {
+    case KEYSERVER_NOT_SUPPORTED:
+      return gpg_error (GPG_ERR_NOT_SUPPORTED);
+    case KEYSERVER_NO_MEMORY:
+      return gpg_error (GPG_ERR_ENOMEM);
+    case KEYSERVER_KEY_INCOMPLETE:
+      return gpg_error (GPG_ERR_INV_KEYRING);
+    default:
+      return gpg_error (GPG_ERR_KEYSERVER);
+    }
+}
+
+/* Report any errors to the user.  Returns the error or 0 if there
+ * was none.  */
+static gpg_error_t
+check_errors (struct helper_s *helper)
 {
+  gchar *message;
+  gpg_error_t err;
+
+  if (!helper->exit_status)
+    return 0;
+
   /* Error during connection. Try to parse the output and report the
    * error.
    */
-  if (version == 0)
+  if (helper->version == 0)
     {
       /* With Version 0 plugins, we just can't know the error, so we
        * show the error output from the plugin to the user if the process
        * ended with error */
-      if (exit_status)
-        {
-          gchar *message = g_strdup_printf (_("An error ocurred while "
-                                              "contacting the server:\n\n%s"),
-                                            error_message);
-          gpa_window_error (message, parent);
-          return TRUE;
-        }
+      message = g_strdup_printf (_("An error ocurred while "
+                                   "contacting the server:\n\n%s"),
+                                 helper->errors->str);
+      err = gpg_error (GPG_ERR_KEYSERVER);
     }
   /* If version != 0, at least try to use version 1 error codes */
-  else if (exit_status)
+  else
     {
-      gint error_code = parse_helper_output (output_filename);
       /* Not really errors */
-      if (error_code == KEYSERVER_OK ||
-          error_code == KEYSERVER_KEY_NOT_FOUND ||
-          error_code == KEYSERVER_KEY_EXISTS)
+      if (helper->error_code == KEYSERVER_OK ||
+          helper->error_code == KEYSERVER_KEY_NOT_FOUND ||
+          helper->error_code == KEYSERVER_KEY_EXISTS)
         {
-          return FALSE;
+          return 0;
         }
-      else
+      message = g_strdup_printf (_("An error ocurred while "
+                                   "contacting the server:\n\n%s"),
+                                 error_string (helper->error_code));
+      err = helper_error (helper->error_code);
+    }
+  gpa_window_error (message, helper->parent);
+  g_free (message);
+  return err;
+}
+
+static void
+remove_channel (GIOChannel **channel, guint *watch)
+{
+  if (*watch)
+    g_source_remove (*watch);
+  *watch = 0;
+  if (*channel)
+    {
+      g_io_channel_shutdown (*channel, FALSE, NULL);
+      g_io_channel_unref (*channel);
+    }
+  *channel = NULL;
+}
+
+/* Call the callback once the helper has exited and all of its output
+   has been read.  */
+static void
+maybe_finish (struct helper_s *helper)
+{
+  gpg_error_t err;
+
+  if (!helper->exited || helper->out_watch || helper->err_watch)
+    return;
+
+  /* The helper may have exited without reading all of the input.  */
+  remove_channel (&helper->in_channel, &helper->in_watch);
+  remove_channel (&helper->out_channel, &helper->out_watch);
+  remove_channel (&helper->err_channel, &helper->err_watch);
+
+  if (helper->dialog)
+    gtk_widget_destroy (helper->dialog);
+  if (helper->canceled)
+    err = gpg_error (GPG_ERR_CANCELED);
+  else
+    err = check_errors (helper);
+  if (helper->parent)
+    g_object_remove_weak_pointer (G_OBJECT (helper->parent),
+                                  (gpointer *) &helper->parent);
+
+  gpgme_data_seek (helper->output, 0, SEEK_SET);
+  helper->cb (err, helper->output, helper->opaque);
+
+  g_string_free (helper->input, TRUE);
+  g_string_free (helper->line, TRUE);
+  g_string_free (helper->errors, TRUE);
+  g_free (helper);
+}
+
+/* Look at a complete line of the helper's output.  */
+static void
+parse_output_line (struct helper_s *helper, const char *line)
+{
+  char keyid[17];
+  int version;
+  int error;
+
+  if (sscanf (line, "VERSION %d", &version) == 1)
+    helper->version = version;
+  else if (helper->error_code == KEYSERVER_GENERAL_ERROR
+           && sscanf (line, "KEY %16s FAILED %i", keyid, &error) == 2)
+    helper->error_code = error;
+}
+
+static gboolean
+helper_input_cb (GIOChannel *channel, GIOCondition condition, gpointer data)
+{
+  struct helper_s *helper = data;
+  gsize written = 0;
+  GIOStatus status = G_IO_STATUS_NORMAL;
+
+  if ((condition & G_IO_OUT) && helper->input_off < helper->input->len)
+    status = g_io_channel_write_chars (channel,
+                                       helper->input->str + helper->input_off,
+                                       helper->input->len - helper->input_off,
+                                       &written, NULL);
+  helper->input_off += written;
+
+  if (status == G_IO_STATUS_AGAIN
+      || (status == G_IO_STATUS_NORMAL
+          && helper->input_off < helper->input->len
+          && !(condition & (G_IO_ERR | G_IO_HUP))))
+    return TRUE;
+
+  /* All written or the helper does not want more.  Closing the pipe
+     tells the helper that the command is complete.  */
+  helper->in_watch = 0;
+  g_io_channel_shutdown (channel, TRUE, NULL);
+  g_io_channel_unref (channel);
+  helper->in_channel = NULL;
+  return FALSE;
+}
+
+static gboolean
+helper_output_cb (GIOChannel *channel, GIOCondition condition, gpointer data)
+{
+  struct helper_s *helper = data;
+  gboolean is_stdout = (channel == helper->out_channel);
+  char buffer[4096];
+  gsize nread = 0;
+  GIOStatus status;
+
+  status = g_io_channel_read_chars (channel, buffer, sizeof buffer,
+                                    &nread, NULL);
+  if (nread && is_stdout)
+    {
+      char *p;
+
+      gpgme_data_write (helper->output, buffer, nread);
+      g_string_append_len (helper->line, buffer, nread);
+      while ((p = memchr (helper->line->str, '\n', helper->line->len)))
         {
-          gchar *message = g_strdup_printf (_("An error ocurred while "
-                                              "contacting the server:\n\n%s"),
-                                            error_string (error_code));
-          gpa_window_error (message, parent);
-          return TRUE;
+          *p = 0;
+          parse_output_line (helper, helper->line->str);
+          g_string_erase (helper->line, 0, p - helper->line->str + 1);
         }
     }
+  else if (nread)
+    g_string_append_len (helper->errors, buffer, nread);
+
+  if (status == G_IO_STATUS_NORMAL || status == G_IO_STATUS_AGAIN)
+    return TRUE;
+
+  /* End of file or error.  */
+  if (is_stdout)
+    {
+      if (helper->line->len)
+        parse_output_line (helper, helper->line->str);
+      helper->out_watch = 0;
+    }
+  else
+    helper->err_watch = 0;
+  maybe_finish (helper);
   return FALSE;
 }
 
-/* This is a hack: when a SIGCHLD is received, close the dialog. We need a
- * global variable to pass the dialog to the signal handler. */
-#ifdef G_OS_UNIX
-GtkWidget *waiting_dlg;
 static void
-close_dialog (int sig)
+helper_exit_cb (GPid pid, gint status, gpointer data)
 {
-  gtk_dialog_response (GTK_DIALOG (waiting_dlg), GTK_RESPONSE_CLOSE);
+  struct helper_s *helper = data;
+
+  g_spawn_close_pid (pid);
+  helper->exited = TRUE;
+  helper->exit_status = status;
+  maybe_finish (helper);
 }
-#endif /*G_OS_UNIX*/
 
-/* Run the helper, and update the dialog if possible. Returns FALSE on error */
-static gboolean
-do_spawn (const gchar *scheme, const gchar *command_filename,
-          const gchar *output_filename, gchar **error_output,
-          gint *exit_status, GtkWidget *dialog)
+static GIOChannel *
+helper_channel (struct helper_s *helper, int fd, GIOCondition condition,
+                GIOFunc func, guint *watch)
 {
-  gchar *helper_argv[] = {NULL, "-o", NULL, NULL, NULL};
-  GError *error = NULL;
-#ifdef G_OS_UNIX
-  pid_t pid;
-  gint standard_error;
-  gsize length;
   GIOChannel *channel;
+
+#ifdef G_OS_WIN32
+  channel = g_io_channel_win32_new_fd (fd);
+#else
+  channel = g_io_channel_unix_new (fd);
+  g_io_channel_set_flags (channel, G_IO_FLAG_NONBLOCK, NULL);
 #endif
+  g_io_channel_set_encoding (channel, NULL, NULL);
+  g_io_channel_set_buffered (channel, FALSE);
+  g_io_channel_set_close_on_unref (channel, TRUE);
+  *watch = g_io_add_watch (channel, condition | G_IO_ERR | G_IO_HUP,
+                           func, helper);
+  return channel;
+}
 
-  /* Make sure output parameters get a sane value */
-  *error_output = NULL;
-  *exit_status = 127;
-  /* Build the command line */
-  helper_argv[0] = helper_path (scheme);
-  helper_argv[2] = (gchar*) output_filename;
-  helper_argv[3] = (gchar*) command_filename;
+/* Run the helper for SCHEME with COMMAND as its input.  Returns FALSE
+   if the helper could not be started; otherwise CB is called with the
+   output of the helper once it has finished.  */
+static gboolean
+start_helper (const gchar *server, const gchar *scheme, GString *command,
+              GtkWidget *parent, server_access_cb_t cb, gpointer opaque)
+{
+  gchar *helper_argv[] = {NULL, NULL};
+  struct helper_s *helper;
+  GError *error = NULL;
+  gint in_fd, out_fd, err_fd;
+  gpg_error_t err;
 
-  /* Invoke the keyserver helper */
-#ifdef G_OS_UNIX
-  /* On Unix, run the helper asyncronously, so that we can update the dialog */
+  /* Without arguments the helper reads the command from stdin and
+     writes to stdout.  */
+  helper_argv[0] = helper_path (scheme);
+  helper = g_new0 (struct helper_s, 1);
   g_spawn_async_with_pipes (NULL, helper_argv, NULL,
-                            G_SPAWN_STDOUT_TO_DEV_NULL|
                             G_SPAWN_DO_NOT_REAP_CHILD,
-                            NULL, NULL, &pid, NULL, NULL, &standard_error,
-                            &error);
-#else
-  /* On Windows, use syncronous spawn */
-  g_spawn_sync (NULL, helper_argv, NULL,
-		G_SPAWN_STDOUT_TO_DEV_NULL, NULL, NULL,
-		NULL, error_output, exit_status, &error);
-#endif
-
-  /* Free the helper's filename */
+                            NULL, NULL, &helper->pid,
+                            &in_fd, &out_fd, &err_fd, &error);
   g_free (helper_argv[0]);
 
   if (error)
@@ -471,146 +643,94 @@ do_spawn (const gchar *scheme, const gchar *command_filename,
       /* An error ocurred in the fork/exec: we assume that there is no plugin.
        */
       gpa_window_error (_("There is no plugin available for the keyserver\n"
-                          "protocol you specified."), dialog);
+                          "protocol you specified."), parent);
+      g_error_free (error);
+      g_string_free (command, TRUE);
+      g_free (helper);
       return FALSE;
     }
 
-#ifdef G_OS_UNIX
-  /* FIXME: Could we do this properly, without a global variable? */
-  /* We run the dialog until we get a SIGCHLD, meaning the helper has
-   * finnished, then we wait for it. */
-  waiting_dlg = dialog;
-  signal (SIGCHLD, close_dialog);
-  gtk_dialog_run (GTK_DIALOG (dialog));
-  signal (SIGCHLD, SIG_DFL);
-  wait (exit_status);
-  /* Read stderr, since we need any error message */
-  channel = g_io_channel_unix_new (standard_error);
-  g_io_channel_read_to_end (channel, error_output, &length, NULL);
-  g_io_channel_unref (channel);
-  /* Make sure the pipe is closed */
-  close (standard_error);
-#endif
-
-  return TRUE;
-}
-
-static gboolean
-invoke_helper (const gchar *server, const gchar *scheme,
-               gchar *command_filename, gchar **output_filename,
-               GtkWidget *parent)
-{
-  int exit_status;
-  int output_fd;
-  gchar *error_output;
-  GtkWidget *dialog = NULL;
-  gboolean result = TRUE;
+  err = gpgme_data_new (&helper->output);
+  if (err)
+    gpa_gpgme_error (err);
+  helper->parent = parent;
+  if (parent)
+    g_object_add_weak_pointer (G_OBJECT (parent), (gpointer *) &helper->parent);
+  helper->input = command;
+  helper->line = g_string_new (NULL);
+  helper->errors = g_string_new (NULL);
+  helper->error_code = KEYSERVER_GENERAL_ERROR;
+  helper->exit_status = 127;
+  helper->cb = cb;
+  helper->opaque = opaque;
+
+  helper->in_channel = helper_channel (helper, in_fd, G_IO_OUT,
+                                       helper_input_cb, &helper->in_watch);
+  helper->out_channel = helper_channel (helper, out_fd, G_IO_IN,
+                                        helper_output_cb, &helper->out_watch);
+  helper->err_channel = helper_channel (helper, err_fd, G_IO_IN,
+                                        helper_output_cb, &helper->err_watch);
+  g_child_watch_add (helper->pid, helper_exit_cb, helper);
 
   /* Display a pretty dialog */
-  dialog = wait_dialog (server, parent);
-  /* Open the output file */
-  output_fd = g_file_open_tmp (OUTPUT_TEMP_NAME, output_filename, NULL);
-  /* Run the helper */
-  result = do_spawn (scheme, command_filename, *output_filename, &error_output,
-                     &exit_status, dialog);
-  /* If the exec went well, check for errors in the output */
-  if (result)
-    {
-      result = !check_errors (exit_status, error_output, *output_filename,
-                              protocol_version (scheme), dialog);
-    }
-  close (output_fd);
-  g_free (error_output);
-  /* Destroy the dialog */
-  gtk_widget_destroy (dialog);
+  helper->dialog = wait_dialog (server, helper);
 
-  return result;
+  return TRUE;
 }
 
 /* Public functions */
 
 gboolean
 server_send_keys (const gchar *server, const gchar *keyid,
-                  gpgme_data_t data, GtkWidget *parent)
+                  gpgme_data_t data, GtkWidget *parent,
+                  server_access_cb_t cb, gpointer opaque)
 {
   gchar *keyserver = g_strdup (server);
-  gchar *command_filename, *output_filename;
-  int command_fd;
-  FILE *command;
-  gchar *scheme, *host, *port, *opaque;
+  GString *command;
+  gchar *scheme, *host, *port, *opaque_uri;
   gboolean success;
 
   /* Parse the URI */
-  if (!parse_keyserver_uri (keyserver, &scheme, &host, &port, &opaque))
+  if (!parse_keyserver_uri (keyserver, &scheme, &host, &port, &opaque_uri))
     {
       gpa_window_error (_("The keyserver you specified is not valid"), parent);
+      g_free (keyserver);
       return FALSE;
     }
-  /* Create a temp command file */
-  command_fd = g_file_open_tmp (COMMAND_TEMP_NAME, &command_filename, NULL);
-  command = fdopen (command_fd, "w");
-  /* Write the command to the file */
-  write_command (command, scheme, host, port, opaque, "SEND");
-  /* Write the keys to the file */
-  fprintf (command, "\nKEY %s BEGIN\n", keyid);
-  dump_data_to_file (data, command);
-  fprintf (command, "\nKEY %s END\n", keyid);
-  fclose (command);
-  success = invoke_helper (server, scheme, command_filename,
-                           &output_filename, parent);
+  command = g_string_new (NULL);
+  write_command (command, scheme, host, port, opaque_uri, "SEND");
+  /* Append the keys */
+  g_string_append_printf (command, "\nKEY %s BEGIN\n", keyid);
+  append_data (command, data);
+  g_string_append_printf (command, "\nKEY %s END\n", keyid);
+  success = start_helper (server, scheme, command, parent, cb, opaque);
   g_free (keyserver);
-  /* Delete temp files */
-  unlink (command_filename);
-  g_free (command_filename);
-  unlink (output_filename);
-  g_free (output_filename);
 
   return success;
 }
 
 gboolean
 server_get_key (const gchar *server, const gchar *keyid,
-                gpgme_data_t *data, GtkWidget *parent)
+                GtkWidget *parent, server_access_cb_t cb, gpointer opaque)
 {
   gchar *keyserver = g_strdup (server);
-  gchar *command_filename, *output_filename;
-  int command_fd;
-  FILE *command;
-  gchar *scheme, *host, *port, *opaque;
-  int success;
-  gpg_error_t err;
+  GString *command;
+  gchar *scheme, *host, *port, *opaque_uri;
+  gboolean success;
 
   /* Parse the URI */
-  if (!parse_keyserver_uri (keyserver, &scheme, &host, &port, &opaque))
+  if (!parse_keyserver_uri (keyserver, &scheme, &host, &port, &opaque_uri))
     {
-      /* Create an empty gpgme_data_t, so that we always return a valid one */
-      err = gpgme_data_new (data);
-      if (err)
-        gpa_gpgme_error (err);
       gpa_window_error (_("The keyserver you specified is not valid"), parent);
+      g_free (keyserver);
       return FALSE;
     }
-  /* Create a temp command file */
-  command_fd = g_file_open_tmp (COMMAND_TEMP_NAME, &command_filename, NULL);
-  command = fdopen (command_fd, "w");
-  /* Write the command to the file */
-  write_command (command, scheme, host, port, opaque, "GET");
-  /* Write the keys to the file */
-  fprintf (command, "0x%s\n", keyid);
-  fclose (command);
-  success = invoke_helper (server, scheme, command_filename,
-                           &output_filename, parent);
-  /* Read the output */
-  /* No error checking: the import will take care of that. */
-  err = gpa_gpgme_data_new_from_file (data, output_filename, parent);
-  if (err)
-    gpa_gpgme_error (err);
+  command = g_string_new (NULL);
+  write_command (command, scheme, host, port, opaque_uri, "GET");
+  /* Append the key */
+  g_string_append_printf (command, "0x%s\n", keyid);
+  success = start_helper (server, scheme, command, parent, cb, opaque);
   g_free (keyserver);
-  /* Delete temp files */
-  unlink (command_filename);
-  g_free (command_filename);
-  unlink (output_filename);
-  g_free (output_filename);
 
   return success;
 }
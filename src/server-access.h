@@ -29,14 +29,29 @@
 #include <gpgme.h>
 #include "gpa.h"
 
-/* Send the keys in NULL terminated array KEYS to the keyserver SERVER.
- * The PARENT window is used as parent for any dialog the function displays.
+/* The function called when a keyserver helper has finished.  ERR is
+ * 0 if the helper succeeded and GPG_ERR_CANCELED if the user closed
+ * the wait dialog; other errors have already been shown to the user.
+ * DATA holds the output of the helper and belongs to the callee.
+ */
+typedef void (*server_access_cb_t) (gpg_error_t err, gpgme_data_t data,
+                                    gpointer opaque);
+
+/* Send the exported keys in DATA to the keyserver SERVER.  KEYID is
+ * used to label them.  The PARENT window is used as parent for any
+ * dialog the function displays.  Returns FALSE if the helper could
+ * not be started; otherwise CB is called with OPAQUE when it is done.
  */
 gboolean server_send_keys (const gchar *server, const gchar *keyid,
-		       gpgme_data_t data, GtkWidget *parent);
+		           gpgme_data_t data, GtkWidget *parent,
+                           server_access_cb_t cb, gpointer opaque);
 
+/* Retrieve the key KEYID from the keyserver SERVER.  As above, but
+ * the key is passed to CB.
+ */
 gboolean server_get_key (const gchar *server, const gchar *keyid,
-                         gpgme_data_t *data, GtkWidget *parent);
+                         GtkWidget *parent,
+                         server_access_cb_t cb, gpointer opaque);
 
 #endif /*ENABLE_KEYSERVER_SUPPORT*/
 #endif /*SERVER_ACCESS_H*/
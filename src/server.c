@@ -46,6 +46,8 @@
 #include "gpafiledecryptop.h"
 #include "gpafileverifyop.h"
 #include "gpafileimportop.h"
+#include "gpatrace.h"
+#include "keyref.h"
 
 
 #define set_error(e,t) assuan_set_error (ctx, gpg_error (e), (t))
@@ -169,6 +171,30 @@ has_option (const char *line, const char *name)
   return (s && (s == line || spacep (s-1)) && (!s[n] || spacep (s+n)));
 }
 
+/* Return the value of the option NAME from LINE as a malloced and
+   percent-decoded string.  Returns NULL if the option is not given
+   or has no value.  For example with NAME being "--manifest" this
+   returns "foo bar" for "--manifest=foo%20bar".  */
+static char *
+get_option_value (const char *line, const char *name)
+{
+  const char *s;
+  char *value;
+  int n;
+
+  s = has_option_name (line, name);
+  if (!s || *s != '=')
+    return NULL;
+  s++;
+  for (n = 0; s[n] && !spacep (s + n); n++)
+    ;
+  if (!n)
+    return NULL;
+  value = g_strndup (s, n);
+  decode_percent_string (value);
+  return value;
+}
+
 /* Skip over options. */
 static char *
 skip_options (char *line)
@@ -360,7 +386,7 @@ release_keys (gpgme_key_t *keys)
       int idx;
 
       for (idx=0; keys[idx]; idx++)
-        gpgme_key_unref (keys[idx]);
+        gpa_key_unref (keys[idx], GPA_KEY_OWNER_SERVER);
       g_free (keys);
     }
 }
@@ -395,6 +421,25 @@ parse_protocol_option (assuan_context_t ctx, char *line, int mandatory,
 }
 
 
+/* Helper to parse a compression policy option.  */
+static gpg_error_t
+parse_compress_option (assuan_context_t ctx, const char *line,
+                       gpa_compress_policy_t *r_policy)
+{
+  *r_policy = GPA_COMPRESS_AUTO;
+  if (has_option (line, "--compress=auto"))
+    *r_policy = GPA_COMPRESS_AUTO;
+  else if (has_option (line, "--compress=always"))
+    *r_policy = GPA_COMPRESS_ALWAYS;
+  else if (has_option (line, "--compress=never"))
+    *r_policy = GPA_COMPRESS_NEVER;
+  else if (has_option_name (line, "--compress"))
+    return set_error (GPG_ERR_ASS_PARAMETER, "invalid compression policy");
+
+  return 0;
+}
+
+
 static void
 close_message_fd (conn_ctrl_t ctrl)
 {
@@ -662,20 +707,26 @@ cont_encrypt (assuan_context_t ctx, gpg_error_t err)
 
 
 static const char hlp_encrypt[] =
-  "ENCRYPT --protocol=OpenPGP|CMS\n"
+  "ENCRYPT --protocol=OpenPGP|CMS [--compress=auto|always|never]\n"
   "\n"
-  "Encrypt the data received on INPUT to OUTPUT.";
+  "Encrypt the data received on INPUT to OUTPUT.  With --compress=never\n"
+  "the data is not compressed before encryption; this saves time for\n"
+  "data which is already compressed.";
 static gpg_error_t
 cmd_encrypt (assuan_context_t ctx, char *line)
 {
   conn_ctrl_t ctrl = assuan_get_pointer (ctx);
   gpg_error_t err;
   gpgme_protocol_t protocol = 0;
+  gpa_compress_policy_t compress;
   GpaStreamEncryptOperation *op;
   gpgme_data_t input_data = NULL;
   gpgme_data_t output_data = NULL;
 
   err = parse_protocol_option (ctx, line, 1, &protocol);
+  if (err)
+    goto leave;
+  err = parse_compress_option (ctx, line, &compress);
   if (err)
     goto leave;
 
@@ -705,6 +756,7 @@ cmd_encrypt (assuan_context_t ctx, char *line)
                                          ctrl->recipients,
                                          ctrl->recipient_keys,
                                          protocol, 0);
+  gpa_stream_encrypt_operation_set_compress (op, compress);
   input_data = output_data = NULL;
   g_signal_connect_swapped (G_OBJECT (op), "completed",
 			    G_CALLBACK (run_server_continuation), ctx);
@@ -742,6 +794,16 @@ cont_prep_encrypt (assuan_context_t ctx, gpg_error_t err)
       ctrl->recipient_keys = gpa_stream_encrypt_operation_get_keys
         (GPA_STREAM_ENCRYPT_OPERATION (ctrl->gpa_op),
          &ctrl->selected_protocol);
+#ifdef ENABLE_KEY_ACCOUNTING
+      if (ctrl->recipient_keys)
+        {
+          int idx;
+
+          for (idx=0; ctrl->recipient_keys[idx]; idx++)
+            gpa_key_transfer (ctrl->recipient_keys[idx],
+                              GPA_KEY_OWNER_OTHER, GPA_KEY_OWNER_SERVER);
+        }
+#endif /*ENABLE_KEY_ACCOUNTING*/
 
       if (ctrl->recipient_keys)
         g_print ("received some keys\n");
@@ -1230,7 +1292,10 @@ static const char hlp_getinfo[] =
   "\n"
   "  version     - Return the version of the program.\n"
   "  name        - Return the name of the program\n"
-  "  pid         - Return the process id of the server.";
+  "  pid         - Return the process id of the server.\n"
+  "  startup     - Return the startup phases with their durations.\n"
+  "  keyrefs     - Return the live key references if the key\n"
+  "                accounting has been enabled at build time.";
 static gpg_error_t
 cmd_getinfo (assuan_context_t ctx, char *line)
 {
@@ -1253,6 +1318,21 @@ cmd_getinfo (assuan_context_t ctx, char *line)
       const char *s = PACKAGE_NAME;
       err = assuan_send_data (ctx, s, strlen (s));
     }
+  else if (!strcmp (line, "startup"))
+    {
+      char *s = gpa_startup_report ();
+      err = assuan_send_data (ctx, s, strlen (s));
+      g_free (s);
+    }
+  else if (!strcmp (line, "keyrefs"))
+    {
+      char *s = gpa_keyref_report ();
+      if (s)
+        err = assuan_send_data (ctx, s, strlen (s));
+      else
+        err = set_error (GPG_ERR_NOT_ENABLED, "key accounting not enabled");
+      g_free (s);
+    }
   else
     err = set_error (GPG_ERR_ASS_PARAMETER, "unknown value for WHAT");
 
@@ -1294,21 +1374,163 @@ cmd_file (assuan_context_t ctx, char *line)
 }
 
 
-/* Encrypt or sign files.  If neither ENCR nor SIGN is set, import
-   files. */
+/* Options common to the file operation commands.  */
+struct file_op_options_s
+{
+  /* --manifest=FILE: Skip files unchanged since the last run.  */
+  char *manifest;
+  /* --journal=FILE: Record the finished files in FILE.  */
+  char *journal;
+  /* --resume: Skip the files already finished according to the
+     journal.  */
+  int resume;
+  /* --continue-on-error: Do not abort the batch if a file fails.  */
+  int continue_on_error;
+  /* --compress=auto|always|never: The compression policy for
+     encryption.  */
+  gpa_compress_policy_t compress;
+  /* --conflict=ask|overwrite|skip|rename|fail: What to do with
+     existing output files.  */
+  gpa_conflict_policy_t conflict;
+};
+typedef struct file_op_options_s *file_op_options_t;
+
+
+/* Parse the file operation options from LINE into OPTS.  OPTS must
+   be released even on error.  */
 static gpg_error_t
-impl_encrypt_sign_files (assuan_context_t ctx, int encr, int sign)
+parse_file_op_options (assuan_context_t ctx, const char *line,
+                       file_op_options_t opts)
+{
+  memset (opts, 0, sizeof *opts);
+  opts->manifest = get_option_value (line, "--manifest");
+  opts->journal = get_option_value (line, "--journal");
+  opts->resume = has_option (line, "--resume");
+  opts->continue_on_error = has_option (line, "--continue-on-error");
+  opts->conflict = GPA_CONFLICT_ASK;
+  if (has_option_name (line, "--conflict"))
+    {
+      char *value = get_option_value (line, "--conflict");
+      gboolean okay;
+
+      okay = gpa_conflict_policy_from_string (value, &opts->conflict);
+      xfree (value);
+      if (!okay)
+        return set_error (GPG_ERR_ASS_PARAMETER, "invalid conflict policy");
+    }
+  return parse_compress_option (ctx, line, &opts->compress);
+}
+
+
+static void
+release_file_op_options (file_op_options_t opts)
+{
+  g_free (opts->manifest);
+  g_free (opts->journal);
+}
+
+
+/* Check the file operation options OPTS for an operation of type
+   KIND for consistency and, if no files have been given but a
+   journal is to be resumed, take the files from that journal.  The
+   journal is opened and stored at R_JOURNAL, so that no operation is
+   created if that fails.  */
+static gpg_error_t
+check_file_op_options (assuan_context_t ctx, file_op_options_t opts,
+                       const char *kind, gpa_journal_t *r_journal)
 {
-  gpg_error_t err = 0;
   conn_ctrl_t ctrl = assuan_get_pointer (ctx);
-  GpaFileOperation *op;
+
+  *r_journal = NULL;
+  if (opts->resume && !opts->journal)
+    return set_error (GPG_ERR_ASS_PARAMETER, "--resume requires --journal");
+
+  if (opts->resume)
+    {
+      char *journal_kind;
+      GList *files;
+      int mismatch;
+
+      /* A journal which does not yet exist is created.  */
+      if (! gpa_journal_read_job (opts->journal, &journal_kind, &files))
+        {
+          mismatch = strcmp (journal_kind, kind);
+          g_free (journal_kind);
+          if (mismatch || ctrl->files)
+            {
+              g_list_foreach (files, (GFunc) free_file_item, NULL);
+              g_list_free (files);
+            }
+          else
+            ctrl->files = files;
+          if (mismatch)
+            return set_error (GPG_ERR_CONFLICT,
+                              "journal is of another operation");
+        }
+    }
 
   if (! ctrl->files)
+    return set_error (GPG_ERR_ASS_SYNTAX, "no files specified");
+
+  if (opts->journal)
     {
-      err = set_error (GPG_ERR_ASS_SYNTAX, "no files specified");
-      return assuan_process_done (ctx, err);
+      *r_journal = gpa_journal_open (opts->journal, kind, ctrl->files,
+                                     opts->resume);
+      if (! *r_journal)
+        return set_error (GPG_ERR_GENERAL, "error opening journal");
     }
 
+  return 0;
+}
+
+
+/* Apply the file operation options OPTS and the JOURNAL opened by
+   check_file_op_options to the operation OP.  */
+static void
+apply_file_op_options (GpaFileOperation *op, file_op_options_t opts,
+                       gpa_journal_t journal)
+{
+  if (opts->manifest)
+    gpa_file_operation_set_manifest (op, opts->manifest);
+  if (journal)
+    gpa_file_operation_take_journal (op, journal, FALSE);
+  gpa_file_operation_set_continue_on_error (op, opts->continue_on_error);
+  gpa_file_operation_set_conflict_policy (op, opts->conflict);
+  if (GPA_IS_FILE_ENCRYPT_OPERATION (op))
+    gpa_file_encrypt_operation_set_compress (GPA_FILE_ENCRYPT_OPERATION (op),
+                                             opts->compress);
+}
+
+
+
+/* Encrypt or sign files.  If neither ENCR nor SIGN is set, import
+   files.  OPTS are the file operation options or NULL.  */
+static gpg_error_t
+impl_encrypt_sign_files (assuan_context_t ctx, int encr, int sign,
+                         file_op_options_t opts)
+{
+  gpg_error_t err = 0;
+  conn_ctrl_t ctrl = assuan_get_pointer (ctx);
+  GpaFileOperation *op;
+  gpa_journal_t journal = NULL;
+  const char *kind;
+
+  if (encr && sign)
+    kind = "encrypt-sign";
+  else if (encr)
+    kind = "encrypt";
+  else if (sign)
+    kind = "sign";
+  else
+    kind = "import";
+
+  if (opts)
+    err = check_file_op_options (ctx, opts, kind, &journal);
+  else if (! ctrl->files)
+    err = set_error (GPG_ERR_ASS_SYNTAX, "no files specified");
+  if (err)
+    return assuan_process_done (ctx, err);
+
   /* FIXME: Needs a root window.  Need to set "sign" default.  */
   if (encr && sign)
     op = (GpaFileOperation *)
@@ -1325,6 +1547,8 @@ impl_encrypt_sign_files (assuan_context_t ctx, int encr, int sign)
 
   /* Ownership of CTRL->files was passed to callee.  */
   ctrl->files = NULL;
+  if (opts)
+    apply_file_op_options (op, opts, journal);
   g_signal_connect (G_OBJECT (op), "completed",
 		    G_CALLBACK (g_object_unref), NULL);
 
@@ -1332,11 +1556,14 @@ impl_encrypt_sign_files (assuan_context_t ctx, int encr, int sign)
 }
 
 
-/* ENCRYPT_FILES --nohup  */
+/* ENCRYPT_FILES --nohup [--manifest=FILE]
+                 [--journal=FILE [--resume]] [--continue-on-error]
+                 [--compress=auto|always|never] [--conflict=POLICY]  */
 static gpg_error_t
 cmd_encrypt_files (assuan_context_t ctx, char *line)
 {
   gpg_error_t err;
+  struct file_op_options_s opts;
 
   if (! has_option (line, "--nohup"))
     {
@@ -1344,22 +1571,27 @@ cmd_encrypt_files (assuan_context_t ctx, char *line)
       return assuan_process_done (ctx, err);
     }
 
+  err = parse_file_op_options (ctx, line, &opts);
   line = skip_options (line);
-  if (*line)
-    {
-      err = set_error (GPG_ERR_ASS_SYNTAX, NULL);
-      return assuan_process_done (ctx, err);
-    }
-
-  return impl_encrypt_sign_files (ctx, 1, 0);
+  if (!err && *line)
+    err = set_error (GPG_ERR_ASS_SYNTAX, NULL);
+  if (err)
+    err = assuan_process_done (ctx, err);
+  else
+    err = impl_encrypt_sign_files (ctx, 1, 0, &opts);
+  release_file_op_options (&opts);
+  return err;
 }
 
 
-/* SIGN_FILES --nohup  */
+/* SIGN_FILES --nohup [--manifest=FILE]
+              [--journal=FILE [--resume]] [--continue-on-error]
+              [--conflict=POLICY]  */
 static gpg_error_t
 cmd_sign_files (assuan_context_t ctx, char *line)
 {
   gpg_error_t err;
+  struct file_op_options_s opts;
 
   if (! has_option (line, "--nohup"))
     {
@@ -1367,22 +1599,27 @@ cmd_sign_files (assuan_context_t ctx, char *line)
       return assuan_process_done (ctx, err);
     }
 
+  err = parse_file_op_options (ctx, line, &opts);
   line = skip_options (line);
-  if (*line)
-    {
-      err = set_error (GPG_ERR_ASS_SYNTAX, NULL);
-      return assuan_process_done (ctx, err);
-    }
-
-  return impl_encrypt_sign_files (ctx, 0, 1);
+  if (!err && *line)
+    err = set_error (GPG_ERR_ASS_SYNTAX, NULL);
+  if (err)
+    err = assuan_process_done (ctx, err);
+  else
+    err = impl_encrypt_sign_files (ctx, 0, 1, &opts);
+  release_file_op_options (&opts);
+  return err;
 }
 
-
-/* ENCRYPT_SIGN_FILES --nohup  */
+
+/* ENCRYPT_SIGN_FILES --nohup [--manifest=FILE]
+                      [--journal=FILE [--resume]] [--continue-on-error]
+                      [--compress=auto|always|never] [--conflict=POLICY]  */
 static gpg_error_t
 cmd_encrypt_sign_files (assuan_context_t ctx, char *line)
 {
   gpg_error_t err;
+  struct file_op_options_s opts;
 
   if (! has_option (line, "--nohup"))
     {
@@ -1390,29 +1627,42 @@ cmd_encrypt_sign_files (assuan_context_t ctx, char *line)
       return assuan_process_done (ctx, err);
     }
 
+  err = parse_file_op_options (ctx, line, &opts);
   line = skip_options (line);
-  if (*line)
-    {
-      err = set_error (GPG_ERR_ASS_SYNTAX, NULL);
-      return assuan_process_done (ctx, err);
-    }
-
-  return impl_encrypt_sign_files (ctx, 1, 1);
+  if (!err && *line)
+    err = set_error (GPG_ERR_ASS_SYNTAX, NULL);
+  if (err)
+    err = assuan_process_done (ctx, err);
+  else
+    err = impl_encrypt_sign_files (ctx, 1, 1, &opts);
+  release_file_op_options (&opts);
+  return err;
 }
 
 
 static gpg_error_t
-impl_decrypt_verify_files (assuan_context_t ctx, int decrypt, int verify)
+impl_decrypt_verify_files (assuan_context_t ctx, int decrypt, int verify,
+                           file_op_options_t opts)
 {
   gpg_error_t err = 0;
   conn_ctrl_t ctrl = assuan_get_pointer (ctx);
   GpaFileOperation *op;
+  gpa_journal_t journal = NULL;
+  const char *kind;
 
-  if (! ctrl->files)
-    {
-      err = set_error (GPG_ERR_ASS_SYNTAX, "no files specified");
-      return assuan_process_done (ctx, err);
-    }
+  if (decrypt && verify)
+    kind = "decrypt-verify";
+  else if (decrypt)
+    kind = "decrypt";
+  else
+    kind = "verify";
+
+  if (opts)
+    err = check_file_op_options (ctx, opts, kind, &journal);
+  else if (! ctrl->files)
+    err = set_error (GPG_ERR_ASS_SYNTAX, "no files specified");
+  if (err)
+    return assuan_process_done (ctx, err);
 
   /* FIXME: Needs a root window.  Need to enable "verify".  */
   if (decrypt && verify)
@@ -1427,6 +1677,8 @@ impl_decrypt_verify_files (assuan_context_t ctx, int decrypt, int verify)
 
   /* Ownership of CTRL->files was passed to callee.  */
   ctrl->files = NULL;
+  if (opts)
+    apply_file_op_options (op, opts, journal);
   g_signal_connect (G_OBJECT (op), "completed",
 		    G_CALLBACK (g_object_unref), NULL);
 
@@ -1434,11 +1686,13 @@ impl_decrypt_verify_files (assuan_context_t ctx, int decrypt, int verify)
 }
 
 
-/* DECRYPT_FILES --nohup  */
+/* DECRYPT_FILES --nohup [--journal=FILE [--resume]]
+                 [--continue-on-error] [--conflict=POLICY]  */
 static gpg_error_t
 cmd_decrypt_files (assuan_context_t ctx, char *line)
 {
   gpg_error_t err;
+  struct file_op_options_s opts;
 
   if (! has_option (line, "--nohup"))
     {
@@ -1446,14 +1700,16 @@ cmd_decrypt_files (assuan_context_t ctx, char *line)
       return assuan_process_done (ctx, err);
     }
 
+  err = parse_file_op_options (ctx, line, &opts);
   line = skip_options (line);
-  if (*line)
-    {
-      err = set_error (GPG_ERR_ASS_SYNTAX, NULL);
-      return assuan_process_done (ctx, err);
-    }
-
-  return impl_decrypt_verify_files (ctx, 1, 0);
+  if (!err && *line)
+    err = set_error (GPG_ERR_ASS_SYNTAX, NULL);
+  if (err)
+    err = assuan_process_done (ctx, err);
+  else
+    err = impl_decrypt_verify_files (ctx, 1, 0, &opts);
+  release_file_op_options (&opts);
+  return err;
 }
 
 
@@ -1476,15 +1732,17 @@ cmd_verify_files (assuan_context_t ctx, char *line)
       return assuan_process_done (ctx, err);
     }
 
-  return impl_decrypt_verify_files (ctx, 0, 1);
+  return impl_decrypt_verify_files (ctx, 0, 1, NULL);
 }
 
-
-/* DECRYPT_VERIFY_FILES --nohup  */
+
+/* DECRYPT_VERIFY_FILES --nohup [--journal=FILE [--resume]]
+                        [--continue-on-error] [--conflict=POLICY]  */
 static gpg_error_t
 cmd_decrypt_verify_files (assuan_context_t ctx, char *line)
 {
   gpg_error_t err;
+  struct file_op_options_s opts;
 
   if (! has_option (line, "--nohup"))
     {
@@ -1492,16 +1750,19 @@ cmd_decrypt_verify_files (assuan_context_t ctx, char *line)
       return assuan_process_done (ctx, err);
     }
 
+  err = parse_file_op_options (ctx, line, &opts);
   line = skip_options (line);
-  if (*line)
-    {
-      err = set_error (GPG_ERR_ASS_SYNTAX, NULL);
-      return assuan_process_done (ctx, err);
-    }
-
-  return impl_decrypt_verify_files (ctx, 1, 1);
+  if (!err && *line)
+    err = set_error (GPG_ERR_ASS_SYNTAX, NULL);
+  if (err)
+    err = assuan_process_done (ctx, err);
+  else
+    err = impl_decrypt_verify_files (ctx, 1, 1, &opts);
+  release_file_op_options (&opts);
+  return err;
 }
 
+
 
 /* IMPORT_FILES --nohup  */
 static gpg_error_t
@@ -1522,7 +1783,7 @@ cmd_import_files (assuan_context_t ctx, char *line)
       return assuan_process_done (ctx, err);
     }
 
-  return impl_encrypt_sign_files (ctx, 0, 0);
+  return impl_encrypt_sign_files (ctx, 0, 0, NULL);
 }
 
 
@@ -1728,6 +1989,7 @@ connection_startup (assuan_fd_t fd)
   assuan_set_log_stream (ctx, stderr);
   assuan_register_reset_notify (ctx, reset_notify);
   assuan_register_output_notify (ctx, output_notify);
+  gpa_trace_server (ctx);
   ctrl->message_fd = -1;
 
   connection_counter++;
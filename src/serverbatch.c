@@ -0,0 +1,357 @@
+/* serverbatch.c - Run batches of keyserver requests.
+   Copyright (C) 2026 g10 Code GmbH
+
+   This file is part of GPA.
+
+   GPA is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   GPA is distributed in the hope that it will be useful, but WITHOUT
+   ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+   or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public
+   License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, see <http://www.gnu.org/licenses/>.  */
+
+/*
+   The queued requests are started in order whenever a slot is free
+   and the rate limit allows it; if it does not, a timeout continues
+   once the minimum interval has passed.  The number of slots is
+   fixed when the scheduler starts running.  Canceling and the
+   callbacks may release the scheduler while one of its functions is
+   still running; the release is then deferred until that function
+   returns.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <string.h>
+
+#include <glib.h>
+
+#include "gpa.h"
+#include "serverbatch.h"
+
+
+/* One queued request.  */
+struct job_s
+{
+  gpgme_key_t *keys;    /* NULL terminated array of the keys.  */
+  guint count;
+};
+
+/* One context for running requests.  */
+struct slot_s
+{
+  gpa_server_batch_t batch;
+  GpaContext *context;
+  struct job_s *job;    /* The running request or NULL.  */
+};
+
+struct gpa_server_batch_s
+{
+  gpa_server_batch_start_t start_cb;
+  gpa_server_batch_done_t done_cb;
+  gpa_server_batch_finish_t finish_cb;
+  void *opaque;
+
+  GQueue jobs;
+  struct slot_s *slots;
+  guint nslots;
+  guint running;
+
+  guint batch_size;
+  guint interval;       /* Minimum time between two requests in ms.  */
+  gint64 last_start;
+  guint timeout_id;
+
+  gboolean canceled;
+  gboolean finished;
+
+  /* Defer the release while a function of the scheduler runs.  */
+  guint busy;
+  gboolean released;
+};
+
+
+static void schedule (gpa_server_batch_t batch);
+
+
+static struct job_s *
+new_job (gpgme_key_t *keys, guint count)
+{
+  struct job_s *job = g_new0 (struct job_s, 1);
+
+  job->keys = g_new0 (gpgme_key_t, count + 1);
+  memcpy (job->keys, keys, count * sizeof *keys);
+  job->count = count;
+
+  return job;
+}
+
+
+static void
+free_job (struct job_s *job)
+{
+  if (!job)
+    return;
+  g_free (job->keys);
+  g_free (job);
+}
+
+
+static void
+destroy (gpa_server_batch_t batch)
+{
+  struct job_s *job;
+  guint i;
+
+  if (batch->timeout_id)
+    g_source_remove (batch->timeout_id);
+  for (i = 0; i < batch->nslots; i++)
+    {
+      free_job (batch->slots[i].job);
+      g_object_unref (batch->slots[i].context);
+    }
+  g_free (batch->slots);
+  while ((job = g_queue_pop_head (&batch->jobs)))
+    free_job (job);
+  g_free (batch);
+}
+
+
+/* Mark BATCH as busy, so that releasing it is deferred.  */
+static void
+hold (gpa_server_batch_t batch)
+{
+  batch->busy++;
+}
+
+
+/* Undo hold and do a deferred release.  */
+static void
+unhold (gpa_server_batch_t batch)
+{
+  if (!--batch->busy && batch->released)
+    destroy (batch);
+}
+
+
+/* Create a new scheduler calling START_CB, DONE_CB and FINISH_CB
+   with OPAQUE.  */
+gpa_server_batch_t
+gpa_server_batch_new (gpa_server_batch_start_t start_cb,
+                      gpa_server_batch_done_t done_cb,
+                      gpa_server_batch_finish_t finish_cb, void *opaque)
+{
+  GpaOptions *options = gpa_options_get_instance ();
+  gpa_server_batch_t batch;
+  guint rate;
+
+  batch = g_malloc0 (sizeof *batch);
+  batch->start_cb = start_cb;
+  batch->done_cb = done_cb;
+  batch->finish_cb = finish_cb;
+  batch->opaque = opaque;
+  g_queue_init (&batch->jobs);
+
+  batch->batch_size = MAX (1, gpa_options_get_keyserver_batch_size (options));
+  rate = gpa_options_get_keyserver_rate (options);
+  batch->interval = rate? 60000 / rate : 0;
+
+  return batch;
+}
+
+
+/* Release BATCH.  Running requests are not canceled.  */
+void
+gpa_server_batch_release (gpa_server_batch_t batch)
+{
+  if (!batch)
+    return;
+
+  if (batch->busy)
+    batch->released = TRUE;
+  else
+    destroy (batch);
+}
+
+
+/* Queue requests for the COUNT keys at KEYS.  */
+void
+gpa_server_batch_add_keys (gpa_server_batch_t batch,
+                           gpgme_key_t *keys, guint count)
+{
+  guint i;
+
+  for (i = 0; i < count; i += batch->batch_size)
+    g_queue_push_tail (&batch->jobs,
+                       new_job (keys + i, MIN (batch->batch_size,
+                                               count - i)));
+}
+
+
+/* Queue one request for each of the COUNT keys at KEYS before all
+   other requests.  */
+void
+gpa_server_batch_retry_keys (gpa_server_batch_t batch,
+                             gpgme_key_t *keys, guint count)
+{
+  guint i;
+
+  for (i = count; i > 0; i--)
+    g_queue_push_head (&batch->jobs, new_job (&keys[i-1], 1));
+}
+
+
+/* Pass the result of the JOB to the done callback and release it.  */
+static void
+job_done (gpa_server_batch_t batch, GpaContext *context,
+          struct job_s *job, gpg_error_t err)
+{
+  batch->done_cb (context, job->keys, job->count, err, batch->opaque);
+  free_job (job);
+}
+
+
+static void
+slot_done_cb (GpaContext *context, gpg_error_t err, struct slot_s *slot)
+{
+  gpa_server_batch_t batch = slot->batch;
+  struct job_s *job = slot->job;
+
+  hold (batch);
+  slot->job = NULL;
+  batch->running--;
+  job_done (batch, context, job, err);
+  schedule (batch);
+  unhold (batch);
+}
+
+
+static gboolean
+rate_timeout_cb (gpointer data)
+{
+  gpa_server_batch_t batch = data;
+
+  batch->timeout_id = 0;
+  hold (batch);
+  schedule (batch);
+  unhold (batch);
+
+  return FALSE;
+}
+
+
+/* Start requests until all slots are busy or the rate limit is hit.
+   Calls the finish callback when nothing is left to do.  The caller
+   must hold BATCH.  */
+static void
+schedule (gpa_server_batch_t batch)
+{
+  while (!batch->canceled && !g_queue_is_empty (&batch->jobs)
+         && batch->running < batch->nslots)
+    {
+      struct slot_s *slot = NULL;
+      gint64 now = g_get_monotonic_time ();
+      gpg_error_t err;
+      guint i;
+
+      if (batch->interval && batch->last_start
+          && now - batch->last_start < (gint64) batch->interval * 1000)
+        {
+          if (!batch->timeout_id)
+            batch->timeout_id = g_timeout_add
+              (batch->interval - (now - batch->last_start) / 1000,
+               rate_timeout_cb, batch);
+          return;
+        }
+
+      for (i = 0; i < batch->nslots; i++)
+        if (!batch->slots[i].job)
+          {
+            slot = &batch->slots[i];
+            break;
+          }
+      g_assert (slot);
+
+      slot->job = g_queue_pop_head (&batch->jobs);
+      batch->last_start = now;
+      err = batch->start_cb (slot->context, slot->job->keys, batch->opaque);
+      if (err)
+        {
+          struct job_s *job = slot->job;
+
+          slot->job = NULL;
+          job_done (batch, NULL, job, err);
+        }
+      else
+        batch->running++;
+    }
+
+  if (!batch->running && !batch->finished
+      && (batch->canceled || g_queue_is_empty (&batch->jobs)))
+    {
+      if (batch->timeout_id)
+        {
+          g_source_remove (batch->timeout_id);
+          batch->timeout_id = 0;
+        }
+      batch->finished = TRUE;
+      batch->finish_cb (batch->opaque);
+    }
+}
+
+
+/* Start running the queued requests.  */
+void
+gpa_server_batch_run (gpa_server_batch_t batch)
+{
+  GpaOptions *options = gpa_options_get_instance ();
+  guint i;
+
+  /* No need for more slots than requests.  */
+  batch->nslots = MAX (1, gpa_options_get_keyserver_concurrency (options));
+  batch->nslots = MIN (batch->nslots,
+                       MAX (1, g_queue_get_length (&batch->jobs)));
+  batch->slots = g_new0 (struct slot_s, batch->nslots);
+  for (i = 0; i < batch->nslots; i++)
+    {
+      batch->slots[i].batch = batch;
+      batch->slots[i].context = gpa_context_new ();
+      g_signal_connect (G_OBJECT (batch->slots[i].context), "done",
+                        G_CALLBACK (slot_done_cb), &batch->slots[i]);
+    }
+
+  hold (batch);
+  schedule (batch);
+  unhold (batch);
+}
+
+
+/* Cancel the running requests and don't start new ones.  */
+void
+gpa_server_batch_cancel (gpa_server_batch_t batch)
+{
+  guint i;
+
+  if (batch->canceled)
+    return;
+  batch->canceled = TRUE;
+
+  /* Canceling may call the callbacks right away.  */
+  hold (batch);
+  for (i = 0; i < batch->nslots; i++)
+    if (batch->slots[i].job)
+      gpgme_cancel (batch->slots[i].context->ctx);
+
+  /* Finish at once if we are only waiting for the rate limit.  */
+  if (batch->slots && !batch->running)
+    schedule (batch);
+  unhold (batch);
+}
@@ -0,0 +1,79 @@
+/* serverbatch.h - Run batches of keyserver requests.
+   Copyright (C) 2026 g10 Code GmbH
+
+   This file is part of GPA.
+
+   GPA is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   GPA is distributed in the hope that it will be useful, but WITHOUT
+   ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+   or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public
+   License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, see <http://www.gnu.org/licenses/>.  */
+
+#ifndef SERVERBATCH_H
+#define SERVERBATCH_H
+
+#include <glib.h>
+#include <gpgme.h>
+
+#include "gpacontext.h"
+
+/* A scheduler for keyserver requests on groups of keys.  The keys
+   are split into groups of keyserver-batch-size keys; up to
+   keyserver-concurrency requests run at the same time, each with
+   its own context, and at most keyserver-rate requests are started
+   per minute.  The scheduler does not take references to the keys;
+   they must be kept alive by its owner.  */
+typedef struct gpa_server_batch_s *gpa_server_batch_t;
+
+/* Start the request for the NULL terminated array KEYS in
+   CONTEXT.  */
+typedef gpg_error_t (*gpa_server_batch_start_t) (GpaContext *context,
+                                                 gpgme_key_t *keys,
+                                                 void *opaque);
+
+/* The request for the COUNT keys in KEYS has finished with ERR.
+   CONTEXT is NULL if the request could not be started.  */
+typedef void (*gpa_server_batch_done_t) (GpaContext *context,
+                                         gpgme_key_t *keys, guint count,
+                                         gpg_error_t err, void *opaque);
+
+/* All requests have finished, or the remaining ones have been
+   canceled.  The scheduler may be released from here.  */
+typedef void (*gpa_server_batch_finish_t) (void *opaque);
+
+/* Create a new scheduler calling START_CB, DONE_CB and FINISH_CB
+   with OPAQUE.  */
+gpa_server_batch_t gpa_server_batch_new (gpa_server_batch_start_t start_cb,
+                                         gpa_server_batch_done_t done_cb,
+                                         gpa_server_batch_finish_t finish_cb,
+                                         void *opaque);
+
+/* Release BATCH.  Running requests are not canceled.  */
+void gpa_server_batch_release (gpa_server_batch_t batch);
+
+/* Queue requests for the COUNT keys at KEYS.  */
+void gpa_server_batch_add_keys (gpa_server_batch_t batch,
+                                gpgme_key_t *keys, guint count);
+
+/* Queue one request for each of the COUNT keys at KEYS before all
+   other requests.  This is used from the done callback to retry the
+   keys of a failed request one by one.  */
+void gpa_server_batch_retry_keys (gpa_server_batch_t batch,
+                                  gpgme_key_t *keys, guint count);
+
+/* Start running the queued requests.  */
+void gpa_server_batch_run (gpa_server_batch_t batch);
+
+/* Cancel the running requests and don't start new ones.  The finish
+   callback is called once the running requests have finished, which
+   may be at once.  */
+void gpa_server_batch_cancel (gpa_server_batch_t batch);
+
+#endif /*SERVERBATCH_H*/
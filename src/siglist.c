@@ -25,12 +25,22 @@
 #include <gtk/gtk.h>
 
 #include "gpa.h"
+#include "keyref.h"
 #include "siglist.h"
 
 /*
  *  Implement a List showing signatures
+ *
+ *  Keys with many thousands of certifications must not freeze the
+ *  details pane.  The model thus only holds pointers to the
+ *  signatures of the displayed key and the cells are rendered by data
+ *  functions.  In fixed height mode the tree view only calls them for
+ *  the rows in view.  The rows themselves are appended in chunks from
+ *  an idle handler and the signer names are converted once and then
+ *  taken from a cache.
  */
 
+/* The displayed fields.  */
 typedef enum
 {
   SIG_KEYID_COLUMN,
@@ -41,32 +51,165 @@ typedef enum
   SIG_N_COLUMNS
 } SignatureListColumn;
 
+/* The only column of the model, holding a gpgme_key_sig_t.  */
+#define SIG_DATA_COLUMN 0
+
+/* The number of rows appended at once and per idle call.  */
+#define SIG_FIRST_CHUNK  200
+#define SIG_CHUNK        2000
+
+/* The state of the list, attached to the tree view.  */
+typedef struct
+{
+  gpgme_key_t key;         /* The key owning the signatures.  */
+  GPtrArray *sigs;         /* The signatures to show, sorted.  */
+  guint next;              /* The index of the next one to append.  */
+  guint idle_id;           /* The source appending the rows.  */
+  GHashTable *revoked;     /* The revoked signatures or NULL.  */
+  GHashTable *names;       /* Map key IDs to converted signer names.  */
+} SigListData;
+
+
+static SigListData *
+get_data (GtkWidget *list)
+{
+  return g_object_get_data (G_OBJECT (list), "gpa-siglist-data");
+}
+
+
+/* Drop the signatures of the previous key.  */
+static void
+reset_data (SigListData *data)
+{
+  if (data->idle_id)
+    {
+      g_source_remove (data->idle_id);
+      data->idle_id = 0;
+    }
+  if (data->sigs)
+    {
+      g_ptr_array_free (data->sigs, TRUE);
+      data->sigs = NULL;
+    }
+  data->next = 0;
+  if (data->revoked)
+    {
+      g_hash_table_destroy (data->revoked);
+      data->revoked = NULL;
+    }
+  g_hash_table_remove_all (data->names);
+  if (data->key)
+    {
+      gpa_key_unref (data->key, GPA_KEY_OWNER_KEYDETAILS);
+      data->key = NULL;
+    }
+}
+
+
+static void
+free_data (gpointer user_data)
+{
+  SigListData *data = user_data;
+
+  reset_data (data);
+  g_hash_table_destroy (data->names);
+  g_free (data);
+}
+
+
+/* Return the signer name of SIG.  The string is owned by the cache of
+   DATA.  */
+static const gchar *
+signer_name (SigListData *data, gpgme_key_sig_t sig)
+{
+  gchar *name;
+
+  name = g_hash_table_lookup (data->names, sig->keyid);
+  if (!name)
+    {
+      name = gpa_gpgme_key_sig_get_userid (sig);
+      g_hash_table_insert (data->names, sig->keyid, name);
+    }
+  return name;
+}
+
+
+static gpgme_key_sig_t
+get_sig (GtkTreeModel *model, GtkTreeIter *iter)
+{
+  gpgme_key_sig_t sig;
+
+  gtk_tree_model_get (model, iter, SIG_DATA_COLUMN, &sig, -1);
+  return sig;
+}
+
+
 gboolean
 search_siglist_function (GtkTreeModel *model, int column,
                          const gchar *key_to_search_for, GtkTreeIter *iter,
                          gpointer search_data)
 {
-  gboolean result=TRUE;
-  gchar *key_id, *user_id;
+  SigListData *data = search_data;
+  gpgme_key_sig_t sig = get_sig (model, iter);
   gint search_len;
 
-  gtk_tree_model_get (model, iter,
-                     SIG_KEYID_COLUMN, &key_id,
-                     SIG_USERID_COLUMN, &user_id, -1);
+  if (!sig)
+    return TRUE;
 
   search_len = strlen (key_to_search_for);
 
-  if (!g_ascii_strncasecmp (key_id, key_to_search_for, search_len))
-	result=FALSE;
-  if (!g_ascii_strncasecmp (user_id, key_to_search_for, search_len))
-	result=FALSE;
+  if (!g_ascii_strncasecmp (gpa_gpgme_key_sig_get_short_keyid (sig),
+			    key_to_search_for, search_len))
+	return FALSE;
+  if (!g_ascii_strncasecmp (signer_name (data, sig),
+			    key_to_search_for, search_len))
+	return FALSE;
+
+  return TRUE;
+}
 
-  g_free (key_id);
-  g_free (user_id);
 
-  return result;
+/* Render the field given by USER_DATA of the signature in ITER.  */
+static void
+sig_cell_data_func (GtkTreeViewColumn *column, GtkCellRenderer *renderer,
+		    GtkTreeModel *model, GtkTreeIter *iter,
+		    gpointer user_data)
+{
+  GtkWidget *list = gtk_tree_view_column_get_tree_view (column);
+  SigListData *data = get_data (list);
+  gpgme_key_sig_t sig = get_sig (model, iter);
+
+  if (!sig)
+    return;
+
+  switch (GPOINTER_TO_INT (user_data))
+    {
+    case SIG_KEYID_COLUMN:
+      g_object_set (renderer, "text",
+		    gpa_gpgme_key_sig_get_short_keyid (sig), NULL);
+      break;
+    case SIG_STATUS_COLUMN:
+      /* The list of revoked signatures might not be always
+	 available.  */
+      g_object_set (renderer, "markup",
+		    data->revoked
+		    ? gpa_gpgme_key_sig_get_sig_status (sig, data->revoked)
+		    : "", NULL);
+      break;
+    case SIG_USERID_COLUMN:
+      g_object_set (renderer, "text", signer_name (data, sig), NULL);
+      break;
+    case SIG_LOCAL_COLUMN:
+      g_object_set (renderer, "active", !sig->exportable, NULL);
+      break;
+    case SIG_LEVEL_COLUMN:
+      g_object_set (renderer, "markup",
+		    gpa_gpgme_key_sig_get_level (sig), NULL);
+      break;
+    }
 }
 
+
 static void
 gpa_siglist_ui_mode_changed_cb (GpaOptions *options, GtkWidget *list);
 
@@ -76,23 +219,32 @@ gpa_siglist_new (void)
 {
   GtkListStore *store;
   GtkWidget *list;
+  SigListData *data;
+
+  data = g_new0 (SigListData, 1);
+  /* The key IDs are owned by the key.  */
+  data->names = g_hash_table_new_full (g_str_hash, g_str_equal,
+				       NULL, g_free);
 
-  store = gtk_list_store_new (SIG_N_COLUMNS, G_TYPE_STRING,
-			      G_TYPE_STRING, G_TYPE_STRING, G_TYPE_BOOLEAN,
-			      G_TYPE_STRING);
+  store = gtk_list_store_new (1, G_TYPE_POINTER);
   list = gtk_tree_view_new_with_model (GTK_TREE_MODEL (store));
+  g_object_unref (store);
   gtk_widget_set_size_request (list, 400, 100);
+  g_object_set_data_full (G_OBJECT (list), "gpa-siglist-data",
+			  data, free_data);
 
-  gtk_tree_sortable_set_sort_column_id (GTK_TREE_SORTABLE (store),
-                                        SIG_USERID_COLUMN, GTK_SORT_ASCENDING);
+  /* Only the rows in view are rendered.  This requires that all
+     columns have a fixed size.  */
+  gtk_tree_view_set_fixed_height_mode (GTK_TREE_VIEW (list), TRUE);
 
   gtk_tree_view_set_enable_search (GTK_TREE_VIEW (list), TRUE);
   gtk_tree_view_set_search_equal_func (GTK_TREE_VIEW (list),
-                                       search_siglist_function, NULL, NULL);
+                                       search_siglist_function, data, NULL);
 
-  g_signal_connect (G_OBJECT (gpa_options_get_instance ()),
-		    "changed_ui_mode",
-                    G_CALLBACK (gpa_siglist_ui_mode_changed_cb), list);
+  g_signal_connect_object (G_OBJECT (gpa_options_get_instance ()),
+			   "changed_ui_mode",
+			   G_CALLBACK (gpa_siglist_ui_mode_changed_cb),
+			   list, 0);
 
   return list;
 }
@@ -109,113 +261,138 @@ gpa_siglist_clear_columns (GtkWidget *list)
       gtk_tree_view_remove_column (GTK_TREE_VIEW (list),
                                    (GtkTreeViewColumn*) i->data);
     }
+  g_list_free (columns);
 }
 
-/* Add columns common to signatures on all UID's */
+/* Append a fixed size column showing FIELD.  */
 static void
-gpa_siglist_all_add_columns (GtkWidget *list)
+add_column (GtkWidget *list, const gchar *title, GtkCellRenderer *renderer,
+	    SignatureListColumn field, gint width)
 {
   GtkTreeViewColumn *column;
-  GtkCellRenderer *renderer;
 
-  renderer = gtk_cell_renderer_text_new ();
-  column = gtk_tree_view_column_new_with_attributes (_("Key ID"), renderer,
-						     "text", SIG_KEYID_COLUMN,
-						     NULL);
+  column = gtk_tree_view_column_new ();
+  gtk_tree_view_column_set_title (column, title);
+  gtk_tree_view_column_pack_start (column, renderer, TRUE);
+  gtk_tree_view_column_set_cell_data_func (column, renderer,
+					   sig_cell_data_func,
+					   GINT_TO_POINTER (field), NULL);
+  gtk_tree_view_column_set_sizing (column, GTK_TREE_VIEW_COLUMN_FIXED);
+  gtk_tree_view_column_set_fixed_width (column, width);
+  gtk_tree_view_column_set_resizable (column, TRUE);
+  if (field == SIG_USERID_COLUMN)
+    gtk_tree_view_column_set_expand (column, TRUE);
   gtk_tree_view_append_column (GTK_TREE_VIEW (list), column);
+}
 
-  renderer = gtk_cell_renderer_text_new ();
-  column = gtk_tree_view_column_new_with_attributes (_("User Name"), renderer,
-						     "text", SIG_USERID_COLUMN,
-						     NULL);
-  gtk_tree_view_append_column (GTK_TREE_VIEW (list), column);
+/* Add columns common to signatures on all UID's */
+static void
+gpa_siglist_all_add_columns (GtkWidget *list)
+{
+  add_column (list, _("Key ID"), gtk_cell_renderer_text_new (),
+	      SIG_KEYID_COLUMN, 100);
+  add_column (list, _("User Name"), gtk_cell_renderer_text_new (),
+	      SIG_USERID_COLUMN, 250);
 }
 
 /* Add columns for signatures on one UID */
 static void
 gpa_siglist_uid_add_columns (GtkWidget *list)
 {
-  GtkTreeViewColumn *column;
-  GtkCellRenderer *renderer;
-
-  renderer = gtk_cell_renderer_text_new ();
-  column = gtk_tree_view_column_new_with_attributes (_("Key ID"), renderer,
-						     "text", SIG_KEYID_COLUMN,
-						     NULL);
-  gtk_tree_view_append_column (GTK_TREE_VIEW (list), column);
-
-  renderer = gtk_cell_renderer_text_new ();
-  column = gtk_tree_view_column_new_with_attributes (_("Status"), renderer,
-						     "markup", 
-						     SIG_STATUS_COLUMN, NULL);
-  gtk_tree_view_append_column (GTK_TREE_VIEW (list), column);
+  add_column (list, _("Key ID"), gtk_cell_renderer_text_new (),
+	      SIG_KEYID_COLUMN, 100);
+  add_column (list, _("Status"), gtk_cell_renderer_text_new (),
+	      SIG_STATUS_COLUMN, 80);
 
   if (!gpa_options_get_simplified_ui (gpa_options_get_instance ()))
     {
-      renderer = gtk_cell_renderer_text_new ();
-      column = gtk_tree_view_column_new_with_attributes (_("Level"), renderer,
-							 "markup", 
-							 SIG_LEVEL_COLUMN,
-							 NULL);
-      gtk_tree_view_append_column (GTK_TREE_VIEW (list), column);
-      
-      renderer = gtk_cell_renderer_toggle_new ();
-      column = gtk_tree_view_column_new_with_attributes (_("Local"), renderer,
-							 "active", 
-							 SIG_LOCAL_COLUMN,
-							 NULL);
-      gtk_tree_view_append_column (GTK_TREE_VIEW (list), column);
+      add_column (list, _("Level"), gtk_cell_renderer_text_new (),
+		  SIG_LEVEL_COLUMN, 80);
+      add_column (list, _("Local"), gtk_cell_renderer_toggle_new (),
+		  SIG_LOCAL_COLUMN, 50);
     }
 
-  renderer = gtk_cell_renderer_text_new ();
-  column = gtk_tree_view_column_new_with_attributes (_("User Name"), renderer,
-						     "text", SIG_USERID_COLUMN,
-						     NULL);
-  gtk_tree_view_append_column (GTK_TREE_VIEW (list), column);
+  add_column (list, _("User Name"), gtk_cell_renderer_text_new (),
+	      SIG_USERID_COLUMN, 250);
 }
 
-static void
-add_signature (gpgme_key_sig_t sig, GtkListStore *store, GHashTable *revoked)
+/* Sort signatures by the signer's user ID as given by gpgme.  Unknown
+   signers go last.  */
+static gint
+compare_sigs (gconstpointer a, gconstpointer b)
 {
-  GtkTreeIter iter;
-  const gchar *sig_level, *status;
-  gchar *user_id;
-
-  sig_level = gpa_gpgme_key_sig_get_level (sig);
-  user_id = gpa_gpgme_key_sig_get_userid (sig);
-  /* The list of revoked signatures might not be always available */
-  if (revoked)
-    {
-      status = gpa_gpgme_key_sig_get_sig_status (sig, revoked);
-    }
-  else
-    {
-      status = "";
-    }
-  /* Append it to the list */
-  gtk_list_store_append (store, &iter);
-  gtk_list_store_set (store, &iter,
-                      SIG_KEYID_COLUMN, gpa_gpgme_key_sig_get_short_keyid(sig),
-		      SIG_STATUS_COLUMN, status,
-                      SIG_USERID_COLUMN, user_id,
-		      SIG_LEVEL_COLUMN, sig_level,
-		      SIG_LOCAL_COLUMN, !sig->exportable,
-		      -1);
-  g_free (user_id);
+  gpgme_key_sig_t sa = *(gpgme_key_sig_t *) a;
+  gpgme_key_sig_t sb = *(gpgme_key_sig_t *) b;
+  const char *ua = sa->uid && *sa->uid ? sa->uid : NULL;
+  const char *ub = sb->uid && *sb->uid ? sb->uid : NULL;
+
+  if (!ua || !ub)
+    return ua? -1 : ub? 1 : strcmp (sa->keyid, sb->keyid);
+  return g_ascii_strcasecmp (ua, ub);
 }
 
-static void add_signature_cb (gchar *keyid, gpgme_key_sig_t sig,
-			      GtkListStore *store)
+/* Append the next chunk of at most COUNT signatures to the model.
+   Returns TRUE if more are left.  */
+static gboolean
+append_chunk (GtkWidget *list, guint count)
 {
-  add_signature (sig, store, NULL);
+  SigListData *data = get_data (list);
+  GtkListStore *store = GTK_LIST_STORE (gtk_tree_view_get_model
+                                        (GTK_TREE_VIEW (list)));
+
+  for (; count && data->next < data->sigs->len; count--, data->next++)
+    gtk_list_store_insert_with_values (store, NULL, -1, SIG_DATA_COLUMN,
+				       g_ptr_array_index (data->sigs,
+							  data->next), -1);
+
+  return data->next < data->sigs->len;
 }
 
+static gboolean
+append_chunk_idle (gpointer user_data)
+{
+  GtkWidget *list = user_data;
+
+  if (append_chunk (list, SIG_CHUNK))
+    return TRUE;
+
+  get_data (list)->idle_id = 0;
+  return FALSE;
+}
+
+/* Show the signatures in SIGS, which are owned by KEY.  */
 static void
-gpa_siglist_set_all (GtkWidget * list, const gpgme_key_t key)
+gpa_siglist_fill (GtkWidget *list, gpgme_key_t key, GPtrArray *sigs)
+{
+  SigListData *data = get_data (list);
+
+  g_ptr_array_sort (sigs, compare_sigs);
+  data->sigs = sigs;
+  gpa_key_ref (key, GPA_KEY_OWNER_KEYDETAILS);
+  data->key = key;
+
+  /* Show the first rows at once, so that the list does not flicker
+     for the common case of a few signatures.  */
+  if (append_chunk (list, SIG_FIRST_CHUNK))
+    data->idle_id = g_idle_add (append_chunk_idle, list);
+}
+
+/* Clear the model and forget the previous key.  */
+static void
+gpa_siglist_clear (GtkWidget *list)
 {
   GtkListStore *store = GTK_LIST_STORE (gtk_tree_view_get_model
                                         (GTK_TREE_VIEW (list)));
+
+  gtk_list_store_clear (store);
+  reset_data (get_data (list));
+}
+
+static void
+gpa_siglist_set_all (GtkWidget * list, const gpgme_key_t key)
+{
   gpgme_user_id_t uid;
+  GPtrArray *sigs;
 
   /* Create the hash table */
   GHashTable *hash = g_hash_table_new (g_str_hash, g_str_equal);
@@ -225,9 +402,11 @@ gpa_siglist_set_all (GtkWidget * list, const gpgme_key_t key)
   gpa_siglist_all_add_columns (list);
 
   /* Clear the model */
-  gtk_list_store_clear (store);
+  gpa_siglist_clear (list);
 
-  /* Iterate over UID's and signatures and add unique values to the hash */
+  sigs = g_ptr_array_new ();
+
+  /* Iterate over UID's and signatures and collect unique values */
   for (uid = key->uids; uid; uid = uid->next)
     {
       gpgme_key_sig_t sig;
@@ -238,20 +417,21 @@ gpa_siglist_set_all (GtkWidget * list, const gpgme_key_t key)
            * is basically no other way to do this, and in this context it
            * doens't matter that much (at most, one signature will be missing
            * from the "all" list).*/
-          if (!g_hash_table_lookup (hash, keyid))
+          if (!g_hash_table_contains (hash, keyid))
             {
               /* Add the signature to the list */
               /* FIXME: This saves the first signature on the key in each UID,
                * if they have different attributes, this may cause trouble */
-              g_hash_table_insert (hash, (gchar*) keyid, sig);
+              g_hash_table_add (hash, keyid);
+              g_ptr_array_add (sigs, sig);
             }
         }
     }
-  /* Now, add each signature to the list */
-  g_hash_table_foreach (hash, (GHFunc)add_signature_cb, store);
-  
+
   /* Delete the hash table */
   g_hash_table_destroy (hash);
+
+  gpa_siglist_fill (list, key, sigs);
 }
 
 static GHashTable*
@@ -275,34 +455,34 @@ static void
 gpa_siglist_set_userid (GtkWidget * list, const gpgme_key_t key,
 			gpgme_user_id_t uid)
 {
-  GtkListStore *store = GTK_LIST_STORE (gtk_tree_view_get_model
-                                        (GTK_TREE_VIEW (list)));
-  GHashTable *revoked;
   gpgme_key_sig_t sig;
+  GPtrArray *sigs;
 
   /* Set the appropiate columns */
   gpa_siglist_clear_columns (list);
   gpa_siglist_uid_add_columns (list);
 
   /* Clear the model */
-  gtk_list_store_clear (store);
+  gpa_siglist_clear (list);
 
   if (!uid)
     /* No user ID -> no signatures, do nothing here. */
     return;
 
   /* Get the list of revoked signatures */
-  revoked = revoked_signatures (key, uid);
+  get_data (list)->revoked = revoked_signatures (key, uid);
 
-  /* Add the signatures to the model */
+  sigs = g_ptr_array_new ();
   for (sig = uid->signatures; sig; sig = sig->next)
     {
       /* Ignore revocation signatures */
       if (!sig->revoked)
         {
-	  add_signature (sig, store, revoked);
+	  g_ptr_array_add (sigs, sig);
         }
     }
+
+  gpa_siglist_fill (list, key, sigs);
 }
 
 /* Update the siglist to the right mode */
@@ -325,8 +505,6 @@ gpa_siglist_ui_mode_changed_cb (GpaOptions *options, GtkWidget *list)
 void
 gpa_siglist_set_signatures (GtkWidget * list, gpgme_key_t key, int idx)
 {
-  GtkListStore *store = GTK_LIST_STORE (gtk_tree_view_get_model
-                                        (GTK_TREE_VIEW (list)));
   if (key)
     {
       if (idx == -1)
@@ -350,6 +528,6 @@ gpa_siglist_set_signatures (GtkWidget * list, gpgme_key_t key, int idx)
     }
   else
     {
-      gtk_list_store_clear (store);
+      gpa_siglist_clear (list);
     }
 }
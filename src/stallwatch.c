@@ -0,0 +1,384 @@
+/* stallwatch.c - Detect handlers which stall the main loop.
+   Copyright (C) 2026 g10 Code GmbH
+
+   This file is part of GPA.
+
+   GPA is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   GPA is distributed in the hope that it will be useful, but WITHOUT
+   ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+   or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public
+   License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, see <http://www.gnu.org/licenses/>.  */
+
+/*
+   GLib has no hook to time the dispatching of sources.  We therefore
+   replace the dispatch functions of the idle, timeout and I/O watch
+   sources, which are used for almost all of GPA's own handlers
+   including the gpgme I/O callbacks, with wrappers which time the
+   original function.  The time spent in other sources, for example
+   the GDK event source, is measured by a poll function wrapper as
+   the time between two polls which has not been accounted for.
+
+   Only sources attached to the default main context are timed.  The
+   handlers are identified by their callback address which is mapped
+   to a symbol name if possible; for static functions the module and
+   offset are shown which can be resolved with addr2line.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef HAVE_DLADDR
+# include <dlfcn.h>
+#endif
+
+#include <glib.h>
+#ifdef G_OS_UNIX
+# include <glib-unix.h>
+# include <signal.h>
+#endif
+
+#include "gpa.h"
+
+
+/* The number of histogram buckets.  Bucket N counts dispatches which
+   took less than 4^N ms; the last bucket counts all longer ones.  */
+#define N_BUCKETS 8
+
+/* The number of stalls kept for the dump.  */
+#define N_RECENT 32
+
+/* Statistics about one handler.  */
+struct handler_s
+{
+  char *name;
+  unsigned long count;
+  unsigned long stalls;
+  double total_ms;
+  double max_ms;
+};
+
+/* A recorded stall.  */
+struct stall_s
+{
+  struct handler_s *handler;
+  double when;     /* Seconds since start.  */
+  double ms;
+};
+
+/* The threshold in ms; 0 if the stall watch is not active.  */
+static unsigned int threshold;
+
+/* The time the stall watch was started.  */
+static gint64 start_time;
+
+/* Map callback addresses to struct handler_s.  */
+static GHashTable *handler_table;
+
+/* The pseudo handler for time not spent in a timed source.  */
+static struct handler_s other_sources = { (char *) "(other sources)" };
+
+static unsigned long histogram[N_BUCKETS];
+static unsigned long dispatch_count;
+
+static struct stall_s recent[N_RECENT];
+static unsigned int recent_next;
+
+/* The original dispatch functions.  */
+static gboolean (*idle_dispatch) (GSource *, GSourceFunc, gpointer);
+static gboolean (*timeout_dispatch) (GSource *, GSourceFunc, gpointer);
+static gboolean (*io_watch_dispatch) (GSource *, GSourceFunc, gpointer);
+
+/* The original poll function.  */
+static GPollFunc orig_poll;
+
+/* The number of calls to the poll function so far; used to detect
+   nested main loops.  */
+static unsigned long poll_count;
+
+/* The time the last poll returned and the time since then which has
+   been accounted to timed sources, both in microseconds.  */
+static gint64 poll_return_time;
+static gint64 accounted_time;
+
+
+
+/* Return a malloced description of the function FUNC.  */
+static char *
+describe_function (gpointer func, const char *source_name)
+{
+  char *desc = NULL;
+  char *result;
+#ifdef HAVE_DLADDR
+  Dl_info info;
+
+  if (dladdr (func, &info))
+    {
+      if (info.dli_sname && info.dli_saddr == func)
+        desc = g_strdup (info.dli_sname);
+      else if (info.dli_fname)
+        {
+          char *base = g_path_get_basename (info.dli_fname);
+
+          desc = g_strdup_printf ("%s+0x%lx", base,
+                                  (unsigned long) ((char *) func
+                                                   - (char *) info.dli_fbase));
+          g_free (base);
+        }
+    }
+#endif /*HAVE_DLADDR*/
+  if (!desc)
+    desc = g_strdup_printf ("%p", func);
+
+  if (!source_name)
+    return desc;
+  result = g_strdup_printf ("%s (%s)", desc, source_name);
+  g_free (desc);
+  return result;
+}
+
+
+/* Account the duration MS to HANDLER.  */
+static void
+record (struct handler_s *handler, double ms)
+{
+  double limit;
+  int idx;
+
+  for (idx = 0, limit = 1; idx < N_BUCKETS - 1 && ms >= limit; idx++)
+    limit *= 4;
+  histogram[idx]++;
+  dispatch_count++;
+
+  handler->count++;
+  handler->total_ms += ms;
+  if (ms > handler->max_ms)
+    handler->max_ms = ms;
+
+  if (ms >= threshold)
+    {
+      struct stall_s *stall = &recent[recent_next++ % N_RECENT];
+
+      handler->stalls++;
+      stall->handler = handler;
+      stall->when = (g_get_monotonic_time () - start_time) / 1000000.0;
+      stall->ms = ms;
+      g_message ("main loop stalled for %.1f ms in %s", ms, handler->name);
+    }
+}
+
+
+static struct handler_s *
+get_handler (gpointer func, GSource *source)
+{
+  struct handler_s *handler;
+
+  handler = g_hash_table_lookup (handler_table, func);
+  if (!handler)
+    {
+      handler = g_malloc0 (sizeof *handler);
+      handler->name = describe_function (func, g_source_get_name (source));
+      g_hash_table_insert (handler_table, func, handler);
+    }
+  return handler;
+}
+
+
+/* Call DISPATCH and account its duration to the callback.  */
+static gboolean
+timed_dispatch (gboolean (*dispatch) (GSource *, GSourceFunc, gpointer),
+                GSource *source, GSourceFunc callback, gpointer user_data)
+{
+  struct handler_s *handler;
+  unsigned long polls;
+  gint64 start, elapsed;
+  gboolean result;
+
+  if (g_source_get_context (source) != g_main_context_default ())
+    return dispatch (source, callback, user_data);
+
+  /* Look up the handler first because the source may be destroyed
+     by the dispatch.  */
+  handler = get_handler (callback? (gpointer) callback : (gpointer) dispatch,
+                         source);
+  polls = poll_count;
+  start = g_get_monotonic_time ();
+  result = dispatch (source, callback, user_data);
+  elapsed = g_get_monotonic_time () - start;
+
+  /* Without a nested main loop the time has been spent entirely
+     since the last poll.  */
+  if (polls == poll_count)
+    accounted_time += elapsed;
+  record (handler, elapsed / 1000.0);
+
+  return result;
+}
+
+
+static gboolean
+timed_idle_dispatch (GSource *source, GSourceFunc callback, gpointer data)
+{
+  return timed_dispatch (idle_dispatch, source, callback, data);
+}
+
+
+static gboolean
+timed_timeout_dispatch (GSource *source, GSourceFunc callback, gpointer data)
+{
+  return timed_dispatch (timeout_dispatch, source, callback, data);
+}
+
+
+static gboolean
+timed_io_watch_dispatch (GSource *source, GSourceFunc callback, gpointer data)
+{
+  return timed_dispatch (io_watch_dispatch, source, callback, data);
+}
+
+
+/* Account the time since the last poll which was not spent in a
+   timed source and call the original poll function.  */
+static gint
+timed_poll (GPollFD *fds, guint nfds, gint timeout)
+{
+  gint result;
+
+  if (poll_return_time)
+    {
+      gint64 other = (g_get_monotonic_time () - poll_return_time
+                      - accounted_time);
+
+      if (other >= 1000)
+        record (&other_sources, other / 1000.0);
+    }
+
+  poll_count++;
+  result = orig_poll (fds, nfds, timeout);
+  poll_return_time = g_get_monotonic_time ();
+  accounted_time = 0;
+
+  return result;
+}
+
+
+#ifdef G_OS_UNIX
+static gboolean
+dump_signal_cb (gpointer user_data)
+{
+  gpa_stallwatch_dump ();
+  return G_SOURCE_CONTINUE;
+}
+#endif /*G_OS_UNIX*/
+
+
+
+/* Start to watch the main loop for handlers which take THRESHOLD ms
+   or longer.  Must be called before other threads are started.  */
+void
+gpa_init_stallwatch (unsigned int threshold_ms)
+{
+  if (threshold || !threshold_ms)
+    return;
+
+  threshold = threshold_ms;
+  start_time = g_get_monotonic_time ();
+  handler_table = g_hash_table_new (g_direct_hash, g_direct_equal);
+
+  idle_dispatch = g_idle_funcs.dispatch;
+  g_idle_funcs.dispatch = timed_idle_dispatch;
+  timeout_dispatch = g_timeout_funcs.dispatch;
+  g_timeout_funcs.dispatch = timed_timeout_dispatch;
+  io_watch_dispatch = g_io_watch_funcs.dispatch;
+  g_io_watch_funcs.dispatch = timed_io_watch_dispatch;
+
+  orig_poll = g_main_context_get_poll_func (NULL);
+  g_main_context_set_poll_func (NULL, timed_poll);
+
+#ifdef G_OS_UNIX
+  g_unix_signal_add (SIGUSR1, dump_signal_cb, NULL);
+#endif
+}
+
+
+static gint
+compare_handlers (gconstpointer a, gconstpointer b)
+{
+  const struct handler_s *ha = *(const struct handler_s **) a;
+  const struct handler_s *hb = *(const struct handler_s **) b;
+
+  return ha->max_ms < hb->max_ms? 1 : ha->max_ms > hb->max_ms? -1 : 0;
+}
+
+
+static void
+print_handler (struct handler_s *handler)
+{
+  fprintf (stderr, "gpa: %8lu %7lu %11.1f %9.1f  %s\n",
+           handler->count, handler->stalls, handler->total_ms,
+           handler->max_ms, handler->name);
+}
+
+
+/* Print the histogram of dispatch times, the handlers which exceeded
+   the threshold and the most recent stalls to stderr.  */
+void
+gpa_stallwatch_dump (void)
+{
+  GPtrArray *stalled;
+  GHashTableIter iter;
+  gpointer value;
+  unsigned int idx, n;
+  unsigned long limit;
+
+  if (!threshold)
+    return;
+
+  fprintf (stderr, "gpa: main loop statistics (threshold %u ms)\n",
+           threshold);
+  fprintf (stderr, "gpa: %lu dispatches\n", dispatch_count);
+  for (idx = 0, limit = 1; idx < N_BUCKETS; idx++, limit *= 4)
+    {
+      if (idx < N_BUCKETS - 1)
+        fprintf (stderr, "gpa:   < %5lu ms: %lu\n", limit, histogram[idx]);
+      else
+        fprintf (stderr, "gpa:  >= %5lu ms: %lu\n", limit / 4,
+                 histogram[idx]);
+    }
+
+  stalled = g_ptr_array_new ();
+  g_hash_table_iter_init (&iter, handler_table);
+  while (g_hash_table_iter_next (&iter, NULL, &value))
+    if (((struct handler_s *) value)->stalls)
+      g_ptr_array_add (stalled, value);
+  g_ptr_array_sort (stalled, compare_handlers);
+
+  fprintf (stderr, "gpa: handlers exceeding the threshold:\n");
+  fprintf (stderr, "gpa:    count  stalls    total ms    max ms  handler\n");
+  for (idx = 0; idx < stalled->len; idx++)
+    print_handler (g_ptr_array_index (stalled, idx));
+  if (other_sources.stalls)
+    print_handler (&other_sources);
+  g_ptr_array_free (stalled, TRUE);
+
+  n = MIN (recent_next, N_RECENT);
+  if (n)
+    fprintf (stderr, "gpa: most recent stalls:\n");
+  for (idx = recent_next - n; idx < recent_next; idx++)
+    {
+      struct stall_s *stall = &recent[idx % N_RECENT];
+
+      fprintf (stderr, "gpa: %10.3f s %9.1f ms  %s\n",
+               stall->when, stall->ms, stall->handler->name);
+    }
+}